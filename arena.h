@@ -0,0 +1,131 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+// Bump allocator, nothing is freed on its own, everything goes at once with
+// arenaReset or arenaFree. Blocks are kept over a reset so that reading the
+// same data again does no mallocs.
+
+#define ARENA_BLOCK_SIZE 0x10000
+#define ARENA_ALIGN 16
+
+typedef struct ArenaBlock {
+    struct ArenaBlock *next;
+    size_t capacity;
+    size_t used;
+    size_t _pad; // keeps data ARENA_ALIGN aligned
+    uint8_t data[];
+} ArenaBlock;
+_Static_assert(sizeof(ArenaBlock) % ARENA_ALIGN == 0, "ArenaBlock data is unaligned");
+
+typedef struct {
+    ArenaBlock *first;
+    ArenaBlock *current;
+    void *last; // Most recent allocation, arenaRealloc can grow it in place
+    size_t allocations; // Since the last reset
+    size_t mallocs; // Since the last free
+} Arena;
+
+#define ARENA_ALIGNED(size) (((size) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+// Returns zeroed memory, never NULL
+static inline void *arenaAlloc(Arena *arena, size_t size) {
+    size_t aligned = ARENA_ALIGNED(size);
+    ArenaBlock *block = arena->current;
+    while (block != NULL && block->capacity - block->used < aligned) block = block->next;
+    if (block == NULL) {
+        size_t capacity = aligned > ARENA_BLOCK_SIZE ? aligned : ARENA_BLOCK_SIZE;
+        block = malloc(sizeof(ArenaBlock) + capacity);
+        assert(block != NULL);
+        *block = (ArenaBlock){ .capacity = capacity };
+        ArenaBlock **tail = &arena->first;
+        while (*tail != NULL) tail = &(*tail)->next;
+        *tail = block;
+        arena->mallocs ++;
+    }
+    arena->current = block;
+    void *ptr = block->data + block->used;
+    block->used += aligned;
+    arena->last = ptr;
+    arena->allocations ++;
+    memset(ptr, 0, size);
+    return ptr;
+}
+
+// Like realloc, but the caller has to say how big ptr was. Anything after
+// old_size is zeroed. The old space is only reused after a reset.
+static inline void *arenaRealloc(Arena *arena, void *ptr, size_t old_size, size_t size) {
+    if (ptr == NULL) return arenaAlloc(arena, size);
+    if (size <= old_size) return ptr;
+    ArenaBlock *block = arena->current;
+    if (ptr == arena->last && block->capacity - ((uint8_t *)ptr - block->data) >= ARENA_ALIGNED(size)) {
+        block->used = ((uint8_t *)ptr - block->data) + ARENA_ALIGNED(size);
+        memset((uint8_t *)ptr + old_size, 0, size - old_size);
+        return ptr;
+    }
+    void *new_ptr = arenaAlloc(arena, size);
+    memcpy(new_ptr, ptr, old_size);
+    return new_ptr;
+}
+
+static inline void arenaReset(Arena *arena) {
+    for (ArenaBlock *block = arena->first; block != NULL; block = block->next) {
+        block->used = 0;
+    }
+    arena->current = arena->first;
+    arena->last = NULL;
+    arena->allocations = 0;
+}
+
+static inline void arenaFree(Arena *arena) {
+    ArenaBlock *block = arena->first;
+    while (block != NULL) {
+        ArenaBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+    *arena = (Arena){0};
+}
+
+// ARRAY_ENSURE and ARRAY_ADD for arrays whose data lives in an arena, never ARRAY_FREE these
+#define ARENA_ARRAY_ENSURE(arena, a, size) do { \
+    if ((size) <= (a).capacity) break; \
+    (a).data = arenaRealloc((arena), (a).data, (a).capacity * sizeof((a).data[0]), (size) * sizeof((a).data[0])); \
+    (a).capacity = (size); \
+} while (false)
+
+#define ARENA_ARRAY_ADD(arena, a, datum) do { \
+    if ((a).length == (a).capacity) { \
+        size_t new_cap = (a).capacity == 0 ? 16 : (a).capacity * 2; \
+        ARENA_ARRAY_ENSURE((arena), (a), new_cap); \
+    } \
+    (a).data[(a).length ++] = (datum); \
+} while (false)
+
+// SMALL_ARRAY_ENSURE and SMALL_ARRAY_ADD for small arrays that spill into an arena, never SMALL_ARRAY_FREE these
+#define ARENA_SMALL_ARRAY_ENSURE(arena, a, size) do { \
+    size_t old_cap = SMALL_ARRAY_CAPACITY(a); \
+    if ((size) <= old_cap) break; \
+    if ((a).heap == NULL) { \
+        (a).heap = arenaAlloc((arena), (size) * sizeof((a).small[0])); \
+        memcpy((a).heap, (a).small, sizeof((a).small)); \
+    } else { \
+        (a).heap = arenaRealloc((arena), (a).heap, old_cap * sizeof((a).small[0]), (size) * sizeof((a).small[0])); \
+    } \
+    (a).capacity = (size); \
+} while (false)
+
+#define ARENA_SMALL_ARRAY_ADD(arena, a, datum) do { \
+    if ((a).length == SMALL_ARRAY_CAPACITY(a)) { \
+        ARENA_SMALL_ARRAY_ENSURE((arena), (a), (a).length * 2); \
+    } \
+    SMALL_ARRAY_DATA(a)[(a).length ++] = (datum); \
+} while (false)
+
+#endif // ARENA_H
@@ -5,6 +5,7 @@
 #include <stddef.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
 
 #define C_ARRAY_LEN(a) (sizeof((a)) / sizeof((a)[0]))
 
@@ -37,4 +38,45 @@
     (a).capacity = 0; \
     (a).length = 0; \
 } while (false)
+
+// Like ARRAY, but the first n elements live in the struct itself and it only
+// goes to the heap when there are more. The elements move when that happens,
+// so always go through SMALL_ARRAY_DATA rather than holding on to heap.
+#define SMALL_ARRAY(type, n) struct { \
+        size_t capacity; /* of heap, the small buffer is used while heap is NULL */ \
+        size_t length; \
+        type *heap; \
+        type small[n]; \
+    }
+
+#define SMALL_ARRAY_DATA(a) ((a).heap != NULL ? (a).heap : (a).small)
+#define SMALL_ARRAY_CAPACITY(a) ((a).heap != NULL ? (a).capacity : C_ARRAY_LEN((a).small))
+
+// zero says whether to clear the new elements, SMALL_ARRAY_ADD doesn't as it overwrites them anyway
+#define SMALL_ARRAY_GROW(a, size, zero) do { \
+    size_t old_cap = SMALL_ARRAY_CAPACITY(a); \
+    if ((size) <= old_cap) break; \
+    void *new_data = realloc((a).heap, (size) * sizeof((a).small[0])); \
+    assert(new_data != NULL); \
+    if ((a).heap == NULL) memcpy(new_data, (a).small, sizeof((a).small)); \
+    if (zero) memset((uint8_t*)new_data + old_cap * sizeof((a).small[0]), 0, ((size) - old_cap) * sizeof((a).small[0])); \
+    (a).capacity = (size); \
+    (a).heap = new_data; \
+} while (false)
+
+#define SMALL_ARRAY_ENSURE(a, size) SMALL_ARRAY_GROW((a), (size), true)
+
+#define SMALL_ARRAY_ADD(a, datum) do { \
+    if ((a).length == SMALL_ARRAY_CAPACITY(a)) { \
+        SMALL_ARRAY_GROW((a), (a).length * 2, false); \
+    } \
+    SMALL_ARRAY_DATA(a)[(a).length ++] = (datum); \
+} while (false)
+
+#define SMALL_ARRAY_FREE(a) do { \
+    free((a).heap); \
+    (a).heap = NULL; \
+    (a).capacity = 0; \
+    (a).length = 0; \
+} while (false)
 #endif /* ARRAY_H */
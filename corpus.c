@@ -0,0 +1,204 @@
+#include "corpus.h"
+
+#include <assert.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+
+static int compareNames(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+bool corpusFiles(char **paths, size_t num_paths, CorpusFiles *files) {
+    for (size_t i = 0; i < num_paths; i ++) {
+        struct stat path_stat;
+        if (strcmp(paths[i], "-") == 0) {
+            char *line = NULL;
+            size_t capacity = 0;
+            ssize_t length;
+            while ((length = getline(&line, &capacity, stdin)) > 0) {
+                if (line[length - 1] == '\n') line[-- length] = '\0';
+                if (length > 0) ARRAY_ADD(*files, strdup(line));
+            }
+            free(line);
+        } else if (stat(paths[i], &path_stat) == 0 && S_ISDIR(path_stat.st_mode)) {
+            DIR *dir = opendir(paths[i]);
+            if (dir == NULL) {
+                fprintf(stderr, "Could not open directory %s\n", paths[i]);
+                return false;
+            }
+            size_t first = files->length;
+            struct dirent *entry;
+            while ((entry = readdir(dir)) != NULL) {
+                size_t length = strlen(entry->d_name);
+                if (length < 4 || strcasecmp(entry->d_name + length - 4, ".SPL") != 0) continue;
+                char *path = NULL;
+                if (asprintf(&path, "%s/%s", paths[i], entry->d_name) <= 0) {
+                    assert(false);
+                }
+                ARRAY_ADD(*files, path);
+            }
+            closedir(dir);
+            qsort(files->data + first, files->length - first, sizeof(files->data[0]), compareNames);
+        } else {
+            ARRAY_ADD(*files, strdup(paths[i]));
+        }
+    }
+    return true;
+}
+
+void freeCorpusFiles(CorpusFiles *files) {
+    for (size_t i = 0; i < files->length; i ++) free(files->data[i]);
+    ARRAY_FREE(*files);
+}
+
+typedef struct {
+    pthread_mutex_t lock;
+    size_t begin; // Taken from here by the owner
+    size_t end; // and from here by thieves
+} CorpusQueue;
+
+typedef struct {
+    char *text;
+    size_t length;
+    bool ok;
+    bool done;
+} CorpusResult;
+
+typedef struct {
+    CorpusFiles *files;
+    CorpusTask task;
+    void *ctx;
+    CorpusQueue *queues;
+    size_t num_queues;
+    CorpusResult *results;
+    pthread_mutex_t lock; // For results
+    pthread_cond_t done;
+} Corpus;
+
+typedef struct {
+    Corpus *corpus;
+    size_t index;
+} CorpusWorker;
+
+// Moves the back half of the largest other queue to queue, false if all are empty
+static bool steal(Corpus *corpus, CorpusQueue *queue) {
+    while (true) {
+        CorpusQueue *victim = NULL;
+        size_t most = 0;
+        for (size_t i = 0; i < corpus->num_queues; i ++) {
+            CorpusQueue *other = &corpus->queues[i];
+            pthread_mutex_lock(&other->lock);
+            size_t left = other->end - other->begin;
+            pthread_mutex_unlock(&other->lock);
+            if (other != queue && left > most) {
+                victim = other;
+                most = left;
+            }
+        }
+        if (victim == NULL) return false;
+
+        pthread_mutex_lock(&victim->lock);
+        size_t left = victim->end - victim->begin;
+        size_t middle = victim->begin + left / 2;
+        size_t end = victim->end;
+        if (left > 0) victim->end = middle;
+        pthread_mutex_unlock(&victim->lock);
+        if (left == 0) continue; // Emptied since we looked
+
+        pthread_mutex_lock(&queue->lock);
+        queue->begin = middle;
+        queue->end = end;
+        pthread_mutex_unlock(&queue->lock);
+        return true;
+    }
+}
+
+static void *corpusWorker(void *arg) {
+    CorpusWorker *worker = arg;
+    Corpus *corpus = worker->corpus;
+    CorpusQueue *queue = &corpus->queues[worker->index];
+    while (true) {
+        pthread_mutex_lock(&queue->lock);
+        bool have = queue->begin < queue->end;
+        size_t idx = have ? queue->begin ++ : 0;
+        pthread_mutex_unlock(&queue->lock);
+        if (!have) {
+            if (!steal(corpus, queue)) break;
+            continue;
+        }
+
+        CorpusResult result = {0};
+        FILE *out = open_memstream(&result.text, &result.length);
+        assert(out != NULL);
+        result.ok = corpus->task(corpus->ctx, corpus->files->data[idx], out);
+        fclose(out);
+        result.done = true;
+
+        pthread_mutex_lock(&corpus->lock);
+        corpus->results[idx] = result;
+        pthread_cond_broadcast(&corpus->done);
+        pthread_mutex_unlock(&corpus->lock);
+    }
+    return NULL;
+}
+
+bool runCorpus(CorpusFiles *files, size_t num_threads, CorpusTask task, void *ctx) {
+    if (files->length == 0) return true;
+    if (num_threads == 0) num_threads = 1;
+    if (num_threads > files->length) num_threads = files->length;
+    Corpus corpus = {
+        .files = files,
+        .task = task,
+        .ctx = ctx,
+        .num_queues = num_threads,
+    };
+    corpus.queues = calloc(num_threads, sizeof(*corpus.queues));
+    corpus.results = calloc(files->length, sizeof(*corpus.results));
+    CorpusWorker *workers = calloc(num_threads, sizeof(*workers));
+    pthread_t *threads = calloc(num_threads, sizeof(*threads));
+    assert(corpus.queues != NULL && corpus.results != NULL && workers != NULL && threads != NULL);
+    pthread_mutex_init(&corpus.lock, NULL);
+    pthread_cond_init(&corpus.done, NULL);
+    for (size_t i = 0; i < num_threads; i ++) {
+        pthread_mutex_init(&corpus.queues[i].lock, NULL);
+        corpus.queues[i].begin = files->length * i / num_threads;
+        corpus.queues[i].end = files->length * (i + 1) / num_threads;
+    }
+
+    size_t started = 0;
+    for (; started < num_threads; started ++) {
+        workers[started] = (CorpusWorker){ .corpus = &corpus, .index = started };
+        if (pthread_create(&threads[started], NULL, corpusWorker, &workers[started]) != 0) break;
+    }
+    if (started == 0) {
+        // Do it all here, stealing everyone's share
+        workers[0] = (CorpusWorker){ .corpus = &corpus, .index = 0 };
+        corpusWorker(&workers[0]);
+    }
+
+    bool ret = true;
+    for (size_t i = 0; i < files->length; i ++) {
+        pthread_mutex_lock(&corpus.lock);
+        while (!corpus.results[i].done) pthread_cond_wait(&corpus.done, &corpus.lock);
+        CorpusResult result = corpus.results[i];
+        pthread_mutex_unlock(&corpus.lock);
+        fwrite(result.text, 1, result.length, stdout);
+        fflush(stdout);
+        free(result.text);
+        if (!result.ok) ret = false;
+    }
+
+    for (size_t i = 0; i < started; i ++) pthread_join(threads[i], NULL);
+    for (size_t i = 0; i < num_threads; i ++) pthread_mutex_destroy(&corpus.queues[i].lock);
+    pthread_mutex_destroy(&corpus.lock);
+    pthread_cond_destroy(&corpus.done);
+    free(threads);
+    free(workers);
+    free(corpus.results);
+    free(corpus.queues);
+    return ret;
+}
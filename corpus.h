@@ -0,0 +1,28 @@
+#ifndef CORPUS_H
+#define CORPUS_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "array.h"
+
+// Runs a task over many room files at once, see runCorpus
+
+typedef ARRAY(char *) CorpusFiles;
+
+// Adds each path, the *.SPL files in it (sorted by name) if it is a
+// directory, or the lines of stdin for "-". Free with freeCorpusFiles.
+bool corpusFiles(char **paths, size_t num_paths, CorpusFiles *files);
+void freeCorpusFiles(CorpusFiles *files);
+
+// Called on a worker thread for each file, anything for stdout goes to out
+typedef bool (*CorpusTask)(void *ctx, char *path, FILE *out);
+
+// Every worker starts with an even share of files and steals half of the
+// largest share left once it runs out. Each file's output is printed as soon
+// as it and all files before it are done, so it comes out in input order.
+// Returns false if any task did.
+bool runCorpus(CorpusFiles *files, size_t num_threads, CorpusTask task, void *ctx);
+
+#endif // CORPUS_H
@@ -0,0 +1,32 @@
+#!/bin/bash
+# Deleting a switch has to move the ones after it whole, chunks and all.
+# Works on a copy of ROOMS.SPL, in a directory of its own.
+
+set -o errexit
+room=${1:-2}
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+cp a.out ROOMS.SPL "$dir"
+cd "$dir"
+
+# Start with no switches, whatever the room had
+while ./a.out display $room 2>/dev/null | grep -q 'idx=0\]{\.x'; do
+    ./a.out delete $room 'switch[0]' >/dev/null 2>&1
+done
+# Each switch's chunks fill its small buffer, with an index of its own
+args=()
+for s in 0 1 2; do
+    args+=("switches[$s].x" $((2 + 4 * s)) .y 19)
+    for c in 1 2 3; do
+        args+=("switches[$s].chunks[$c].type" TOGGLE_OBJECT .index $((3 * s + c)))
+    done
+done
+./a.out patch $room "${args[@]}" >/dev/null 2>&1
+./a.out delete $room 'switch[1]' >/dev/null 2>&1
+
+got=$(./a.out display $room 2>/dev/null | sed -n 's/.*TOGGLE_OBJECT, \.index = \([0-9]*\).*/\1/p' | tr '\n' ' ')
+if [[ "$got" != "1 2 3 7 8 9 " ]]; then
+    echo "Expected indexes 1 2 3 7 8 9 after deleting switch[1], got $got"
+    exit 1
+fi
+echo OK
@@ -4,10 +4,13 @@
 
 #include <ctype.h>
 
+#include <errno.h>
+
 #include <poll.h>
 
 #include <signal.h>
 
+#include <stdarg.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -17,10 +20,23 @@
 #include <unistd.h>
 
 #include <sys/ioctl.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
 
 #include <dlfcn.h>
 
+// Built with EDITOR_RELEASE, loop_main is called straight from editor_main and
+// never reloads, so no editor.so or compiler is needed.
+// Built with EDITOR_LIBTCC, editor_main compiles the editor into memory with
+// libtcc instead of building and loading editor.so, see editor_main_in_process.
+// That code is compiled with EDITOR_IN_PROCESS. It has no make target as it has
+// not been built against a real libtcc yet, add -DEDITOR_LIBTCC -ltcc -ldl to try it.
+#ifdef EDITOR_LIBTCC
+#include <libtcc.h>
+#endif
+
 #include <time.h>
 #define TIME_NEWER(t1, t2) (((t1).tv_sec > (t2).tv_sec) || (((t1).tv_sec == (t2).tv_sec) && (t1).tv_nsec > (t2).tv_nsec))
 
@@ -41,27 +57,60 @@
 #endif
 
 #ifdef __TINYC__
-#define LIBRARY_BUILD_CMD "tcc -g -ggdb -Werror -Wall -Wpedantic -fsanitize=address -fpic -shared room.c -o"
+#define LIBRARY_BUILD_CMD "tcc -g -ggdb -Werror -Wall -Wpedantic -fsanitize=address -fpic -shared room.c patch.c validate.c -o"
+#define UNIT_BUILD_CMD "tcc -g -ggdb -Werror -Wall -Wpedantic -fsanitize=address -fpic -c"
+#define UNIT_LINK_CMD "tcc -g -fsanitize=address -shared"
 #else
-#define LIBRARY_BUILD_CMD "cc -g -ggdb -Werror -Wall -Wpedantic -fsanitize=address -fpic -shared room.c -o"
+#define LIBRARY_BUILD_CMD "cc -g -ggdb -Werror -Wall -Wpedantic -fsanitize=address -fpic -shared room.c patch.c validate.c -o"
+#define UNIT_BUILD_CMD "cc -g -ggdb -Werror -Wall -Wpedantic -fsanitize=address -fpic -c"
+#define UNIT_LINK_CMD "cc -g -fsanitize=address -shared"
 #endif
+// What LIBRARY_BUILD_CMD compiles along with __FILE__, for editor_main_in_process
+#define LIBRARY_SOURCES "room.c", "patch.c", "validate.c"
 
+#include "patch.h"
 #include "room.h"
+#include "validate.h"
 
-bool any_source_newer(struct timespec test_time) {
+// Set by editor_main_in_process before each call to loop_main
+typedef struct {
+    struct timespec started; // of the compile, sources changed after this need compiling again
+    bool failed; // loop_main is the one from before
+} compile_status;
+#if defined(EDITOR_IN_PROCESS)
+extern compile_status editor_compile; // Lives in the host, added with tcc_add_symbol
+#elif defined(EDITOR_LIBTCC)
+compile_status editor_compile;
+#endif
+
+// The background rebuild compiles each of these to its own object, and only
+// when the source or a header it includes is newer than that object
+typedef struct {
+    char *source;
+    char *object;
+    char *headers[5];
+} library_unit;
+
+static library_unit library_units[] = {
+    { "room.c", "room.pic.o", { "room.h", "array.h", "arena.h" } },
+    { "patch.c", "patch.pic.o", { "patch.h", "room.h", "array.h", "arena.h" } },
+    { "validate.c", "validate.pic.o", { "validate.h", "room.h", "array.h", "arena.h" } },
+    { __FILE__, "editor.pic.o", { "patch.h", "room.h", "validate.h", "array.h", "arena.h" } },
+};
+#define NUM_LIBRARY_UNITS C_ARRAY_LEN(library_units)
+
+bool unit_newer(library_unit *unit, struct timespec test_time) {
     struct stat file_stat;
-    char *files[] = {
-        __FILE__,
-        "room.c",
-        "room.h",
-        "array.h"
-    };
-    for (size_t i = 0; i < C_ARRAY_LEN(files); i ++) {
-        if (stat(files[i], &file_stat) == 0) {
-            if (TIME_NEWER(file_stat.st_mtim, test_time)) {
-                return true;
-            }
-        }
+    if (stat(unit->source, &file_stat) == 0 && TIME_NEWER(file_stat.st_mtim, test_time)) return true;
+    for (size_t i = 0; i < C_ARRAY_LEN(unit->headers) && unit->headers[i] != NULL; i ++) {
+        if (stat(unit->headers[i], &file_stat) == 0 && TIME_NEWER(file_stat.st_mtim, test_time)) return true;
+    }
+    return false;
+}
+
+bool any_source_newer(struct timespec test_time) {
+    for (size_t i = 0; i < NUM_LIBRARY_UNITS; i ++) {
+        if (unit_newer(&library_units[i], test_time)) return true;
     }
     return false;
 }
@@ -77,6 +126,8 @@ bool any_source_newer(struct timespec test_time) {
 
 #define ENABLE_ALT_BUFFER  "\x1b[1049h"
 #define DISABLE_ALT_BUFFER "\x1b[1049l"
+#define ENABLE_BRACKETED_PASTE  "\x1b[?2004h"
+#define DISABLE_BRACKETED_PASTE "\x1b[?2004l"
 
 #define RESET_GFX_MODE "\x1b[0m"
 #define CLEAR_SCREEN   "\x1b[0J"
@@ -124,10 +175,10 @@ bool any_source_newer(struct timespec test_time) {
 #define KEYPAD_9  PAGE_UP
 #define KEYPAD_0  INSERT
 
-#define F1  "\x1b[OP"
-#define F2  "\x1b[OQ"
-#define F3  "\x1b[OR"
-#define F4  "\x1b[OS"
+#define F1  "\x1bOP"
+#define F2  "\x1bOQ"
+#define F3  "\x1bOR"
+#define F4  "\x1bOS"
 #define F5  "\x1b[15~"
 #define F6  "\x1b[17~"
 #define F7  "\x1b[18~"
@@ -137,7 +188,43 @@ bool any_source_newer(struct timespec test_time) {
 #define F11  "\x1b[23~"
 #define F12  "\x1b[24~"
 
+// Around whatever was pasted, see ENABLE_BRACKETED_PASTE
+#define PASTE_START "\x1b[200~"
+#define PASTE_END   "\x1b[201~"
+
+#define CTRL_D          "\x04"
+#define CTRL_H          "\x08"
+#define CTRL_Q          "\x11"
+#define CTRL_R          "\x12"
+#define CTRL_S          "\x13"
+#define CTRL_T          "\x14"
+#define CTRL_W          "\x17"
+#define CTRL_UNDERSCORE "\x1f" // Ctrl-? on most terminals
+
 #define ESCAPE '\033'
+#define ENTER     "\n"
+#define BACKSPACE "\x7f"
+
+// Bytes left in ROOMS.SPL under which the size budget is highlighted
+#define BUDGET_WARNING 0x40
+// Time COMPRESS_FIT can spend on a save before giving up
+#define SAVE_SECONDS 0.05
+// Snapshots kept for u/U, each only costs a copy of the rooms changed since the one before
+#define UNDO_DEPTH 64
+// Listened on for commands from scripts, see control_setup
+#define CONTROL_SOCKET "editor.sock"
+// Seconds a script has to send its whole batch
+#define CONTROL_TIMEOUT 1
+// Scripts that can be sending a batch at once, more wait to be accepted
+#define CONTROL_CLIENTS 4
+// Bytes a batch can be, a longer one is refused before any of it is run
+#define CONTROL_MAX_BATCH (1 << 20)
+// Where the compiler output of the last background rebuild goes
+#define REBUILD_LOG "editor.log"
+// Seconds the time each unit took to rebuild is shown for
+#define REBUILD_SHOWN 5
+// Seconds a notice stays on the screen
+#define NOTICE_SHOWN 5
 
 #define MIN_HEIGHT (HEIGHT_TILES + 1)
 #define MIN_WIDTH (2 * WIDTH_TILES)
@@ -181,13 +268,78 @@ typedef enum {
     EDIT_SWITCHDETAILS_CHUNK_OBJECT_DETAILS,
 
     TOGGLE_DISPLAY,
+    WORLD_VIEW,
     NUM_STATES
 } game_state_state;
 
+typedef enum {
+    REBUILD_IDLE,
+    REBUILD_RUNNING,
+    REBUILD_FAILED, // Until the sources change again, see REBUILD_LOG
+} rebuild_status;
+
+// Left at the start of game_state by the build of the library that made it,
+// so that the next build can find the fields it knows about, see setup
+#define STATE_LAYOUT_MAGIC 0x53544131 // Anything else is a state from before layouts
+#define MAX_STATE_FIELDS 48
+
+typedef struct {
+    char name[24];
+    size_t offset;
+    size_t size;
+    int version;
+} state_field_layout;
+
+typedef struct {
+    uint32_t magic;
+    size_t num_fields;
+    state_field_layout fields[MAX_STATE_FIELDS];
+} state_layout;
+
+// Each zoom halves the size rooms are drawn at in WORLD_VIEW
+#define WORLD_ZOOMS 3
+
+// Rooms drawn for WORLD_VIEW, kept until the room is edited, see room_edited
+typedef struct {
+    int zoom; // 0 is a character for each tile across and two down
+    size_t root; // Rooms are laid out from here, see world_layout
+    bool cached[64];
+    char cells[64][HEIGHT_TILES][WIDTH_TILES]; // Only the top left corner is used when zoomed out
+} world_view;
+
+// What copy_selection took, for paste_clipboard
+typedef struct {
+    int width, height; // 0 until something is copied
+    uint8_t tiles[WIDTH_TILES * HEIGHT_TILES]; // WIDTH_TILES apart
+    ARRAY(struct RoomObject) objects; // x and y from the top left
+    ARRAY(struct SwitchChunk) chunks; // Each switch from its PREAMBLE on, x and y from the top left
+} tile_clipboard;
+
+// Two half blocks with their colours, then a reset
+#define GLYPH_SIZE 96
+
+// Tiles drawn from GRAPHICS_FILE, each kept as the escapes for its two
+// characters from the first time it is drawn, indexed by GRAPHICS_TILE
+typedef struct {
+    bool shown;
+    TileGraphics tiles; // Loaded the first time it is shown
+    bool cached[MAX_GRAPHICS_TILES];
+    uint8_t lengths[MAX_GRAPHICS_TILES];
+    char glyphs[MAX_GRAPHICS_TILES][GLYPH_SIZE];
+} tile_graphics;
+
+// A script still sending its batch, read from each frame as far as it has
+// got so that a slow one does not hold up the editor
+typedef struct {
+    int fd; // 0 when free, stdin is never a client
+    ARRAY(char) input;
+    struct timespec connected;
+} control_client;
+
 typedef struct {
+    state_layout layout; // Must stay first
     game_state_state current_state;
     game_state_state previous_state;
-    size_t size;
     v2 cursors[64];
     size_t current_level;
     v2 screen_dimensions;
@@ -208,13 +360,67 @@ typedef struct {
     size_t current_switch;
     size_t current_chunk;
     bool switch_on;
+
+    CompressLevel compress_level;
+
+    RoomSnapshot history[UNDO_DEPTH];
+    size_t history_length;
+    size_t history_current; // history[history_current] is what rooms looks like now
+    struct timespec rooms_mtime; // ROOMS.SPL is reloaded when changed after this, so not for our own writes
+    int control_fd; // -1 if CONTROL_SOCKET could not be listened on
+    control_client control_clients[CONTROL_CLIENTS];
+    Validator validator; // Only rooms invalidated since the last redraw are checked again
+    rebuild_status rebuild;
+    struct {
+        pid_t pid; // 0 unless it is being compiled
+        bool failed;
+        bool stale; // Its source changed while it compiled, see rebuild_poll
+        struct timespec started;
+        struct timespec source_time; // CLOCK_REALTIME as the compile started, to compare with source mtimes
+        double seconds; // of its last compile, 0 if it did not need one
+    } units[NUM_LIBRARY_UNITS];
+    pid_t link_pid; // 0 unless the units are being linked
+    struct timespec rebuild_started;
+    double rebuild_total; // Seconds the last rebuild took, shown for REBUILD_SHOWN after
+    struct timespec rebuilt;
+    char input[4096]; // Read but not yet run, at most the start of one escape sequence between frames
+    size_t input_length;
+    bool pasting; // Between PASTE_START and PASTE_END
+    ARRAY(char) paste;
+    char notice[80]; // Shown for NOTICE_SHOWN after noticed
+    struct timespec noticed;
+    bool selecting; // From mark to the cursor, while it is in mark_level
+    v2 mark;
+    size_t mark_level;
+    tile_clipboard clipboard;
+    world_view world;
+    tile_graphics graphics;
 } game_state;
 game_state *state = NULL;
 
 void end() {
-    printf(RESTORE_CURSOR SHOW_CURSOR RESTORE_SCREEN DISABLE_ALT_BUFFER);
+    printf(DISABLE_BRACKETED_PASTE RESTORE_CURSOR SHOW_CURSOR RESTORE_SCREEN DISABLE_ALT_BUFFER);
     if (state != NULL) {
         assert(tcsetattr(STDIN_FILENO, TCSANOW, &state->original_termios) == 0);
+        for (size_t i = 0; i < state->history_length; i ++) {
+            releaseSnapshot(&state->history[i]);
+        }
+        if (state->control_fd != -1) {
+            close(state->control_fd);
+            unlink(CONTROL_SOCKET);
+        }
+        for (size_t i = 0; i < CONTROL_CLIENTS; i ++) {
+            if (state->control_clients[i].fd != 0) close(state->control_clients[i].fd);
+            ARRAY_FREE(state->control_clients[i].input);
+        }
+        for (size_t i = 0; i < NUM_LIBRARY_UNITS; i ++) {
+            if (state->units[i].pid != 0) kill(state->units[i].pid, SIGTERM);
+        }
+        if (state->link_pid != 0) kill(state->link_pid, SIGTERM);
+        freeValidator(&state->validator);
+        ARRAY_FREE(state->paste);
+        ARRAY_FREE(state->clipboard.objects);
+        ARRAY_FREE(state->clipboard.chunks);
         freeRoomFile(&state->rooms);
         free(state);
     }
@@ -241,6 +447,256 @@ bool debugany() {
         state->debug.pos;
 }
 
+double rebuild_seconds(struct timespec start) {
+    struct timespec now;
+    assert(clock_gettime(CLOCK_MONOTONIC, &now) == 0);
+    return (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+__attribute__((format(printf, 1, 2)))
+void notify(const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(state->notice, sizeof(state->notice), fmt, args);
+    va_end(args);
+    assert(clock_gettime(CLOCK_MONOTONIC, &state->noticed) == 0);
+}
+
+// Edits that would not fit are kept in memory but not written, redraw()
+// shows how far over the budget the file is.
+void write_rooms() {
+    if (!relinkSwitchBits(&state->rooms)) {
+        notify("Not saved, a TOGGLE_BIT chunk points at a switch that is gone");
+        return;
+    }
+    if (!compressRooms(&state->rooms, state->compress_level, MAX_ROOM_FILE_SIZE, SAVE_SECONDS)) return;
+    if (!writeRooms(&state->rooms, state->compress_level)) {
+        notify("Could not write %s, edits are kept", ROOMS_FILE);
+        return;
+    }
+    struct stat rooms_stat;
+    if (stat(ROOMS_FILE, &rooms_stat) == 0) state->rooms_mtime = rooms_stat.st_mtim;
+}
+
+// Drops anything that could be redone, and the oldest snapshot once full
+void record_history() {
+    while (state->history_length > state->history_current + 1) {
+        releaseSnapshot(&state->history[-- state->history_length]);
+    }
+    if (state->history_length == UNDO_DEPTH) {
+        releaseSnapshot(&state->history[0]);
+        memmove(state->history, state->history + 1, (UNDO_DEPTH - 1) * sizeof(state->history[0]));
+        state->history_length --;
+    }
+    takeSnapshot(&state->rooms, &state->history[state->history_length]);
+    state->history_current = state->history_length ++;
+}
+
+// Anything worked out from the room's contents is stale
+void room_edited(size_t idx) {
+    validatorInvalidate(&state->validator, idx);
+    state->world.cached[idx] = false;
+}
+
+// -1 to undo, +1 to redo
+void undo(int direction) {
+    if (direction < 0 && state->history_current == 0) return;
+    if (direction > 0 && state->history_current + 1 >= state->history_length) return;
+    state->history_current += direction;
+    for (size_t idx = 0; idx < C_ARRAY_LEN(state->rooms.rooms); idx ++) {
+        if (state->history[state->history_current].rooms[idx] != state->rooms.versions[idx]) {
+            room_edited(idx);
+        }
+    }
+    restoreSnapshot(&state->rooms, &state->history[state->history_current]);
+    write_rooms();
+}
+
+// Scripts can drive a running editor instead of rewriting ROOMS.SPL behind
+// its back. Each connection is one batch: send lines of
+//     patch ROOM_ID ADDR VALUE [ADDR VALUE]...
+//     delete ROOM_ID (switch[i]|switch[x].chunk[i]|object[i])...
+//     update rooms ROOMS [set FIELD=VALUE...] [clear switches|objects] [where ...]
+//     query ROOM_ID ADDR [ADDR]...
+// then shut down writing (nc -N, socat). Each line gets "ok" (followed by the
+// values for query) or "error", with the usual messages in between, and the
+// file is written once at the end of the batch.
+void control_setup() {
+    state->control_fd = -1;
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        perror("socket");
+        return;
+    }
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    strncpy(addr.sun_path, CONTROL_SOCKET, sizeof(addr.sun_path) - 1);
+    unlink(CONTROL_SOCKET);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 || listen(fd, 4) == -1) {
+        perror("Could not listen on " CONTROL_SOCKET);
+        close(fd);
+        return;
+    }
+    state->control_fd = fd;
+}
+
+// Reads each address with the same parsing as patch, only room fields and rest can be read
+bool control_query(int argc, char **argv, uint8_array *values) {
+    if (argc < 3) {
+        fprintf(stderr, "Usage: query ROOM_ID ADDR [ADDR]...\n");
+        return false;
+    }
+    PatchInstructionArray patches = {0};
+    bool ret = true;
+    for (int i = 2; ret && i < argc; i ++) {
+        char *patch_argv[] = { "patch", argv[1], argv[i], "0" };
+        int patch_argc = C_ARRAY_LEN(patch_argv);
+        char **patch_args = patch_argv;
+        ret = parsePatch(&patch_argc, &patch_args, "query", &state->rooms, &patches);
+    }
+    for (size_t i = 0; ret && i < patches.length; i ++) {
+        uint8_t value = 0;
+        ret = readPatchField(&state->rooms, &SMALL_ARRAY_DATA(patches)[i], &value);
+        char hex[4];
+        snprintf(hex, sizeof(hex), " %02x", value);
+        for (size_t c = 0; ret && hex[c] != '\0'; c ++) ARRAY_ADD(*values, hex[c]);
+    }
+    SMALL_ARRAY_FREE(patches);
+    return ret;
+}
+
+// Runs the lines of input, which is changed as it is split up
+void control_batch(int client, char *input) {
+    fflush(stderr);
+    int saved_stderr = dup(STDERR_FILENO);
+    dup2(client, STDERR_FILENO);
+    bool changed = false;
+    uint8_array values = {0};
+    char *line = input;
+    while (line != NULL && *line != '\0') {
+        char *next = strchr(line, '\n');
+        if (next != NULL) *next++ = '\0';
+        char *args[256];
+        size_t argc = splitPatchLine(line, args, C_ARRAY_LEN(args));
+        line = next;
+        if (argc == 0 || args[0][0] == '#') continue;
+
+        bool ok = false;
+        if (argc > C_ARRAY_LEN(args)) {
+            fprintf(stderr, "Too many arguments\n");
+        } else if (strcasecmp(args[0], "query") == 0) {
+            ok = control_query(argc, args, &values);
+        } else if (strcasecmp(args[0], "patch") == 0 || strcasecmp(args[0], "delete") == 0 || strcasecmp(args[0], "update") == 0) {
+            PatchInstructionArray patches = {0};
+            uint8_array rooms = {0};
+            int left = argc;
+            char **rest = args;
+            if (strcasecmp(args[0], "patch") == 0) ok = parsePatch(&left, &rest, "patch", &state->rooms, &patches);
+            else if (strcasecmp(args[0], "delete") == 0) ok = parseDelete(&left, &rest, "delete", &state->rooms, &patches);
+            else ok = parseUpdate(&left, &rest, "update", &state->rooms, &patches);
+            if (ok && left != 0) {
+                fprintf(stderr, "Unexpected argument: %s\n", rest[0]);
+                ok = false;
+            }
+            if (ok) {
+                changed = true;
+                ok = applyPatches(&state->rooms, &patches, args[0], &rooms);
+            }
+            for (size_t r = 0; r < rooms.length; r ++) room_edited(rooms.data[r]);
+            ARRAY_FREE(rooms);
+            SMALL_ARRAY_FREE(patches);
+        } else {
+            fprintf(stderr, "Unknown command: %s\n", args[0]);
+        }
+        if (ok) dprintf(client, "ok%.*s\n", (int)values.length, (char *)values.data);
+        else dprintf(client, "error\n");
+        values.length = 0;
+    }
+    ARRAY_FREE(values);
+    fflush(stderr);
+    dup2(saved_stderr, STDERR_FILENO);
+    close(saved_stderr);
+
+    if (changed) {
+        write_rooms();
+        record_history();
+    }
+}
+
+void control_close(control_client *client) {
+    close(client->fd);
+    client->fd = 0;
+    ARRAY_FREE(client->input);
+}
+
+// Takes what each script has sent so far without waiting for more, its batch
+// is run once it shuts down writing. Replies are written with the socket
+// blocking again, for at most CONTROL_TIMEOUT.
+void control_poll() {
+    if (state->control_fd == -1) return;
+    for (size_t i = 0; i < CONTROL_CLIENTS; i ++) {
+        control_client *client = &state->control_clients[i];
+        if (client->fd != 0) continue;
+        int fd = accept4(state->control_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (fd == -1) break;
+        struct timeval timeout = { .tv_sec = CONTROL_TIMEOUT };
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        client->fd = fd;
+        assert(clock_gettime(CLOCK_MONOTONIC, &client->connected) == 0);
+    }
+
+    for (size_t i = 0; i < CONTROL_CLIENTS; i ++) {
+        control_client *client = &state->control_clients[i];
+        if (client->fd == 0) continue;
+        char buf[4096];
+        ssize_t n = -1;
+        while (client->input.length <= CONTROL_MAX_BATCH && (n = recv(client->fd, buf, sizeof(buf), MSG_DONTWAIT)) > 0) {
+            for (ssize_t b = 0; b < n; b ++) ARRAY_ADD(client->input, buf[b]);
+        }
+        if (client->input.length > CONTROL_MAX_BATCH) {
+            dprintf(client->fd, "Batch is over %d bytes\nerror\n", CONTROL_MAX_BATCH);
+        } else if (n == 0) {
+            ARRAY_ADD(client->input, '\0');
+            control_batch(client->fd, client->input.data);
+        } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            // Gone without shutting down
+        } else if (rebuild_seconds(client->connected) > CONTROL_TIMEOUT) {
+            dprintf(client->fd, "Batch not sent within %d seconds\nerror\n", CONTROL_TIMEOUT);
+        } else {
+            continue;
+        }
+        control_close(client);
+    }
+}
+
+// Runs play.sh in its own session. The middle child exits straight away and is
+// waited for here, so that rebuild_poll can wait for its own child.
+void play() {
+    pid_t child = fork();
+    if (child == 0) {
+        if (state != NULL) {
+            freeRoomFile(&state->rooms);
+            free(state);
+        }
+        pid_t sid = fork();
+        if (sid == -1) exit(EXIT_FAILURE);
+        if (sid > 0) exit(EXIT_SUCCESS);
+        if (setsid() == -1) exit(EXIT_FAILURE);
+        execv("./play.sh", (char *[]){ "./play.sh", NULL });
+        exit(EXIT_FAILURE);
+    }
+    if (child > 0) waitpid(child, NULL, 0);
+}
+
+// Only the current room is recompressed, the others keep their cached
+// compressed data.
+void save_room() {
+    state->rooms.rooms[state->current_level].compressed.length = 0;
+    roomChanged(&state->rooms, state->current_level);
+    room_edited(state->current_level);
+    write_rooms();
+    record_history();
+}
+
 void move(int dx, int dy) {
     int x = state->cursors[state->current_level].x;
     int y = state->cursors[state->current_level].y;
@@ -269,8 +725,7 @@ void move(int dx, int dy) {
             object->y += dy;
             state->cursors[state->current_level].x += dx;
             state->cursors[state->current_level].y += dy;
-            ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-            assert(writeRooms(&state->rooms));
+            save_room();
             moved = true;
         }
     }
@@ -279,8 +734,8 @@ void move(int dx, int dy) {
         bool sw = false;
         for (size_t i = 0; i < room->num_switches; i ++) {
             switcch = room->switches + i;
-            if (switcch->chunks.length > 0 && switcch->chunks.data[0].type == PREAMBLE &&
-                    x == switcch->chunks.data[0].x && y == switcch->chunks.data[0].y) {
+            if (switcch->chunks.length > 0 && SMALL_ARRAY_DATA(switcch->chunks)[0].type == PREAMBLE &&
+                    x == SMALL_ARRAY_DATA(switcch->chunks)[0].x && y == SMALL_ARRAY_DATA(switcch->chunks)[0].y) {
                 sw = true;
                 break;
             }
@@ -288,12 +743,11 @@ void move(int dx, int dy) {
         if (sw) {
             room->tiles[TILE_IDX(x + dx, y + dy)] = room->tiles[TILE_IDX(x, y)];
             room->tiles[TILE_IDX(x, y)] = 0;
-            switcch->chunks.data[0].x += dx;
-            switcch->chunks.data[0].y += dy;
+            SMALL_ARRAY_DATA(switcch->chunks)[0].x += dx;
+            SMALL_ARRAY_DATA(switcch->chunks)[0].y += dy;
             state->cursors[state->current_level].x += dx;
             state->cursors[state->current_level].y += dy;
-            ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-            assert(writeRooms(&state->rooms));
+            save_room();
             moved = true;
         } else {
             struct SwitchChunk *chunk = NULL;
@@ -301,7 +755,7 @@ void move(int dx, int dy) {
             for (size_t i = 0; i < room->num_switches; i ++) {
                 switcch = room->switches + i;
                 for (size_t c = 1; c < switcch->chunks.length; c ++) {
-                    chunk = switcch->chunks.data + c;
+                    chunk = SMALL_ARRAY_DATA(switcch->chunks) + c;
                     if (chunk->type == TOGGLE_BLOCK &&
                             (chunk->dir == HORIZONTAL ?
                                  y == chunk->y && x >= chunk->x && x < chunk->x + chunk->size :
@@ -319,8 +773,7 @@ void move(int dx, int dy) {
                     chunk->y += dy;
                     state->cursors[state->current_level].x += dx;
                     state->cursors[state->current_level].y += dy;
-                    ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                    assert(writeRooms(&state->rooms));
+                    save_room();
                     moved = true;
                     break;
                 }
@@ -332,8 +785,7 @@ void move(int dx, int dy) {
         room->tiles[TILE_IDX(x, y)] = 0;
         state->cursors[state->current_level].x += dx;
         state->cursors[state->current_level].y += dy;
-        ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-        assert(writeRooms(&state->rooms));
+        save_room();
     }
 }
 
@@ -352,7 +804,7 @@ void stretch(int dx, int dy) {
                     y >= object->y && y < object->y + object->block.height &&
                     (int)object->x + dx >= 0 && (int)object->x + object->block.width + dx <= WIDTH_TILES &&
                     (int)object->y + dy >= 0 && (int)object->y + object->block.height + dy <= HEIGHT_TILES) {
-                if ((dx && object->block.width < 8) || (dy && object->block.height < 4)) {
+                if ((dx && object->block.width < MAX_BLOCK_WIDTH) || (dy && object->block.height < MAX_BLOCK_HEIGHT)) {
                     obj = true;
                     break;
                 }
@@ -360,48 +812,31 @@ void stretch(int dx, int dy) {
         }
         if (obj) {
             assert(object->type == BLOCK);
-            assert(object->tiles);
+            // Tiles are packed row by row, so growing moves every row along
+            // in place, starting from the last so nothing is overwritten
+            size_t width = object->block.width;
+            size_t height = object->block.height;
             if (dx) {
                 // copy column
-                uint8_t *tiles = malloc((object->block.width + 1) * object->block.height);
-                assert(tiles != NULL);
-                for (size_t _y = 0; _y < object->block.height; _y ++) {
-                    if (x - object->x > 0) {
-                        memcpy(tiles + _y * (object->block.width + 1),
-                                object->tiles + _y * object->block.width,
-                                x - object->x);
-                    }
-                    tiles[_y * (object->block.width + 1) + (x - object->x)] = object->tiles[_y * object->block.width + (x - object->x)];
-                    if (dx < 0) {
-                        memcpy(tiles + _y * (object->block.width + 1) + (x - object->x) - dx,
-                                object->tiles + _y * object->block.width + (x - object->x),
-                                object->block.width - (x - object->x));
-                    } else {
-                        memcpy(tiles + _y * (object->block.width + 1) + (x - object->x) + 1,
-                                object->tiles + _y * object->block.width + (x - object->x),
-                                object->block.width - (x - object->x));
-                    }
+                size_t c = x - object->x;
+                for (size_t _y = height; _y-- > 0;) {
+                    uint8_t *src = object->tiles + _y * width;
+                    uint8_t *dst = object->tiles + _y * (width + 1);
+                    memmove(dst + c + 1, src + c, width - c);
+                    memmove(dst, src, c + 1);
                 }
                 object->block.width ++;
                 if (dx < 0) object->x += dx;
-                free(object->tiles);
-                object->tiles = tiles;
             } else {
                 // copy row
-                uint8_t *tiles = malloc(object->block.width * (object->block.height + 1));
-                memset(tiles, 1, object->block.width * (object->block.height + 1));
-                assert(tiles != NULL);
-                memcpy(tiles, object->tiles, (y - object->y + 1) * object->block.width);
-                memcpy(tiles + (y - object->y + 1) * object->block.width, object->tiles + (y - object->y) * object->block.width, (object->block.height - (y - object->y)) * object->block.width);
+                size_t r = y - object->y;
+                memmove(object->tiles + (r + 1) * width, object->tiles + r * width, (height - r) * width);
                 object->block.height ++;
                 if (dy < 0) object->y += dy;
-                free(object->tiles);
-                object->tiles = tiles;
             }
             state->cursors[state->current_level].x += dx;
             state->cursors[state->current_level].y += dy;
-            ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-            assert(writeRooms(&state->rooms));
+            save_room();
 
             stretched = true;
         }
@@ -413,7 +848,7 @@ void stretch(int dx, int dy) {
         for (size_t i = 0; i < room->num_switches; i ++) {
             switcch = room->switches + i;
             for (size_t c = 1; c < switcch->chunks.length; c ++) {
-                chunk = switcch->chunks.data + c;
+                chunk = SMALL_ARRAY_DATA(switcch->chunks) + c;
                 if (chunk->type == TOGGLE_BLOCK &&
                         y >= chunk->y && x >= chunk->x &&
                         chunk->x + dx >= 0 && chunk->y + dy >= 0) {
@@ -448,11 +883,11 @@ void stretch(int dx, int dy) {
                     while (conflict) {
                         conflict = false;
                         for (size_t i = 1; i < switcch->chunks.length; i ++) {
-                            if (switcch->chunks.data[i].x == _x && switcch->chunks.data[i].y == _y &&
-                                    switcch->chunks.data[i].type == TOGGLE_BLOCK &&
-                                    switcch->chunks.data[i].on == chunk->on &&
-                                    switcch->chunks.data[i].off == chunk->off &&
-                                    switcch->chunks.data[i].size == chunk->size) {
+                            if (SMALL_ARRAY_DATA(switcch->chunks)[i].x == _x && SMALL_ARRAY_DATA(switcch->chunks)[i].y == _y &&
+                                    SMALL_ARRAY_DATA(switcch->chunks)[i].type == TOGGLE_BLOCK &&
+                                    SMALL_ARRAY_DATA(switcch->chunks)[i].on == chunk->on &&
+                                    SMALL_ARRAY_DATA(switcch->chunks)[i].off == chunk->off &&
+                                    SMALL_ARRAY_DATA(switcch->chunks)[i].size == chunk->size) {
                                 _x += dx;
                                 _y += dy;
                                 conflict = true;
@@ -460,14 +895,13 @@ void stretch(int dx, int dy) {
                             }
                         }
                     }
-                    ARRAY_ADD(switcch->chunks, ((struct SwitchChunk){ .type = TOGGLE_BLOCK,
+                    ARENA_SMALL_ARRAY_ADD(&state->rooms.arena, switcch->chunks, ((struct SwitchChunk){ .type = TOGGLE_BLOCK,
                                 .x = _x, .y = _y, .size = chunk->size,
                                 .on = chunk->on, .off = chunk->off, .dir = chunk->dir }));
                 }
                 state->cursors[state->current_level].x += dx;
                 state->cursors[state->current_level].y += dy;
-                ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                assert(writeRooms(&state->rooms));
+                save_room();
                 stretched = true;
                 break;
             }
@@ -477,8 +911,7 @@ void stretch(int dx, int dy) {
         room->tiles[TILE_IDX(x + dx, y + dy)] = room->tiles[TILE_IDX(x, y)];
         state->cursors[state->current_level].x += dx;
         state->cursors[state->current_level].y += dy;
-        ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-        assert(writeRooms(&state->rooms));
+        save_room();
     }
 }
 
@@ -494,10 +927,12 @@ void shrink(int dx, int dy) {
             object = room->objects + i;
             if (object->type == BLOCK &&
                     x >= object->x && x < object->x + object->block.width &&
-                    y >= object->y && y < object->y + object->block.height &&
-                    (int)object->x + dx >= 0 && (int)object->x + object->block.width + dx <= WIDTH_TILES &&
-                    (int)object->y + dy >= 0 && (int)object->y + object->block.height + dy <= HEIGHT_TILES) {
-                if ((dx && object->block.width < 8) || (dy && object->block.height < 4)) {
+                    y >= object->y && y < object->y + object->block.height) {
+                // Pulls the far end in, so the first row/column can't shrink up/left and the last can't shrink down/right
+                int c = x - object->x;
+                int r = y - object->y;
+                if ((dx < 0 && c > 0) || (dx > 0 && c < object->block.width - 1) ||
+                        (dy < 0 && r > 0) || (dy > 0 && r < object->block.height - 1)) {
                     obj = true;
                     break;
                 }
@@ -505,21 +940,32 @@ void shrink(int dx, int dy) {
         }
         if (obj) {
             assert(object->type == BLOCK);
-            assert(object->tiles);
-            fprintf(stderr, "%s:%d: UNIMPLEMENTED: shrink object", __FILE__, __LINE__);
-            abort();
-
-            // FIXME I guess pull one end to the direction you are shrinking
-            // so if row 0 and dy -1 noop, but row 1 and dy -1 shifts rows up by one
-            // and row 2 and dy -1 will keep row 1 the same, then shift 3-N up by one
-            // and row 3 will keep row 1&2 the same, then shift 4-N up by one
-            // if dy +1, then keep bottom rows (if any), shift down by one to y
-            // dx the same but in horizontal dir
+            // Tiles are packed row by row, so shrinking moves every row back
+            // in place, starting from the first so nothing is overwritten
+            size_t width = object->block.width;
+            size_t height = object->block.height;
+            if (dx) {
+                // drop column
+                size_t c = x - object->x;
+                for (size_t _y = 0; _y < height; _y ++) {
+                    uint8_t *src = object->tiles + _y * width;
+                    uint8_t *dst = object->tiles + _y * (width - 1);
+                    memmove(dst, src, c);
+                    memmove(dst + c, src + c + 1, width - c - 1);
+                }
+                object->block.width --;
+                if (dx > 0) object->x += dx;
+            } else {
+                // drop row
+                size_t r = y - object->y;
+                memmove(object->tiles + r * width, object->tiles + (r + 1) * width, (height - r - 1) * width);
+                object->block.height --;
+                if (dy > 0) object->y += dy;
+            }
 
             state->cursors[state->current_level].x += dx;
             state->cursors[state->current_level].y += dy;
-            ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-            assert(writeRooms(&state->rooms));
+            save_room();
 
             stretched = true;
         }
@@ -531,7 +977,7 @@ void shrink(int dx, int dy) {
         for (size_t i = 0; i < room->num_switches; i ++) {
             switcch = room->switches + i;
             for (size_t c = 1; c < switcch->chunks.length; c ++) {
-                chunk = switcch->chunks.data + c;
+                chunk = SMALL_ARRAY_DATA(switcch->chunks) + c;
                 if (chunk->type == TOGGLE_BLOCK &&
                         y >= chunk->y && x >= chunk->x &&
                         chunk->x + dx >= 0 && chunk->y + dy >= 0) {
@@ -566,11 +1012,11 @@ void shrink(int dx, int dy) {
                     while (conflict) {
                         conflict = false;
                         for (size_t i = 1; i < switcch->chunks.length; i ++) {
-                            if (switcch->chunks.data[i].x == _x && switcch->chunks.data[i].y == _y &&
-                                    switcch->chunks.data[i].type == TOGGLE_BLOCK &&
-                                    switcch->chunks.data[i].on == chunk->on &&
-                                    switcch->chunks.data[i].off == chunk->off &&
-                                    switcch->chunks.data[i].size == chunk->size) {
+                            if (SMALL_ARRAY_DATA(switcch->chunks)[i].x == _x && SMALL_ARRAY_DATA(switcch->chunks)[i].y == _y &&
+                                    SMALL_ARRAY_DATA(switcch->chunks)[i].type == TOGGLE_BLOCK &&
+                                    SMALL_ARRAY_DATA(switcch->chunks)[i].on == chunk->on &&
+                                    SMALL_ARRAY_DATA(switcch->chunks)[i].off == chunk->off &&
+                                    SMALL_ARRAY_DATA(switcch->chunks)[i].size == chunk->size) {
                                 _x += dx;
                                 _y += dy;
                                 conflict = true;
@@ -578,14 +1024,13 @@ void shrink(int dx, int dy) {
                             }
                         }
                     }
-                    ARRAY_ADD(switcch->chunks, ((struct SwitchChunk){ .type = TOGGLE_BLOCK,
+                    ARENA_SMALL_ARRAY_ADD(&state->rooms.arena, switcch->chunks, ((struct SwitchChunk){ .type = TOGGLE_BLOCK,
                                 .x = _x, .y = _y, .size = chunk->size,
                                 .on = chunk->on, .off = chunk->off, .dir = chunk->dir }));
                 }
                 state->cursors[state->current_level].x += dx;
                 state->cursors[state->current_level].y += dy;
-                ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                assert(writeRooms(&state->rooms));
+                save_room();
                 stretched = true;
                 break;
             }
@@ -595,3932 +1040,2024 @@ void shrink(int dx, int dy) {
         room->tiles[TILE_IDX(x + dx, y + dy)] = room->tiles[TILE_IDX(x, y)];
         state->cursors[state->current_level].x += dx;
         state->cursors[state->current_level].y += dy;
-        ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-        assert(writeRooms(&state->rooms));
+        save_room();
     }
 }
 
-void process_input() {
-    struct pollfd fd = {
-        .fd = STDIN_FILENO,
-        .events = POLLIN,
-    };
-    assert(poll(&fd, 1, 0) >= 0);
-    if (fd.revents != 0 && (fd.revents & POLLIN) != 0) {
-        char buf[64];
-        ssize_t n = read(fd.fd, buf, sizeof(buf));
-        assert(n >= 0);
+void enter_state(game_state_state next) {
+    state->previous_state = state->current_state;
+    state->current_state = next;
+    state->current_switch = 0;
+    state->switch_on = false;
+    state->current_chunk = 0;
+}
 
-        int i = 0;
-        while (i < n) {
-            v2 *cursor = &state->cursors[state->current_level];
-            size_t *cursorlevel = &state->current_level;
-
-            /* FIXME make this more user friendly to add a key to action */
-
-            char *match = NULL;
-#define KEY_MATCHES(key) ((strncmp(buf + i, (key), strlen((key))) == 0) && (match = key))
-            switch (state->current_state) {
-                case GOTO_OBJECT:
-                {
-                    if (isxdigit(buf[i])) {
-                        struct DecompresssedRoom *room = &state->rooms.rooms[*cursorlevel].data;
-                        if (room->num_objects > 15) {
-                            // FIXME support 2 digit nums
-                            UNREACHABLE();
-                        }
-                        size_t id;
-                        if (buf[i] > '9') {
-                            id = tolower(buf[i]) - 'a' + 10;
-                        } else {
-                            id = buf[i] - '0';
-                        }
-                        if (id < room->num_objects) {
-                            struct RoomObject *obj = room->objects + id;
-                            if (obj->x < WIDTH_TILES && obj->y < HEIGHT_TILES) {
-                                cursor->x = obj->x;
-                                cursor->y = obj->y;
-                                state->current_state = state->previous_state;
-                                state->previous_state = NORMAL;
-                            }
-                        }
-                    } else if (buf[i] == ESCAPE) {
-                        if (state->help) {
-                            state->help = false;
-                        } else {
-                            state->current_state = state->previous_state;
-                            state->current_switch = 0;
-                            state->switch_on = false;
-                            state->current_chunk = 0;
-                            state->previous_state = NORMAL;
-                        }
-                    } else if (iscntrl(buf[i])) {
-                        switch (buf[i] + 'A' - 1) {
-                            case '_': state->help = !state->help; break;
-                            case 'H': state->debug.hex = !state->debug.hex; break;
-                        }
-                    } else if (buf[i] == 'q') {
-                        if (state->help) {
-                            state->help = !state->help;
-                        } else {
-                            if (state->partial_byte) {
-                                state->partial_byte = 0;
-                            } else {
-                                state->current_state = state->previous_state;
-                                state->current_switch = 0;
-                                state->switch_on = false;
-                                state->current_chunk = 0;
-                                state->previous_state = NORMAL;
-                            }
-                        }
-                    } else if (buf[i] == '?') {
-                        state->help = !state->help;
-                    }
-                    i ++;
-                }; break;
-
-                case GOTO_SWITCH:
-                {
-                    if (isxdigit(buf[i])) {
-                        struct DecompresssedRoom *room = &state->rooms.rooms[*cursorlevel].data;
-                        if (room->num_switches > 15) {
-                            // FIXME support 2 digit nums
-                            UNREACHABLE();
-                        }
-                        size_t id;
-                        if (buf[i] > '9') {
-                            id = tolower(buf[i]) - 'a' + 10;
-                        } else {
-                            id = buf[i] - '0';
-                        }
-                        if (id < room->num_switches) {
-                            state->current_switch = id + 1;
-                            struct SwitchObject *sw = room->switches + id;
-                            if (sw->chunks.length > 0 && sw->chunks.data[0].type == PREAMBLE && sw->chunks.data[0].x < WIDTH_TILES && sw->chunks.data[0].y < HEIGHT_TILES) {
-                                cursor->x = sw->chunks.data[0].x;
-                                cursor->y = sw->chunks.data[0].y;
-                                state->current_state = state->previous_state;
-                                state->previous_state = NORMAL;
-                            } else {
-                                state->current_state = EDIT_SWITCHDETAILS;
-                            }
-                        }
-                    } else if (buf[i] == ESCAPE) {
-                        if (state->help) {
-                            state->help = false;
-                        } else {
-                            state->current_state = state->previous_state;
-                            state->current_switch = 0;
-                            state->switch_on = false;
-                            state->current_chunk = 0;
-                            state->previous_state = NORMAL;
-                        }
-                    } else if (iscntrl(buf[i])) {
-                        switch (buf[i] + 'A' - 1) {
-                            case '_': state->help = !state->help; break;
-                            case 'H': state->debug.hex = !state->debug.hex; break;
-                        }
-                    } else if (buf[i] == 'q') {
-                        if (state->help) {
-                            state->help = !state->help;
-                        } else {
-                            if (state->partial_byte) {
-                                state->partial_byte = 0;
-                            } else {
-                                state->current_state = state->previous_state;
-                                state->current_switch = 0;
-                                state->switch_on = false;
-                                state->current_chunk = 0;
-                                state->previous_state = NORMAL;
-                            }
-                        }
-                    } else if (buf[i] == '?') {
-                        state->help = !state->help;
-                    }
-                    i ++;
-                }; break;
-
-                case GOTO_ROOM:
-                {
-                    if (state->partial_byte && ((state->debug.hex && isxdigit(buf[i])) || (!state->debug.hex && isdigit(buf[i])))) {
-                        int digit;
-                        if (buf[i] > '9') {
-                            digit = tolower(buf[i]) - 'a' + 10;
-                        } else {
-                            digit = buf[i] - '0';
-                        }
-                        size_t room = digit;
-                        if (state->debug.hex) {
-                            room += 16 * (state->partial_byte & 0xFF);
-                        } else {
-                            room += 10 * (state->partial_byte & 0xFF);
-                        }
-                        if (room < C_ARRAY_LEN(state->rooms.rooms)) {
-                            *cursorlevel = room;
-                            state->current_state = state->previous_state;
-                            state->current_switch = 0;
-                            state->switch_on = false;
-                            state->current_chunk = 0;
-                            state->previous_state = NORMAL;
-                            state->partial_byte = 0;
-                            if (state->roomname_cursor) {
-                                memset(state->room_name, 0, state->roomname_cursor);
-                                state->roomname_cursor = 0;
-                            }
-                        }
-                    } else if (state->roomname_cursor == 0 && state->partial_byte == 0 && buf[i] >= '0' &&
-                                buf[i] <= (state->debug.hex ? '3' : '6')) {
-                        state->partial_byte = 0xFF00 | (buf[i] - '0');
-                    } else if (buf[i] == 0x7f) {
-                        if (state->roomname_cursor) {
-                            state->room_name[--state->roomname_cursor] = 0;
-                        } else {
-                            state->partial_byte = 0;
-                        }
-                    } else if (buf[i] == ESCAPE) {
-                        if (i + 1 < n) {
-                            switch (buf[i + 1]) {
-                                case '[':
-                                    if (i + 2 < n) {
-                                        // CSI sequence
-                                        i += 2;
-                                        uint8_t arg = 0;
-                                        while (i < n) {
-                                            if (isdigit(buf[i])) {
-                                                arg = 10 * arg + buf[i] - '0';
-                                            } else if (buf[i] == ';') {
-                                                arg = 0;
-                                            } else {
-                                                switch (buf[i]) {
-                                                    case '~':
-                                                    {
-                                                        switch (arg) {
-                                                            case 3:
-                                                                if (state->roomname_cursor) {
-                                                                    state->room_name[--state->roomname_cursor] = 0;
-                                                                } else {
-                                                                    state->partial_byte = 0;
-                                                                }
-                                                                break;
-
-                                                            default: fprintf(stderr, "%s:%d: UNIMPLEMENTED: csi terminator %c arg %d", __FILE__, __LINE__, buf[i], arg);
-                                                        }
-                                                    }; break;
-
-                                                    case 'A':
-                                                    {
-                                                        *cursorlevel = state->rooms.rooms[*cursorlevel].data.room_north;
-                                                        state->current_state = state->previous_state;
-                                                        state->current_switch = 0;
-                                                        state->switch_on = false;
-                                                        state->current_chunk = 0;
-                                                        state->previous_state = NORMAL;
-                                                        state->partial_byte = 0;
-                                                        if (state->roomname_cursor) {
-                                                            memset(state->room_name, 0, state->roomname_cursor);
-                                                            state->roomname_cursor = 0;
-                                                        }
-                                                    }; break;
-
-                                                    case 'B':
-                                                    {
-                                                        *cursorlevel = state->rooms.rooms[*cursorlevel].data.room_south;
-                                                        state->current_state = state->previous_state;
-                                                        state->current_switch = 0;
-                                                        state->switch_on = false;
-                                                        state->current_chunk = 0;
-                                                        state->previous_state = NORMAL;
-                                                        state->partial_byte = 0;
-                                                        if (state->roomname_cursor) {
-                                                            memset(state->room_name, 0, state->roomname_cursor);
-                                                            state->roomname_cursor = 0;
-                                                        }
-                                                    }; break;
-
-                                                    case 'C':
-                                                    {
-                                                        *cursorlevel = state->rooms.rooms[*cursorlevel].data.room_east;
-                                                        state->current_state = state->previous_state;
-                                                        state->current_switch = 0;
-                                                        state->switch_on = false;
-                                                        state->current_chunk = 0;
-                                                        state->previous_state = NORMAL;
-                                                        state->partial_byte = 0;
-                                                        if (state->roomname_cursor) {
-                                                            memset(state->room_name, 0, state->roomname_cursor);
-                                                            state->roomname_cursor = 0;
-                                                        }
-                                                    }; break;
-
-                                                    case 'D':
-                                                    {
-                                                        *cursorlevel = state->rooms.rooms[*cursorlevel].data.room_west;
-                                                        state->current_state = state->previous_state;
-                                                        state->current_switch = 0;
-                                                        state->switch_on = false;
-                                                        state->current_chunk = 0;
-                                                        state->previous_state = NORMAL;
-                                                        state->partial_byte = 0;
-                                                        if (state->roomname_cursor) {
-                                                            memset(state->room_name, 0, state->roomname_cursor);
-                                                            state->roomname_cursor = 0;
-                                                        }
-                                                    }; break;
-
-                                                    default: fprintf(stderr, "%s:%d: UNIMPLEMENTED: csi terminator %c arg %d", __FILE__, __LINE__, buf[i], arg);
-                                                }
-                                                break;
-                                            }
-                                            i ++;
-                                        }
-                                    }
-                                    break;
+// Off the edge of the room goes to the same row or column of its neighbour
+void move_cursor(int dx, int dy) {
+    v2 *cursor = &state->cursors[state->current_level];
+    cursor->x += dx;
+    cursor->y += dy;
+    state->partial_byte = 0;
+    state->current_switch = 0;
+    state->switch_on = false;
+    state->current_chunk = 0;
+    if (cursor->x >= 0 && cursor->x < WIDTH_TILES && cursor->y >= 0 && cursor->y < HEIGHT_TILES) return;
+    cursor->x -= dx;
+    cursor->y -= dy;
+    struct DecompresssedRoom *room = &state->rooms.rooms[state->current_level].data;
+    size_t level = dx < 0 ? room->room_west : dx > 0 ? room->room_east : dy < 0 ? room->room_north : room->room_south;
+    state->cursors[level].x = dx < 0 ? WIDTH_TILES - 1 : dx > 0 ? 0 : cursor->x;
+    state->cursors[level].y = dy < 0 ? HEIGHT_TILES - 1 : dy > 0 ? 0 : cursor->y;
+    state->current_level = level;
+}
 
-                                case 'h':
-                                {
-                                    *cursorlevel = state->rooms.rooms[*cursorlevel].data.room_west;
-                                    state->current_state = state->previous_state;
-                                    state->current_switch = 0;
-                                    state->switch_on = false;
-                                    state->current_chunk = 0;
-                                    state->previous_state = NORMAL;
-                                    state->partial_byte = 0;
-                                    if (state->roomname_cursor) {
-                                        memset(state->room_name, 0, state->roomname_cursor);
-                                        state->roomname_cursor = 0;
-                                    }
-                                }; break;
-
-                                case 'j':
-                                {
-                                    *cursorlevel = state->rooms.rooms[*cursorlevel].data.room_south;
-                                    state->current_state = state->previous_state;
-                                    state->current_switch = 0;
-                                    state->switch_on = false;
-                                    state->current_chunk = 0;
-                                    state->previous_state = NORMAL;
-                                    state->partial_byte = 0;
-                                    if (state->roomname_cursor) {
-                                        memset(state->room_name, 0, state->roomname_cursor);
-                                        state->roomname_cursor = 0;
-                                    }
-                                }; break;
-
-                                case 'k':
-                                {
-                                    *cursorlevel = state->rooms.rooms[*cursorlevel].data.room_north;
-                                    state->current_state = state->previous_state;
-                                    state->current_switch = 0;
-                                    state->switch_on = false;
-                                    state->current_chunk = 0;
-                                    state->previous_state = NORMAL;
-                                    state->partial_byte = 0;
-                                    if (state->roomname_cursor) {
-                                        memset(state->room_name, 0, state->roomname_cursor);
-                                        state->roomname_cursor = 0;
-                                    }
-                                }; break;
-
-                                case 'l':
-                                {
-                                    *cursorlevel = state->rooms.rooms[*cursorlevel].data.room_east;
-                                    state->current_state = state->previous_state;
-                                    state->current_switch = 0;
-                                    state->switch_on = false;
-                                    state->current_chunk = 0;
-                                    state->previous_state = NORMAL;
-                                    state->partial_byte = 0;
-                                    if (state->roomname_cursor) {
-                                        memset(state->room_name, 0, state->roomname_cursor);
-                                        state->roomname_cursor = 0;
-                                    }
-                                }; break;
+#define DIRECTION_ACTIONS(action) \
+    void action##_left() { action(-1, 0); } \
+    void action##_down() { action(0, +1); } \
+    void action##_up() { action(0, -1); } \
+    void action##_right() { action(+1, 0); }
+DIRECTION_ACTIONS(move_cursor)
+// FIXME Currently doesn't move objects through to neighbours
+DIRECTION_ACTIONS(move)
+DIRECTION_ACTIONS(stretch)
+DIRECTION_ACTIONS(shrink)
+#undef DIRECTION_ACTIONS
+
+void quit_key() {
+    if (state->help) {
+        state->help = false;
+    } else {
+        if (state->partial_byte) {
+            state->partial_byte = 0;
+        } else {
+            end();
+            UNREACHABLE();
+        }
+    }
+}
 
-                            }
-                        } else if (state->help) {
-                            state->help = false;
-                        } else {
-                            state->current_state = state->previous_state;
-                            state->current_switch = 0;
-                            state->switch_on = false;
-                            state->current_chunk = 0;
-                            state->previous_state = NORMAL;
-                            state->partial_byte = 0;
-                            if (state->roomname_cursor) {
-                                memset(state->room_name, 0, state->roomname_cursor);
-                                state->roomname_cursor = 0;
-                            }
-                        }
-                    } else if (iscntrl(buf[i])) {
-                        switch (buf[i] + 'A' - 1) {
-                            case '_': state->help = !state->help; break;
-                            case 'H':
-                                state->debug.hex = !state->debug.hex;
-                                if (state->partial_byte) {
-                                    if (state->debug.hex) {
-                                        state->partial_byte = ((state->partial_byte & 0xFF) * 10 / 16) % 16 + 1;
-                                    } else {
-                                        state->partial_byte = ((state->partial_byte & 0xFF) * 16 / 10) % 10 + 1;
-                                    }
-                                }
-                                break;
+void escape_key() {
+    if (state->help) {
+        state->help = false;
+    } else {
+        if ((state->partial_byte & 0xFF00) != 0) {
+            state->partial_byte = 0;
+        }
+    }
+}
 
-                            case 'Q':
-                            {
-                                if (state->help) {
-                                    state->help = !state->help;
-                                } else {
-                                    state->current_state = state->previous_state;
-                                    state->current_switch = 0;
-                                    state->switch_on = false;
-                                    state->current_chunk = 0;
-                                    state->previous_state = NORMAL;
-                                    state->partial_byte = 0;
-                                    if (state->roomname_cursor) {
-                                        memset(state->room_name, 0, state->roomname_cursor);
-                                        state->roomname_cursor = 0;
-                                    }
-                                }
-                            }; break;
+void toggle_help() { state->help = !state->help; }
+void toggle_hex() { state->debug.hex = !state->debug.hex; }
+void cycle_compress_level() { state->compress_level = (state->compress_level + 1) % NUM_COMPRESS_LEVELS; }
+void undo_key() { undo(-1); }
+void redo_key() { undo(+1); }
+void toggle_display_key() { enter_state(TOGGLE_DISPLAY); }
+void tile_edit_key() { enter_state(TILE_EDIT); }
+void normal_key() { enter_state(NORMAL); }
+
+void goto_room_key() {
+    enter_state(GOTO_ROOM);
+    state->partial_byte = 0;
+}
 
-                        }
-                    } else {
-                        if (buf[i] == '[') {
-                            if (i + 1 < n) {
-                                // CSI sequence
-                                i += 1;
-                                uint8_t arg = 0;
-                                while (i < n) {
-                                    if (isdigit(buf[i])) {
-                                        arg = 10 * arg + buf[i] - '0';
-                                    } else if (buf[i] == ';') {
-                                        arg = 0;
-                                    } else {
-                                        if (arg == 3 && buf[i] == '~') {
-                                            state->partial_byte = 0;
-                                        } else {
-                                            fprintf(stderr, "%s:%d: UNIMPLEMENTED: csi terminator %c arg %d", __FILE__, __LINE__, buf[i], arg);
-                                        }
-                                        break;
-                                    }
-                                    i ++;
-                                }
-                            } else {
-                                UNREACHABLE();
-                            }
-                        } else if (state->partial_byte == 0 && isprint(buf[i])) {
-                            if (state->roomname_cursor < C_ARRAY_LEN(state->room_name) - 1) {
-                                state->room_name[state->roomname_cursor++] = buf[i];
-
-                                bool possible = false;
-                                bool duplicate = false;
-                                size_t matching_room = 0;
-                                if (state->roomname_cursor) {
-                                    for (size_t _room = 0; _room < C_ARRAY_LEN(state->rooms.rooms); _room ++) {
-                                        struct DecompresssedRoom *room = &state->rooms.rooms[_room].data;
-                                        if (strncasecmp(room->name, state->room_name, state->roomname_cursor) == 0) {
-                                            if (possible) {
-                                                duplicate = true;
-                                                break;
-                                            } else {
-                                                duplicate = false;
-                                            }
-                                            possible = true;
-                                            matching_room = _room;
-                                        }
-                                    }
-                                } else {
-                                    possible = true;
-                                }
-                                if (!possible) {
-                                    state->room_name[--state->roomname_cursor] = 0;
-                                } else if (!duplicate) {
-                                    *cursorlevel = matching_room;
-                                    state->current_state = state->previous_state;
-                                    state->current_switch = 0;
-                                    state->switch_on = false;
-                                    state->current_chunk = 0;
-                                    state->previous_state = NORMAL;
-                                    state->partial_byte = 0;
-                                    if (state->roomname_cursor) {
-                                        memset(state->room_name, 0, state->roomname_cursor);
-                                        state->roomname_cursor = 0;
-                                    }
-                                }
-                            }
-                        }
-                    }
-                    i ++;
-                }; break;
-
-                case EDIT_ROOMNAME:
-                {
-                    if (state->help) {
-                        switch (buf[i]) {
-                            case ESCAPE:
-                            case 'q':
-                            case 0x1f:
-                                state->help = false;
-                                break;
-                        }
-                        i ++;
-                        continue;
-                    }
+void goto_switch_key() {
+    enter_state(GOTO_SWITCH);
+    state->partial_byte = 0;
+}
 
-                    if (buf[i] == '\n') {
-                        // ENTER
-                        struct DecompresssedRoom *room = &state->rooms.rooms[*cursorlevel].data;
-                        assert(C_ARRAY_LEN(state->room_name) <= C_ARRAY_LEN(room->name));
-                        strncpy(room->name, state->room_name, C_ARRAY_LEN(room->name));
-                        state->current_state = state->previous_state;
-                        state->current_switch = 0;
-                        state->switch_on = false;
-                        state->current_chunk = 0;
-                        state->previous_state = NORMAL;
-                        ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                        assert(writeRooms(&state->rooms));
-                    } else if (isprint(buf[i])) {
-                        if (state->roomname_cursor < C_ARRAY_LEN(state->room_name) - 1) {
-                            state->room_name[state->roomname_cursor++] = buf[i];
-                        }
-                    } else if (buf[i] == ESCAPE) {
-                        if (i + 1 < n) {
-                            switch (buf[i + 1]) {
-                                case '[':
-                                    if (i + 2 < n) {
-                                        // CSI sequence, with leading esc
-                                        i += 2;
-                                        uint8_t arg = 0;
-                                        while (i < n) {
-                                            if (isdigit(buf[i])) {
-                                                arg = 10 * arg + buf[i] - '0';
-                                            } else if (buf[i] == ';') {
-                                                fprintf(stderr, "%s:%d: UNIMPLEMENTED: multiple csi args", __FILE__, __LINE__);
-                                                arg = 0;
-                                            } else {
-                                                switch (buf[i]) {
-                                                    case '~':
-                                                    {
-                                                        switch (arg) {
-                                                            case 1:
-                                                            {
-                                                                // HOME
-                                                                state->roomname_cursor = 0;
-                                                            }; break;
-
-                                                            case 3:
-                                                            {
-                                                                // DELETE
-                                                                for (size_t c = state->roomname_cursor; c < C_ARRAY_LEN(state->room_name) - 1; c ++) {
-                                                                    state->room_name[c] = state->room_name[c + 1];
-                                                                    state->room_name[c + 1] = '\0';
-                                                                }
-                                                                if (state->roomname_cursor) {
-                                                                    state->roomname_cursor--;
-                                                                }
-                                                            }; break;
-
-                                                            case 4:
-                                                            {
-                                                                // END
-                                                                state->roomname_cursor = strlen(state->room_name);
-                                                            }; break;
-
-                                                            default:
-                                                                fprintf(stderr, "%s:%d: UNIMPLEMENTED: csi terminator ~ arg %d", __FILE__, __LINE__, arg);
-                                                        }
-                                                    }; break;
-
-                                                    case 'C':
-                                                    {
-                                                        // RIGHT ARROW
-                                                        if (state->roomname_cursor < C_ARRAY_LEN(state->room_name) - 1 && state->room_name[state->roomname_cursor]) {
-                                                            state->roomname_cursor ++;
-                                                        }
-                                                    }; break;
-
-                                                    case 'D':
-                                                    {
-                                                        // LEFT ARROW
-                                                        if (state->roomname_cursor > 0) {
-                                                            state->roomname_cursor --;
-                                                        }
-                                                    }; break;
-
-                                                    default: fprintf(stderr, "%s:%d: UNIMPLEMENTED: csi terminator %c arg %d", __FILE__, __LINE__, buf[i], arg);
-                                                }
-                                                i ++;
-                                                break;
-                                            }
-                                            i ++;
-                                        }
-                                    } else {
-                                        UNREACHABLE();
-                                    }
-                                    break;
-                            }
-                            break;
-                        } else {
-                            state->current_state = state->previous_state;
-                            state->current_switch = 0;
-                            state->switch_on = false;
-                            state->current_chunk = 0;
-                            state->previous_state = NORMAL;
-                        }
-                    } else if (buf[i] == 0x7f) {
-                        if (state->roomname_cursor) {
-                            for (size_t c = state->roomname_cursor - 1; c < C_ARRAY_LEN(state->room_name) - 1; c ++) {
-                                state->room_name[c] = state->room_name[c + 1];
-                                state->room_name[c + 1] = '\0';
-                            }
-                            if (state->roomname_cursor) {
-                                state->roomname_cursor--;
-                            }
-                        }
-                    } else if (iscntrl(buf[i])) {
-                        switch (buf[i] + 'A' - 1) {
-                            case 'H': state->debug.hex = !state->debug.hex; break;
-                            case '_': state->help = !state->help; break;
-                        }
-                    }
-                    i ++;
-                }; break;
-
-                case TOGGLE_DISPLAY:
-                {
-                    if (state->help) {
-                        switch (buf[i]) {
-                            case 0x08:
-                                state->debug.hex = !state->debug.hex;
-                                break;
-                            case ESCAPE:
-                            case 'q':
-                            case 0x1f:
-                            case '?':
-                                state->help = false;
-                                break;
-                        }
-                        i ++;
-                        continue;
-                    }
+void goto_object_key() {
+    enter_state(GOTO_OBJECT);
+    state->partial_byte = 0;
+}
 
-                    uint8_t changed = 1;
-                    switch (buf[i]) {
-                        case 'a': debugalltoggle(); break;
-                        case 'd': state->debug.data = !state->debug.data; break;
-                        case 'n': state->debug.neighbours = !state->debug.neighbours; break;
-                        case 'o': state->debug.objects = !state->debug.objects; break;
-                        case 'p': state->debug.pos = !state->debug.pos; break;
-                        case 's': state->debug.switches = !state->debug.switches; break;
-                        case 'u': state->debug.unknowns = !state->debug.unknowns; break;
-
-                        case 'q':
-                        case ESCAPE:
-                            break;
+// The current room's name, without the spaces it is padded with
+void load_room_name() {
+    state->roomname_cursor = 0;
+    strncpy(state->room_name, state->rooms.rooms[state->current_level].data.name, C_ARRAY_LEN(state->room_name));
+    for (size_t i = 0; i < C_ARRAY_LEN(state->room_name); i ++) {
+        if (state->room_name[C_ARRAY_LEN(state->room_name) - i] == '\0') continue;
+        if (state->room_name[C_ARRAY_LEN(state->room_name) - i] == ' ') {
+            state->room_name[C_ARRAY_LEN(state->room_name) - i] = '\0';
+        } else {
+            break;
+        }
+    }
+}
 
-                        case 0x08:
-                            state->debug.hex = !state->debug.hex;
-                            break;
+void edit_roomname_key() {
+    enter_state(EDIT_ROOMNAME);
+    load_room_name();
+}
 
-                        case '?':
-                        case 0x1F:
-                            state->help = !state->help;
-                            fallthrough;
-                        default: fprintf(stderr, "buf[i] = %02x\n", buf[i]); UNREACHABLE();changed = 0;
-                    }
-                    i++;
-                    if (changed) {
-                        state->current_state = state->previous_state;
-                        state->current_switch = 0;
-                        state->switch_on = false;
-                        state->current_chunk = 0;
-                        state->previous_state = NORMAL;
-                    }
-                }; break;
-
-                case EDIT_ROOMDETAILS:
-                {
-                    if (buf[i] == ESCAPE && i + 1 < n && buf[i + 1] == '[') {
-                        // CSI sequence
-                        i += 2;
-                        uint8_t arg = 0;
-                        while (i < n) {
-                            if (isdigit(buf[i])) {
-                                arg = 10 * arg + buf[i] - '0';
-                            } else if (buf[i] == ';') {
-                                arg = 0;
-                            } else {
-                                switch (buf[i]) {
-                                    case 'A':
-                                    case 'B':
-                                    case 'C':
-                                    case 'D':
-                                        state->current_state = EDIT_ROOMDETAILS_ROOM;
-                                        state->current_switch = 0;
-                                        state->switch_on = false;
-                                        state->current_chunk = 0;
-                                        state->room_detail = buf[i];
-                                        break;
-                                }
-                                break;
-                            }
-                            i ++;
-                        }
-                    } else {
-                        switch (buf[i]) {
-                            case 'h':
-                            case 'j':
-                            case 'k':
-                            case 'l':
-                                state->room_detail = buf[i];
-                                state->current_state = EDIT_ROOMDETAILS_ROOM;
-                                state->current_switch = 0;
-                                state->switch_on = false;
-                                state->current_chunk = 0;
-                                break;
-
-                            case 'g':
-                            case 't':
-                            case 'd':
-                            case '|':
-                            case '-':
-
-                            case 'b':
-                            case 'c':
-                            case 'e':
-                            case 'f':
-                            {
-                                state->room_detail = buf[i];
-                                state->current_state = EDIT_ROOMDETAILS_NUM;
-                                state->current_switch = 0;
-                                state->switch_on = false;
-                                state->current_chunk = 0;
-                            }; break;
-
-                            case 'p':
-                            {
-                                signal(SIGCHLD, SIG_IGN);
-                                pid_t child = fork();
-                                if (child == 0) {
-                                    if (state != NULL) {
-                                        freeRoomFile(&state->rooms);
-                                        free(state);
-                                    }
-                                    pid_t sid = fork();
-                                    if (sid == -1) exit(EXIT_FAILURE);
-                                    if (sid > 0) exit(EXIT_SUCCESS);
-                                    if (setsid() == -1) exit(EXIT_FAILURE);
-                                    execv("./play.sh", (char**){0});
-                                    exit(EXIT_FAILURE);
-                                }
-                            }; break;
-
-                            case 'q':
-                            case ESCAPE:
-                                if (state->help) {
-                                    state->help = false;
-                                } else {
-                                    state->current_state = state->previous_state;
-                                    state->current_switch = 0;
-                                    state->switch_on = false;
-                                    state->current_chunk = 0;
-                                    state->previous_state = TILE_EDIT;
-                                }
-                                break;
-
-                            default:
-                                if (buf[i] == '?') {
-                                    state->help = !state->help;
-                                } else if (iscntrl(buf[i])) {
-                                    switch (buf[i] + 'A' - 1) {
-                                        case '_': state->help = !state->help; break;
-                                        case 'H':
-                                            state->debug.hex = !state->debug.hex;
-                                            if (state->partial_byte) {
-                                                if (state->debug.hex) {
-                                                    state->partial_byte = ((state->partial_byte & 0xFF) * 10 / 16) % 16 + 1;
-                                                } else {
-                                                    state->partial_byte = ((state->partial_byte & 0xFF) * 16 / 10) % 10 + 1;
-                                                }
-                                            }
-                                    }
-                                }
+void delete_key() {
+    if (state->partial_byte) {
+        state->partial_byte = 0;
+    } else {
+        // FIXME find object or switch underneath
+        struct RoomObject *object_underneath = NULL;
+        struct SwitchObject *switch_underneath = NULL;
+        struct SwitchChunk *chunk_underneath = NULL;
+        struct SwitchObject *chunk_switch_underneath = NULL;
+
+        struct DecompresssedRoom *room = &state->rooms.rooms[state->current_level].data;
+        int x = state->cursors[state->current_level].x;
+        int y = state->cursors[state->current_level].y;
+        int i;
+        for (i = 0; i < room->num_objects; i ++) {
+            struct RoomObject *object = room->objects + i;
+            if (object->type == BLOCK &&
+                    x >= object->x && x < object->x + object->block.width &&
+                    y >= object->y && y < object->y + object->block.height) {
+                object_underneath = object;
+                break;
+            } else if (object->type == SPRITE && x == object->x && y == object->y) {
+                object_underneath = object;
+                break;
+            }
+        }
+        int obj_i = i;
+        for (i = 0; i < room->num_switches; i ++) {
+            struct SwitchObject *switcch = room->switches + i;
+            if (switcch->chunks.length > 0 && SMALL_ARRAY_DATA(switcch->chunks)[0].type == PREAMBLE &&
+                    x == SMALL_ARRAY_DATA(switcch->chunks)[0].x && y == SMALL_ARRAY_DATA(switcch->chunks)[0].y) {
+                switch_underneath = switcch;
+                break;
+            }
+        }
+        int sw_i = i;
+        int c;
+        for (i = 0; i < room->num_switches; i ++) {
+            struct SwitchObject *switcch = room->switches + i;
+            for (c = 1; c < (signed) switcch->chunks.length; c ++) {
+                struct SwitchChunk *chunk = SMALL_ARRAY_DATA(switcch->chunks) + c;
+                if (chunk->type == TOGGLE_BLOCK) {
+                    if (chunk->dir == HORIZONTAL) {
+                        if (y == chunk->y && x >= chunk->x && x < chunk->x + chunk->size) {
+                            chunk_switch_underneath = switcch;
+                            chunk_underneath = chunk;
+                            break;
                         }
+                    } else if (x == chunk->x && y >= chunk->y && y < chunk->y + chunk->size) {
+                        chunk_switch_underneath = switcch;
+                        chunk_underneath = chunk;
+                        break;
                     }
-                    i++;
-                }; break;
-
-                case EDIT_ROOMDETAILS_NUM:
-                {
-                    if ((state->debug.hex && isxdigit(buf[i])) || (!state->debug.hex && isdigit(buf[i]))) {
-                        int digit;
-                        if (buf[i] > '9') {
-                            digit = tolower(buf[i]) - 'a' + 10;
-                        } else {
-                            digit = buf[i] - '0';
-                        }
-                        if (state->partial_byte) {
-                            size_t value = digit;
-                            if (state->debug.hex) {
-                                value += 16 * (state->partial_byte & 0xFF);
-                            } else {
-                                value += 10 * (state->partial_byte & 0xFF);
-                            }
+                }
+            }
+            if (chunk_underneath) break;
+        }
 
-                            struct DecompresssedRoom *room = &state->rooms.rooms[state->current_level].data;
-                            switch (state->room_detail) {
-                                case 'g': room->background = value; break;
-                                case 't': room->tile_offset = value; break;
-                                case 'd': room->room_damage = value; break;
-                                case '|': room->gravity_vertical = value; break;
-                                case '-': room->gravity_horizontal = value; break;
-
-                                case 'b': room->UNKNOWN_b = value; break;
-                                case 'c': room->UNKNOWN_c = value; break;
-                                case 'e':
-                                    if ((value & ~0x3) == 0) {
-                                        room->_num_switches |= value;
-                                    }
-                                    break;
+        if (object_underneath) {
+            while (obj_i < room->num_objects - 1) {
+                room->objects[obj_i] = room->objects[obj_i+1];
+                obj_i++;
+            }
+            memset(room->objects + obj_i, 0, sizeof(struct RoomObject));
+            room->num_objects --;
+        } else if (switch_underneath) {
+            while (sw_i < room->num_switches - 1) {
+                room->switches[sw_i] = room->switches[sw_i+1];
+                sw_i++;
+            }
+            memset(room->switches + sw_i, 0, sizeof(struct SwitchObject));
+            room->num_switches --;
+        } else if (chunk_underneath) {
+            while (c < (signed) chunk_switch_underneath->chunks.length - 1) {
+                SMALL_ARRAY_DATA(chunk_switch_underneath->chunks)[c] = SMALL_ARRAY_DATA(chunk_switch_underneath->chunks)[c+1];
+                c++;
+            }
+            memset(SMALL_ARRAY_DATA(chunk_switch_underneath->chunks) + c, 0, sizeof(struct SwitchChunk));
+            chunk_switch_underneath->chunks.length --;
+        } else {
+            room->tiles[TILE_IDX(x, y)] = 0;
+        }
+        save_room();
+    }
+}
 
-                                case 'f': room->UNKNOWN_f = value; break;
+// Corners of the selection, top left first, if there is one in this room
+bool selection(v2 *from, v2 *to) {
+    if (!state->selecting || state->mark_level != state->current_level) return false;
+    v2 cursor = state->cursors[state->current_level];
+    *from = (v2){ cursor.x < state->mark.x ? cursor.x : state->mark.x, cursor.y < state->mark.y ? cursor.y : state->mark.y };
+    *to = (v2){ cursor.x > state->mark.x ? cursor.x : state->mark.x, cursor.y > state->mark.y ? cursor.y : state->mark.y };
+    return true;
+}
 
-                                default: UNREACHABLE();
-                            }
-                            state->current_state = EDIT_ROOMDETAILS;
-                            state->current_switch = 0;
-                            state->switch_on = false;
-                            state->current_chunk = 0;
-                            state->partial_byte = 0;
-                            state->room_detail = 0;
-                            ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                            assert(writeRooms(&state->rooms));
-                        } else {
-                            if (state->room_detail != 'e' || digit == 0) {
-                                state->partial_byte = 0xFF00 | digit;
-                            }
-                        }
-                    } else if (buf[i] == 0x7f) {
-                        state->partial_byte = 0;
-                    } else if (buf[i] == ESCAPE) {
-                        if (state->help) {
-                            state->help = false;
-                        } else {
-                            state->current_state = EDIT_ROOMDETAILS;
-                            state->current_switch = 0;
-                            state->switch_on = false;
-                            state->current_chunk = 0;
-                            state->partial_byte = 0;
-                            state->room_detail = 0;
-                        }
-                    } else if (iscntrl(buf[i])) {
-                        switch (buf[i] + 'A' - 1) {
-                            case '_': state->help = !state->help; break;
-                            case 'H':
-                                state->debug.hex = !state->debug.hex;
-                                if (state->partial_byte) {
-                                    if (state->debug.hex) {
-                                        state->partial_byte = ((state->partial_byte & 0xFF) * 10 / 16) % 16 + 1;
-                                    } else {
-                                        state->partial_byte = ((state->partial_byte & 0xFF) * 16 / 10) % 10 + 1;
-                                    }
-                                }
-                        }
-                    } else if (buf[i] == 'q') {
-                        if (state->help) {
-                            state->help = !state->help;
-                        } else {
-                            state->current_state = EDIT_ROOMDETAILS;
-                            state->current_switch = 0;
-                            state->switch_on = false;
-                            state->current_chunk = 0;
-                            state->partial_byte = 0;
-                            state->room_detail = 0;
-                        }
-                    } else if (buf[i] == '?') {
-                        state->help = !state->help;
-                    } else if (buf[i] == 'p') {
-                        signal(SIGCHLD, SIG_IGN);
-                        pid_t child = fork();
-                        if (child == 0) {
-                            if (state != NULL) {
-                                freeRoomFile(&state->rooms);
-                                free(state);
-                            }
-                            pid_t sid = fork();
-                            if (sid == -1) exit(EXIT_FAILURE);
-                            if (sid > 0) exit(EXIT_SUCCESS);
-                            if (setsid() == -1) exit(EXIT_FAILURE);
-                            execv("./play.sh", (char**){0});
-                            exit(EXIT_FAILURE);
-                        }
-                    } else {
-                        switch (buf[i]) {
-                            case '[':
-                                if (i + 1 < n) {
-                                    // CSI sequence
-                                    i += 1;
-                                    uint8_t arg = 0;
-                                    while (i < n) {
-                                        if (isdigit(buf[i])) {
-                                            arg = 10 * arg + buf[i] - '0';
-                                        } else if (buf[i] == ';') {
-                                            arg = 0;
-                                        } else {
-                                            if (arg == 3 && buf[i] == '~') {
-                                                state->partial_byte = 0;
-                                            } else {
-                                                fprintf(stderr, "%s:%d: UNIMPLEMENTED: csi terminator %c arg %d", __FILE__, __LINE__, buf[i], arg);
-                                            }
-                                            break;
-                                        }
-                                        i ++;
-                                    }
-                                } else {
-                                    UNREACHABLE();
-                                }
-                                break;
-                        }
-                    }
-                    i ++;
-                }; break;
-
-                case EDIT_ROOMDETAILS_ROOM:
-                {
-                    if (state->partial_byte && ((state->debug.hex && isxdigit(buf[i])) || (!state->debug.hex && isdigit(buf[i])))) {
-                        int digit;
-                        if (buf[i] > '9') {
-                            digit = tolower(buf[i]) - 'a' + 10;
-                        } else {
-                            digit = buf[i] - '0';
-                        }
-                        size_t room_id = digit;
-                        if (state->debug.hex) {
-                            room_id += 16 * (state->partial_byte & 0xFF);
-                        } else {
-                            room_id += 10 * (state->partial_byte & 0xFF);
-                        }
-                        if (room_id < C_ARRAY_LEN(state->rooms.rooms)) {
-                            struct DecompresssedRoom *room = &state->rooms.rooms[state->current_level].data;
-                            switch (state->room_detail) {
-                                case 'A':
-                                case 'k':
-                                    room->room_north = room_id;
-                                    break;
+bool inside(v2 from, v2 to, int x, int y, int width, int height) {
+    return x >= from.x && y >= from.y && x + width - 1 <= to.x && y + height - 1 <= to.y;
+}
 
-                                case 'B':
-                                case 'j':
-                                    room->room_south = room_id;
-                                    break;
+void toggle_selection() {
+    if (state->selecting && state->mark_level == state->current_level) {
+        state->selecting = false;
+        return;
+    }
+    state->selecting = true;
+    state->mark = state->cursors[state->current_level];
+    state->mark_level = state->current_level;
+}
 
-                                case 'C':
-                                case 'l':
-                                    room->room_east = room_id;
-                                    break;
+// Takes the objects, switches and TOGGLE_BLOCK chunks wholly in the selection,
+// or under the cursor without one. TOGGLE_OBJECT chunks only come along with
+// their object, TOGGLE_BIT chunks keep pointing at the same switch.
+void copy_selection() {
+    v2 from, to;
+    if (!selection(&from, &to)) from = to = state->cursors[state->current_level];
+    struct DecompresssedRoom *room = &state->rooms.rooms[state->current_level].data;
+    tile_clipboard *clipboard = &state->clipboard;
+    clipboard->width = to.x - from.x + 1;
+    clipboard->height = to.y - from.y + 1;
+    for (int y = 0; y < clipboard->height; y ++) {
+        memcpy(clipboard->tiles + y * WIDTH_TILES, room->tiles + TILE_IDX(from.x, from.y + y), clipboard->width);
+    }
 
-                                case 'D':
-                                case 'h':
-                                    room->room_west = room_id;
-                                    break;
+    clipboard->objects.length = 0;
+    size_t copied[256] = {0}; // Index in clipboard->objects + 1 of each object
+    for (size_t o = 0; o < room->num_objects; o ++) {
+        struct RoomObject object = room->objects[o];
+        int width = object.type == BLOCK ? object.block.width : 1;
+        int height = object.type == BLOCK ? object.block.height : 1;
+        if (!inside(from, to, object.x, object.y, width, height)) continue;
+        object.x -= from.x;
+        object.y -= from.y;
+        ARRAY_ADD(clipboard->objects, object);
+        copied[o] = clipboard->objects.length;
+    }
 
-                                default: UNREACHABLE();
-                            }
-                            state->current_state = EDIT_ROOMDETAILS;
-                            state->current_switch = 0;
-                            state->switch_on = false;
-                            state->current_chunk = 0;
-                            state->partial_byte = 0;
-                            state->room_detail = 0;
-                            if (state->roomname_cursor) {
-                                memset(state->room_name, 0, state->roomname_cursor);
-                                state->roomname_cursor = 0;
-                            }
-                            ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                            assert(writeRooms(&state->rooms));
-                        }
-                    } else if (state->roomname_cursor == 0 && state->partial_byte == 0 && buf[i] >= '0' &&
-                                buf[i] <= (state->debug.hex ? '3' : '6')) {
-                        state->partial_byte = 0xFF00 | (buf[i] - '0');
-                    } else if (buf[i] == 0x7f) {
-                        if (state->roomname_cursor) {
-                            state->room_name[--state->roomname_cursor] = 0;
-                        } else {
-                            state->partial_byte = 0;
-                        }
-                    } else if (buf[i] == ESCAPE) {
-                        if (i + 1 < n) {
-                            if (buf[i + 1] == '[') {
-                                if (i + 2 < n) {
-                                    // CSI sequence
-                                    i += 2;
-                                    uint8_t arg = 0;
-                                    while (i < n) {
-                                        if (isdigit(buf[i])) {
-                                            arg = 10 * arg + buf[i] - '0';
-                                        } else if (buf[i] == ';') {
-                                            arg = 0;
-                                        } else {
-                                            switch (buf[i]) {
-                                                case '~':
-                                                {
-                                                    switch (arg) {
-                                                        case 3:
-                                                            if (state->roomname_cursor) {
-                                                                state->room_name[--state->roomname_cursor] = 0;
-                                                            } else {
-                                                                state->partial_byte = 0;
-                                                            }
-                                                            break;
-
-                                                        default: fprintf(stderr, "%s:%d: UNIMPLEMENTED: csi terminator %c arg %d", __FILE__, __LINE__, buf[i], arg);
-                                                    }
-                                                }; break;
-
-                                                default: fprintf(stderr, "%s:%d: UNIMPLEMENTED: csi terminator %c arg %d", __FILE__, __LINE__, buf[i], arg);
-                                            }
-                                            break;
-                                        }
-                                        i ++;
-                                    }
-                                }
-                            } else {
+    clipboard->chunks.length = 0;
+    size_t switches = 0;
+    for (size_t sw = 0; sw < room->num_switches; sw ++) {
+        struct SwitchObject *switcch = room->switches + sw;
+        struct SwitchChunk *chunks = SMALL_ARRAY_DATA(switcch->chunks);
+        if (switcch->chunks.length == 0) continue;
+        struct SwitchPreamble *at = chunkPreamble(chunks);
+        if (!inside(from, to, at->x, at->y, 1, 1)) continue;
+        for (size_t c = 0; c < switcch->chunks.length; c ++) {
+            struct SwitchChunk chunk = chunks[c];
+            switch (chunk.type) {
+                case PREAMBLE: {
+                    struct SwitchPreamble *preamble = chunkPreamble(&chunk);
+                    preamble->x -= from.x;
+                    preamble->y -= from.y;
+                } break;
+                case TOGGLE_BLOCK: {
+                    struct SwitchToggleBlock *block = chunkToggleBlock(&chunk);
+                    if (!inside(from, to, block->x, block->y, block->dir == HORIZONTAL ? block->size : 1, block->dir == HORIZONTAL ? 1 : block->size)) continue;
+                    block->x -= from.x;
+                    block->y -= from.y;
+                } break;
+                case TOGGLE_OBJECT: {
+                    struct SwitchToggleObject *toggle = chunkToggleObject(&chunk);
+                    if (copied[toggle->index] == 0) continue;
+                    toggle->index = copied[toggle->index] - 1;
+                } break;
+                case TOGGLE_BIT:
+                    break;
+                default: UNREACHABLE();
+            }
+            ARRAY_ADD(clipboard->chunks, chunk);
+        }
+        switches ++;
+    }
+    state->selecting = false;
+    notify("Copied %dx%d tiles, %zu objects, %zu switches", clipboard->width, clipboard->height, clipboard->objects.length, switches);
+}
 
-                            }
-                        } else if (state->help) {
-                            state->help = false;
-                        } else {
-                            state->current_state = EDIT_ROOMDETAILS;
-                            state->current_switch = 0;
-                            state->switch_on = false;
-                            state->current_chunk = 0;
-                            state->partial_byte = 0;
-                            if (state->roomname_cursor) {
-                                memset(state->room_name, 0, state->roomname_cursor);
-                                state->roomname_cursor = 0;
-                            }
-                        }
-                    } else if (iscntrl(buf[i])) {
-                        switch (buf[i] + 'A' - 1) {
-                            case '_': state->help = !state->help; break;
-                            case 'H':
-                                      state->debug.hex = !state->debug.hex;
-                                      if (state->partial_byte) {
-                                          if (state->debug.hex) {
-                                              state->partial_byte = ((state->partial_byte & 0xFF) * 10 / 16) % 16 + 1;
-                                          } else {
-                                              state->partial_byte = ((state->partial_byte & 0xFF) * 16 / 10) % 10 + 1;
-                                          }
-                                      }
-                                      break;
-
-                            case 'Q':
-                                      if (state->help) {
-                                          state->help = !state->help;
-                                      } else {
-                                          state->current_state = EDIT_ROOMDETAILS;
-                                          state->current_switch = 0;
-                                          state->switch_on = false;
-                                          state->current_chunk = 0;
-                                          state->partial_byte = 0;
-                                          if (state->roomname_cursor) {
-                                              memset(state->room_name, 0, state->roomname_cursor);
-                                              state->roomname_cursor = 0;
-                                          }
-                                      }
-                                      break;
-                        }
-                    } else {
-                        if (buf[i] == '[') {
-                            if (i + 1 < n) {
-                                // CSI sequence
-                                i += 1;
-                                uint8_t arg = 0;
-                                while (i < n) {
-                                    if (isdigit(buf[i])) {
-                                        arg = 10 * arg + buf[i] - '0';
-                                    } else if (buf[i] == ';') {
-                                        arg = 0;
-                                    } else {
-                                        if (arg == 3 && buf[i] == '~') {
-                                            if (state->roomname_cursor) {
-                                                state->room_name[--state->roomname_cursor] = 0;
-                                            } else {
-                                                state->partial_byte = 0;
-                                            }
-                                        } else {
-                                            fprintf(stderr, "%s:%d: UNIMPLEMENTED: csi terminator %c arg %d", __FILE__, __LINE__, buf[i], arg);
-                                        }
-                                        break;
-                                    }
-                                    i ++;
-                                }
-                            } else {
-                                UNREACHABLE();
-                            }
-                        } else if (state->partial_byte == 0 && isprint(buf[i])) {
-                            if (state->roomname_cursor < C_ARRAY_LEN(state->room_name) - 1) {
-                                state->room_name[state->roomname_cursor++] = buf[i];
-
-                                bool possible = false;
-                                bool duplicate = false;
-                                size_t matching_room = 0;
-                                if (state->roomname_cursor) {
-                                    for (size_t _room = 0; _room < C_ARRAY_LEN(state->rooms.rooms); _room ++) {
-                                        struct DecompresssedRoom *room = &state->rooms.rooms[_room].data;
-                                        if (strncasecmp(room->name, state->room_name, state->roomname_cursor) == 0) {
-                                            if (possible) {
-                                                duplicate = true;
-                                                break;
-                                            } else {
-                                                duplicate = false;
-                                            }
-                                            possible = true;
-                                            matching_room = _room;
-                                        }
-                                    }
-                                } else {
-                                    possible = true;
-                                }
-                                if (!possible) {
-                                    state->room_name[--state->roomname_cursor] = 0;
-                                } else if (!duplicate) {
-                                    struct DecompresssedRoom *room = &state->rooms.rooms[state->current_level].data;
-                                    switch (state->room_detail) {
-                                        case 'A':
-                                        case 'k':
-                                            room->room_north = matching_room;
-                                            break;
-
-                                        case 'B':
-                                        case 'j':
-                                            room->room_south = matching_room;
-                                            break;
-
-                                        case 'C':
-                                        case 'l':
-                                            room->room_east = matching_room;
-                                            break;
-
-                                        case 'D':
-                                        case 'h':
-                                            room->room_west = matching_room;
-                                            break;
-
-                                        default: UNREACHABLE();
-                                    }
-                                    state->current_state = EDIT_ROOMDETAILS;
-                                    state->current_switch = 0;
-                                    state->switch_on = false;
-                                    state->current_chunk = 0;
-                                    state->partial_byte = 0;
-                                    state->room_detail = 0;
-                                    if (state->roomname_cursor) {
-                                        memset(state->room_name, 0, state->roomname_cursor);
-                                        state->roomname_cursor = 0;
-                                    }
-                                    ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                                    assert(writeRooms(&state->rooms));
-                                }
-                            }
-                        }
-                    }
-                    i ++;
-                }; break;
-
-                case EDIT_SWITCHDETAILS:
-                {
-                    if (buf[i] == ESCAPE && i + 1 < n && buf[i + 1] == '[') {
-                        // CSI sequence
-                        i += 2;
-                        uint8_t arg = 0;
-                        while (i < n) {
-                            if (isdigit(buf[i])) {
-                                arg = 10 * arg + buf[i] - '0';
-                            } else if (buf[i] == ';') {
-                                arg = 0;
-                            } else {
-                                switch (buf[i]) {
-                                    case '~':
-                                    {
-                                        switch (arg) {
-                                            case 3:
-                                            {
-                                                if (!state->current_switch) UNREACHABLE();
-                                                struct DecompresssedRoom *room = &state->rooms.rooms[state->current_level].data;
-                                                size_t sw_i = state->current_switch - 1;
-                                                while (sw_i < (size_t)(room->num_switches - 1)) {
-                                                    room->switches[sw_i] = room->switches[sw_i+1];
-                                                    sw_i++;
-                                                }
-                                                memset(room->switches + sw_i, 0, sizeof(struct SwitchObject));
-                                                room->num_switches --;
-
-                                                state->current_state = state->previous_state;
-                                                state->current_switch = 0;
-                                                state->switch_on = false;
-                                                state->current_chunk = 0;
-                                                state->previous_state = NORMAL;
-                                                state->partial_byte = 0;
-                                                if (state->roomname_cursor) {
-                                                    memset(state->room_name, 0, state->roomname_cursor);
-                                                    state->roomname_cursor = 0;
-                                                }
-                                                ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                                                assert(writeRooms(&state->rooms));
-                                            }; break;
-
-                                            default: fprintf(stderr, "%s:%d: UNIMPLEMENTED: csi terminator %c arg %d", __FILE__, __LINE__, buf[i], arg);
-                                        }
-                                    }; break;
-
-                                    case 'A':
-                                    {
-                                        struct DecompresssedRoom *room = &state->rooms.rooms[state->current_level].data;
-                                        room->switches[state->current_switch - 1].chunks.data[0].side = TOP;
-                                        ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                                        assert(writeRooms(&state->rooms));
-                                    }; break;
-
-                                    case 'B':
-                                    {
-                                        struct DecompresssedRoom *room = &state->rooms.rooms[state->current_level].data;
-                                        room->switches[state->current_switch - 1].chunks.data[0].side = BOTTOM;
-                                        ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                                        assert(writeRooms(&state->rooms));
-                                    }; break;
-
-                                    case 'C':
-                                    {
-                                        struct DecompresssedRoom *room = &state->rooms.rooms[state->current_level].data;
-                                        room->switches[state->current_switch - 1].chunks.data[0].side = RIGHT;
-                                        ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                                        assert(writeRooms(&state->rooms));
-                                    }; break;
-
-                                    case 'D':
-                                    {
-                                        struct DecompresssedRoom *room = &state->rooms.rooms[state->current_level].data;
-                                        room->switches[state->current_switch - 1].chunks.data[0].side = LEFT;
-                                        ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                                        assert(writeRooms(&state->rooms));
-                                    }; break;
-
-                                    default: fprintf(stderr, "%s:%d: UNIMPLEMENTED: csi terminator %c arg %d", __FILE__, __LINE__, buf[i], arg);
-                                }
-                                break;
-                            }
-                            i ++;
-                        }
-                    } else if (buf[i] == 'p') {
-                        signal(SIGCHLD, SIG_IGN);
-                        pid_t child = fork();
-                        if (child == 0) {
-                            if (state != NULL) {
-                                freeRoomFile(&state->rooms);
-                                free(state);
-                            }
-                            pid_t sid = fork();
-                            if (sid == -1) exit(EXIT_FAILURE);
-                            if (sid > 0) exit(EXIT_SUCCESS);
-                            if (setsid() == -1) exit(EXIT_FAILURE);
-                            execv("./play.sh", (char**){0});
-                            exit(EXIT_FAILURE);
-                        }
-                    } else {
-                        switch (buf[i]) {
-                            case 0x7f:
-                            {
-                                if (!state->current_switch) UNREACHABLE();
-                                struct DecompresssedRoom *room = &state->rooms.rooms[state->current_level].data;
-                                size_t sw_i = state->current_switch - 1;
-                                while (sw_i < (size_t)(room->num_switches - 1)) {
-                                    room->switches[sw_i] = room->switches[sw_i+1];
-                                    sw_i++;
-                                }
-                                memset(room->switches + sw_i, 0, sizeof(struct SwitchObject));
-                                room->num_switches --;
-
-                                state->current_state = state->previous_state;
-                                state->current_switch = 0;
-                                state->switch_on = false;
-                                state->current_chunk = 0;
-                                state->previous_state = NORMAL;
-                                state->partial_byte = 0;
-                                if (state->roomname_cursor) {
-                                    memset(state->room_name, 0, state->roomname_cursor);
-                                    state->roomname_cursor = 0;
-                                }
-                                ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                                assert(writeRooms(&state->rooms));
-                            }; break;
+// Into whichever room the cursor is in, added to what is already there.
+// Objects, switches and chunks that would go off the edge are left out.
+void paste_clipboard() {
+    tile_clipboard *clipboard = &state->clipboard;
+    if (clipboard->width == 0) {
+        notify("Nothing has been copied");
+        return;
+    }
+    struct DecompresssedRoom *room = &state->rooms.rooms[state->current_level].data;
+    v2 at = state->cursors[state->current_level];
+    v2 to = { WIDTH_TILES - 1, HEIGHT_TILES - 1 };
+    int width = clipboard->width < WIDTH_TILES - at.x ? clipboard->width : WIDTH_TILES - at.x;
+    int height = clipboard->height < HEIGHT_TILES - at.y ? clipboard->height : HEIGHT_TILES - at.y;
+    for (int y = 0; y < height; y ++) {
+        memcpy(room->tiles + TILE_IDX(at.x, at.y + y), clipboard->tiles + y * WIDTH_TILES, width);
+    }
 
-                            case '+':
-                            {
-                                if (state->current_switch) {
-                                    struct DecompresssedRoom *room = &state->rooms.rooms[state->current_level].data;
-                                    size_t sw_i = state->current_switch - 1;
-                                    struct SwitchObject sw = room->switches[sw_i];
-                                    if (sw_i < (unsigned)room->num_switches - 1) {
-                                        room->switches[sw_i] = room->switches[sw_i+1];
-                                        room->switches[sw_i+1] = sw;
-                                        state->current_switch ++;
-                                        ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                                        assert(writeRooms(&state->rooms));
-                                    }
-                                }
-                            }; break;
+    Arena *arena = &state->rooms.arena;
+    size_t placed[256] = {0}; // Index in room->objects + 1 of each clipboard object
+    size_t num_objects = room->num_objects;
+    room->objects = arenaRealloc(arena, room->objects, num_objects * sizeof(struct RoomObject),
+            (num_objects + clipboard->objects.length) * sizeof(struct RoomObject));
+    for (size_t o = 0; o < clipboard->objects.length && num_objects < UINT8_MAX; o ++) {
+        struct RoomObject object = clipboard->objects.data[o];
+        int object_width = object.type == BLOCK ? object.block.width : 1;
+        int object_height = object.type == BLOCK ? object.block.height : 1;
+        if (!inside((v2){0}, to, at.x + object.x, at.y + object.y, object_width, object_height)) continue;
+        object.x += at.x;
+        object.y += at.y;
+        room->objects[num_objects ++] = object;
+        placed[o] = num_objects;
+    }
+    size_t objects = num_objects - room->num_objects;
+    room->num_objects = num_objects;
+
+    size_t num_switches = room->num_switches;
+    size_t preambles = 0;
+    for (size_t c = 0; c < clipboard->chunks.length; c ++) preambles += clipboard->chunks.data[c].type == PREAMBLE;
+    room->switches = arenaRealloc(arena, room->switches, num_switches * sizeof(struct SwitchObject),
+            (num_switches + preambles) * sizeof(struct SwitchObject));
+    struct SwitchObject *switcch = NULL;
+    for (size_t c = 0; c < clipboard->chunks.length; c ++) {
+        struct SwitchChunk chunk = clipboard->chunks.data[c];
+        if (chunk.type == PREAMBLE) {
+            struct SwitchPreamble *preamble = chunkPreamble(&chunk);
+            switcch = NULL;
+            if (num_switches == UINT8_MAX || !inside((v2){0}, to, at.x + preamble->x, at.y + preamble->y, 1, 1)) continue;
+            preamble->x += at.x;
+            preamble->y += at.y;
+            switcch = room->switches + num_switches ++;
+            *switcch = (struct SwitchObject){0};
+        }
+        if (switcch == NULL) continue;
+        if (chunk.type == TOGGLE_OBJECT) {
+            struct SwitchToggleObject *toggle = chunkToggleObject(&chunk);
+            if (placed[toggle->index] == 0) continue;
+            toggle->index = placed[toggle->index] - 1;
+        } else if (chunk.type == TOGGLE_BLOCK) {
+            struct SwitchToggleBlock *block = chunkToggleBlock(&chunk);
+            int block_width = block->dir == HORIZONTAL ? block->size : 1;
+            int block_height = block->dir == VERTICAL ? block->size : 1;
+            if (!inside((v2){0}, to, at.x + block->x, at.y + block->y, block_width, block_height)) continue;
+            block->x += at.x;
+            block->y += at.y;
+        }
+        ARENA_SMALL_ARRAY_ADD(arena, switcch->chunks, chunk);
+    }
+    size_t switches = num_switches - room->num_switches;
+    room->num_switches = num_switches;
 
-                            case '-':
-                            {
-                                if (state->current_switch) {
-                                    struct DecompresssedRoom *room = &state->rooms.rooms[state->current_level].data;
-                                    size_t sw_i = state->current_switch - 1;
-                                    struct SwitchObject sw = room->switches[sw_i];
-                                    if (sw_i) {
-                                        room->switches[sw_i] = room->switches[sw_i-1];
-                                        room->switches[sw_i-1] = sw;
-                                        state->current_switch --;
-                                        ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                                        assert(writeRooms(&state->rooms));
-                                    }
-                                }
-                            }; break;
+    state->partial_byte = 0;
+    save_room();
+    notify("Pasted %dx%d tiles, %zu objects, %zu switches", width, height, objects, switches);
+}
 
-                            case 'h':
-                            {
-                                struct DecompresssedRoom *room = &state->rooms.rooms[state->current_level].data;
-                                room->switches[state->current_switch - 1].chunks.data[0].side = LEFT;
-                                ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                                assert(writeRooms(&state->rooms));
-                            }; break;
+// The spot on a grid of each room reachable from world.root along its
+// room_north etc. The first room to get to a spot keeps it, as the links of
+// different rooms do not have to agree.
+void world_layout(v2 spots[64], bool placed[64]) {
+    memset(placed, 0, 64 * sizeof(bool));
+    size_t queue[64];
+    size_t head = 0, tail = 0;
+    spots[state->world.root] = (v2){0};
+    placed[state->world.root] = true;
+    queue[tail ++] = state->world.root;
+    while (head < tail) {
+        size_t idx = queue[head ++];
+        struct DecompresssedRoom *room = &state->rooms.rooms[idx].data;
+        struct { uint8_t link; v2 direction; } neighbours[] = {
+            { room->room_north, { 0, -1 } },
+            { room->room_east, { +1, 0 } },
+            { room->room_south, { 0, +1 } },
+            { room->room_west, { -1, 0 } },
+        };
+        for (size_t n = 0; n < C_ARRAY_LEN(neighbours); n ++) {
+            size_t next = neighbours[n].link;
+            if (next >= 64 || placed[next] || !state->rooms.rooms[next].valid) continue;
+            v2 spot = { spots[idx].x + neighbours[n].direction.x, spots[idx].y + neighbours[n].direction.y };
+            bool taken = false;
+            for (size_t other = 0; !taken && other < 64; other ++) {
+                taken = placed[other] && spots[other].x == spot.x && spots[other].y == spot.y;
+            }
+            if (taken) continue;
+            spots[next] = spot;
+            placed[next] = true;
+            queue[tail ++] = next;
+        }
+    }
+}
 
-                            case 'j':
-                            {
-                                struct DecompresssedRoom *room = &state->rooms.rooms[state->current_level].data;
-                                room->switches[state->current_switch - 1].chunks.data[0].side = BOTTOM;
-                                ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                                assert(writeRooms(&state->rooms));
-                            }; break;
+int world_columns() { return WIDTH_TILES >> state->world.zoom; }
+int world_rows() { return (HEIGHT_TILES + (2 << state->world.zoom) - 1) / (2 << state->world.zoom); }
+
+// A character for each zoomed in block of tiles, darker the more tiles in it
+// are not blank, or @ where there is a sprite
+void world_render(size_t idx) {
+    struct DecompresssedRoom *room = &state->rooms.rooms[idx].data;
+    int across = 1 << state->world.zoom;
+    int down = 2 << state->world.zoom;
+    int counts[HEIGHT_TILES][WIDTH_TILES] = {0};
+    for (int y = 0; y < HEIGHT_TILES; y ++) {
+        for (int x = 0; x < WIDTH_TILES; x ++) {
+            if (room->tiles[TILE_IDX(x, y)] != BLANK_TILE) counts[y / down][x / across] ++;
+        }
+    }
+    for (size_t o = 0; o < room->num_objects; o ++) {
+        struct RoomObject *object = room->objects + o;
+        if (object->type != BLOCK) continue;
+        for (int y = 0; y < object->block.height && object->y + y < HEIGHT_TILES; y ++) {
+            for (int x = 0; x < object->block.width && object->x + x < WIDTH_TILES; x ++) {
+                if (object->tiles[y * object->block.width + x] != BLANK_TILE) counts[(object->y + y) / down][(object->x + x) / across] ++;
+            }
+        }
+    }
+    const char shades[] = " .:+#";
+    for (int y = 0; y < world_rows(); y ++) {
+        for (int x = 0; x < world_columns(); x ++) {
+            int count = counts[y][x] < across * down ? counts[y][x] : across * down;
+            state->world.cells[idx][y][x] = count == 0 ? ' ' : shades[1 + (count - 1) * (C_ARRAY_LEN(shades) - 2) / (across * down)];
+        }
+    }
+    for (size_t o = 0; o < room->num_objects; o ++) {
+        struct RoomObject *object = room->objects + o;
+        if (object->type == SPRITE && object->x < WIDTH_TILES && object->y < HEIGHT_TILES) {
+            state->world.cells[idx][object->y / down][object->x / across] = '@';
+        }
+    }
+    state->world.cached[idx] = true;
+}
 
-                            case 'k':
-                            {
-                                struct DecompresssedRoom *room = &state->rooms.rooms[state->current_level].data;
-                                room->switches[state->current_switch - 1].chunks.data[0].side = TOP;
-                                ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                                assert(writeRooms(&state->rooms));
-                            }; break;
+// Centred on the current room. Only rooms on the screen are drawn, each from
+// its cells, which are only worked out again after it changes.
+void redraw_world() {
+    v2 spots[64] = {0};
+    bool placed[64];
+    world_layout(spots, placed);
+    // The current room can be left out when it was changed some other way,
+    // like going to a room, so lay them out again from it
+    if (!placed[state->current_level]) {
+        state->world.root = state->current_level;
+        world_layout(spots, placed);
+    }
+    int columns = world_columns();
+    int rows = world_rows();
+    // A line above each room for its number and name, a column between them
+    int room_width = columns + 1;
+    int room_height = rows + 1;
+    v2 screen = state->screen_dimensions;
+    v2 focus = spots[state->current_level];
+    int origin_x = screen.x / 2 - room_width / 2 - focus.x * room_width;
+    int origin_y = screen.y / 2 - room_height / 2 - focus.y * room_height;
+    for (size_t idx = 0; idx < 64; idx ++) {
+        if (!placed[idx]) continue;
+        int left = origin_x + spots[idx].x * room_width;
+        int top = origin_y + spots[idx].y * room_height;
+        if (left + room_width <= 0 || left >= screen.x || top + room_height <= 0 || top >= screen.y) continue;
+        if (!state->world.cached[idx]) world_render(idx);
+        int from = left < 0 ? -left : 0;
+        int to = left + columns > screen.x ? screen.x - left : columns;
+        if (top >= 0) {
+            char label[WIDTH_TILES + 1];
+            snprintf(label, sizeof(label), "%02zu %.24s", idx, state->rooms.rooms[idx].data.name);
+            GOTO(left + from, top);
+            if (idx == state->current_level) printf("\033[7m");
+            printf("%.*s\033[m", to - from, strlen(label) > (size_t)from ? label + from : "");
+        }
+        for (int y = 0; y < rows; y ++) {
+            if (top + 1 + y < 0 || top + 1 + y >= screen.y) continue;
+            GOTO(left + from, top + 1 + y);
+            fwrite(state->world.cells[idx][y] + from, 1, to - from, stdout);
+        }
+    }
+}
 
-                            case 'l':
-                            {
-                                struct DecompresssedRoom *room = &state->rooms.rooms[state->current_level].data;
-                                room->switches[state->current_switch - 1].chunks.data[0].side = RIGHT;
-                                ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                                assert(writeRooms(&state->rooms));
-                            }; break;
+void enter_world() {
+    enter_state(WORLD_VIEW);
+    state->world.root = state->current_level;
+}
 
-                            case 'o':
-                            {
-                                struct DecompresssedRoom *room = &state->rooms.rooms[state->current_level].data;
-                                room->switches[state->current_switch - 1].chunks.data[0].one_time_use = !room->switches[state->current_switch - 1].chunks.data[0].one_time_use;
-                                ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                                assert(writeRooms(&state->rooms));
-                            }; break;
+void leave_world() {
+    state->current_state = state->previous_state == WORLD_VIEW ? NORMAL : state->previous_state;
+    state->previous_state = NORMAL;
+}
 
-                            case 'e':
-                            {
-                                struct DecompresssedRoom *room = &state->rooms.rooms[state->current_level].data;
-                                room->switches[state->current_switch - 1].chunks.data[0].room_entry = !room->switches[state->current_switch - 1].chunks.data[0].room_entry;
-                                ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                                assert(writeRooms(&state->rooms));
-                            }; break;
+// Along the current room's link, laying the rooms out again from there if it
+// did not get a spot
+void world_move(int dx, int dy) {
+    struct DecompresssedRoom *room = &state->rooms.rooms[state->current_level].data;
+    size_t next = dx < 0 ? room->room_west : dx > 0 ? room->room_east : dy < 0 ? room->room_north : room->room_south;
+    if (next >= 64 || !state->rooms.rooms[next].valid) return;
+    v2 spots[64];
+    bool placed[64];
+    world_layout(spots, placed);
+    if (!placed[next]) state->world.root = next;
+    state->current_level = next;
+}
 
-                            case 's':
-                            {
-                                struct DecompresssedRoom *room = &state->rooms.rooms[state->current_level].data;
-                                room->switches[state->current_switch - 1].chunks.data[0].side = (room->switches[state->current_switch - 1].chunks.data[0].side + 1) % NUM_SIDES;
-                                ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                                assert(writeRooms(&state->rooms));
-                            }; break;
+void world_zoom(int by) {
+    int zoom = state->world.zoom + by;
+    if (zoom < 0 || zoom >= WORLD_ZOOMS) return;
+    state->world.zoom = zoom;
+    memset(state->world.cached, 0, sizeof(state->world.cached));
+}
 
-                            case 'c':
-                            {
+void world_left() { world_move(-1, 0); }
+void world_down() { world_move(0, +1); }
+void world_up() { world_move(0, -1); }
+void world_right() { world_move(+1, 0); }
+void world_zoom_in() { world_zoom(-1); }
+void world_zoom_out() { world_zoom(+1); }
+
+// The default EGA palette
+const uint8_t ega_palette[16][3] = {
+    {0x00, 0x00, 0x00}, {0x00, 0x00, 0xaa}, {0x00, 0xaa, 0x00}, {0x00, 0xaa, 0xaa},
+    {0xaa, 0x00, 0x00}, {0xaa, 0x00, 0xaa}, {0xaa, 0x55, 0x00}, {0xaa, 0xaa, 0xaa},
+    {0x55, 0x55, 0x55}, {0x55, 0x55, 0xff}, {0x55, 0xff, 0x55}, {0x55, 0xff, 0xff},
+    {0xff, 0x55, 0x55}, {0xff, 0x55, 0xff}, {0xff, 0xff, 0x55}, {0xff, 0xff, 0xff},
+};
 
-                                struct DecompresssedRoom *room = &state->rooms.rooms[state->current_level].data;
-                                struct SwitchObject *sw = room->switches + state->current_switch - 1;
-                                if (sw->chunks.length == 1) {
-                                    // create new one
-                                    struct DecompresssedRoom *room = &state->rooms.rooms[state->current_level].data;
-                                    struct SwitchObject *sw = room->switches + state->current_switch - 1;
-                                    state->current_chunk = sw->chunks.length;
-                                    ARRAY_ADD(sw->chunks, ((struct SwitchChunk){ .type = TOGGLE_BLOCK }));
-                                    state->current_state = EDIT_SWITCHDETAILS_CHUNK_BLOCK_DETAILS;
-                                    state->switch_on = false;
-                                    ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                                    assert(writeRooms(&state->rooms));
-                                } else if (sw->chunks.length == 2) {
-                                    // The first chunk is the preamble, uneditable as a chunk, only as a switch
-                                    state->current_chunk = 1;
-                                    assert(sw->chunks.data[0].type == PREAMBLE);
-                                    struct SwitchChunk *chunk = sw->chunks.data + 1;
-                                    switch (chunk->type) {
-                                        case PREAMBLE: UNREACHABLE();
-                                        case TOGGLE_BLOCK:
-                                        {
-                                            size_t overflow = WIDTH_TILES * HEIGHT_TILES;
-                                            size_t point = chunk->y * WIDTH_TILES + chunk->x;
-                                            if (point >= overflow) {
-                                                state->current_state = EDIT_SWITCHDETAILS_CHUNK_MEMORY_DETAILS;
-                                            } else {
-                                                state->current_state = EDIT_SWITCHDETAILS_CHUNK_BLOCK_DETAILS;
-                                            }
-                                        }; break;
+// The tile as two upper half blocks, each quarter of the tile drawn in its
+// average colour. NULL if the graphics do not have it.
+const char *tile_glyph(uint8_t tile, uint8_t tile_offset, size_t *length) {
+    size_t t = GRAPHICS_TILE(tile, tile_offset);
+    if (t >= state->graphics.tiles.num_tiles) return NULL;
+    char *glyph = state->graphics.glyphs[t];
+    if (!state->graphics.cached[t]) {
+        int half = TILE_PIXELS / 2;
+        int used = 0;
+        for (int column = 0; column < 2; column ++) {
+            int rgb[2][3] = {0}; // Top then bottom
+            for (int y = 0; y < TILE_PIXELS; y ++) {
+                for (int x = column * half; x < (column + 1) * half; x ++) {
+                    const uint8_t *colour = ega_palette[state->graphics.tiles.pixels[t][y][x]];
+                    for (int c = 0; c < 3; c ++) rgb[y / half][c] += colour[c];
+                }
+            }
+            int n = half * half;
+            used += snprintf(glyph + used, GLYPH_SIZE - used, "\033[38;2;%d;%d;%d;48;2;%d;%d;%dm▀",
+                    rgb[0][0] / n, rgb[0][1] / n, rgb[0][2] / n, rgb[1][0] / n, rgb[1][1] / n, rgb[1][2] / n);
+        }
+        used += snprintf(glyph + used, GLYPH_SIZE - used, "\033[m");
+        assert(used < GLYPH_SIZE);
+        state->graphics.lengths[t] = used;
+        state->graphics.cached[t] = true;
+    }
+    *length = state->graphics.lengths[t];
+    return glyph;
+}
 
-                                        case TOGGLE_BIT:
-                                            state->current_state = EDIT_SWITCHDETAILS_CHUNK_SWITCH_DETAILS;
-                                            break;
+// GRAPHICS_FILE is loaded the first time, so it can be put there while editing
+void toggle_graphics() {
+    if (!state->graphics.shown && state->graphics.tiles.num_tiles == 0) {
+        if (!readGraphics(&state->graphics.tiles)) {
+            notify("Could not load %s, tiles stay as numbers", GRAPHICS_FILE);
+            return;
+        }
+        memset(state->graphics.cached, 0, sizeof(state->graphics.cached));
+    }
+    state->graphics.shown = !state->graphics.shown;
+}
 
-                                        case TOGGLE_OBJECT:
-                                            state->current_state = EDIT_SWITCHDETAILS_CHUNK_OBJECT_DETAILS;
-                                            break;
+// The key being run, for actions bound to OTHER_KEY or to more than one key,
+// see process_key
+char typed_key;
 
-                                        default: UNREACHABLE();
-                                    }
-                                } else {
-                                    state->current_state = EDIT_SWITCHDETAILS_SELECT_CHUNK;
-                                }
-                            }; break;
+void leave_state() {
+    state->current_state = state->previous_state;
+    state->previous_state = NORMAL;
+    state->current_switch = 0;
+    state->switch_on = false;
+    state->current_chunk = 0;
+}
 
-                            case 'C':
-                            {
-                                struct DecompresssedRoom *room = &state->rooms.rooms[state->current_level].data;
-                                struct SwitchObject *sw = room->switches + state->current_switch - 1;
-                                if (sw->chunks.length == 16) {
-                                    i++;
-                                    break;
-                                }
-                                state->current_chunk = sw->chunks.length;
-                                ARRAY_ADD(sw->chunks, ((struct SwitchChunk){ .type = TOGGLE_BLOCK }));
-                                state->current_state = EDIT_SWITCHDETAILS_CHUNK_BLOCK_DETAILS;
-                                state->switch_on = false;
-                                ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                                assert(writeRooms(&state->rooms));
-                            }; break;
+// Escape and q close the help first, then drop a half typed number
+void leave_key() {
+    if (state->help) {
+        state->help = false;
+    } else if (state->partial_byte) {
+        state->partial_byte = 0;
+    } else {
+        leave_state();
+    }
+}
 
-                            case 'q':
-                            case ESCAPE:
-                                if (state->help) {
-                                    state->help = false;
-                                } else {
-                                    state->current_state = state->previous_state;
-                                    state->current_switch = 0;
-                                    state->switch_on = false;
-                                    state->previous_state = TILE_EDIT;
-                                }
-                                break;
+// For states where a half typed number is kept across a change of base
+void toggle_hex_typing() {
+    toggle_hex();
+    if (state->partial_byte) {
+        if (state->debug.hex) {
+            state->partial_byte = ((state->partial_byte & 0xFF) * 10 / 16) % 16 + 1;
+        } else {
+            state->partial_byte = ((state->partial_byte & 0xFF) * 16 / 10) % 10 + 1;
+        }
+    }
+}
 
-                            default:
-                                if (buf[i] == '?') {
-                                    state->help = !state->help;
-                                } else if (iscntrl(buf[i])) {
-                                    switch (buf[i] + 'A' - 1) {
-                                        case '_': state->help = !state->help; break;
-                                        case 'H':
-                                            state->debug.hex = !state->debug.hex;
-                                            if (state->partial_byte) {
-                                                if (state->debug.hex) {
-                                                    state->partial_byte = ((state->partial_byte & 0xFF) * 10 / 16) % 16 + 1;
-                                                } else {
-                                                    state->partial_byte = ((state->partial_byte & 0xFF) * 16 / 10) % 10 + 1;
-                                                }
-                                            }
-                                    }
-                                }
-                        }
-                    }
-                    i++;
-                }; break;
-
-                case EDIT_SWITCHDETAILS_SELECT_CHUNK:
-                {
-                    if (isxdigit(buf[i])) {
-                        struct SwitchObject *sw = state->rooms.rooms[*cursorlevel].data.switches + state->current_switch - 1;
-                        if (sw->chunks.length > 16) {
-                            // FIXME support 2 digit nums, remove define above when done (used in staticdefines)
-                            fprintf(stderr, "%s:%d: UNIMPLEMENTED: support two digit numbers", __FILE__, __LINE__);
-                            UNREACHABLE();
-                        }
-                        size_t id;
-                        if (buf[i] > '9') {
-                            id = tolower(buf[i]) - 'a' + 10;
-                        } else {
-                            id = buf[i] - '0';
-                        }
-                        if (id < sw->chunks.length) {
-                            state->current_chunk = id;
-                            struct SwitchChunk *chunk = sw->chunks.data + id;
-                            switch (chunk->type) {
-                                case PREAMBLE: UNREACHABLE();
-                                case TOGGLE_BLOCK:
-                                {
-                                    size_t overflow = WIDTH_TILES * HEIGHT_TILES;
-                                    size_t point = chunk->y * WIDTH_TILES + chunk->x;
-                                    if (point >= overflow) {
-                                        state->current_state = EDIT_SWITCHDETAILS_CHUNK_MEMORY_DETAILS;
-                                    } else {
-                                        state->current_state = EDIT_SWITCHDETAILS_CHUNK_BLOCK_DETAILS;
-                                    }
-                                }; break;
+void forget_typed_key() { state->partial_byte = 0; }
 
-                                case TOGGLE_BIT:
-                                    state->current_state = EDIT_SWITCHDETAILS_CHUNK_SWITCH_DETAILS;
-                                    break;
+int digit_value(char c) { return isdigit(c) ? c - '0' : tolower(c) - 'a' + 10; }
 
-                                case TOGGLE_OBJECT:
-                                    state->current_state = EDIT_SWITCHDETAILS_CHUNK_OBJECT_DETAILS;
-                                    break;
+// Bytes are typed as two digits, true with the byte once the second one is
+bool byte_typed(size_t *value) {
+    if (!isxdigit(typed_key)) return false;
+    uint8_t digit = digit_value(typed_key);
+    if ((state->partial_byte & 0xFF00) == 0) {
+        state->partial_byte = 0xFF00 | digit;
+        return false;
+    }
+    *value = digit + (state->debug.hex ? 16 : 10) * (state->partial_byte & 0xFF);
+    state->partial_byte = 0;
+    return true;
+}
 
-                                default: UNREACHABLE();
-                            }
-                        }
-                    } else if (buf[i] == 0x7f) {
-                        state->partial_byte = 0;
-                    } else if (buf[i] == ESCAPE) {
-                        if (state->help) {
-                            state->help = false;
-                        } else {
-                            state->current_state = EDIT_SWITCHDETAILS;
-                        }
-                    } else if (iscntrl(buf[i])) {
-                        switch (buf[i] + 'A' - 1) {
-                            case '_': state->help = !state->help; break;
-                            case 'H': state->debug.hex = !state->debug.hex; break;
-                        }
-                    } else if (buf[i] == 'q') {
-                        if (state->help) {
-                            state->help = !state->help;
-                        } else {
-                            state->current_state = EDIT_SWITCHDETAILS;
-                        }
-                    } else if (buf[i] == '?') {
-                        state->help = !state->help;
-                    } else if (buf[i] == '+') {
-                        // create new one
-                        struct DecompresssedRoom *room = &state->rooms.rooms[state->current_level].data;
-                        struct SwitchObject *sw = room->switches + state->current_switch - 1;
-                        if (sw->chunks.length == 16) {
-                            i++;
-                            break;
-                        }
-                        ARRAY_ADD(sw->chunks, ((struct SwitchChunk){ .type = TOGGLE_BLOCK }));
-                        state->switch_on = false;
-                        ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                        assert(writeRooms(&state->rooms));
-                    } else if (buf[i] == 'p') {
-                        signal(SIGCHLD, SIG_IGN);
-                        pid_t child = fork();
-                        if (child == 0) {
-                            if (state != NULL) {
-                                freeRoomFile(&state->rooms);
-                                free(state);
-                            }
-                            pid_t sid = fork();
-                            if (sid == -1) exit(EXIT_FAILURE);
-                            if (sid > 0) exit(EXIT_SUCCESS);
-                            if (setsid() == -1) exit(EXIT_FAILURE);
-                            execv("./play.sh", (char**){0});
-                            exit(EXIT_FAILURE);
-                        }
-                    }
-                    i ++;
-                }; break;
-
-                case EDIT_SWITCHDETAILS_CHUNK_SWITCH_DETAILS:
-                {
-                    if (isxdigit(buf[i])) {
-                        uint8_t b = 0;
-                        if (isdigit(buf[i])) {
-                            b = *buf - '0';
-                        } else {
-                            b = 10 + tolower(buf[i]) - 'a';
-                        }
-                        if ((state->partial_byte & 0xFF00) != 0) {
-                            size_t index = b;
-                            if (state->debug.hex) {
-                                index += 16 * (state->partial_byte & 0xFF);
-                            } else {
-                                index += 10 * (state->partial_byte & 0xFF);
-                            }
-                            struct SwitchObject *sw = state->rooms.rooms[*cursorlevel].data.switches + state->current_switch - 1;
-                            struct SwitchChunk *chunk = sw->chunks.data + state->current_chunk;
-                            assert(chunk->type == TOGGLE_BIT);
-                            chunk->switch_idx = index;
-                            state->partial_byte = 0;
-                            ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                            assert(writeRooms(&state->rooms));
-                        } else {
-                            state->partial_byte = 0xFF00 | b;
-                        }
-                    } else if (buf[i] == 'r') {
-                        state->current_state = EDIT_SWITCHDETAILS_CHUNK_SWITCH_DETAILS_ROOM;
-                    } else if (buf[i] == 'o') {
-                        struct SwitchObject *sw = state->rooms.rooms[*cursorlevel].data.switches + state->current_switch - 1;
-                        struct SwitchChunk *chunk = sw->chunks.data + state->current_chunk;
-                        assert(chunk->type == TOGGLE_BIT);
-                        chunk->off = (chunk->off + 1) % 4;
-                        ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                        assert(writeRooms(&state->rooms));
-                    } else if (buf[i] == 'n') {
-                        struct SwitchObject *sw = state->rooms.rooms[*cursorlevel].data.switches + state->current_switch - 1;
-                        struct SwitchChunk *chunk = sw->chunks.data + state->current_chunk;
-                        assert(chunk->type == TOGGLE_BIT);
-                        chunk->on = (chunk->on + 1) % 4;
-                        ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                        assert(writeRooms(&state->rooms));
-                    } else if (buf[i] == 0x7f) {
-                        if (state->partial_byte) {
-                            state->partial_byte = 0;
-                        } else {
-                            if (!state->current_switch) UNREACHABLE();
-                            if (!state->current_chunk) UNREACHABLE();
-                            struct DecompresssedRoom *room = &state->rooms.rooms[state->current_level].data;
-                            struct SwitchObject *sw = room->switches + state->current_switch - 1;
-                            size_t ch_i = state->current_chunk;
-                            if (sw->chunks.length <= 1) UNREACHABLE();
-                            while (ch_i < sw->chunks.length - 1) {
-                                sw->chunks.data[ch_i] = sw->chunks.data[ch_i+1];
-                                ch_i++;
-                            }
-                            memset(sw->chunks.data + ch_i, 0, sizeof(struct SwitchChunk));
-                            sw->chunks.length --;
-                            ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                            assert(writeRooms(&state->rooms));
-                            if (state->current_chunk > 2) state->current_chunk --;
-                            switch (sw->chunks.length) {
-                                case 1: state->current_state = EDIT_SWITCHDETAILS; break;
-                                case 2:
-                                {
-                                    switch (sw->chunks.data[1].type) {
-                                        case PREAMBLE: UNREACHABLE();
-                                        case TOGGLE_BIT:
-                                            state->current_state = EDIT_SWITCHDETAILS_CHUNK_SWITCH_DETAILS;
-                                            break;
-
-                                        case TOGGLE_OBJECT:
-                                            state->current_state = EDIT_SWITCHDETAILS_CHUNK_OBJECT_DETAILS;
-                                            break;
-
-                                        case TOGGLE_BLOCK:
-                                        {
-                                            size_t overflow = WIDTH_TILES * HEIGHT_TILES;
-                                            size_t point = sw->chunks.data[1].y * WIDTH_TILES + sw->chunks.data[1].x;
-                                            if (point >= overflow) {
-                                                state->current_state = EDIT_SWITCHDETAILS_CHUNK_MEMORY_DETAILS;
-                                            } else {
-                                                state->current_state = EDIT_SWITCHDETAILS_CHUNK_BLOCK_DETAILS;
-                                            }
-                                        }; break;
+void goto_object_typed() {
+    if (!isxdigit(typed_key)) return;
+    struct DecompresssedRoom *room = &state->rooms.rooms[state->current_level].data;
+    if (room->num_objects > 15) {
+        // FIXME support 2 digit nums
+        UNREACHABLE();
+    }
+    size_t id = digit_value(typed_key);
+    if (id >= room->num_objects) return;
+    struct RoomObject *obj = room->objects + id;
+    if (obj->x < WIDTH_TILES && obj->y < HEIGHT_TILES) {
+        state->cursors[state->current_level].x = obj->x;
+        state->cursors[state->current_level].y = obj->y;
+        state->current_state = state->previous_state;
+        state->previous_state = NORMAL;
+    }
+}
 
-                                        default: UNREACHABLE();
-                                    }
-                                }; break;
+void goto_switch_typed() {
+    if (!isxdigit(typed_key)) return;
+    struct DecompresssedRoom *room = &state->rooms.rooms[state->current_level].data;
+    if (room->num_switches > 15) {
+        // FIXME support 2 digit nums
+        UNREACHABLE();
+    }
+    size_t id = digit_value(typed_key);
+    if (id >= room->num_switches) return;
+    state->current_switch = id + 1;
+    struct SwitchChunk *preamble = SMALL_ARRAY_DATA(room->switches[id].chunks);
+    if (room->switches[id].chunks.length > 0 && preamble->type == PREAMBLE && preamble->x < WIDTH_TILES && preamble->y < HEIGHT_TILES) {
+        state->cursors[state->current_level].x = preamble->x;
+        state->cursors[state->current_level].y = preamble->y;
+        state->current_state = state->previous_state;
+        state->previous_state = NORMAL;
+    } else {
+        state->current_state = EDIT_SWITCHDETAILS;
+    }
+}
 
-                                default: state->current_state = EDIT_SWITCHDETAILS_SELECT_CHUNK;
-                            }
-                        }
-                    } else if (buf[i] == ESCAPE) {
-                        if (i + 1 < n && buf[i+1] == '[' && i + 2 < n) {
-                            // CSI sequence
-                            i += 2;
-                            uint8_t arg = 0;
-                            while (i < n) {
-                                if (isdigit(buf[i])) {
-                                    arg = 10 * arg + buf[i] - '0';
-                                } else if (buf[i] == ';') {
-                                    arg = 0;
-                                } else {
-                                    switch (buf[i]) {
-                                        case '~':
-                                        {
-                                            switch (arg) {
-                                                case 3:
-                                                {
-                                                    if (state->partial_byte) {
-                                                        state->partial_byte = 0;
-                                                    } else {
-                                                        if (!state->current_switch) UNREACHABLE();
-                                                        if (!state->current_chunk) UNREACHABLE();
-                                                        struct DecompresssedRoom *room = &state->rooms.rooms[state->current_level].data;
-                                                        struct SwitchObject *sw = room->switches + state->current_switch - 1;
-                                                        size_t ch_i = state->current_chunk;
-                                                        if (sw->chunks.length <= 1) UNREACHABLE();
-                                                        while (ch_i < sw->chunks.length - 1) {
-                                                            sw->chunks.data[ch_i] = sw->chunks.data[ch_i+1];
-                                                            ch_i++;
-                                                        }
-                                                        memset(sw->chunks.data + ch_i, 0, sizeof(struct SwitchChunk));
-                                                        sw->chunks.length --;
-                                                        ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                                                        assert(writeRooms(&state->rooms));
-                                                        if (state->current_chunk > 2) state->current_chunk --;
-                                                        switch (sw->chunks.length) {
-                                                            case 1: state->current_state = EDIT_SWITCHDETAILS; break;
-                                                            case 2:
-                                                                    {
-                                                                        switch (sw->chunks.data[1].type) {
-                                                                            case PREAMBLE: UNREACHABLE();
-                                                                            case TOGGLE_BIT:
-                                                                                           state->current_state = EDIT_SWITCHDETAILS_CHUNK_SWITCH_DETAILS;
-                                                                                           break;
-
-                                                                            case TOGGLE_OBJECT:
-                                                                                           state->current_state = EDIT_SWITCHDETAILS_CHUNK_OBJECT_DETAILS;
-                                                                                           break;
-
-                                                                            case TOGGLE_BLOCK:
-                                                                                           {
-                                                                                               size_t overflow = WIDTH_TILES * HEIGHT_TILES;
-                                                                                               size_t point = sw->chunks.data[1].y * WIDTH_TILES + sw->chunks.data[1].x;
-                                                                                               if (point >= overflow) {
-                                                                                                   state->current_state = EDIT_SWITCHDETAILS_CHUNK_MEMORY_DETAILS;
-                                                                                               } else {
-                                                                                                   state->current_state = EDIT_SWITCHDETAILS_CHUNK_BLOCK_DETAILS;
-                                                                                               }
-                                                                                           }; break;
-
-                                                                            default: UNREACHABLE();
-                                                                        }
-                                                                    }; break;
-
-                                                            default: state->current_state = EDIT_SWITCHDETAILS_SELECT_CHUNK;
-                                                        }
-                                                    }
-                                                }; break;
-
-                                                default: fprintf(stderr, "%s:%d: UNIMPLEMENTED: csi terminator %c arg %d", __FILE__, __LINE__, buf[i], arg);
-                                            }
-                                        }; break;
+// Rooms are picked by a two digit number, the first at most 3 in hex or 6 in
+// decimal, or by the start of their name. True with the room once only one fits.
+bool room_typed(size_t *room) {
+    char c = typed_key;
+    if (state->partial_byte && (state->debug.hex ? isxdigit(c) : isdigit(c))) {
+        *room = digit_value(c) + (state->debug.hex ? 16 : 10) * (state->partial_byte & 0xFF);
+        return *room < C_ARRAY_LEN(state->rooms.rooms);
+    }
+    if (state->roomname_cursor == 0 && state->partial_byte == 0 && c >= '0' && c <= (state->debug.hex ? '3' : '6')) {
+        state->partial_byte = 0xFF00 | (c - '0');
+        return false;
+    }
+    if (state->partial_byte || !isprint(c) || state->roomname_cursor >= C_ARRAY_LEN(state->room_name) - 1) return false;
+    state->room_name[state->roomname_cursor++] = c;
+    size_t matches = 0;
+    for (size_t r = 0; r < C_ARRAY_LEN(state->rooms.rooms) && matches < 2; r ++) {
+        if (strncasecmp(state->rooms.rooms[r].data.name, state->room_name, state->roomname_cursor) == 0) {
+            if (matches ++ == 0) *room = r;
+        }
+    }
+    if (matches == 0) state->room_name[--state->roomname_cursor] = 0;
+    return matches == 1;
+}
 
-                                        default: fprintf(stderr, "%s:%d: UNIMPLEMENTED: csi terminator %c arg %d", __FILE__, __LINE__, buf[i], arg);
-                                    }
-                                    break;
-                                }
-                                i ++;
-                            }
-                        } else if (state->help) {
-                            state->help = false;
-                        } else {
-                            if (state->partial_byte) {
-                                state->partial_byte = 0;
-                            } else {
-                                struct SwitchObject *sw = state->rooms.rooms[*cursorlevel].data.switches + state->current_switch - 1;
-                                if (sw->chunks.length <= 2) {
-                                    state->current_state = EDIT_SWITCHDETAILS;
-                                } else {
-                                    state->current_state = EDIT_SWITCHDETAILS_SELECT_CHUNK;
-                                }
-                                state->current_chunk = 0;
-                            }
-                        }
-                    } else if (buf[i] == 't') {
-                        struct SwitchObject *sw = state->rooms.rooms[*cursorlevel].data.switches + state->current_switch - 1;
-                        struct SwitchChunk *chunk = sw->chunks.data + state->current_chunk;
-                        enum SwitchChunkType typ = chunk->type;
-                        switch (typ) {
-                            case TOGGLE_BLOCK:
-                            {
-                                size_t overflow = WIDTH_TILES * HEIGHT_TILES;
-                                size_t point = chunk->y * WIDTH_TILES + chunk->x;
-                                if (point < overflow) {
-                                    memset(chunk, 0, sizeof(*chunk));
-                                    chunk->type = TOGGLE_BLOCK;
-                                    chunk->x = 0;
-                                    chunk->y = HEIGHT_TILES;
-                                    chunk->size = 1;
-                                    state->current_state = EDIT_SWITCHDETAILS_CHUNK_MEMORY_DETAILS;
-                                    break;
-                                }
-                            }; fallthrough;
-                            default:
-                                memset(chunk, 0, sizeof(*chunk));
-                                chunk->type = (typ + 1) % NUM_CHUNK_TYPES;
-                                if (chunk->type == PREAMBLE) chunk->type = (chunk->type + 1) % NUM_CHUNK_TYPES;
-                                switch (chunk->type) {
-                                    case TOGGLE_BIT:
-                                        state->current_state = EDIT_SWITCHDETAILS_CHUNK_SWITCH_DETAILS;
-                                        chunk->bitmask = 0x1;
-                                        break;
+void clear_room_search() {
+    state->partial_byte = 0;
+    if (state->roomname_cursor) {
+        memset(state->room_name, 0, state->roomname_cursor);
+        state->roomname_cursor = 0;
+    }
+}
 
-                                    case TOGGLE_OBJECT:
-                                        state->current_state = EDIT_SWITCHDETAILS_CHUNK_OBJECT_DETAILS;
-                                        break;
+void room_erase_key() {
+    if (state->roomname_cursor) {
+        state->room_name[--state->roomname_cursor] = 0;
+    } else {
+        state->partial_byte = 0;
+    }
+}
 
-                                    case TOGGLE_BLOCK:
-                                        state->current_state = EDIT_SWITCHDETAILS_CHUNK_BLOCK_DETAILS;
-                                        break;
+void goto_room(size_t level) {
+    state->current_level = level;
+    leave_state();
+    clear_room_search();
+}
 
-                                    default: UNREACHABLE();
-                                }
+void goto_room_typed() {
+    size_t room;
+    if (room_typed(&room)) goto_room(room);
+}
 
-                        }
-                        ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                        assert(writeRooms(&state->rooms));
-                    } else if (iscntrl(buf[i])) {
-                        switch (buf[i] + 'A' - 1) {
-                            case '_': state->help = !state->help; break;
-                            case 'H': state->debug.hex = !state->debug.hex; break;
-                        }
-                    } else if (buf[i] == 'q') {
-                        if (state->help) {
-                            state->help = !state->help;
-                        } else {
-                            if (state->partial_byte) {
-                                state->partial_byte = 0;
-                            } else {
-                                struct SwitchObject *sw = state->rooms.rooms[*cursorlevel].data.switches + state->current_switch - 1;
-                                if (sw->chunks.length <= 2) {
-                                    state->current_state = EDIT_SWITCHDETAILS;
-                                } else {
-                                    state->current_state = EDIT_SWITCHDETAILS_SELECT_CHUNK;
-                                }
-                                state->current_chunk = 0;
-                            }
-                        }
-                    } else if (buf[i] == '?') {
-                        state->help = !state->help;
-                    } else if (buf[i] == '+') {
-                        if (state->current_switch) {
-                            struct SwitchObject *sw = state->rooms.rooms[*cursorlevel].data.switches + state->current_switch - 1;
-                            struct SwitchChunk ch = sw->chunks.data[state->current_chunk];
-                            if (state->current_chunk < sw->chunks.length - 1) {
-                                sw->chunks.data[state->current_chunk] = sw->chunks.data[state->current_chunk+1];
-                                sw->chunks.data[state->current_chunk+1] = ch;
-                                state->current_chunk ++;
-                                ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                                assert(writeRooms(&state->rooms));
-                            }
-                        }
-                    } else if (buf[i] == '-') {
-                        if (state->current_switch) {
-                            struct SwitchObject *sw = state->rooms.rooms[*cursorlevel].data.switches + state->current_switch - 1;
-                            struct SwitchChunk ch = sw->chunks.data[state->current_chunk];
-                            if (state->current_chunk > 1) {
-                                sw->chunks.data[state->current_chunk] = sw->chunks.data[state->current_chunk-1];
-                                sw->chunks.data[state->current_chunk-1] = ch;
-                                state->current_chunk --;
-                                ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                                assert(writeRooms(&state->rooms));
-                            }
-                        }
-                    } else if (buf[i] == 'p') {
-                        signal(SIGCHLD, SIG_IGN);
-                        pid_t child = fork();
-                        if (child == 0) {
-                            if (state != NULL) {
-                                freeRoomFile(&state->rooms);
-                                free(state);
-                            }
-                            pid_t sid = fork();
-                            if (sid == -1) exit(EXIT_FAILURE);
-                            if (sid > 0) exit(EXIT_SUCCESS);
-                            if (setsid() == -1) exit(EXIT_FAILURE);
-                            execv("./play.sh", (char**){0});
-                            exit(EXIT_FAILURE);
-                        }
-                    }
-                    i ++;
-                }; break;
-
-                case EDIT_SWITCHDETAILS_CHUNK_SWITCH_DETAILS_ROOM:
-                {
-                    if (state->partial_byte && ((state->debug.hex && isxdigit(buf[i])) || (!state->debug.hex && isdigit(buf[i])))) {
-                        int digit;
-                        if (buf[i] > '9') {
-                            digit = tolower(buf[i]) - 'a' + 10;
-                        } else {
-                            digit = buf[i] - '0';
-                        }
-                        size_t room_id = digit;
-                        if (state->debug.hex) {
-                            room_id += 16 * (state->partial_byte & 0xFF);
-                        } else {
-                            room_id += 10 * (state->partial_byte & 0xFF);
-                        }
-                        if (room_id < C_ARRAY_LEN(state->rooms.rooms)) {
-                            struct SwitchObject *sw = state->rooms.rooms[*cursorlevel].data.switches + state->current_switch - 1;
-                            struct SwitchChunk *chunk = sw->chunks.data + state->current_chunk;
-                            assert(chunk->type == TOGGLE_BIT);
-                            chunk->room_idx = room_id;
-                            chunk->switch_idx = 0;
-                            state->current_state = EDIT_SWITCHDETAILS_CHUNK_SWITCH_DETAILS;
-                            state->partial_byte = 0;
-                            state->roomname_cursor = 0;
-                            strncpy(state->room_name, state->rooms.rooms[*cursorlevel].data.name, C_ARRAY_LEN(state->room_name));
-                            for (size_t i = 0; i < C_ARRAY_LEN(state->room_name); i ++) {
-                                if (state->room_name[C_ARRAY_LEN(state->room_name) - i] == '\0') continue;
-                                if (state->room_name[C_ARRAY_LEN(state->room_name) - i] == ' ') {
-                                    state->room_name[C_ARRAY_LEN(state->room_name) - i] = '\0';
-                                } else {
-                                    break;
-                                }
-                            }
-                            ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                            assert(writeRooms(&state->rooms));
-                        }
-                    } else if (state->roomname_cursor == 0 && state->partial_byte == 0 && buf[i] >= '0' &&
-                                buf[i] <= (state->debug.hex ? '3' : '6')) {
-                        state->partial_byte = 0xFF00 | (buf[i] - '0');
-                    } else if (buf[i] == 0x7f) {
-                        if (state->roomname_cursor) {
-                            state->room_name[--state->roomname_cursor] = 0;
-                        } else {
-                            state->partial_byte = 0;
-                        }
-                    } else if (buf[i] == ESCAPE) {
-                        if (i + 1 < n) {
-                            if (buf[i + 1] == '[') {
-                                if (i + 2 < n) {
-                                    // CSI sequence
-                                    i += 2;
-                                    uint8_t arg = 0;
-                                    while (i < n) {
-                                        if (isdigit(buf[i])) {
-                                            arg = 10 * arg + buf[i] - '0';
-                                        } else if (buf[i] == ';') {
-                                            arg = 0;
-                                        } else {
-                                            switch (buf[i]) {
-                                                case '~':
-                                                {
-                                                    switch (arg) {
-                                                        case 3:
-                                                            if (state->roomname_cursor) {
-                                                                state->room_name[--state->roomname_cursor] = 0;
-                                                            } else {
-                                                                state->partial_byte = 0;
-                                                            }
-                                                            break;
-
-                                                        default: fprintf(stderr, "%s:%d: UNIMPLEMENTED: csi terminator %c arg %d", __FILE__, __LINE__, buf[i], arg);
-                                                    }
-                                                }; break;
-
-                                                default: fprintf(stderr, "%s:%d: UNIMPLEMENTED: csi terminator %c arg %d", __FILE__, __LINE__, buf[i], arg);
-                                            }
-                                            break;
-                                        }
-                                        i ++;
-                                    }
-                                }
-                            } else {
+void goto_room_north() { goto_room(state->rooms.rooms[state->current_level].data.room_north); }
+void goto_room_south() { goto_room(state->rooms.rooms[state->current_level].data.room_south); }
+void goto_room_east() { goto_room(state->rooms.rooms[state->current_level].data.room_east); }
+void goto_room_west() { goto_room(state->rooms.rooms[state->current_level].data.room_west); }
 
-                            }
-                        } else if (state->help) {
-                            state->help = false;
-                        } else {
-                            state->current_state = EDIT_SWITCHDETAILS_CHUNK_SWITCH_DETAILS;
-                            state->partial_byte = 0;
-                            state->roomname_cursor = 0;
-                            strncpy(state->room_name, state->rooms.rooms[*cursorlevel].data.name, C_ARRAY_LEN(state->room_name));
-                            for (size_t i = 0; i < C_ARRAY_LEN(state->room_name); i ++) {
-                                if (state->room_name[C_ARRAY_LEN(state->room_name) - i] == '\0') continue;
-                                if (state->room_name[C_ARRAY_LEN(state->room_name) - i] == ' ') {
-                                    state->room_name[C_ARRAY_LEN(state->room_name) - i] = '\0';
-                                } else {
-                                    break;
-                                }
-                            }
-                        }
-                    } else if (iscntrl(buf[i])) {
-                        switch (buf[i] + 'A' - 1) {
-                            case '_': state->help = !state->help; break;
-                            case 'H':
-                                      state->debug.hex = !state->debug.hex;
-                                      if (state->partial_byte) {
-                                          if (state->debug.hex) {
-                                              state->partial_byte = ((state->partial_byte & 0xFF) * 10 / 16) % 16 + 1;
-                                          } else {
-                                              state->partial_byte = ((state->partial_byte & 0xFF) * 16 / 10) % 10 + 1;
-                                          }
-                                      }
-                                      break;
-
-                            case 'Q':
-                                      if (state->help) {
-                                          state->help = !state->help;
-                                      } else {
-                                          state->current_state = EDIT_SWITCHDETAILS_CHUNK_SWITCH_DETAILS;
-                                          state->partial_byte = 0;
-                                          state->roomname_cursor = 0;
-                                          strncpy(state->room_name, state->rooms.rooms[*cursorlevel].data.name, C_ARRAY_LEN(state->room_name));
-                                          for (size_t i = 0; i < C_ARRAY_LEN(state->room_name); i ++) {
-                                              if (state->room_name[C_ARRAY_LEN(state->room_name) - i] == '\0') continue;
-                                              if (state->room_name[C_ARRAY_LEN(state->room_name) - i] == ' ') {
-                                                  state->room_name[C_ARRAY_LEN(state->room_name) - i] = '\0';
-                                              } else {
-                                                  break;
-                                              }
-                                          }
-                                      }
-                                      break;
-                        }
-                    } else {
-                        if (buf[i] == '[') {
-                            if (i + 1 < n) {
-                                // CSI sequence
-                                i += 1;
-                                uint8_t arg = 0;
-                                while (i < n) {
-                                    if (isdigit(buf[i])) {
-                                        arg = 10 * arg + buf[i] - '0';
-                                    } else if (buf[i] == ';') {
-                                        arg = 0;
-                                    } else {
-                                        if (arg == 3 && buf[i] == '~') {
-                                            if (state->roomname_cursor) {
-                                                state->room_name[--state->roomname_cursor] = 0;
-                                            } else {
-                                                state->partial_byte = 0;
-                                            }
-                                        } else {
-                                            fprintf(stderr, "%s:%d: UNIMPLEMENTED: csi terminator %c arg %d", __FILE__, __LINE__, buf[i], arg);
-                                        }
-                                        break;
-                                    }
-                                    i ++;
-                                }
-                            } else {
-                                UNREACHABLE();
-                            }
-                        } else if (state->partial_byte == 0 && isprint(buf[i])) {
-                            if (state->roomname_cursor < C_ARRAY_LEN(state->room_name) - 1) {
-                                state->room_name[state->roomname_cursor++] = buf[i];
-
-                                bool possible = false;
-                                bool duplicate = false;
-                                size_t matching_room = 0;
-                                if (state->roomname_cursor) {
-                                    for (size_t _room = 0; _room < C_ARRAY_LEN(state->rooms.rooms); _room ++) {
-                                        struct DecompresssedRoom *room = &state->rooms.rooms[_room].data;
-                                        if (strncasecmp(room->name, state->room_name, state->roomname_cursor) == 0) {
-                                            if (possible) {
-                                                duplicate = true;
-                                                break;
-                                            } else {
-                                                duplicate = false;
-                                            }
-                                            possible = true;
-                                            matching_room = _room;
-                                        }
-                                    }
-                                } else {
-                                    possible = true;
-                                }
-                                if (!possible) {
-                                    state->room_name[--state->roomname_cursor] = 0;
-                                } else if (!duplicate) {
-
-                                    struct SwitchObject *sw = state->rooms.rooms[*cursorlevel].data.switches + state->current_switch - 1;
-                                    struct SwitchChunk *chunk = sw->chunks.data + state->current_chunk;
-                                    assert(chunk->type == TOGGLE_BIT);
-                                    chunk->room_idx = matching_room;
-                                    chunk->switch_idx = 0;
-                                    state->current_state = EDIT_SWITCHDETAILS_CHUNK_SWITCH_DETAILS;
-                                    state->partial_byte = 0;
-                                    state->roomname_cursor = 0;
-                                    strncpy(state->room_name, state->rooms.rooms[*cursorlevel].data.name, C_ARRAY_LEN(state->room_name));
-                                    for (size_t i = 0; i < C_ARRAY_LEN(state->room_name); i ++) {
-                                        if (state->room_name[C_ARRAY_LEN(state->room_name) - i] == '\0') continue;
-                                        if (state->room_name[C_ARRAY_LEN(state->room_name) - i] == ' ') {
-                                            state->room_name[C_ARRAY_LEN(state->room_name) - i] = '\0';
-                                        } else {
-                                            break;
-                                        }
-                                    }
-                                    ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                                    assert(writeRooms(&state->rooms));
-                                }
-                            }
-                        }
-                    }
-                    i ++;
-                }; break;
-
-                case EDIT_SWITCHDETAILS_CHUNK_MEMORY_DETAILS:
-                {
-                    if (isxdigit(buf[i])) {
-                        uint8_t b = 0;
-                        if (isdigit(buf[i])) {
-                            b = *buf - '0';
-                        } else {
-                            b = 10 + tolower(buf[i]) - 'a';
-                        }
-                        if ((state->partial_byte & 0xFF00) != 0) {
-                            size_t value = b;
-                            if (state->debug.hex) {
-                                value += 16 * (state->partial_byte & 0xFF);
-                            } else {
-                                value += 10 * (state->partial_byte & 0xFF);
-                            }
-                            struct SwitchObject *sw = state->rooms.rooms[*cursorlevel].data.switches + state->current_switch - 1;
-                            struct SwitchChunk *chunk = sw->chunks.data + state->current_chunk;
-                            assert(chunk->type == TOGGLE_BLOCK);
-                            if (state->switch_on) {
-                                chunk->on = value;
-                            } else {
-                                chunk->off = value;
-                            }
-                            state->partial_byte = 0;
-                            ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                            assert(writeRooms(&state->rooms));
-                        } else {
-                            state->partial_byte = 0xFF00 | b;
-                        }
-                    } else if (buf[i] == 'h') {
-                        struct SwitchObject *sw = state->rooms.rooms[*cursorlevel].data.switches + state->current_switch - 1;
-                        struct SwitchChunk *chunk = sw->chunks.data + state->current_chunk;
-                        assert(chunk->type == TOGGLE_BLOCK);
-                        if (chunk->x) {
-                            chunk->x --;
-                        } else {
-                            if (chunk->y == HEIGHT_TILES) {
-                                chunk->y = (offsetof(struct DecompresssedRoom, end_marker) - 1) / WIDTH_TILES;
-                                chunk->x = (offsetof(struct DecompresssedRoom, end_marker) - 1) % WIDTH_TILES;
-                            } else {
-                                chunk->y --;
-                                chunk->x = WIDTH_TILES - 1;
-                            }
-                        }
-                        ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                        assert(writeRooms(&state->rooms));
-                    } else if (buf[i] == 'j') {
-                        struct SwitchObject *sw = state->rooms.rooms[*cursorlevel].data.switches + state->current_switch - 1;
-                        struct SwitchChunk *chunk = sw->chunks.data + state->current_chunk;
-                        assert(chunk->type == TOGGLE_BLOCK);
-                        chunk->x ++;
-                        if (chunk->x == WIDTH_TILES) {
-                            chunk->x = 0;
-                            chunk->y ++;
-                        }
-                        size_t overflow = WIDTH_TILES * HEIGHT_TILES;
-                        size_t point = chunk->y * WIDTH_TILES + chunk->x;
-                        size_t offset = point - overflow;
-                        size_t end = offsetof(struct DecompresssedRoom, end_marker) - overflow;
-                        if (offset >= end) {
-                            chunk->y = HEIGHT_TILES;
-                            chunk->x = 0;
-                        }
-                        ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                        assert(writeRooms(&state->rooms));
-                    } else if (buf[i] == 'k') {
-                        struct SwitchObject *sw = state->rooms.rooms[*cursorlevel].data.switches + state->current_switch - 1;
-                        struct SwitchChunk *chunk = sw->chunks.data + state->current_chunk;
-                        assert(chunk->type == TOGGLE_BLOCK);
-                        if (chunk->x) {
-                            chunk->x --;
-                        } else {
-                            if (chunk->y == HEIGHT_TILES) {
-                                chunk->y = (offsetof(struct DecompresssedRoom, end_marker) - 1) / WIDTH_TILES;
-                                chunk->x = (offsetof(struct DecompresssedRoom, end_marker) - 1) % WIDTH_TILES;
-                            } else {
-                                chunk->y --;
-                                chunk->x = WIDTH_TILES - 1;
-                            }
-                        }
-                        ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                        assert(writeRooms(&state->rooms));
-                    } else if (buf[i] == 'l') {
-                        struct SwitchObject *sw = state->rooms.rooms[*cursorlevel].data.switches + state->current_switch - 1;
-                        struct SwitchChunk *chunk = sw->chunks.data + state->current_chunk;
-                        assert(chunk->type == TOGGLE_BLOCK);
-                        chunk->x ++;
-                        if (chunk->x == WIDTH_TILES) {
-                            chunk->x = 0;
-                            chunk->y ++;
-                        }
-                        size_t overflow = WIDTH_TILES * HEIGHT_TILES;
-                        size_t point = chunk->y * WIDTH_TILES + chunk->x;
-                        size_t offset = point - overflow;
-                        size_t end = offsetof(struct DecompresssedRoom, end_marker) - overflow;
-                        if (offset >= end) {
-                            chunk->y = HEIGHT_TILES;
-                            chunk->x = 0;
-                        }
-                        ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                        assert(writeRooms(&state->rooms));
-                    } else if (buf[i] == 'o') {
-                        state->switch_on = !state->switch_on;
-                    } else if (buf[i] == ' ') {
-                        struct SwitchObject *sw = state->rooms.rooms[*cursorlevel].data.switches + state->current_switch - 1;
-                        struct SwitchChunk *chunk = sw->chunks.data + state->current_chunk;
-                        assert(chunk->type == TOGGLE_BLOCK);
-                        chunk->x ++;
-                        if (chunk->x == WIDTH_TILES) {
-                            chunk->x = 0;
-                            chunk->y ++;
-                        }
-                        size_t overflow = WIDTH_TILES * HEIGHT_TILES;
-                        size_t point = chunk->y * WIDTH_TILES + chunk->x;
-                        size_t offset = point - overflow;
-                        size_t end = offsetof(struct DecompresssedRoom, end_marker) - overflow;
-                        if (offset >= end) {
-                            chunk->y = HEIGHT_TILES;
-                            chunk->x = 0;
-                        }
-                        ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                        assert(writeRooms(&state->rooms));
-                    } else if (buf[i] == '^') {
-                        struct SwitchObject *sw = state->rooms.rooms[*cursorlevel].data.switches + state->current_switch - 1;
-                        struct SwitchChunk *chunk = sw->chunks.data + state->current_chunk;
-                        assert(chunk->type == TOGGLE_BLOCK);
-                        if (chunk->size < 8) chunk->size ++;
-                        ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                        assert(writeRooms(&state->rooms));
-                    } else if (buf[i] == 'v') {
-                        struct SwitchObject *sw = state->rooms.rooms[*cursorlevel].data.switches + state->current_switch - 1;
-                        struct SwitchChunk *chunk = sw->chunks.data + state->current_chunk;
-                        assert(chunk->type == TOGGLE_BLOCK);
-                        if (chunk->size > 1) chunk->size --;
-                        ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                        assert(writeRooms(&state->rooms));
-                    } else if (buf[i] == 'r') {
-                        struct SwitchObject *sw = state->rooms.rooms[*cursorlevel].data.switches + state->current_switch - 1;
-                        struct SwitchChunk *chunk = sw->chunks.data + state->current_chunk;
-                        assert(chunk->type == TOGGLE_BLOCK);
-                        chunk->dir = (chunk->dir + 1) % NUM_DIRECTIONS;
-                        ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                        assert(writeRooms(&state->rooms));
-                    } else if (buf[i] == 0x7f) {
-                        if (state->partial_byte) {
-                            state->partial_byte = 0;
-                        } else {
-                            if (!state->current_switch) UNREACHABLE();
-                            if (!state->current_chunk) UNREACHABLE();
-                            struct DecompresssedRoom *room = &state->rooms.rooms[state->current_level].data;
-                            struct SwitchObject *sw = room->switches + state->current_switch - 1;
-                            size_t ch_i = state->current_chunk;
-                            if (sw->chunks.length <= 1) UNREACHABLE();
-                            while (ch_i < sw->chunks.length - 1) {
-                                sw->chunks.data[ch_i] = sw->chunks.data[ch_i+1];
-                                ch_i++;
-                            }
-                            memset(sw->chunks.data + ch_i, 0, sizeof(struct SwitchChunk));
-                            sw->chunks.length --;
-                            ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                            assert(writeRooms(&state->rooms));
-                            if (state->current_chunk > 2) state->current_chunk --;
-                            switch (sw->chunks.length) {
-                                case 1: state->current_state = EDIT_SWITCHDETAILS; break;
-                                case 2:
-                                {
-                                    switch (sw->chunks.data[1].type) {
-                                        case PREAMBLE: UNREACHABLE();
-                                        case TOGGLE_BIT:
-                                            state->current_state = EDIT_SWITCHDETAILS_CHUNK_SWITCH_DETAILS;
-                                            break;
-
-                                        case TOGGLE_OBJECT:
-                                            state->current_state = EDIT_SWITCHDETAILS_CHUNK_OBJECT_DETAILS;
-                                            break;
-
-                                        case TOGGLE_BLOCK:
-                                        {
-                                            size_t overflow = WIDTH_TILES * HEIGHT_TILES;
-                                            size_t point = sw->chunks.data[1].y * WIDTH_TILES + sw->chunks.data[1].x;
-                                            if (point >= overflow) {
-                                                state->current_state = EDIT_SWITCHDETAILS_CHUNK_MEMORY_DETAILS;
-                                            } else {
-                                                state->current_state = EDIT_SWITCHDETAILS_CHUNK_BLOCK_DETAILS;
-                                            }
-                                        }; break;
+// Escape and Ctrl-q, as q is part of a name
+void goto_room_leave_key() {
+    if (state->help) {
+        state->help = false;
+    } else {
+        leave_state();
+        clear_room_search();
+    }
+}
 
-                                        default: UNREACHABLE();
-                                    }
-                                }; break;
+// While help is up a room name takes no keys, other than to close it
+void roomname_typed() {
+    if (state->help) {
+        if (typed_key == 'q') state->help = false;
+    } else if (isprint(typed_key) && state->roomname_cursor < C_ARRAY_LEN(state->room_name) - 1) {
+        state->room_name[state->roomname_cursor++] = typed_key;
+    }
+}
 
-                                default: state->current_state = EDIT_SWITCHDETAILS_SELECT_CHUNK;
-                            }
-                        }
-                    } else if (buf[i] == ESCAPE) {
-                        if (i + 1 < n && buf[i+1] == '[' && i + 2 < n) {
-                            // CSI sequence
-                            i += 2;
-                            uint8_t arg = 0;
-                            while (i < n) {
-                                if (isdigit(buf[i])) {
-                                    arg = 10 * arg + buf[i] - '0';
-                                } else if (buf[i] == ';') {
-                                    arg = 0;
-                                } else {
-                                    switch (buf[i]) {
-                                        case '~':
-                                        {
-                                            switch (arg) {
-                                                case 3:
-                                                {
-                                                    if (state->partial_byte) {
-                                                        state->partial_byte = 0;
-                                                    } else {
-                                                        if (!state->current_switch) UNREACHABLE();
-                                                        if (!state->current_chunk) UNREACHABLE();
-                                                        struct DecompresssedRoom *room = &state->rooms.rooms[state->current_level].data;
-                                                        struct SwitchObject *sw = room->switches + state->current_switch - 1;
-                                                        size_t ch_i = state->current_chunk;
-                                                        if (sw->chunks.length <= 1) UNREACHABLE();
-                                                        while (ch_i < sw->chunks.length - 1) {
-                                                            sw->chunks.data[ch_i] = sw->chunks.data[ch_i+1];
-                                                            ch_i++;
-                                                        }
-                                                        memset(sw->chunks.data + ch_i, 0, sizeof(struct SwitchChunk));
-                                                        sw->chunks.length --;
-                                                        ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                                                        assert(writeRooms(&state->rooms));
-                                                        if (state->current_chunk > 2) state->current_chunk --;
-                                                        switch (sw->chunks.length) {
-                                                            case 1: state->current_state = EDIT_SWITCHDETAILS; break;
-                                                            case 2:
-                                                                    {
-                                                                        switch (sw->chunks.data[1].type) {
-                                                                            case PREAMBLE: UNREACHABLE();
-                                                                            case TOGGLE_BIT:
-                                                                                           state->current_state = EDIT_SWITCHDETAILS_CHUNK_SWITCH_DETAILS;
-                                                                                           break;
-
-                                                                            case TOGGLE_OBJECT:
-                                                                                           state->current_state = EDIT_SWITCHDETAILS_CHUNK_OBJECT_DETAILS;
-                                                                                           break;
-
-                                                                            case TOGGLE_BLOCK:
-                                                                                           {
-                                                                                               size_t overflow = WIDTH_TILES * HEIGHT_TILES;
-                                                                                               size_t point = sw->chunks.data[1].y * WIDTH_TILES + sw->chunks.data[1].x;
-                                                                                               if (point >= overflow) {
-                                                                                                   state->current_state = EDIT_SWITCHDETAILS_CHUNK_MEMORY_DETAILS;
-                                                                                               } else {
-                                                                                                   state->current_state = EDIT_SWITCHDETAILS_CHUNK_BLOCK_DETAILS;
-                                                                                               }
-                                                                                           }; break;
-
-                                                                            default: UNREACHABLE();
-                                                                        }
-                                                                    }; break;
-
-                                                            default: state->current_state = EDIT_SWITCHDETAILS_SELECT_CHUNK;
-                                                        }
-                                                    }
-                                                }; break;
-
-                                                default: fprintf(stderr, "%s:%d: UNIMPLEMENTED: csi terminator %c arg %d", __FILE__, __LINE__, buf[i], arg);
-                                            }
-                                        }; break;
-
-                                        case 'A':
-                                        {
-                                            struct SwitchObject *sw = state->rooms.rooms[*cursorlevel].data.switches + state->current_switch - 1;
-                                            struct SwitchChunk *chunk = sw->chunks.data + state->current_chunk;
-                                            assert(chunk->type == TOGGLE_BLOCK);
-                                            if (chunk->x) {
-                                                chunk->x --;
-                                            } else {
-                                                if (chunk->y == HEIGHT_TILES) {
-                                                    chunk->y = (offsetof(struct DecompresssedRoom, end_marker) - 1) / WIDTH_TILES;
-                                                    chunk->x = (offsetof(struct DecompresssedRoom, end_marker) - 1) % WIDTH_TILES;
-                                                } else {
-                                                    chunk->y --;
-                                                    chunk->x = WIDTH_TILES - 1;
-                                                }
-                                            }
-                                            ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                                            assert(writeRooms(&state->rooms));
-                                        }; break;
-
-                                        case 'B':
-                                        {
-                                            struct SwitchObject *sw = state->rooms.rooms[*cursorlevel].data.switches + state->current_switch - 1;
-                                            struct SwitchChunk *chunk = sw->chunks.data + state->current_chunk;
-                                            assert(chunk->type == TOGGLE_BLOCK);
-                                            chunk->x ++;
-                                            if (chunk->x == WIDTH_TILES) {
-                                                chunk->x = 0;
-                                                chunk->y ++;
-                                            }
-                                            size_t overflow = WIDTH_TILES * HEIGHT_TILES;
-                                            size_t point = chunk->y * WIDTH_TILES + chunk->x;
-                                            size_t offset = point - overflow;
-                                            size_t end = offsetof(struct DecompresssedRoom, end_marker) - overflow;
-                                            if (offset >= end) {
-                                                chunk->y = HEIGHT_TILES;
-                                                chunk->x = 0;
-                                            }
-                                            ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                                            assert(writeRooms(&state->rooms));
-                                        }; break;
-
-                                        case 'C':
-                                        {
-                                            struct SwitchObject *sw = state->rooms.rooms[*cursorlevel].data.switches + state->current_switch - 1;
-                                            struct SwitchChunk *chunk = sw->chunks.data + state->current_chunk;
-                                            assert(chunk->type == TOGGLE_BLOCK);
-                                            chunk->x ++;
-                                            if (chunk->x == WIDTH_TILES) {
-                                                chunk->x = 0;
-                                                chunk->y ++;
-                                            }
-                                            size_t overflow = WIDTH_TILES * HEIGHT_TILES;
-                                            size_t point = chunk->y * WIDTH_TILES + chunk->x;
-                                            size_t offset = point - overflow;
-                                            size_t end = offsetof(struct DecompresssedRoom, end_marker) - overflow;
-                                            if (offset >= end) {
-                                                chunk->y = HEIGHT_TILES;
-                                                chunk->x = 0;
-                                            }
-                                            ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                                            assert(writeRooms(&state->rooms));
-                                        }; break;
-
-                                        case 'D':
-                                        {
-                                            struct SwitchObject *sw = state->rooms.rooms[*cursorlevel].data.switches + state->current_switch - 1;
-                                            struct SwitchChunk *chunk = sw->chunks.data + state->current_chunk;
-                                            assert(chunk->type == TOGGLE_BLOCK);
-                                            if (chunk->x) {
-                                                chunk->x --;
-                                            } else {
-                                                if (chunk->y == HEIGHT_TILES) {
-                                                    chunk->y = (offsetof(struct DecompresssedRoom, end_marker) - 1) / WIDTH_TILES;
-                                                    chunk->x = (offsetof(struct DecompresssedRoom, end_marker) - 1) % WIDTH_TILES;
-                                                } else {
-                                                    chunk->y --;
-                                                    chunk->x = WIDTH_TILES - 1;
-                                                }
-                                            }
-                                            ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                                            assert(writeRooms(&state->rooms));
-                                        }; break;
+void roomname_enter_key() {
+    if (state->help) return;
+    struct DecompresssedRoom *room = &state->rooms.rooms[state->current_level].data;
+    assert(C_ARRAY_LEN(state->room_name) <= C_ARRAY_LEN(room->name));
+    strncpy(room->name, state->room_name, C_ARRAY_LEN(room->name));
+    leave_state();
+    save_room();
+}
 
-                                        default: fprintf(stderr, "%s:%d: UNIMPLEMENTED: csi terminator %c arg %d", __FILE__, __LINE__, buf[i], arg);
-                                    }
-                                    break;
-                                }
-                                i ++;
-                            }
-                        } else if (state->help) {
-                            state->help = false;
-                        } else {
-                            if (state->partial_byte) {
-                                state->partial_byte = 0;
-                            } else {
-                                struct SwitchObject *sw = state->rooms.rooms[*cursorlevel].data.switches + state->current_switch - 1;
-                                if (sw->chunks.length <= 2) {
-                                    state->current_state = EDIT_SWITCHDETAILS;
-                                } else {
-                                    state->current_state = EDIT_SWITCHDETAILS_SELECT_CHUNK;
-                                }
-                                state->current_chunk = 0;
-                            }
-                        }
-                    } else if (buf[i] == 't') {
-                        struct SwitchObject *sw = state->rooms.rooms[*cursorlevel].data.switches + state->current_switch - 1;
-                        struct SwitchChunk *chunk = sw->chunks.data + state->current_chunk;
-                        enum SwitchChunkType typ = chunk->type;
-                        switch (typ) {
-                            case TOGGLE_BLOCK:
-                            {
-                                size_t overflow = WIDTH_TILES * HEIGHT_TILES;
-                                size_t point = chunk->y * WIDTH_TILES + chunk->x;
-                                if (point < overflow) {
-                                    memset(chunk, 0, sizeof(*chunk));
-                                    chunk->type = TOGGLE_BLOCK;
-                                    chunk->x = 0;
-                                    chunk->y = HEIGHT_TILES;
-                                    chunk->size = 1;
-                                    state->current_state = EDIT_SWITCHDETAILS_CHUNK_MEMORY_DETAILS;
-                                    break;
-                                }
-                            }; fallthrough;
-                            default:
-                                memset(chunk, 0, sizeof(*chunk));
-                                chunk->type = (typ + 1) % NUM_CHUNK_TYPES;
-                                if (chunk->type == PREAMBLE) chunk->type = (chunk->type + 1) % NUM_CHUNK_TYPES;
-                                switch (chunk->type) {
-                                    case TOGGLE_BIT:
-                                        state->current_state = EDIT_SWITCHDETAILS_CHUNK_SWITCH_DETAILS;
-                                        chunk->bitmask = 0x1;
-                                        break;
+void roomname_leave_key() {
+    if (state->help) {
+        state->help = false;
+    } else {
+        leave_state();
+    }
+}
 
-                                    case TOGGLE_OBJECT:
-                                        state->current_state = EDIT_SWITCHDETAILS_CHUNK_OBJECT_DETAILS;
-                                        break;
+void roomname_home_key() {
+    if (!state->help) state->roomname_cursor = 0;
+}
 
-                                    case TOGGLE_BLOCK:
-                                        state->current_state = EDIT_SWITCHDETAILS_CHUNK_BLOCK_DETAILS;
-                                        break;
+void roomname_end_key() {
+    if (!state->help) state->roomname_cursor = strlen(state->room_name);
+}
+
+void roomname_left_key() {
+    if (!state->help && state->roomname_cursor > 0) state->roomname_cursor --;
+}
+
+void roomname_right_key() {
+    if (!state->help && state->roomname_cursor < C_ARRAY_LEN(state->room_name) - 1 && state->room_name[state->roomname_cursor]) {
+        state->roomname_cursor ++;
+    }
+}
+
+void roomname_delete_key() {
+    if (state->help) return;
+    for (size_t c = state->roomname_cursor; c < C_ARRAY_LEN(state->room_name) - 1; c ++) {
+        state->room_name[c] = state->room_name[c + 1];
+        state->room_name[c + 1] = '\0';
+    }
+    if (state->roomname_cursor) state->roomname_cursor--;
+}
+
+void roomname_backspace_key() {
+    if (state->help || state->roomname_cursor == 0) return;
+    for (size_t c = state->roomname_cursor - 1; c < C_ARRAY_LEN(state->room_name) - 1; c ++) {
+        state->room_name[c] = state->room_name[c + 1];
+        state->room_name[c + 1] = '\0';
+    }
+    state->roomname_cursor--;
+}
+
+void roomname_hex_key() {
+    if (!state->help) toggle_hex();
+}
+
+// Each shows or hides one thing, then goes back to the state before
+#define DISPLAY_ACTION(name, toggle) \
+    void display_##name() { \
+        if (state->help) return; \
+        toggle; \
+        leave_state(); \
+    }
+DISPLAY_ACTION(all, debugalltoggle())
+DISPLAY_ACTION(data, state->debug.data = !state->debug.data)
+DISPLAY_ACTION(graphics, toggle_graphics())
+DISPLAY_ACTION(neighbours, state->debug.neighbours = !state->debug.neighbours)
+DISPLAY_ACTION(objects, state->debug.objects = !state->debug.objects)
+DISPLAY_ACTION(pos, state->debug.pos = !state->debug.pos)
+DISPLAY_ACTION(switches, state->debug.switches = !state->debug.switches)
+DISPLAY_ACTION(unknowns, state->debug.unknowns = !state->debug.unknowns)
+#undef DISPLAY_ACTION
+
+void display_hex() {
+    toggle_hex();
+    if (!state->help) leave_state();
+}
+
+void display_leave_key() {
+    if (state->help) {
+        state->help = false;
+    } else {
+        leave_state();
+    }
+}
+
+// Room and switch details go back to TILE_EDIT, where Ctrl-r and Ctrl-s are
+void details_leave_key() {
+    if (state->help) {
+        state->help = false;
+    } else {
+        leave_state();
+        state->previous_state = TILE_EDIT;
+    }
+}
+
+// room_detail is the key for the detail, see redraw
+void edit_room_detail(game_state_state next, char detail) {
+    state->current_state = next;
+    state->current_switch = 0;
+    state->switch_on = false;
+    state->current_chunk = 0;
+    state->room_detail = detail;
+}
+
+void edit_room_north() { edit_room_detail(EDIT_ROOMDETAILS_ROOM, 'k'); }
+void edit_room_south() { edit_room_detail(EDIT_ROOMDETAILS_ROOM, 'j'); }
+void edit_room_east() { edit_room_detail(EDIT_ROOMDETAILS_ROOM, 'l'); }
+void edit_room_west() { edit_room_detail(EDIT_ROOMDETAILS_ROOM, 'h'); }
+void edit_room_number() { edit_room_detail(EDIT_ROOMDETAILS_NUM, typed_key); }
+
+void room_details_back() {
+    edit_room_detail(EDIT_ROOMDETAILS, 0);
+    clear_room_search();
+}
+
+void room_detail_leave_key() {
+    if (state->help) {
+        state->help = false;
+    } else {
+        room_details_back();
+    }
+}
+
+void room_detail_typed() {
+    if (state->debug.hex ? !isxdigit(typed_key) : !isdigit(typed_key)) return;
+    int digit = digit_value(typed_key);
+    if (!state->partial_byte) {
+        if (state->room_detail != 'e' || digit == 0) state->partial_byte = 0xFF00 | digit;
+        return;
+    }
+    size_t value = digit + (state->debug.hex ? 16 : 10) * (state->partial_byte & 0xFF);
+    struct DecompresssedRoom *room = &state->rooms.rooms[state->current_level].data;
+    switch (state->room_detail) {
+        case 'g': room->background = value; break;
+        case 't': room->tile_offset = value; break;
+        case 'd': room->room_damage = value; break;
+        case '|': room->gravity_vertical = value; break;
+        case '-': room->gravity_horizontal = value; break;
+
+        case 'b': room->UNKNOWN_b = value; break;
+        case 'c': room->UNKNOWN_c = value; break;
+        case 'e':
+            if ((value & ~0x3) == 0) {
+                room->_num_switches |= value;
+            }
+            break;
+
+        case 'f': room->UNKNOWN_f = value; break;
+
+        default: UNREACHABLE();
+    }
+    room_details_back();
+    save_room();
+}
+
+void room_neighbour_typed() {
+    size_t room_id;
+    if (!room_typed(&room_id)) return;
+    struct DecompresssedRoom *room = &state->rooms.rooms[state->current_level].data;
+    switch (state->room_detail) {
+        case 'k': room->room_north = room_id; break;
+        case 'j': room->room_south = room_id; break;
+        case 'l': room->room_east = room_id; break;
+        case 'h': room->room_west = room_id; break;
+        default: UNREACHABLE();
+    }
+    room_details_back();
+    save_room();
+}
+
+struct SwitchObject *editing_switch() {
+    assert(state->current_switch);
+    return state->rooms.rooms[state->current_level].data.switches + state->current_switch - 1;
+}
+
+struct SwitchChunk *editing_chunk() {
+    return SMALL_ARRAY_DATA(editing_switch()->chunks) + state->current_chunk;
+}
+
+// The details state for the current chunk, by its type and where it points
+void open_chunk() {
+    struct SwitchChunk *chunk = editing_chunk();
+    switch (chunk->type) {
+        case PREAMBLE: UNREACHABLE();
+        case TOGGLE_BLOCK:
+        {
+            size_t overflow = WIDTH_TILES * HEIGHT_TILES;
+            size_t point = chunk->y * WIDTH_TILES + chunk->x;
+            if (point >= overflow) {
+                state->current_state = EDIT_SWITCHDETAILS_CHUNK_MEMORY_DETAILS;
+            } else {
+                state->current_state = EDIT_SWITCHDETAILS_CHUNK_BLOCK_DETAILS;
+            }
+        }; break;
+
+        case TOGGLE_BIT:
+            state->current_state = EDIT_SWITCHDETAILS_CHUNK_SWITCH_DETAILS;
+            break;
+
+        case TOGGLE_OBJECT:
+            state->current_state = EDIT_SWITCHDETAILS_CHUNK_OBJECT_DETAILS;
+            break;
+
+        default: UNREACHABLE();
+    }
+}
+
+void delete_switch_key() {
+    struct DecompresssedRoom *room = &state->rooms.rooms[state->current_level].data;
+    size_t sw_i = editing_switch() - room->switches;
+    while (sw_i < (size_t)(room->num_switches - 1)) {
+        room->switches[sw_i] = room->switches[sw_i+1];
+        sw_i++;
+    }
+    memset(room->switches + sw_i, 0, sizeof(struct SwitchObject));
+    room->num_switches --;
+    leave_state();
+    clear_room_search();
+    save_room();
+}
+
+void swap_switch(int by) {
+    struct DecompresssedRoom *room = &state->rooms.rooms[state->current_level].data;
+    size_t sw_i = editing_switch() - room->switches;
+    if (sw_i + by >= room->num_switches) return;
+    struct SwitchObject sw = room->switches[sw_i];
+    room->switches[sw_i] = room->switches[sw_i+by];
+    room->switches[sw_i+by] = sw;
+    state->current_switch += by;
+    save_room();
+}
+
+void switch_earlier_key() { swap_switch(-1); }
+void switch_later_key() { swap_switch(+1); }
+
+void set_switch_side(enum SwitchSide side) {
+    SMALL_ARRAY_DATA(editing_switch()->chunks)[0].side = side;
+    save_room();
+}
+
+void switch_side_top() { set_switch_side(TOP); }
+void switch_side_right() { set_switch_side(RIGHT); }
+void switch_side_bottom() { set_switch_side(BOTTOM); }
+void switch_side_left() { set_switch_side(LEFT); }
+
+void cycle_switch_side() {
+    struct SwitchChunk *preamble = SMALL_ARRAY_DATA(editing_switch()->chunks);
+    preamble->side = (preamble->side + 1) % NUM_SIDES;
+    save_room();
+}
+
+void toggle_one_time_use() {
+    struct SwitchChunk *preamble = SMALL_ARRAY_DATA(editing_switch()->chunks);
+    preamble->one_time_use = !preamble->one_time_use;
+    save_room();
+}
+
+void toggle_room_entry() {
+    struct SwitchChunk *preamble = SMALL_ARRAY_DATA(editing_switch()->chunks);
+    preamble->room_entry = !preamble->room_entry;
+    save_room();
+}
+
+void add_chunk_key() {
+    struct SwitchObject *sw = editing_switch();
+    if (sw->chunks.length == 16) return;
+    state->current_chunk = sw->chunks.length;
+    ARENA_SMALL_ARRAY_ADD(&state->rooms.arena, sw->chunks, ((struct SwitchChunk){ .type = TOGGLE_BLOCK }));
+    state->current_state = EDIT_SWITCHDETAILS_CHUNK_BLOCK_DETAILS;
+    state->switch_on = false;
+    save_room();
+}
+
+// The first chunk is the preamble, uneditable as a chunk, only as a switch
+void edit_chunks_key() {
+    struct SwitchObject *sw = editing_switch();
+    assert(SMALL_ARRAY_DATA(sw->chunks)[0].type == PREAMBLE);
+    if (sw->chunks.length == 1) {
+        add_chunk_key();
+    } else if (sw->chunks.length == 2) {
+        state->current_chunk = 1;
+        open_chunk();
+    } else {
+        state->current_state = EDIT_SWITCHDETAILS_SELECT_CHUNK;
+    }
+}
+
+void select_chunk_typed() {
+    if (!isxdigit(typed_key)) return;
+    struct SwitchObject *sw = editing_switch();
+    if (sw->chunks.length > 16) {
+        // FIXME support 2 digit nums, remove define above when done (used in staticdefines)
+        fprintf(stderr, "%s:%d: UNIMPLEMENTED: support two digit numbers", __FILE__, __LINE__);
+        UNREACHABLE();
+    }
+    size_t id = digit_value(typed_key);
+    if (id > 0 && id < sw->chunks.length) {
+        state->current_chunk = id;
+        open_chunk();
+    }
+}
+
+void new_chunk_key() {
+    struct SwitchObject *sw = editing_switch();
+    if (sw->chunks.length == 16) return;
+    ARENA_SMALL_ARRAY_ADD(&state->rooms.arena, sw->chunks, ((struct SwitchChunk){ .type = TOGGLE_BLOCK }));
+    state->switch_on = false;
+    save_room();
+}
+
+void select_chunk_leave_key() {
+    if (state->help) {
+        state->help = false;
+    } else {
+        state->current_state = EDIT_SWITCHDETAILS;
+    }
+}
+
+void chunk_leave_key() {
+    if (state->help) {
+        state->help = false;
+    } else if (state->partial_byte) {
+        state->partial_byte = 0;
+    } else {
+        if (editing_switch()->chunks.length <= 2) {
+            state->current_state = EDIT_SWITCHDETAILS;
+        } else {
+            state->current_state = EDIT_SWITCHDETAILS_SELECT_CHUNK;
+        }
+        state->current_chunk = 0;
+    }
+}
+
+void delete_chunk_key() {
+    if (state->partial_byte) {
+        state->partial_byte = 0;
+        return;
+    }
+    if (!state->current_chunk) UNREACHABLE();
+    struct SwitchObject *sw = editing_switch();
+    size_t ch_i = state->current_chunk;
+    if (sw->chunks.length <= 1) UNREACHABLE();
+    while (ch_i < sw->chunks.length - 1) {
+        SMALL_ARRAY_DATA(sw->chunks)[ch_i] = SMALL_ARRAY_DATA(sw->chunks)[ch_i+1];
+        ch_i++;
+    }
+    memset(SMALL_ARRAY_DATA(sw->chunks) + ch_i, 0, sizeof(struct SwitchChunk));
+    sw->chunks.length --;
+    save_room();
+    if (state->current_chunk > 2) state->current_chunk --;
+    switch (sw->chunks.length) {
+        case 1: state->current_state = EDIT_SWITCHDETAILS; break;
+        case 2:
+            state->current_chunk = 1;
+            open_chunk();
+            break;
+
+        default: state->current_state = EDIT_SWITCHDETAILS_SELECT_CHUNK;
+    }
+}
+
+// A block chunk inside the room goes to one past it, into the room's memory,
+// before it becomes the next type
+void cycle_chunk_type() {
+    struct SwitchChunk *chunk = editing_chunk();
+    enum SwitchChunkType typ = chunk->type;
+    switch (typ) {
+        case TOGGLE_BLOCK:
+        {
+            size_t overflow = WIDTH_TILES * HEIGHT_TILES;
+            size_t point = chunk->y * WIDTH_TILES + chunk->x;
+            if (point < overflow) {
+                memset(chunk, 0, sizeof(*chunk));
+                chunk->type = TOGGLE_BLOCK;
+                chunk->x = 0;
+                chunk->y = HEIGHT_TILES;
+                chunk->size = 1;
+                state->current_state = EDIT_SWITCHDETAILS_CHUNK_MEMORY_DETAILS;
+                break;
+            }
+        }; fallthrough;
+        default:
+            memset(chunk, 0, sizeof(*chunk));
+            chunk->type = (typ + 1) % NUM_CHUNK_TYPES;
+            if (chunk->type == PREAMBLE) chunk->type = (chunk->type + 1) % NUM_CHUNK_TYPES;
+            if (chunk->type == TOGGLE_BIT) chunk->bitmask = 0x1;
+            open_chunk();
+    }
+    save_room();
+}
+
+void swap_chunk(int by) {
+    struct SwitchObject *sw = editing_switch();
+    size_t ch_i = state->current_chunk;
+    // Not with the preamble
+    if (ch_i + by < 1 || ch_i + by >= sw->chunks.length) return;
+    struct SwitchChunk ch = SMALL_ARRAY_DATA(sw->chunks)[ch_i];
+    SMALL_ARRAY_DATA(sw->chunks)[ch_i] = SMALL_ARRAY_DATA(sw->chunks)[ch_i+by];
+    SMALL_ARRAY_DATA(sw->chunks)[ch_i+by] = ch;
+    state->current_chunk += by;
+    save_room();
+}
+
+void chunk_earlier_key() { swap_chunk(-1); }
+void chunk_later_key() { swap_chunk(+1); }
+
+void toggle_switch_on() {
+    state->switch_on = !state->switch_on;
+    state->partial_byte = 0;
+}
+
+void chunk_switch_typed() {
+    size_t index;
+    if (!byte_typed(&index)) return;
+    struct SwitchChunk *chunk = editing_chunk();
+    assert(chunk->type == TOGGLE_BIT);
+    chunk->switch_idx = index;
+    save_room();
+}
+
+void chunk_switch_room_key() { state->current_state = EDIT_SWITCHDETAILS_CHUNK_SWITCH_DETAILS_ROOM; }
+
+void cycle_chunk_off() {
+    struct SwitchChunk *chunk = editing_chunk();
+    assert(chunk->type == TOGGLE_BIT);
+    chunk->off = (chunk->off + 1) % 4;
+    save_room();
+}
+
+void cycle_chunk_on() {
+    struct SwitchChunk *chunk = editing_chunk();
+    assert(chunk->type == TOGGLE_BIT);
+    chunk->on = (chunk->on + 1) % 4;
+    save_room();
+}
+
+void chunk_switch_room_back() {
+    state->current_state = EDIT_SWITCHDETAILS_CHUNK_SWITCH_DETAILS;
+    state->partial_byte = 0;
+    load_room_name();
+}
+
+void chunk_switch_room_typed() {
+    size_t room;
+    if (!room_typed(&room)) return;
+    struct SwitchChunk *chunk = editing_chunk();
+    assert(chunk->type == TOGGLE_BIT);
+    chunk->room_idx = room;
+    chunk->switch_idx = 0;
+    chunk_switch_room_back();
+    save_room();
+}
+
+void chunk_switch_room_leave_key() {
+    if (state->help) {
+        state->help = false;
+    } else {
+        chunk_switch_room_back();
+    }
+}
+
+// Block chunks take what the tiles they cover are, with the switch off or on
+void chunk_tile_typed() {
+    size_t value;
+    if (!byte_typed(&value)) return;
+    struct SwitchChunk *chunk = editing_chunk();
+    assert(chunk->type == TOGGLE_BLOCK);
+    if (state->switch_on) {
+        chunk->on = value;
+    } else {
+        chunk->off = value;
+    }
+    save_room();
+}
+
+void grow_chunk() {
+    struct SwitchChunk *chunk = editing_chunk();
+    assert(chunk->type == TOGGLE_BLOCK);
+    if (chunk->size < 8) chunk->size ++;
+    save_room();
+}
+
+void shrink_chunk() {
+    struct SwitchChunk *chunk = editing_chunk();
+    assert(chunk->type == TOGGLE_BLOCK);
+    if (chunk->size > 1) chunk->size --;
+    save_room();
+}
+
+void cycle_chunk_dir() {
+    struct SwitchChunk *chunk = editing_chunk();
+    assert(chunk->type == TOGGLE_BLOCK);
+    chunk->dir = (chunk->dir + 1) % NUM_DIRECTIONS;
+    save_room();
+}
+
+// A block chunk past the bottom of the room points into its memory instead
+void move_chunk(int dx, int dy) {
+    struct SwitchChunk *chunk = editing_chunk();
+    assert(chunk->type == TOGGLE_BLOCK);
+    if ((int)chunk->x + dx < 0 || (int)chunk->y + dy < 0) return;
+    chunk->x += dx;
+    chunk->y += dy;
+    size_t overflow = WIDTH_TILES * HEIGHT_TILES;
+    size_t point = chunk->y * WIDTH_TILES + chunk->x;
+    if (point >= overflow) {
+        state->current_state = EDIT_SWITCHDETAILS_CHUNK_MEMORY_DETAILS;
+    }
+    save_room();
+}
+
+void chunk_left() { move_chunk(-1, 0); }
+void chunk_down() { move_chunk(0, +1); }
+void chunk_up() { move_chunk(0, -1); }
+void chunk_right() { move_chunk(+1, 0); }
+
+// In the room's memory, from the byte after the tiles to the end marker, the
+// first wrapping around to the last
+void chunk_back() {
+    struct SwitchChunk *chunk = editing_chunk();
+    assert(chunk->type == TOGGLE_BLOCK);
+    if (chunk->x) {
+        chunk->x --;
+    } else {
+        if (chunk->y == HEIGHT_TILES) {
+            chunk->y = (offsetof(struct DecompresssedRoom, end_marker) - 1) / WIDTH_TILES;
+            chunk->x = (offsetof(struct DecompresssedRoom, end_marker) - 1) % WIDTH_TILES;
+        } else {
+            chunk->y --;
+            chunk->x = WIDTH_TILES - 1;
+        }
+    }
+    save_room();
+}
+
+void chunk_forward() {
+    struct SwitchChunk *chunk = editing_chunk();
+    assert(chunk->type == TOGGLE_BLOCK);
+    chunk->x ++;
+    if (chunk->x == WIDTH_TILES) {
+        chunk->x = 0;
+        chunk->y ++;
+    }
+    size_t overflow = WIDTH_TILES * HEIGHT_TILES;
+    size_t point = chunk->y * WIDTH_TILES + chunk->x;
+    size_t offset = point - overflow;
+    size_t end = offsetof(struct DecompresssedRoom, end_marker) - overflow;
+    if (offset >= end) {
+        chunk->y = HEIGHT_TILES;
+        chunk->x = 0;
+    }
+    save_room();
+}
+
+void chunk_object_typed() {
+    size_t value;
+    if (!byte_typed(&value)) return;
+    struct SwitchChunk *chunk = editing_chunk();
+    assert(chunk->type == TOGGLE_OBJECT);
+    chunk->value = value;
+    save_room();
+}
+
+void cycle_chunk_index() {
+    struct SwitchChunk *chunk = editing_chunk();
+    chunk->index = (chunk->index + 1) % 0x10;
+    save_room();
+}
+
+void cycle_chunk_test() {
+    struct SwitchChunk *chunk = editing_chunk();
+    chunk->test = (((chunk->test >> 4) + 1) % 4) << 4;
+    save_room();
+}
+
+// The tile under the cursor, or what covers it: a block object's tile, a
+// sprite's type and damage, or what a switch chunk turns it to
+void tile_typed() {
+    size_t value;
+    if (!byte_typed(&value)) return;
+    bool obj = false;
+    bool ch = false;
+    int x = state->cursors[state->current_level].x;
+    int y = state->cursors[state->current_level].y;
+    struct DecompresssedRoom *room = &state->rooms.rooms[state->current_level].data;
+    for (size_t i = 0; i < room->num_objects; i ++) {
+        struct RoomObject *object = room->objects + i;
+        if (object->type == BLOCK &&
+                x >= object->x && x < object->x + object->block.width &&
+                y >= object->y && y < object->y + object->block.height) {
+            obj = true;
+            object->tiles[(y - object->y) * object->block.width + (x - object->x)] = value;
+            break;
+        } else if (object->type == SPRITE && x == object->x && y == object->y) {
+            obj = true;
+            object->sprite.type = value >> 4;
+            object->sprite.damage = value & 0xF;
+            break;
+        }
+    }
+    if (!obj) {
+        struct SwitchObject *switcch = NULL;
+        struct SwitchChunk *chunk = NULL;
+        for (size_t i = 0; i < room->num_switches; i ++) {
+            switcch = room->switches + i;
+            for (size_t c = 1; c < switcch->chunks.length; c ++) {
+                chunk = SMALL_ARRAY_DATA(switcch->chunks) + c;
+                if (chunk->type == TOGGLE_BLOCK &&
+                        ((chunk->dir == VERTICAL && x == chunk->x && y >= chunk->y && y < chunk->y + chunk->size) ||
+                         (chunk->dir == HORIZONTAL && y == chunk->y && x >= chunk->x && x < chunk->x + chunk->size))) {
+                    ch = true;
+                    break;
+                }
+            }
+            if (ch) {
+                // FIXME split up chunks, need one for this byte, and potentially 2 more for either end
+                chunk->on = value;
+                break;
+            }
+        }
+    }
+    if (!obj && !ch) room->tiles[TILE_IDX(x, y)] = value;
+    save_room();
+}
 
-                                    default: UNREACHABLE();
-                                }
+// The object, switch, or switch chunk under the cursor swaps places with the
+// one before or after it, which is drawn under or over it
+void swap_underneath(int by) {
+    struct RoomObject *object_underneath = NULL;
+    struct SwitchObject *switch_underneath = NULL;
+    struct SwitchChunk *chunk_underneath = NULL;
+    struct SwitchObject *chunk_switch_underneath = NULL;
 
-                        }
-                        ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                        assert(writeRooms(&state->rooms));
-                    } else if (iscntrl(buf[i])) {
-                        switch (buf[i] + 'A' - 1) {
-                            case '_': state->help = !state->help; break;
-                            case 'H': state->debug.hex = !state->debug.hex; break;
-                        }
-                    } else if (buf[i] == 'q') {
-                        if (state->help) {
-                            state->help = !state->help;
-                        } else {
-                            if (state->partial_byte) {
-                                state->partial_byte = 0;
-                            } else {
-                                struct SwitchObject *sw = state->rooms.rooms[*cursorlevel].data.switches + state->current_switch - 1;
-                                if (sw->chunks.length <= 2) {
-                                    state->current_state = EDIT_SWITCHDETAILS;
-                                } else {
-                                    state->current_state = EDIT_SWITCHDETAILS_SELECT_CHUNK;
-                                }
-                                state->current_chunk = 0;
-                            }
-                        }
-                    } else if (buf[i] == '?') {
-                        state->help = !state->help;
-                    } else if (buf[i] == '+') {
-                        if (state->current_switch) {
-                            struct SwitchObject *sw = state->rooms.rooms[*cursorlevel].data.switches + state->current_switch - 1;
-                            struct SwitchChunk ch = sw->chunks.data[state->current_chunk];
-                            if (state->current_chunk < sw->chunks.length - 1) {
-                                sw->chunks.data[state->current_chunk] = sw->chunks.data[state->current_chunk+1];
-                                sw->chunks.data[state->current_chunk+1] = ch;
-                                state->current_chunk ++;
-                                ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                                assert(writeRooms(&state->rooms));
-                            }
-                        }
-                    } else if (buf[i] == '-') {
-                        if (state->current_switch) {
-                            struct SwitchObject *sw = state->rooms.rooms[*cursorlevel].data.switches + state->current_switch - 1;
-                            struct SwitchChunk ch = sw->chunks.data[state->current_chunk];
-                            if (state->current_chunk > 1) {
-                                sw->chunks.data[state->current_chunk] = sw->chunks.data[state->current_chunk-1];
-                                sw->chunks.data[state->current_chunk-1] = ch;
-                                state->current_chunk --;
-                                ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                                assert(writeRooms(&state->rooms));
-                            }
-                        }
-                    } else if (buf[i] == 'p') {
-                        signal(SIGCHLD, SIG_IGN);
-                        pid_t child = fork();
-                        if (child == 0) {
-                            if (state != NULL) {
-                                freeRoomFile(&state->rooms);
-                                free(state);
-                            }
-                            pid_t sid = fork();
-                            if (sid == -1) exit(EXIT_FAILURE);
-                            if (sid > 0) exit(EXIT_SUCCESS);
-                            if (setsid() == -1) exit(EXIT_FAILURE);
-                            execv("./play.sh", (char**){0});
-                            exit(EXIT_FAILURE);
-                        }
+    struct DecompresssedRoom *room = &state->rooms.rooms[state->current_level].data;
+    int x = state->cursors[state->current_level].x;
+    int y = state->cursors[state->current_level].y;
+    int i;
+    for (i = 0; i < room->num_objects; i ++) {
+        struct RoomObject *object = room->objects + i;
+        if (object->type == BLOCK &&
+                x >= object->x && x < object->x + object->block.width &&
+                y >= object->y && y < object->y + object->block.height) {
+            object_underneath = object;
+            break;
+        } else if (object->type == SPRITE && x == object->x && y == object->y) {
+            object_underneath = object;
+            break;
+        }
+    }
+    int obj_i = i;
+    for (i = 0; i < room->num_switches; i ++) {
+        struct SwitchObject *switcch = room->switches + i;
+        if (switcch->chunks.length > 0 && SMALL_ARRAY_DATA(switcch->chunks)[0].type == PREAMBLE &&
+                x == SMALL_ARRAY_DATA(switcch->chunks)[0].x && y == SMALL_ARRAY_DATA(switcch->chunks)[0].y) {
+            switch_underneath = switcch;
+            break;
+        }
+    }
+    int sw_i = i;
+    int c;
+    for (i = 0; i < room->num_switches; i ++) {
+        struct SwitchObject *switcch = room->switches + i;
+        for (c = 1; c < (signed) switcch->chunks.length; c ++) {
+            struct SwitchChunk *chunk = SMALL_ARRAY_DATA(switcch->chunks) + c;
+            if (chunk->type == TOGGLE_BLOCK) {
+                if (chunk->dir == HORIZONTAL) {
+                    if (y == chunk->y && x >= chunk->x && x < chunk->x + chunk->size) {
+                        chunk_switch_underneath = switcch;
+                        chunk_underneath = chunk;
+                        break;
                     }
-                    i ++;
-                }; break;
-
-                case EDIT_SWITCHDETAILS_CHUNK_BLOCK_DETAILS:
-                {
-                    if (isxdigit(buf[i])) {
-                        uint8_t b = 0;
-                        if (isdigit(buf[i])) {
-                            b = *buf - '0';
-                        } else {
-                            b = 10 + tolower(buf[i]) - 'a';
-                        }
-                        if ((state->partial_byte & 0xFF00) != 0) {
-                            size_t value = b;
-                            if (state->debug.hex) {
-                                value += 16 * (state->partial_byte & 0xFF);
-                            } else {
-                                value += 10 * (state->partial_byte & 0xFF);
-                            }
-                            struct SwitchObject *sw = state->rooms.rooms[*cursorlevel].data.switches + state->current_switch - 1;
-                            struct SwitchChunk *chunk = sw->chunks.data + state->current_chunk;
-                            assert(chunk->type == TOGGLE_BLOCK);
-                            if (state->switch_on) {
-                                chunk->on = value;
-                            } else {
-                                chunk->off = value;
-                            }
-                            state->partial_byte = 0;
-                            ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                            assert(writeRooms(&state->rooms));
-                        } else {
-                            state->partial_byte = 0xFF00 | b;
-                        }
-                    } else if (buf[i] == 'o') {
-                        state->switch_on = !state->switch_on;
-                        state->partial_byte = 0;
-                    } else if (buf[i] == ' ') {
-                        struct SwitchObject *sw = state->rooms.rooms[*cursorlevel].data.switches + state->current_switch - 1;
-                        struct SwitchChunk *chunk = sw->chunks.data + state->current_chunk;
-                        assert(chunk->type == TOGGLE_BLOCK);
-                        chunk->dir = (chunk->dir + 1) % NUM_DIRECTIONS;
-                        ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                        assert(writeRooms(&state->rooms));
-                    } else if (buf[i] == '^') {
-                        struct SwitchObject *sw = state->rooms.rooms[*cursorlevel].data.switches + state->current_switch - 1;
-                        struct SwitchChunk *chunk = sw->chunks.data + state->current_chunk;
-                        assert(chunk->type == TOGGLE_BLOCK);
-                        if (chunk->size < 8) chunk->size ++;
-                        ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                        assert(writeRooms(&state->rooms));
-                    } else if (buf[i] == 'v') {
-                        struct SwitchObject *sw = state->rooms.rooms[*cursorlevel].data.switches + state->current_switch - 1;
-                        struct SwitchChunk *chunk = sw->chunks.data + state->current_chunk;
-                        assert(chunk->type == TOGGLE_BLOCK);
-                        if (chunk->size > 1) chunk->size --;
-                        ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                        assert(writeRooms(&state->rooms));
-                    } else if (buf[i] == 'h') {
-                        struct SwitchObject *sw = state->rooms.rooms[*cursorlevel].data.switches + state->current_switch - 1;
-                        struct SwitchChunk *chunk = sw->chunks.data + state->current_chunk;
-                        assert(chunk->type == TOGGLE_BLOCK);
-                        if (chunk->x) chunk->x --;
-                        ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                        assert(writeRooms(&state->rooms));
-                    } else if (buf[i] == 'j') {
-                        struct SwitchObject *sw = state->rooms.rooms[*cursorlevel].data.switches + state->current_switch - 1;
-                        struct SwitchChunk *chunk = sw->chunks.data + state->current_chunk;
-                        assert(chunk->type == TOGGLE_BLOCK);
-                        chunk->y ++;
-                        size_t overflow = WIDTH_TILES * HEIGHT_TILES;
-                        size_t point = chunk->y * WIDTH_TILES + chunk->x;
-                        if (point >= overflow) {
-                            state->current_state = EDIT_SWITCHDETAILS_CHUNK_MEMORY_DETAILS;
-                        }
-                        ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                        assert(writeRooms(&state->rooms));
-                    } else if (buf[i] == 'k') {
-                        struct SwitchObject *sw = state->rooms.rooms[*cursorlevel].data.switches + state->current_switch - 1;
-                        struct SwitchChunk *chunk = sw->chunks.data + state->current_chunk;
-                        assert(chunk->type == TOGGLE_BLOCK);
-                        if (chunk->y) chunk->y --;
-                        ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                        assert(writeRooms(&state->rooms));
-                    } else if (buf[i] == 'l') {
-                        struct SwitchObject *sw = state->rooms.rooms[*cursorlevel].data.switches + state->current_switch - 1;
-                        struct SwitchChunk *chunk = sw->chunks.data + state->current_chunk;
-                        assert(chunk->type == TOGGLE_BLOCK);
-                        chunk->x ++;
-                        size_t overflow = WIDTH_TILES * HEIGHT_TILES;
-                        size_t point = chunk->y * WIDTH_TILES + chunk->x;
-                        if (point >= overflow) {
-                            state->current_state = EDIT_SWITCHDETAILS_CHUNK_MEMORY_DETAILS;
-                        }
-                        ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                        assert(writeRooms(&state->rooms));
-                    } else if (buf[i] == 0x7f) {
-                        if (state->partial_byte) {
-                            state->partial_byte = 0;
-                        } else {
-                            if (!state->current_switch) UNREACHABLE();
-                            if (!state->current_chunk) UNREACHABLE();
-                            struct DecompresssedRoom *room = &state->rooms.rooms[state->current_level].data;
-                            struct SwitchObject *sw = room->switches + state->current_switch - 1;
-                            size_t ch_i = state->current_chunk;
-                            if (sw->chunks.length <= 1) UNREACHABLE();
-                            while (ch_i < sw->chunks.length - 1) {
-                                sw->chunks.data[ch_i] = sw->chunks.data[ch_i+1];
-                                ch_i++;
-                            }
-                            memset(sw->chunks.data + ch_i, 0, sizeof(struct SwitchChunk));
-                            sw->chunks.length --;
-                            ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                            assert(writeRooms(&state->rooms));
-                            if (state->current_chunk > 2) state->current_chunk --;
-                            switch (sw->chunks.length) {
-                                case 1: state->current_state = EDIT_SWITCHDETAILS; break;
-                                case 2:
-                                {
-                                    switch (sw->chunks.data[1].type) {
-                                        case PREAMBLE: UNREACHABLE();
-                                        case TOGGLE_BIT:
-                                            state->current_state = EDIT_SWITCHDETAILS_CHUNK_SWITCH_DETAILS;
-                                            break;
-
-                                        case TOGGLE_OBJECT:
-                                            state->current_state = EDIT_SWITCHDETAILS_CHUNK_OBJECT_DETAILS;
-                                            break;
-
-                                        case TOGGLE_BLOCK:
-                                        {
-                                            size_t overflow = WIDTH_TILES * HEIGHT_TILES;
-                                            size_t point = sw->chunks.data[1].y * WIDTH_TILES + sw->chunks.data[1].x;
-                                            if (point >= overflow) {
-                                                state->current_state = EDIT_SWITCHDETAILS_CHUNK_MEMORY_DETAILS;
-                                            } else {
-                                                state->current_state = EDIT_SWITCHDETAILS_CHUNK_BLOCK_DETAILS;
-                                            }
-                                        }; break;
+                } else if (x == chunk->x && y >= chunk->y && y < chunk->y + chunk->size) {
+                    chunk_switch_underneath = switcch;
+                    chunk_underneath = chunk;
+                    break;
+                }
+            }
+        }
+        if (chunk_underneath) break;
+    }
 
-                                        default: UNREACHABLE();
-                                    }
-                                }; break;
+    if (object_underneath) {
+        if (obj_i + by >= 0 && obj_i + by < room->num_objects) {
+            struct RoomObject object = *object_underneath;
+            room->objects[obj_i] = room->objects[obj_i+by];
+            room->objects[obj_i+by] = object;
+        }
+    } else if (switch_underneath) {
+        if (sw_i + by >= 0 && sw_i + by < room->num_switches) {
+            struct SwitchObject sw = *switch_underneath;
+            room->switches[sw_i] = room->switches[sw_i+by];
+            room->switches[sw_i+by] = sw;
+        }
+    } else if (chunk_underneath) {
+        // Not with the preamble
+        if (c + by >= 1 && c + by < (signed) chunk_switch_underneath->chunks.length) {
+            struct SwitchChunk ch = *chunk_underneath;
+            SMALL_ARRAY_DATA(chunk_switch_underneath->chunks)[c] = SMALL_ARRAY_DATA(chunk_switch_underneath->chunks)[c+by];
+            SMALL_ARRAY_DATA(chunk_switch_underneath->chunks)[c+by] = ch;
+        }
+    }
+    save_room();
+}
 
-                                default: state->current_state = EDIT_SWITCHDETAILS_SELECT_CHUNK;
-                            }
-                        }
-                    } else if (buf[i] == ESCAPE) {
-                        if (i + 1 < n && buf[i+1] == '[' && i + 2 < n) {
-                            // CSI sequence
-                            i += 2;
-                            uint8_t arg = 0;
-                            while (i < n) {
-                                if (isdigit(buf[i])) {
-                                    arg = 10 * arg + buf[i] - '0';
-                                } else if (buf[i] == ';') {
-                                    arg = 0;
-                                } else {
-                                    switch (buf[i]) {
-                                        case '~':
-                                        {
-                                            switch (arg) {
-                                                case 3:
-                                                {
-                                                    if (state->partial_byte) {
-                                                        state->partial_byte = 0;
-                                                    } else {
-                                                        if (!state->current_switch) UNREACHABLE();
-                                                        if (!state->current_chunk) UNREACHABLE();
-                                                        struct DecompresssedRoom *room = &state->rooms.rooms[state->current_level].data;
-                                                        struct SwitchObject *sw = room->switches + state->current_switch - 1;
-                                                        size_t ch_i = state->current_chunk;
-                                                        if (sw->chunks.length <= 1) UNREACHABLE();
-                                                        while (ch_i < sw->chunks.length - 1) {
-                                                            sw->chunks.data[ch_i] = sw->chunks.data[ch_i+1];
-                                                            ch_i++;
-                                                        }
-                                                        memset(sw->chunks.data + ch_i, 0, sizeof(struct SwitchChunk));
-                                                        sw->chunks.length --;
-                                                        ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                                                        assert(writeRooms(&state->rooms));
-                                                        if (state->current_chunk > 2) state->current_chunk --;
-                                                        switch (sw->chunks.length) {
-                                                            case 1: state->current_state = EDIT_SWITCHDETAILS; break;
-                                                            case 2:
-                                                                    {
-                                                                        switch (sw->chunks.data[1].type) {
-                                                                            case PREAMBLE: UNREACHABLE();
-                                                                            case TOGGLE_BIT:
-                                                                                           state->current_state = EDIT_SWITCHDETAILS_CHUNK_SWITCH_DETAILS;
-                                                                                           break;
-
-                                                                            case TOGGLE_OBJECT:
-                                                                                           state->current_state = EDIT_SWITCHDETAILS_CHUNK_OBJECT_DETAILS;
-                                                                                           break;
-
-                                                                            case TOGGLE_BLOCK:
-                                                                                           {
-                                                                                               size_t overflow = WIDTH_TILES * HEIGHT_TILES;
-                                                                                               size_t point = sw->chunks.data[1].y * WIDTH_TILES + sw->chunks.data[1].x;
-                                                                                               if (point >= overflow) {
-                                                                                                   state->current_state = EDIT_SWITCHDETAILS_CHUNK_MEMORY_DETAILS;
-                                                                                               } else {
-                                                                                                   state->current_state = EDIT_SWITCHDETAILS_CHUNK_BLOCK_DETAILS;
-                                                                                               }
-                                                                                           }; break;
-
-                                                                            default: UNREACHABLE();
-                                                                        }
-                                                                    }; break;
-
-                                                            default: state->current_state = EDIT_SWITCHDETAILS_SELECT_CHUNK;
-                                                        }
-                                                    }
-                                                }; break;
-
-                                                default: fprintf(stderr, "%s:%d: UNIMPLEMENTED: csi terminator %c arg %d", __FILE__, __LINE__, buf[i], arg);
-                                            }
-                                        }; break;
-
-                                        case 'A':
-                                        {
-                                            struct SwitchObject *sw = state->rooms.rooms[*cursorlevel].data.switches + state->current_switch - 1;
-                                            struct SwitchChunk *chunk = sw->chunks.data + state->current_chunk;
-                                            assert(chunk->type == TOGGLE_BLOCK);
-                                            if (chunk->y) chunk->y --;
-                                            ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                                            assert(writeRooms(&state->rooms));
-                                        }; break;
-
-                                        case 'B':
-                                        {
-                                            struct SwitchObject *sw = state->rooms.rooms[*cursorlevel].data.switches + state->current_switch - 1;
-                                            struct SwitchChunk *chunk = sw->chunks.data + state->current_chunk;
-                                            assert(chunk->type == TOGGLE_BLOCK);
-                                            chunk->y ++;
-                                            size_t overflow = WIDTH_TILES * HEIGHT_TILES;
-                                            size_t point = chunk->y * WIDTH_TILES + chunk->x;
-                                            if (point >= overflow) {
-                                                state->current_state = EDIT_SWITCHDETAILS_CHUNK_MEMORY_DETAILS;
-                                            }
-                                            ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                                            assert(writeRooms(&state->rooms));
-                                        }; break;
-
-                                        case 'C':
-                                        {
-                                            struct SwitchObject *sw = state->rooms.rooms[*cursorlevel].data.switches + state->current_switch - 1;
-                                            struct SwitchChunk *chunk = sw->chunks.data + state->current_chunk;
-                                            assert(chunk->type == TOGGLE_BLOCK);
-                                            chunk->x ++;
-                                            size_t overflow = WIDTH_TILES * HEIGHT_TILES;
-                                            size_t point = chunk->y * WIDTH_TILES + chunk->x;
-                                            if (point >= overflow) {
-                                                state->current_state = EDIT_SWITCHDETAILS_CHUNK_MEMORY_DETAILS;
-                                            }
-                                            ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                                            assert(writeRooms(&state->rooms));
-                                        }; break;
-
-                                        case 'D':
-                                        {
-                                            struct SwitchObject *sw = state->rooms.rooms[*cursorlevel].data.switches + state->current_switch - 1;
-                                            struct SwitchChunk *chunk = sw->chunks.data + state->current_chunk;
-                                            assert(chunk->type == TOGGLE_BLOCK);
-                                            if (chunk->x) chunk->x --;
-                                            ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                                            assert(writeRooms(&state->rooms));
-                                        }; break;
-
-                                        default: fprintf(stderr, "%s:%d: UNIMPLEMENTED: csi terminator %c arg %d", __FILE__, __LINE__, buf[i], arg);
-                                    }
-                                    break;
-                                }
-                                i ++;
-                            }
-                        } else if (state->help) {
-                            state->help = false;
-                        } else {
-                            if (state->partial_byte) {
-                                state->partial_byte = 0;
-                            } else {
-                                struct SwitchObject *sw = state->rooms.rooms[*cursorlevel].data.switches + state->current_switch - 1;
-                                if (sw->chunks.length <= 2) {
-                                    state->current_state = EDIT_SWITCHDETAILS;
-                                } else {
-                                    state->current_state = EDIT_SWITCHDETAILS_SELECT_CHUNK;
-                                }
-                                state->current_chunk = 0;
-                            }
-                        }
-                    } else if (buf[i] == 't') {
-                        struct SwitchObject *sw = state->rooms.rooms[*cursorlevel].data.switches + state->current_switch - 1;
-                        struct SwitchChunk *chunk = sw->chunks.data + state->current_chunk;
-                        enum SwitchChunkType typ = chunk->type;
-                        switch (typ) {
-                            case TOGGLE_BLOCK:
-                            {
-                                size_t overflow = WIDTH_TILES * HEIGHT_TILES;
-                                size_t point = chunk->y * WIDTH_TILES + chunk->x;
-                                if (point < overflow) {
-                                    memset(chunk, 0, sizeof(*chunk));
-                                    chunk->type = TOGGLE_BLOCK;
-                                    chunk->x = 0;
-                                    chunk->y = HEIGHT_TILES;
-                                    chunk->size = 1;
-                                    state->current_state = EDIT_SWITCHDETAILS_CHUNK_MEMORY_DETAILS;
-                                    break;
-                                }
-                            }; fallthrough;
-                            default:
-                                memset(chunk, 0, sizeof(*chunk));
-                                chunk->type = (typ + 1) % NUM_CHUNK_TYPES;
-                                if (chunk->type == PREAMBLE) chunk->type = (chunk->type + 1) % NUM_CHUNK_TYPES;
-                                switch (chunk->type) {
-                                    case TOGGLE_BIT:
-                                        state->current_state = EDIT_SWITCHDETAILS_CHUNK_SWITCH_DETAILS;
-                                        chunk->bitmask = 0x1;
-                                        break;
+void swap_earlier_key() { swap_underneath(-1); }
+void swap_later_key() { swap_underneath(+1); }
 
-                                    case TOGGLE_OBJECT:
-                                        state->current_state = EDIT_SWITCHDETAILS_CHUNK_OBJECT_DETAILS;
-                                        break;
+void edit_roomdetails_key() { enter_state(EDIT_ROOMDETAILS); }
 
-                                    case TOGGLE_BLOCK:
-                                        state->current_state = EDIT_SWITCHDETAILS_CHUNK_BLOCK_DETAILS;
-                                        break;
+// The switch being edited, or the one at the cursor, made if there is none
+void edit_switchdetails_key() {
+    state->previous_state = state->current_state;
+    state->current_state = EDIT_SWITCHDETAILS;
+    if (state->current_switch) return;
+    struct DecompresssedRoom *room = &state->rooms.rooms[state->current_level].data;
+    size_t x = state->cursors[state->current_level].x;
+    size_t y = state->cursors[state->current_level].y;
+    size_t i = 0;
+    while (i < room->num_switches) {
+        struct SwitchObject *sw = room->switches + i;
+        if (sw->chunks.length && SMALL_ARRAY_DATA(sw->chunks)[0].x == x && SMALL_ARRAY_DATA(sw->chunks)[0].y == y) {
+            break;
+        }
+        i ++;
+    }
+    if (i == room->num_switches) {
+        room->switches = arenaRealloc(&state->rooms.arena, room->switches, i * sizeof(struct SwitchObject), (i + 1) * sizeof(struct SwitchObject));
+        room->num_switches ++;
+        struct SwitchObject *sw = room->switches + i;
+        ARENA_SMALL_ARRAY_ADD(&state->rooms.arena, sw->chunks, ((struct SwitchChunk){ .type = PREAMBLE, .x = x, .y = y }));
+    }
+    save_room();
+    state->current_switch = i + 1;
+}
 
-                                    default: UNREACHABLE();
-                                }
+typedef void (*key_action)();
 
-                        }
-                        ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                        assert(writeRooms(&state->rooms));
-                    } else if (iscntrl(buf[i])) {
-                        switch (buf[i] + 'A' - 1) {
-                            case '_': state->help = !state->help; break;
-                            case 'H': state->debug.hex = !state->debug.hex; break;
-                        }
-                    } else if (buf[i] == 'q') {
-                        if (state->help) {
-                            state->help = !state->help;
-                        } else {
-                            if (state->partial_byte) {
-                                state->partial_byte = 0;
-                            } else {
-                                struct SwitchObject *sw = state->rooms.rooms[*cursorlevel].data.switches + state->current_switch - 1;
-                                if (sw->chunks.length <= 2) {
-                                    state->current_state = EDIT_SWITCHDETAILS;
-                                } else {
-                                    state->current_state = EDIT_SWITCHDETAILS_SELECT_CHUNK;
-                                }
-                                state->current_chunk = 0;
-                            }
-                        }
-                    } else if (buf[i] == '?') {
-                        state->help = !state->help;
-                    } else if (buf[i] == '+') {
-                        if (state->current_switch) {
-                            struct SwitchObject *sw = state->rooms.rooms[*cursorlevel].data.switches + state->current_switch - 1;
-                            struct SwitchChunk ch = sw->chunks.data[state->current_chunk];
-                            if (state->current_chunk < sw->chunks.length - 1) {
-                                sw->chunks.data[state->current_chunk] = sw->chunks.data[state->current_chunk+1];
-                                sw->chunks.data[state->current_chunk+1] = ch;
-                                state->current_chunk ++;
-                                ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                                assert(writeRooms(&state->rooms));
-                            }
-                        }
-                    } else if (buf[i] == '-') {
-                        if (state->current_switch) {
-                            struct SwitchObject *sw = state->rooms.rooms[*cursorlevel].data.switches + state->current_switch - 1;
-                            struct SwitchChunk ch = sw->chunks.data[state->current_chunk];
-                            if (state->current_chunk > 1) {
-                                sw->chunks.data[state->current_chunk] = sw->chunks.data[state->current_chunk-1];
-                                sw->chunks.data[state->current_chunk-1] = ch;
-                                state->current_chunk --;
-                                ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                                assert(writeRooms(&state->rooms));
-                            }
-                        }
-                    } else if (buf[i] == 'p') {
-                        signal(SIGCHLD, SIG_IGN);
-                        pid_t child = fork();
-                        if (child == 0) {
-                            if (state != NULL) {
-                                freeRoomFile(&state->rooms);
-                                free(state);
-                            }
-                            pid_t sid = fork();
-                            if (sid == -1) exit(EXIT_FAILURE);
-                            if (sid > 0) exit(EXIT_SUCCESS);
-                            if (setsid() == -1) exit(EXIT_FAILURE);
-                            execv("./play.sh", (char**){0});
-                            exit(EXIT_FAILURE);
-                        }
-                    }
-                    i ++;
-                }; break;
-
-                case EDIT_SWITCHDETAILS_CHUNK_OBJECT_DETAILS:
-                {
-                    if (isxdigit(buf[i])) {
-                        uint8_t b = 0;
-                        if (isdigit(buf[i])) {
-                            b = *buf - '0';
-                        } else {
-                            b = 10 + tolower(buf[i]) - 'a';
-                        }
-                        if ((state->partial_byte & 0xFF00) != 0) {
-                            size_t value = b;
-                            if (state->debug.hex) {
-                                value += 16 * (state->partial_byte & 0xFF);
-                            } else {
-                                value += 10 * (state->partial_byte & 0xFF);
-                            }
-                            struct SwitchObject *sw = state->rooms.rooms[*cursorlevel].data.switches + state->current_switch - 1;
-                            struct SwitchChunk *chunk = sw->chunks.data + state->current_chunk;
-                            assert(chunk->type == TOGGLE_OBJECT);
-                            chunk->value = value;
-                            state->partial_byte = 0;
-                            ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                            assert(writeRooms(&state->rooms));
-                        } else {
-                            state->partial_byte = 0xFF00 | b;
-                        }
-                    } else if (buf[i] == 0x7f) {
-                        if (state->partial_byte) {
-                            state->partial_byte = 0;
-                        } else {
-                            if (!state->current_switch) UNREACHABLE();
-                            if (!state->current_chunk) UNREACHABLE();
-                            struct DecompresssedRoom *room = &state->rooms.rooms[state->current_level].data;
-                            struct SwitchObject *sw = room->switches + state->current_switch - 1;
-                            size_t ch_i = state->current_chunk;
-                            if (sw->chunks.length <= 1) UNREACHABLE();
-                            while (ch_i < sw->chunks.length - 1) {
-                                sw->chunks.data[ch_i] = sw->chunks.data[ch_i+1];
-                                ch_i++;
-                            }
-                            memset(sw->chunks.data + ch_i, 0, sizeof(struct SwitchChunk));
-                            sw->chunks.length --;
-                            ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                            assert(writeRooms(&state->rooms));
-                            if (state->current_chunk > 2) state->current_chunk --;
-                            switch (sw->chunks.length) {
-                                case 1: state->current_state = EDIT_SWITCHDETAILS; break;
-                                case 2:
-                                {
-                                    switch (sw->chunks.data[1].type) {
-                                        case PREAMBLE: UNREACHABLE();
-                                        case TOGGLE_BIT:
-                                            state->current_state = EDIT_SWITCHDETAILS_CHUNK_SWITCH_DETAILS;
-                                            break;
-
-                                        case TOGGLE_OBJECT:
-                                            state->current_state = EDIT_SWITCHDETAILS_CHUNK_OBJECT_DETAILS;
-                                            break;
-
-                                        case TOGGLE_BLOCK:
-                                        {
-                                            size_t overflow = WIDTH_TILES * HEIGHT_TILES;
-                                            size_t point = sw->chunks.data[1].y * WIDTH_TILES + sw->chunks.data[1].x;
-                                            if (point >= overflow) {
-                                                state->current_state = EDIT_SWITCHDETAILS_CHUNK_MEMORY_DETAILS;
-                                            } else {
-                                                state->current_state = EDIT_SWITCHDETAILS_CHUNK_BLOCK_DETAILS;
-                                            }
-                                        }; break;
+typedef struct {
+    const char *key;
+    key_action action;
+} key_binding;
+
+// Any single byte key a state has no binding of its own for, its action reads
+// which from typed_key
+#define OTHER_KEY ""
+
+// Every switch chunk state has these as well as its own
+#define CHUNK_KEYS \
+    {BACKSPACE, delete_chunk_key}, \
+    {DELETE, delete_chunk_key}, \
+    {"t", cycle_chunk_type}, \
+    {"-", chunk_earlier_key}, \
+    {"+", chunk_later_key}, \
+    {"p", play}, \
+    {"q", chunk_leave_key}, \
+    {"\033", chunk_leave_key}, \
+    {"?", toggle_help}, \
+    {CTRL_UNDERSCORE, toggle_help}, \
+    {CTRL_H, toggle_hex}
+key_binding keymaps[NUM_STATES][40] = {
+    [NORMAL]={
+        {"p", play},
+        {"q", quit_key},
+        {"?", toggle_help},
+        {CTRL_UNDERSCORE, toggle_help},
+        {"u", undo_key},
+        {"U", redo_key},
+        {KEY_LEFT, move_cursor_left},
+        {"h", move_cursor_left},
+        {KEY_DOWN, move_cursor_down},
+        {"j", move_cursor_down},
+        {KEY_UP, move_cursor_up},
+        {"k", move_cursor_up},
+        {KEY_RIGHT, move_cursor_right},
+        {"l", move_cursor_right},
+        {"r", goto_room_key},
+        {"s", goto_switch_key},
+        {"o", goto_object_key},
+        {CTRL_D, toggle_display_key},
+        {CTRL_H, toggle_hex},
+        {CTRL_W, cycle_compress_level},
+        {CTRL_T, tile_edit_key},
+        {DELETE, delete_key},
+        {"\033", escape_key},
+        {"w", enter_world},
+        {0},
+    },
 
-                                        default: UNREACHABLE();
-                                    }
-                                }; break;
+    // Along with the NORMAL keys it does not rebind
+    [TILE_EDIT]={
+        {"R", edit_roomname_key},
+        {"v", toggle_selection},
+        {"y", copy_selection},
+        {"P", paste_clipboard},
+        {CTRL_T, normal_key},
+        {SHIFT_LEFT, move_left},
+        {"H", move_left},
+        {SHIFT_DOWN, move_down},
+        {"J", move_down},
+        {SHIFT_UP, move_up},
+        {"K", move_up},
+        {SHIFT_RIGHT, move_right},
+        {"L", move_right},
+        {ALT_LEFT, stretch_left},
+        {"\033h", stretch_left},
+        {ALT_DOWN, stretch_down},
+        {"\033j", stretch_down},
+        {ALT_UP, stretch_up},
+        {"\033k", stretch_up},
+        {ALT_RIGHT, stretch_right},
+        {"\033l", stretch_right},
+        {ALT_SHIFT_LEFT, shrink_left},
+        {"\033H", shrink_left},
+        {ALT_SHIFT_DOWN, shrink_down},
+        {"\033J", shrink_down},
+        {ALT_SHIFT_UP, shrink_up},
+        {"\033K", shrink_up},
+        {ALT_SHIFT_RIGHT, shrink_right},
+        {"\033L", shrink_right},
+        {OTHER_KEY, tile_typed},
+        {"-", swap_earlier_key},
+        {"+", swap_later_key},
+        {BACKSPACE, delete_key},
+        {CTRL_R, edit_roomdetails_key},
+        {CTRL_S, edit_switchdetails_key},
+        {0},
+    },
 
-                                default: state->current_state = EDIT_SWITCHDETAILS_SELECT_CHUNK;
-                            }
-                        }
-                    } else if (buf[i] == ESCAPE) {
-                        if (i + 1 < n && buf[i+1] == '[' && i + 2 < n) {
-                            // CSI sequence
-                            i += 2;
-                            uint8_t arg = 0;
-                            while (i < n) {
-                                if (isdigit(buf[i])) {
-                                    arg = 10 * arg + buf[i] - '0';
-                                } else if (buf[i] == ';') {
-                                    arg = 0;
-                                } else {
-                                    switch (buf[i]) {
-                                        case '~':
-                                        {
-                                            switch (arg) {
-                                                case 3:
-                                                {
-                                                    if (state->partial_byte) {
-                                                        state->partial_byte = 0;
-                                                    } else {
-                                                        if (!state->current_switch) UNREACHABLE();
-                                                        if (!state->current_chunk) UNREACHABLE();
-                                                        struct DecompresssedRoom *room = &state->rooms.rooms[state->current_level].data;
-                                                        struct SwitchObject *sw = room->switches + state->current_switch - 1;
-                                                        size_t ch_i = state->current_chunk;
-                                                        if (sw->chunks.length <= 1) UNREACHABLE();
-                                                        while (ch_i < sw->chunks.length - 1) {
-                                                            sw->chunks.data[ch_i] = sw->chunks.data[ch_i+1];
-                                                            ch_i++;
-                                                        }
-                                                        memset(sw->chunks.data + ch_i, 0, sizeof(struct SwitchChunk));
-                                                        sw->chunks.length --;
-                                                        ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                                                        assert(writeRooms(&state->rooms));
-                                                        if (state->current_chunk > 2) state->current_chunk --;
-                                                        switch (sw->chunks.length) {
-                                                            case 1: state->current_state = EDIT_SWITCHDETAILS; break;
-                                                            case 2:
-                                                                    {
-                                                                        switch (sw->chunks.data[1].type) {
-                                                                            case PREAMBLE: UNREACHABLE();
-                                                                            case TOGGLE_BIT:
-                                                                                           state->current_state = EDIT_SWITCHDETAILS_CHUNK_SWITCH_DETAILS;
-                                                                                           break;
-
-                                                                            case TOGGLE_OBJECT:
-                                                                                           state->current_state = EDIT_SWITCHDETAILS_CHUNK_OBJECT_DETAILS;
-                                                                                           break;
-
-                                                                            case TOGGLE_BLOCK:
-                                                                                           {
-                                                                                               size_t overflow = WIDTH_TILES * HEIGHT_TILES;
-                                                                                               size_t point = sw->chunks.data[1].y * WIDTH_TILES + sw->chunks.data[1].x;
-                                                                                               if (point >= overflow) {
-                                                                                                   state->current_state = EDIT_SWITCHDETAILS_CHUNK_MEMORY_DETAILS;
-                                                                                               } else {
-                                                                                                   state->current_state = EDIT_SWITCHDETAILS_CHUNK_BLOCK_DETAILS;
-                                                                                               }
-                                                                                           }; break;
-
-                                                                            default: UNREACHABLE();
-                                                                        }
-                                                                    }; break;
-
-                                                            default: state->current_state = EDIT_SWITCHDETAILS_SELECT_CHUNK;
-                                                        }
-                                                    }
-                                                }; break;
-
-                                                default: fprintf(stderr, "%s:%d: UNIMPLEMENTED: csi terminator %c arg %d", __FILE__, __LINE__, buf[i], arg);
-                                            }
-                                        }; break;
+    [GOTO_OBJECT]={
+        {OTHER_KEY, goto_object_typed},
+        {"q", leave_key},
+        {"\033", leave_key},
+        {"?", toggle_help},
+        {CTRL_UNDERSCORE, toggle_help},
+        {CTRL_H, toggle_hex},
+        {0},
+    },
 
-                                        default: fprintf(stderr, "%s:%d: UNIMPLEMENTED: csi terminator %c arg %d", __FILE__, __LINE__, buf[i], arg);
-                                    }
-                                    break;
-                                }
-                                i ++;
-                            }
-                        } else if (state->help) {
-                            state->help = false;
-                        } else {
-                            if (state->partial_byte) {
-                                state->partial_byte = 0;
-                            } else {
-                                struct SwitchObject *sw = state->rooms.rooms[*cursorlevel].data.switches + state->current_switch - 1;
-                                if (sw->chunks.length <= 2) {
-                                    state->current_state = EDIT_SWITCHDETAILS;
-                                } else {
-                                    state->current_state = EDIT_SWITCHDETAILS_SELECT_CHUNK;
-                                }
-                                state->current_chunk = 0;
-                            }
-                        }
-                    } else if (buf[i] == 't') {
-                        struct SwitchObject *sw = state->rooms.rooms[*cursorlevel].data.switches + state->current_switch - 1;
-                        struct SwitchChunk *chunk = sw->chunks.data + state->current_chunk;
-                        enum SwitchChunkType typ = chunk->type;
-                        switch (typ) {
-                            case TOGGLE_BLOCK:
-                            {
-                                size_t overflow = WIDTH_TILES * HEIGHT_TILES;
-                                size_t point = chunk->y * WIDTH_TILES + chunk->x;
-                                if (point < overflow) {
-                                    memset(chunk, 0, sizeof(*chunk));
-                                    chunk->type = TOGGLE_BLOCK;
-                                    chunk->x = 0;
-                                    chunk->y = HEIGHT_TILES;
-                                    chunk->size = 1;
-                                    state->current_state = EDIT_SWITCHDETAILS_CHUNK_MEMORY_DETAILS;
-                                    break;
-                                }
-                            }; fallthrough;
-                            default:
-                                memset(chunk, 0, sizeof(*chunk));
-                                chunk->type = (typ + 1) % NUM_CHUNK_TYPES;
-                                if (chunk->type == PREAMBLE) chunk->type = (chunk->type + 1) % NUM_CHUNK_TYPES;
-                                switch (chunk->type) {
-                                    case TOGGLE_BIT:
-                                        state->current_state = EDIT_SWITCHDETAILS_CHUNK_SWITCH_DETAILS;
-                                        chunk->bitmask = 0x1;
-                                        break;
+    [GOTO_SWITCH]={
+        {OTHER_KEY, goto_switch_typed},
+        {"q", leave_key},
+        {"\033", leave_key},
+        {"?", toggle_help},
+        {CTRL_UNDERSCORE, toggle_help},
+        {CTRL_H, toggle_hex},
+        {0},
+    },
 
-                                    case TOGGLE_OBJECT:
-                                        state->current_state = EDIT_SWITCHDETAILS_CHUNK_OBJECT_DETAILS;
-                                        break;
+    // Printable keys are part of a room name
+    [GOTO_ROOM]={
+        {OTHER_KEY, goto_room_typed},
+        {KEY_LEFT, goto_room_west},
+        {"\033h", goto_room_west},
+        {KEY_DOWN, goto_room_south},
+        {"\033j", goto_room_south},
+        {KEY_UP, goto_room_north},
+        {"\033k", goto_room_north},
+        {KEY_RIGHT, goto_room_east},
+        {"\033l", goto_room_east},
+        {BACKSPACE, room_erase_key},
+        {DELETE, room_erase_key},
+        {"\033", goto_room_leave_key},
+        {CTRL_Q, goto_room_leave_key},
+        {CTRL_UNDERSCORE, toggle_help},
+        {CTRL_H, toggle_hex_typing},
+        {0},
+    },
 
-                                    case TOGGLE_BLOCK:
-                                        state->current_state = EDIT_SWITCHDETAILS_CHUNK_BLOCK_DETAILS;
-                                        break;
+    [EDIT_ROOMNAME]={
+        {OTHER_KEY, roomname_typed},
+        {ENTER, roomname_enter_key},
+        {HOME, roomname_home_key},
+        {END, roomname_end_key},
+        {KEY_LEFT, roomname_left_key},
+        {KEY_RIGHT, roomname_right_key},
+        {DELETE, roomname_delete_key},
+        {BACKSPACE, roomname_backspace_key},
+        {"\033", roomname_leave_key},
+        {CTRL_UNDERSCORE, toggle_help},
+        {CTRL_H, roomname_hex_key},
+        {0},
+    },
 
-                                    default: break;
-                                }
+    [EDIT_ROOMDETAILS]={
+        {KEY_LEFT, edit_room_west},
+        {"h", edit_room_west},
+        {KEY_DOWN, edit_room_south},
+        {"j", edit_room_south},
+        {KEY_UP, edit_room_north},
+        {"k", edit_room_north},
+        {KEY_RIGHT, edit_room_east},
+        {"l", edit_room_east},
+        {"g", edit_room_number},
+        {"t", edit_room_number},
+        {"d", edit_room_number},
+        {"|", edit_room_number},
+        {"-", edit_room_number},
+        {"b", edit_room_number},
+        {"c", edit_room_number},
+        {"e", edit_room_number},
+        {"f", edit_room_number},
+        {"p", play},
+        {"q", details_leave_key},
+        {"\033", details_leave_key},
+        {"?", toggle_help},
+        {CTRL_UNDERSCORE, toggle_help},
+        {CTRL_H, toggle_hex_typing},
+        {0},
+    },
 
-                        }
-                        ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                        assert(writeRooms(&state->rooms));
-                    } else if (buf[i] == 'i') {
-                        struct SwitchObject *sw = state->rooms.rooms[*cursorlevel].data.switches + state->current_switch - 1;
-                        struct SwitchChunk *chunk = sw->chunks.data + state->current_chunk;
-                        chunk->index = (chunk->index + 1) % 0x10;
-                        ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                        assert(writeRooms(&state->rooms));
-                    } else if (buf[i] == 's') {
-                        struct SwitchObject *sw = state->rooms.rooms[*cursorlevel].data.switches + state->current_switch - 1;
-                        struct SwitchChunk *chunk = sw->chunks.data + state->current_chunk;
-                        chunk->test = (((chunk->test >> 4) + 1) % 4) << 4;
-                        ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                        assert(writeRooms(&state->rooms));
-                    } else if (iscntrl(buf[i])) {
-                        switch (buf[i] + 'A' - 1) {
-                            case '_': state->help = !state->help; break;
-                            case 'H': state->debug.hex = !state->debug.hex; break;
-                        }
-                    } else if (buf[i] == 'q') {
-                        if (state->help) {
-                            state->help = !state->help;
-                        } else {
-                            if (state->partial_byte) {
-                                state->partial_byte = 0;
-                            } else {
-                                struct SwitchObject *sw = state->rooms.rooms[*cursorlevel].data.switches + state->current_switch - 1;
-                                if (sw->chunks.length <= 2) {
-                                    state->current_state = EDIT_SWITCHDETAILS;
-                                } else {
-                                    state->current_state = EDIT_SWITCHDETAILS_SELECT_CHUNK;
-                                }
-                                state->current_chunk = 0;
-                            }
-                        }
-                    } else if (buf[i] == '?') {
-                        state->help = !state->help;
-                    } else if (buf[i] == '+') {
-                        if (state->current_switch) {
-                            struct SwitchObject *sw = state->rooms.rooms[*cursorlevel].data.switches + state->current_switch - 1;
-                            struct SwitchChunk ch = sw->chunks.data[state->current_chunk];
-                            if (state->current_chunk < sw->chunks.length - 1) {
-                                sw->chunks.data[state->current_chunk] = sw->chunks.data[state->current_chunk+1];
-                                sw->chunks.data[state->current_chunk+1] = ch;
-                                state->current_chunk ++;
-                                ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                                assert(writeRooms(&state->rooms));
-                            }
-                        }
-                    } else if (buf[i] == '-') {
-                        if (state->current_switch) {
-                            struct SwitchObject *sw = state->rooms.rooms[*cursorlevel].data.switches + state->current_switch - 1;
-                            struct SwitchChunk ch = sw->chunks.data[state->current_chunk];
-                            if (state->current_chunk > 1) {
-                                sw->chunks.data[state->current_chunk] = sw->chunks.data[state->current_chunk-1];
-                                sw->chunks.data[state->current_chunk-1] = ch;
-                                state->current_chunk --;
-                                ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                                assert(writeRooms(&state->rooms));
-                            }
-                        }
-                    } else if (buf[i] == 'p') {
-                        signal(SIGCHLD, SIG_IGN);
-                        pid_t child = fork();
-                        if (child == 0) {
-                            if (state != NULL) {
-                                freeRoomFile(&state->rooms);
-                                free(state);
-                            }
-                            pid_t sid = fork();
-                            if (sid == -1) exit(EXIT_FAILURE);
-                            if (sid > 0) exit(EXIT_SUCCESS);
-                            if (setsid() == -1) exit(EXIT_FAILURE);
-                            execv("./play.sh", (char**){0});
-                            exit(EXIT_FAILURE);
-                        }
-                    }
-                    i ++;
-                }; break;
-
-                case TILE_EDIT:
-                {
-                    if (isxdigit(buf[i])) {
-                        uint8_t b = 0;
-                        if (isdigit(buf[i])) {
-                            b = *buf - '0';
-                        } else {
-                            b = 10 + tolower(buf[i]) - 'a';
-                        }
-                        if ((state->partial_byte & 0xFF00) != 0) {
-                            size_t value = b;
-                            if (state->debug.hex) {
-                                value += 16 * (state->partial_byte & 0xFF);
-                            } else {
-                                value += 10 * (state->partial_byte & 0xFF);
-                            }
-                            bool obj = false;
-                            bool ch = false;
-                            int x = state->cursors[state->current_level].x;
-                            int y = state->cursors[state->current_level].y;
-                            struct DecompresssedRoom *room = &state->rooms.rooms[state->current_level].data;
-                            for (size_t i = 0; i < room->num_objects; i ++) {
-                                struct RoomObject *object = room->objects + i;
-                                if (object->type == BLOCK &&
-                                        x >= object->x && x < object->x + object->block.width &&
-                                        y >= object->y && y < object->y + object->block.height) {
-                                    obj = true;
-                                    object->tiles[(y - object->y) * object->block.width + (x - object->x)] = value;
-                                    break;
-                                } else if (object->type == SPRITE && x == object->x && y == object->y) {
-                                    obj = true;
-                                    object->sprite.type = value >> 4;
-                                    object->sprite.damage = value & 0xF;
-                                    break;
-                                }
-                            }
-                            if (!obj) {
-                                struct SwitchObject *switcch = NULL;
-                                struct SwitchChunk *chunk = NULL;
-                                for (size_t i = 0; i < room->num_switches; i ++) {
-                                    switcch = room->switches + i;
-                                    for (size_t c = 1; c < switcch->chunks.length; c ++) {
-                                        chunk = switcch->chunks.data + c;
-                                        if (chunk->type == TOGGLE_BLOCK &&
-                                                ((chunk->dir == VERTICAL && x == chunk->x && y >= chunk->y && y < chunk->y + chunk->size) ||
-                                                 (chunk->dir == HORIZONTAL && y == chunk->y && x >= chunk->x && x < chunk->x + chunk->size))) {
-                                            ch = true;
-                                            break;
-                                        }
-                                    }
-                                    if (ch) {
-                                        // FIXME split up chunks, need one for this byte, and potentially 2 more for either end
-                                        chunk->on = value;
-                                        break;
-                                    }
-                                }
-                            }
-                            if (!obj && !ch) room->tiles[TILE_IDX(x, y)] = value;
-                            ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                            assert(writeRooms(&state->rooms));
-                            state->partial_byte = 0;
-                        } else {
-                            state->partial_byte = 0xFF00 | b;
-                        }
-                        i += 1;
-                        continue;
-                    } else if (KEY_MATCHES("R")) {
-                        state->previous_state = state->current_state;
-                        state->current_state = EDIT_ROOMNAME;
-                        state->current_switch = 0;
-                        state->switch_on = false;
-                        state->current_chunk = 0;
-                        state->roomname_cursor = 0;
-                        strncpy(state->room_name, state->rooms.rooms[*cursorlevel].data.name, C_ARRAY_LEN(state->room_name));
-                        for (size_t i = 0; i < C_ARRAY_LEN(state->room_name); i ++) {
-                            if (state->room_name[C_ARRAY_LEN(state->room_name) - i] == '\0') continue;
-                            if (state->room_name[C_ARRAY_LEN(state->room_name) - i] == ' ') {
-                                state->room_name[C_ARRAY_LEN(state->room_name) - i] = '\0';
-                            } else {
-                                break;
-                            }
-                        }
-                    } else if (buf[i] == '-') {
-                        struct RoomObject *object_underneath = NULL;
-                        struct SwitchObject *switch_underneath = NULL;
-                        struct SwitchChunk *chunk_underneath = NULL;
-                        struct SwitchObject *chunk_switch_underneath = NULL;
-
-                        struct DecompresssedRoom *room = &state->rooms.rooms[state->current_level].data;
-                        int x = state->cursors[state->current_level].x;
-                        int y = state->cursors[state->current_level].y;
-                        int i;
-                        for (i = 0; i < room->num_objects; i ++) {
-                            struct RoomObject *object = room->objects + i;
-                            if (object->type == BLOCK &&
-                                    x >= object->x && x < object->x + object->block.width &&
-                                    y >= object->y && y < object->y + object->block.height) {
-                                object_underneath = object;
-                                break;
-                            } else if (object->type == SPRITE && x == object->x && y == object->y) {
-                                object_underneath = object;
-                                break;
-                            }
-                        }
-                        int obj_i = i;
-                        for (i = 0; i < room->num_switches; i ++) {
-                            struct SwitchObject *switcch = room->switches + i;
-                            if (switcch->chunks.length > 0 && switcch->chunks.data[0].type == PREAMBLE &&
-                                    x == switcch->chunks.data[0].x && y == switcch->chunks.data[0].y) {
-                                switch_underneath = switcch;
-                                break;
-                            }
-                        }
-                        int sw_i = i;
-                        int c;
-                        for (i = 0; i < room->num_switches; i ++) {
-                            struct SwitchObject *switcch = room->switches + i;
-                            for (c = 1; c < (signed) switcch->chunks.length; c ++) {
-                                struct SwitchChunk *chunk = switcch->chunks.data + c;
-                                if (chunk->type == TOGGLE_BLOCK) {
-                                    if (chunk->dir == HORIZONTAL) {
-                                        if (y == chunk->y && x >= chunk->x && x < chunk->x + chunk->size) {
-                                            chunk_switch_underneath = switcch;
-                                            chunk_underneath = chunk;
-                                            break;
-                                        }
-                                    } else if (x == chunk->x && y >= chunk->y && y < chunk->y + chunk->size) {
-                                        chunk_switch_underneath = switcch;
-                                        chunk_underneath = chunk;
-                                        break;
-                                    }
-                                }
-                            }
-                            if (chunk_underneath) break;
-                        }
+    [EDIT_ROOMDETAILS_NUM]={
+        {OTHER_KEY, room_detail_typed},
+        {BACKSPACE, forget_typed_key},
+        {DELETE, forget_typed_key},
+        {"p", play},
+        {"q", room_detail_leave_key},
+        {"\033", room_detail_leave_key},
+        {"?", toggle_help},
+        {CTRL_UNDERSCORE, toggle_help},
+        {CTRL_H, toggle_hex_typing},
+        {0},
+    },
 
-                        if (object_underneath) {
-                            struct RoomObject object = *object_underneath;
-                            if (obj_i) {
-                                room->objects[obj_i] = room->objects[obj_i-1];
-                                room->objects[obj_i-1] = object;
-                            }
-                        } else if (switch_underneath) {
-                            struct SwitchObject sw = *switch_underneath;
-                            if (sw_i) {
-                                room->switches[sw_i] = room->switches[sw_i-1];
-                                room->switches[sw_i-1] = sw;
-                            }
-                        } else if (chunk_underneath) {
-                            struct SwitchChunk ch= *chunk_underneath;
-                            if (c) {
-                                chunk_switch_underneath->chunks.data[c] = chunk_switch_underneath->chunks.data[c-1];
-                                chunk_switch_underneath->chunks.data[c-1] = ch;
-                            }
-                        }
-                        ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                        assert(writeRooms(&state->rooms));
-                    } else if (buf[i] == '+') {
-                        struct RoomObject *object_underneath = NULL;
-                        struct SwitchObject *switch_underneath = NULL;
-                        struct SwitchChunk *chunk_underneath = NULL;
-                        struct SwitchObject *chunk_switch_underneath = NULL;
-
-                        struct DecompresssedRoom *room = &state->rooms.rooms[state->current_level].data;
-                        int x = state->cursors[state->current_level].x;
-                        int y = state->cursors[state->current_level].y;
-                        int i;
-                        for (i = 0; i < room->num_objects; i ++) {
-                            struct RoomObject *object = room->objects + i;
-                            if (object->type == BLOCK &&
-                                    x >= object->x && x < object->x + object->block.width &&
-                                    y >= object->y && y < object->y + object->block.height) {
-                                object_underneath = object;
-                                break;
-                            } else if (object->type == SPRITE && x == object->x && y == object->y) {
-                                object_underneath = object;
-                                break;
-                            }
-                        }
-                        int obj_i = i;
-                        for (i = 0; i < room->num_switches; i ++) {
-                            struct SwitchObject *switcch = room->switches + i;
-                            if (switcch->chunks.length > 0 && switcch->chunks.data[0].type == PREAMBLE &&
-                                    x == switcch->chunks.data[0].x && y == switcch->chunks.data[0].y) {
-                                switch_underneath = switcch;
-                                break;
-                            }
-                        }
-                        int sw_i = i;
-                        int c;
-                        for (i = 0; i < room->num_switches; i ++) {
-                            struct SwitchObject *switcch = room->switches + i;
-                            for (c = 1; c < (signed) switcch->chunks.length; c ++) {
-                                struct SwitchChunk *chunk = switcch->chunks.data + c;
-                                if (chunk->type == TOGGLE_BLOCK) {
-                                    if (chunk->dir == HORIZONTAL) {
-                                        if (y == chunk->y && x >= chunk->x && x < chunk->x + chunk->size) {
-                                            chunk_switch_underneath = switcch;
-                                            chunk_underneath = chunk;
-                                            break;
-                                        }
-                                    } else if (x == chunk->x && y >= chunk->y && y < chunk->y + chunk->size) {
-                                        chunk_switch_underneath = switcch;
-                                        chunk_underneath = chunk;
-                                        break;
-                                    }
-                                }
-                            }
-                            if (chunk_underneath) break;
-                        }
+    // Printable keys are part of a room name
+    [EDIT_ROOMDETAILS_ROOM]={
+        {OTHER_KEY, room_neighbour_typed},
+        {BACKSPACE, room_erase_key},
+        {DELETE, room_erase_key},
+        {"\033", room_detail_leave_key},
+        {CTRL_Q, room_detail_leave_key},
+        {CTRL_UNDERSCORE, toggle_help},
+        {CTRL_H, toggle_hex_typing},
+        {0},
+    },
 
-                        if (object_underneath) {
-                            struct RoomObject object = *object_underneath;
-                            if (obj_i < room->num_objects - 1) {
-                                room->objects[obj_i] = room->objects[obj_i+1];
-                                room->objects[obj_i+1] = object;
-                            }
-                        } else if (switch_underneath) {
-                            struct SwitchObject sw = *switch_underneath;
-                            if (sw_i < room->num_switches - 1) {
-                                room->switches[sw_i] = room->switches[sw_i+1];
-                                room->switches[sw_i+1] = sw;
-                            }
-                        } else if (chunk_underneath) {
-                            struct SwitchChunk ch= *chunk_underneath;
-                            if (c < (signed) chunk_switch_underneath->chunks.length - 1) {
-                                chunk_switch_underneath->chunks.data[c] = chunk_switch_underneath->chunks.data[c+1];
-                                chunk_switch_underneath->chunks.data[c+1] = ch;
-                            }
-                        }
-                        ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                        assert(writeRooms(&state->rooms));
-                    } else if (buf[i] == 0x7f) {
-                        if (state->partial_byte) {
-                            state->partial_byte = 0;
-                        } else {
-                            struct RoomObject *object_underneath = NULL;
-                            struct SwitchObject *switch_underneath = NULL;
-                            struct SwitchChunk *chunk_underneath = NULL;
-                            struct SwitchObject *chunk_switch_underneath = NULL;
-
-                            struct DecompresssedRoom *room = &state->rooms.rooms[state->current_level].data;
-                            int x = state->cursors[state->current_level].x;
-                            int y = state->cursors[state->current_level].y;
-                            int i;
-                            for (i = 0; i < room->num_objects; i ++) {
-                                struct RoomObject *object = room->objects + i;
-                                if (object->type == BLOCK &&
-                                        x >= object->x && x < object->x + object->block.width &&
-                                        y >= object->y && y < object->y + object->block.height) {
-                                    object_underneath = object;
-                                    break;
-                                } else if (object->type == SPRITE && x == object->x && y == object->y) {
-                                    object_underneath = object;
-                                    break;
-                                }
-                            }
-                            int obj_i = i;
-                            for (i = 0; i < room->num_switches; i ++) {
-                                struct SwitchObject *switcch = room->switches + i;
-                                if (switcch->chunks.length > 0 && switcch->chunks.data[0].type == PREAMBLE &&
-                                        x == switcch->chunks.data[0].x && y == switcch->chunks.data[0].y) {
-                                    switch_underneath = switcch;
-                                    break;
-                                }
-                            }
-                            int sw_i = i;
-                            int c;
-                            for (i = 0; i < room->num_switches; i ++) {
-                                struct SwitchObject *switcch = room->switches + i;
-                                for (c = 1; c < (signed) switcch->chunks.length; c ++) {
-                                    struct SwitchChunk *chunk = switcch->chunks.data + c;
-                                    if (chunk->type == TOGGLE_BLOCK) {
-                                        if (chunk->dir == HORIZONTAL) {
-                                            if (y == chunk->y && x >= chunk->x && x < chunk->x + chunk->size) {
-                                                chunk_switch_underneath = switcch;
-                                                chunk_underneath = chunk;
-                                                break;
-                                            }
-                                        } else if (x == chunk->x && y >= chunk->y && y < chunk->y + chunk->size) {
-                                            chunk_switch_underneath = switcch;
-                                            chunk_underneath = chunk;
-                                            break;
-                                        }
-                                    }
-                                }
-                                if (chunk_underneath) break;
-                            }
+    [EDIT_SWITCHDETAILS]={
+        {BACKSPACE, delete_switch_key},
+        {DELETE, delete_switch_key},
+        {"-", switch_earlier_key},
+        {"+", switch_later_key},
+        {KEY_LEFT, switch_side_left},
+        {"h", switch_side_left},
+        {KEY_DOWN, switch_side_bottom},
+        {"j", switch_side_bottom},
+        {KEY_UP, switch_side_top},
+        {"k", switch_side_top},
+        {KEY_RIGHT, switch_side_right},
+        {"l", switch_side_right},
+        {"s", cycle_switch_side},
+        {"o", toggle_one_time_use},
+        {"e", toggle_room_entry},
+        {"c", edit_chunks_key},
+        {"C", add_chunk_key},
+        {"p", play},
+        {"q", details_leave_key},
+        {"\033", details_leave_key},
+        {"?", toggle_help},
+        {CTRL_UNDERSCORE, toggle_help},
+        {CTRL_H, toggle_hex_typing},
+        {0},
+    },
 
-                            if (object_underneath) {
-                                while (obj_i < room->num_objects - 1) {
-                                    if (room->objects[obj_i].tiles) {
-                                        free(room->objects[obj_i].tiles);
-                                    }
-                                    room->objects[obj_i] = room->objects[obj_i+1];
-                                    obj_i++;
-                                }
-                                if (room->objects[obj_i].tiles) {
-                                    free(room->objects[obj_i].tiles);
-                                }
-                                memset(room->objects + obj_i, 0, sizeof(struct RoomObject));
-                                room->num_objects --;
-                            } else if (switch_underneath) {
-                                while (sw_i < room->num_switches - 1) {
-                                    room->switches[sw_i] = room->switches[sw_i+1];
-                                    sw_i++;
-                                }
-                                memset(room->switches + sw_i, 0, sizeof(struct SwitchObject));
-                                room->num_switches --;
-                            } else if (chunk_underneath) {
-                                while (c < (signed) chunk_switch_underneath->chunks.length - 1) {
-                                    chunk_switch_underneath->chunks.data[c] = chunk_switch_underneath->chunks.data[c+1];
-                                    c++;
-                                }
-                                memset(chunk_switch_underneath->chunks.data + c, 0, sizeof(struct SwitchChunk));
-                                chunk_switch_underneath->chunks.length --;
-                            } else {
-                                room->tiles[TILE_IDX(x, y)] = 0;
-                            }
-                            ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                            assert(writeRooms(&state->rooms));
-                        }
-                    } else if (iscntrl(buf[i])) {
-                        switch (buf[i] + 'A' - 1) {
-                            case 'R':
-                                state->previous_state = state->current_state;
-                                state->current_state = EDIT_ROOMDETAILS;
-                                state->current_switch = 0;
-                                state->switch_on = false;
-                                state->current_chunk = 0;
-                                i ++;
-                                continue;
-
-                            case 'S':
-                            {
-                                state->previous_state = state->current_state;
-                                struct DecompresssedRoom *room = &state->rooms.rooms[state->current_level].data;
-                                size_t num_switches = room->num_switches;
-                                if (state->current_switch) {
-                                    state->current_state = EDIT_SWITCHDETAILS;
-                                    i ++;
-                                    continue;
-                                }
-                                size_t x = state->cursors[state->current_level].x;
-                                size_t y = state->cursors[state->current_level].y;
-                                size_t i = 0;
-                                while (i < num_switches) {
-                                    struct SwitchObject *sw = room->switches + i;
-                                    if (sw->chunks.length && sw->chunks.data[0].x == x && sw->chunks.data[0].y == y) {
-                                        break;
-                                    }
-                                    i ++;
-                                }
-                                if (i == room->num_switches) {
-                                    room->switches = realloc(room->switches, (i + 1) * sizeof(struct SwitchObject));
-                                    assert(room->switches != NULL);
-                                    memset(room->switches + i, 0, sizeof(struct SwitchObject));
-                                    room->num_switches ++;
-                                    struct SwitchObject *sw = room->switches + i;
-                                    ARRAY_ADD(sw->chunks, ((struct SwitchChunk){ .type = PREAMBLE, .x = x, .y = y }));
-                                }
-                                ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                                assert(writeRooms(&state->rooms));
-                                state->current_switch = i + 1;
-                                state->current_state = EDIT_SWITCHDETAILS;
-                                i ++;
-                                continue;
-                            }
-                        }
-                    }
+    [EDIT_SWITCHDETAILS_SELECT_CHUNK]={
+        {OTHER_KEY, select_chunk_typed},
+        {"+", new_chunk_key},
+        {BACKSPACE, forget_typed_key},
+        {"p", play},
+        {"q", select_chunk_leave_key},
+        {"\033", select_chunk_leave_key},
+        {"?", toggle_help},
+        {CTRL_UNDERSCORE, toggle_help},
+        {CTRL_H, toggle_hex},
+        {0},
+    },
 
-                }; fallthrough;
-
-                case NORMAL:
-                {
-                    if (KEY_MATCHES("p")) {
-                        signal(SIGCHLD, SIG_IGN);
-                        pid_t child = fork();
-                        if (child == 0) {
-                            if (state != NULL) {
-                                freeRoomFile(&state->rooms);
-                                free(state);
-                            }
-                            pid_t sid = fork();
-                            if (sid == -1) exit(EXIT_FAILURE);
-                            if (sid > 0) exit(EXIT_SUCCESS);
-                            if (setsid() == -1) exit(EXIT_FAILURE);
-                            execv("./play.sh", (char**){0});
-                            exit(EXIT_FAILURE);
-                        }
-                    } else if (KEY_MATCHES("q")) {
-                        if (state->help) {
-                            state->help = false;
-                        } else {
-                            if (state->partial_byte) {
-                                state->partial_byte = 0;
-                            } else {
-                                end();
-                                UNREACHABLE();
-                            }
-                        }
-                    } else if (KEY_MATCHES("?")) {
-                        state->help = !state->help;
-                    } else if (KEY_MATCHES(KEY_LEFT) || KEY_MATCHES("h")) {
-                        cursor->x --;
-                        state->partial_byte = 0;
-                        state->current_switch = 0;
-                        state->switch_on = false;
-                        state->current_chunk = 0;
-                        if (cursor->x < 0) {
-                            cursor->x ++;
-                            size_t level = state->rooms.rooms[*cursorlevel].data.room_west;
-                            state->cursors[level].y = state->cursors[*cursorlevel].y;
-                            state->cursors[level].x = WIDTH_TILES - 1;
-                            *cursorlevel = level;
-                        }
-                    } else if (KEY_MATCHES(KEY_DOWN) || KEY_MATCHES("j")) {
-                        cursor->y ++;
-                        state->partial_byte = 0;
-                        state->current_switch = 0;
-                        state->switch_on = false;
-                        state->current_chunk = 0;
-                        if (cursor->y >= HEIGHT_TILES) {
-                            cursor->y --;
-                            size_t level = state->rooms.rooms[*cursorlevel].data.room_south;
-                            state->cursors[level].y = 0;
-                            state->cursors[level].x = state->cursors[*cursorlevel].x;
-                            *cursorlevel = level;
-                        }
-                    } else if (KEY_MATCHES(KEY_UP) || KEY_MATCHES("k")) {
-                        cursor->y --;
-                        state->partial_byte = 0;
-                        state->current_switch = 0;
-                        state->switch_on = false;
-                        state->current_chunk = 0;
-                        if (cursor->y < 0) {
-                            cursor->y ++;
-                            size_t level = state->rooms.rooms[*cursorlevel].data.room_north;
-                            state->cursors[level].y = HEIGHT_TILES - 1;
-                            state->cursors[level].x = state->cursors[*cursorlevel].x;
-                            *cursorlevel = level;
-                        }
-                    } else if (KEY_MATCHES(KEY_RIGHT) || KEY_MATCHES("l")) {
-                        cursor->x ++;
-                        state->partial_byte = 0;
-                        state->current_switch = 0;
-                        state->switch_on = false;
-                        state->current_chunk = 0;
-                        if (cursor->x >= WIDTH_TILES) {
-                            cursor->x --;
-                            size_t level = state->rooms.rooms[*cursorlevel].data.room_east;
-                            state->cursors[level].x = 0;
-                            state->cursors[level].y = state->cursors[*cursorlevel].y;
-                            *cursorlevel = level;
-                        }
-                    } else if (KEY_MATCHES("r")) {
-                        state->previous_state = state->current_state;
-                        state->current_state = GOTO_ROOM;
-                        state->current_switch = 0;
-                        state->switch_on = false;
-                        state->current_chunk = 0;
-                        state->partial_byte = 0;
-                    } else if (KEY_MATCHES("s")) {
-                        state->previous_state = state->current_state;
-                        state->current_state = GOTO_SWITCH;
-                        state->current_switch = 0;
-                        state->switch_on = false;
-                        state->current_chunk = 0;
-                        state->partial_byte = 0;
-                    } else if (KEY_MATCHES("o")) {
-                        state->previous_state = state->current_state;
-                        state->current_state = GOTO_OBJECT;
-                        state->current_switch = 0;
-                        state->switch_on = false;
-                        state->current_chunk = 0;
-                        state->partial_byte = 0;
-                    }
-                    if (state->current_state == TILE_EDIT) {
-#define LEFT -1, 0
-#define DOWN 0, +1
-#define UP 0, -1
-#define RIGHT +1, 0
-                        // FIXME Currently doesn't move objects through to neighbours
-                        if (KEY_MATCHES(SHIFT_LEFT) || KEY_MATCHES("H")) {
-                            move(LEFT);
-                        } else if (KEY_MATCHES(SHIFT_DOWN) || KEY_MATCHES("J")) {
-                            move(DOWN);
-                        } else if (KEY_MATCHES(SHIFT_UP) || KEY_MATCHES("K")) {
-                            move(UP);
-                        } else if (KEY_MATCHES(SHIFT_RIGHT) || KEY_MATCHES("L")) {
-                            move(RIGHT);
-                        }
-                        if (KEY_MATCHES(ALT_LEFT) || KEY_MATCHES("\033h")) {
-                            stretch(LEFT);
-                        } else if (KEY_MATCHES(ALT_DOWN) || KEY_MATCHES("\033j")) {
-                            stretch(DOWN);
-                        } else if (KEY_MATCHES(ALT_UP) || KEY_MATCHES("\033k")) {
-                            stretch(UP);
-                        } else if (KEY_MATCHES(ALT_RIGHT) || KEY_MATCHES("\033l")) {
-                            stretch(RIGHT);
-                        }
-                        if (KEY_MATCHES(ALT_SHIFT_LEFT) || KEY_MATCHES("\033H")) {
-                            shrink(LEFT);
-                        } else if (KEY_MATCHES(ALT_SHIFT_DOWN) || KEY_MATCHES("\033J")) {
-                            shrink(DOWN);
-                        } else if (KEY_MATCHES(ALT_SHIFT_UP) || KEY_MATCHES("\033K")) {
-                            shrink(UP);
-                        } else if (KEY_MATCHES(ALT_SHIFT_RIGHT) || KEY_MATCHES("\033L")) {
-                            shrink(RIGHT);
-                        }
-                    }
-                    if (iscntrl(buf[i]) != 0) {
-                        switch (buf[i] + 'A' - 1) {
-                            case '_': state->help = !state->help; break;
-                            case 'D':
-                                  state->previous_state = state->current_state;
-                                  state->current_state = TOGGLE_DISPLAY;
-                                  state->current_switch = 0;
-                                  state->switch_on = false;
-                                  state->current_chunk = 0;
-                                  break;
-
-                            case 'H': state->debug.hex = !state->debug.hex; break;
-                            case 'T': {
-                                switch (state->current_state) {
-                                    case NORMAL:
-                                    {
-                                        state->previous_state = state->current_state;
-                                        state->current_state = TILE_EDIT;
-                                        state->current_switch = 0;
-                                        state->switch_on = false;
-                                        state->current_chunk = 0;
-                                    }; break;
-                                    case TILE_EDIT:
-                                    {
-                                        state->previous_state = state->current_state;
-                                        state->current_state = NORMAL;
-                                        state->current_switch = 0;
-                                        state->switch_on = false;
-                                        state->current_chunk = 0;
-                                    }; break;
-
-                                    default: UNREACHABLE();
-                                }
-                            }; break;
-                        }
-                    }
+    [EDIT_SWITCHDETAILS_CHUNK_BLOCK_DETAILS]={
+        {OTHER_KEY, chunk_tile_typed},
+        {"o", toggle_switch_on},
+        {" ", cycle_chunk_dir},
+        {"^", grow_chunk},
+        {"v", shrink_chunk},
+        {KEY_LEFT, chunk_left},
+        {"h", chunk_left},
+        {KEY_DOWN, chunk_down},
+        {"j", chunk_down},
+        {KEY_UP, chunk_up},
+        {"k", chunk_up},
+        {KEY_RIGHT, chunk_right},
+        {"l", chunk_right},
+        CHUNK_KEYS,
+        {0},
+    },
 
+    [EDIT_SWITCHDETAILS_CHUNK_MEMORY_DETAILS]={
+        {OTHER_KEY, chunk_tile_typed},
+        {"o", toggle_switch_on},
+        {"r", cycle_chunk_dir},
+        {"^", grow_chunk},
+        {"v", shrink_chunk},
+        {KEY_LEFT, chunk_back},
+        {"h", chunk_back},
+        {KEY_UP, chunk_back},
+        {"k", chunk_back},
+        {KEY_RIGHT, chunk_forward},
+        {"l", chunk_forward},
+        {KEY_DOWN, chunk_forward},
+        {"j", chunk_forward},
+        {" ", chunk_forward},
+        CHUNK_KEYS,
+        {0},
+    },
 
-                    if (match != NULL) {
-                        i += strlen(match);
-                    } else {
-                        // Swallow unused input
-                        switch (buf[i]) {
-                            case ESCAPE:
-                                if (i + 1 < n) {
-                                    // ESC sequence
-                                    switch (buf[i + 1]) {
-                                        case '[':
-                                            if (i + 2 < n) {
-                                                // CSI sequence
-                                                i += 2;
-                                                uint8_t arg = 0;
-                                                while (i < n) {
-                                                    if (isdigit(buf[i])) {
-                                                        arg = 10 * arg + buf[i] - '0';
-                                                    } else if (buf[i] == ';') {
-                                                        arg = 0;
-                                                    } else {
-                                                        if (buf[i] == '~') {
-                                                            switch (arg) {
-                                                                case 3:
-                                                                {
-                                                                    if (state->partial_byte) {
-                                                                        state->partial_byte = 0;
-                                                                    } else {
-                                                                        // FIXME find object or switch underneath
-                                                                        struct RoomObject *object_underneath = NULL;
-                                                                        struct SwitchObject *switch_underneath = NULL;
-                                                                        struct SwitchChunk *chunk_underneath = NULL;
-                                                                        struct SwitchObject *chunk_switch_underneath = NULL;
-
-                                                                        struct DecompresssedRoom *room = &state->rooms.rooms[state->current_level].data;
-                                                                        int x = state->cursors[state->current_level].x;
-                                                                        int y = state->cursors[state->current_level].y;
-                                                                        int i;
-                                                                        for (i = 0; i < room->num_objects; i ++) {
-                                                                            struct RoomObject *object = room->objects + i;
-                                                                            if (object->type == BLOCK &&
-                                                                                    x >= object->x && x < object->x + object->block.width &&
-                                                                                    y >= object->y && y < object->y + object->block.height) {
-                                                                                object_underneath = object;
-                                                                                break;
-                                                                            } else if (object->type == SPRITE && x == object->x && y == object->y) {
-                                                                                object_underneath = object;
-                                                                                break;
-                                                                            }
-                                                                        }
-                                                                        int obj_i = i;
-                                                                        for (i = 0; i < room->num_switches; i ++) {
-                                                                            struct SwitchObject *switcch = room->switches + i;
-                                                                            if (switcch->chunks.length > 0 && switcch->chunks.data[0].type == PREAMBLE &&
-                                                                                    x == switcch->chunks.data[0].x && y == switcch->chunks.data[0].y) {
-                                                                                switch_underneath = switcch;
-                                                                                break;
-                                                                            }
-                                                                        }
-                                                                        int sw_i = i;
-                                                                        int c;
-                                                                        for (i = 0; i < room->num_switches; i ++) {
-                                                                            struct SwitchObject *switcch = room->switches + i;
-                                                                            for (c = 1; c < (signed) switcch->chunks.length; c ++) {
-                                                                                struct SwitchChunk *chunk = switcch->chunks.data + c;
-                                                                                if (chunk->type == TOGGLE_BLOCK) {
-                                                                                    if (chunk->dir == HORIZONTAL) {
-                                                                                        if (y == chunk->y && x >= chunk->x && x < chunk->x + chunk->size) {
-                                                                                            chunk_switch_underneath = switcch;
-                                                                                            chunk_underneath = chunk;
-                                                                                            break;
-                                                                                        }
-                                                                                    } else if (x == chunk->x && y >= chunk->y && y < chunk->y + chunk->size) {
-                                                                                        chunk_switch_underneath = switcch;
-                                                                                        chunk_underneath = chunk;
-                                                                                        break;
-                                                                                    }
-                                                                                }
-                                                                            }
-                                                                            if (chunk_underneath) break;
-                                                                        }
-
-                                                                        if (object_underneath) {
-                                                                            while (obj_i < room->num_objects - 1) {
-                                                                                if (room->objects[obj_i].tiles) {
-                                                                                    free(room->objects[obj_i].tiles);
-                                                                                }
-                                                                                room->objects[obj_i] = room->objects[obj_i+1];
-                                                                                obj_i++;
-                                                                            }
-                                                                            if (room->objects[obj_i].tiles) {
-                                                                                free(room->objects[obj_i].tiles);
-                                                                            }
-                                                                            memset(room->objects + obj_i, 0, sizeof(struct RoomObject));
-                                                                            room->num_objects --;
-                                                                        } else if (switch_underneath) {
-                                                                            while (sw_i < room->num_switches - 1) {
-                                                                                room->switches[sw_i] = room->switches[sw_i+1];
-                                                                                sw_i++;
-                                                                            }
-                                                                            memset(room->switches + sw_i, 0, sizeof(struct SwitchObject));
-                                                                            room->num_switches --;
-                                                                        } else if (chunk_underneath) {
-                                                                            while (c < (signed) chunk_switch_underneath->chunks.length - 1) {
-                                                                                chunk_switch_underneath->chunks.data[c] = chunk_switch_underneath->chunks.data[c+1];
-                                                                                c++;
-                                                                            }
-                                                                            memset(chunk_switch_underneath->chunks.data + c, 0, sizeof(struct SwitchChunk));
-                                                                            chunk_switch_underneath->chunks.length --;
-                                                                        } else {
-                                                                            room->tiles[TILE_IDX(x, y)] = 0;
-                                                                        }
-                                                                        ARRAY_FREE(state->rooms.rooms[state->current_level].compressed);
-                                                                        assert(writeRooms(&state->rooms));
-                                                                    }
-                                                                }; break;
-
-                                                                default: fprintf(stderr, "%s:%d: UNIMPLEMENTED: csi terminator %c arg %d", __FILE__, __LINE__, buf[i], arg);
-                                                            }
-                                                        } else {
-                                                            fprintf(stderr, "%s:%d: UNIMPLEMENTED: csi terminator %c arg %d", __FILE__, __LINE__, buf[i], arg);
-                                                        }
-                                                    }
-                                                    i ++;
-                                                }
-                                            } else {
-                                                UNREACHABLE();
-                                            }
-                                            break;
+    [EDIT_SWITCHDETAILS_CHUNK_SWITCH_DETAILS]={
+        {OTHER_KEY, chunk_switch_typed},
+        {"r", chunk_switch_room_key},
+        {"o", cycle_chunk_off},
+        {"n", cycle_chunk_on},
+        CHUNK_KEYS,
+        {0},
+    },
 
-                                        default:
-                                            i += 2;
-                                            break;
-                                    }
-                                } else {
-                                    if (state->help) {
-                                        state->help = false;
-                                    } else {
-                                        if ((state->partial_byte & 0xFF00) != 0) {
-                                            state->partial_byte = 0;
-                                        }
-                                    }
-                                    i += 1; // Single escape
-                                }
-                                break;
+    // Printable keys are part of a room name
+    [EDIT_SWITCHDETAILS_CHUNK_SWITCH_DETAILS_ROOM]={
+        {OTHER_KEY, chunk_switch_room_typed},
+        {BACKSPACE, room_erase_key},
+        {DELETE, room_erase_key},
+        {"\033", chunk_switch_room_leave_key},
+        {CTRL_Q, chunk_switch_room_leave_key},
+        {CTRL_UNDERSCORE, toggle_help},
+        {CTRL_H, toggle_hex_typing},
+        {0},
+    },
 
-                            default:
-                                i += 1;
-                        }
-                    }
-                }; break;
+    [EDIT_SWITCHDETAILS_CHUNK_OBJECT_DETAILS]={
+        {OTHER_KEY, chunk_object_typed},
+        {"i", cycle_chunk_index},
+        {"s", cycle_chunk_test},
+        CHUNK_KEYS,
+        {0},
+    },
 
-                default: UNREACHABLE();
+    [TOGGLE_DISPLAY]={
+        {"a", display_all},
+        {"d", display_data},
+        {"g", display_graphics},
+        {"n", display_neighbours},
+        {"o", display_objects},
+        {"p", display_pos},
+        {"s", display_switches},
+        {"u", display_unknowns},
+        {CTRL_H, display_hex},
+        {"q", display_leave_key},
+        {"\033", display_leave_key},
+        {"?", toggle_help},
+        {CTRL_UNDERSCORE, toggle_help},
+        {0},
+    },
+
+    [WORLD_VIEW]={
+        {KEY_LEFT, world_left},
+        {"h", world_left},
+        {KEY_DOWN, world_down},
+        {"j", world_down},
+        {KEY_UP, world_up},
+        {"k", world_up},
+        {KEY_RIGHT, world_right},
+        {"l", world_right},
+        {"+", world_zoom_in},
+        {"-", world_zoom_out},
+        {"?", toggle_help},
+        {CTRL_UNDERSCORE, toggle_help},
+        {"w", leave_world},
+        {"q", leave_world},
+        {"\n", leave_world},
+        {"\033", leave_world},
+        {0},
+    },
+};
+#undef CHUNK_KEYS
+_Static_assert(NORMAL < TILE_EDIT, "TILE_EDIT copies the NORMAL keys, see build_keymaps");
+
+// Every key any state reads, so that escape sequences are known whole
+const char *known_keys[] = {
+    KEY_UP, KEY_DOWN, KEY_RIGHT, KEY_LEFT,
+    SHIFT_UP, SHIFT_DOWN, SHIFT_RIGHT, SHIFT_LEFT,
+    ALT_UP, ALT_DOWN, ALT_RIGHT, ALT_LEFT,
+    ALT_SHIFT_UP, ALT_SHIFT_DOWN, ALT_SHIFT_RIGHT, ALT_SHIFT_LEFT,
+    HOME, INSERT, DELETE, END, PAGE_UP, PAGE_DOWN, KEYPAD_5,
+    F1, F2, F3, F4, F5, F6, F7, F8, F9, F10, F11, F12,
+    PASTE_START,
+};
+
+// A trie of every key in keymaps and known_keys, built by build_keymaps once
+// per library load. Node 0 is the root, so 0 in next is no node.
+#define MAX_KEYS 128
+#define MAX_KEY_NODES 256
+#define MAX_KEY_LENGTH 16 // Longer escape sequences are cut up
+#define KEY_UNKNOWN (-1) // Not in the trie, still a whole key
+#define KEY_TRUNCATED (-2) // Escape sequence that never finished, dropped
+
+typedef struct {
+    uint8_t next[128];
+    int16_t key; // Index into key_sequences, or KEY_UNKNOWN if no key ends here
+} key_node;
+
+key_node key_trie[MAX_KEY_NODES];
+size_t key_trie_length = 0;
+const char *key_sequences[MAX_KEYS];
+size_t key_sequences_length = 0;
+key_action key_actions[NUM_STATES][MAX_KEYS];
+key_action other_key_actions[NUM_STATES]; // See OTHER_KEY
+int paste_key;
+
+int add_key(const char *key) {
+    assert(key[0] == ESCAPE || key[1] == '\0' || !"Only escape sequences can be longer than a byte");
+    size_t node = 0;
+    for (const char *c = key; *c != '\0'; c ++) {
+        uint8_t byte = *c;
+        assert(byte < C_ARRAY_LEN(key_trie[node].next));
+        if (key_trie[node].next[byte] == 0) {
+            assert(key_trie_length < MAX_KEY_NODES && "Raise MAX_KEY_NODES");
+            key_trie[key_trie_length].key = KEY_UNKNOWN;
+            key_trie[node].next[byte] = key_trie_length ++;
+        }
+        node = key_trie[node].next[byte];
+    }
+    if (key_trie[node].key == KEY_UNKNOWN) {
+        assert(key_sequences_length < MAX_KEYS && "Raise MAX_KEYS");
+        key_trie[node].key = key_sequences_length;
+        key_sequences[key_sequences_length ++] = key;
+    }
+    return key_trie[node].key;
+}
+
+void build_keymaps() {
+    memset(key_trie, 0, sizeof(key_trie));
+    memset(key_actions, 0, sizeof(key_actions));
+    memset(other_key_actions, 0, sizeof(other_key_actions));
+    key_trie[0].key = KEY_UNKNOWN;
+    key_trie_length = 1;
+    key_sequences_length = 0;
+    for (size_t k = 0; k < C_ARRAY_LEN(known_keys); k ++) add_key(known_keys[k]);
+    paste_key = add_key(PASTE_START);
+    for (game_state_state s = 0; s < NUM_STATES; s ++) {
+        if (s == TILE_EDIT) memcpy(key_actions[s], key_actions[NORMAL], sizeof(key_actions[s]));
+        for (key_binding *binding = keymaps[s]; binding->key != NULL; binding ++) {
+            if (binding->key[0] == '\0') {
+                other_key_actions[s] = binding->action;
+            } else {
+                key_actions[s][add_key(binding->key)] = binding->action;
             }
-#undef KEY_MATCHES
+        }
+    }
+}
+
+// Length of the key at the start of bytes, 0 when it is an escape sequence
+// that more bytes could still finish. Each byte is looked at once, the escape
+// sequence grammar says where a key ends and the trie which key it is.
+size_t decode_key(const char *bytes, size_t n, bool more, int *key) {
+    size_t node = 0;
+    size_t length = 0;
+    bool finished = false;
+    while (!finished) {
+        if (length == n) {
+            if (more) return 0;
+            break;
+        }
+        uint8_t byte = bytes[length ++];
+        if (node != 0 || length == 1) {
+            node = byte < C_ARRAY_LEN(key_trie[node].next) ? key_trie[node].next[byte] : 0;
+        }
+        if (bytes[0] != ESCAPE) {
+            finished = true;
+        } else if (length == 2) {
+            finished = byte != '[' && byte != 'O';
+        } else if (length > 2) {
+            // SS3 is one more byte, CSI ends on a byte in 0x40-0x7E
+            finished = bytes[1] == 'O' || (byte >= 0x40 && byte <= 0x7E) || length == MAX_KEY_LENGTH;
+        }
+    }
+    *key = node == 0 ? KEY_UNKNOWN : key_trie[node].key;
+    // Nothing came after a lone escape, so it was the key itself
+    if (!finished && length > 1) *key = KEY_TRUNCATED;
+    return length;
+}
+
+// buf is one whole key, key is its id in key_sequences or KEY_UNKNOWN
+void process_key(const char *buf, size_t n, int key) {
+    key_action action = key >= 0 ? key_actions[state->current_state][key] : NULL;
+    if (action == NULL && n == 1) action = other_key_actions[state->current_state];
+    typed_key = buf[0];
+    if (action != NULL) action();
+}
+
+// A bracketed paste of tiles, as display prints them, goes into the room with
+// its top left at the cursor as one edit. In other states it is typed.
+void paste(const char *text, size_t length) {
+    if (state->current_state != NORMAL && state->current_state != TILE_EDIT) {
+        size_t start = 0;
+        while (start < length) {
+            int key;
+            size_t n = decode_key(text + start, length - start, false, &key);
+            if (key != KEY_TRUNCATED && key != paste_key) process_key(text + start, n, key);
+            start += n;
+        }
+        return;
+    }
+    uint8_t tiles[WIDTH_TILES * HEIGHT_TILES];
+    size_t width, height;
+    char error[80];
+    if (!parseTiles(text, length, "paste", tiles, WIDTH_TILES, HEIGHT_TILES, &width, &height, error, sizeof(error))) {
+        notify("Paste is not tiles: %s", error);
+        return;
+    }
+    if (width == 0) return;
+    struct DecompresssedRoom *room = &state->rooms.rooms[state->current_level].data;
+    v2 cursor = state->cursors[state->current_level];
+    // Past the edge of the room is dropped
+    for (size_t y = 0; y < height && cursor.y + y < HEIGHT_TILES; y ++) {
+        for (size_t x = 0; x < width && cursor.x + x < WIDTH_TILES; x ++) {
+            room->tiles[TILE_IDX(cursor.x + x, cursor.y + y)] = tiles[y * WIDTH_TILES + x];
+        }
+    }
+    state->partial_byte = 0;
+    save_room();
+    notify("Pasted %zux%zu tiles", width, height);
+}
+
+// Reads everything waiting, so bursts are taken in one frame, and runs each
+// whole key. The start of an escape sequence is kept for the next frame, and
+// only taken as it is if nothing more arrived by then.
+void process_input() {
+    if (key_trie_length == 0) build_keymaps();
+    bool more = false;
+    for (;;) {
+        struct pollfd fd = {
+            .fd = STDIN_FILENO,
+            .events = POLLIN,
+        };
+        size_t space = sizeof(state->input) - state->input_length;
+        assert(poll(&fd, 1, 0) >= 0);
+        if (space == 0 || fd.revents == 0 || (fd.revents & POLLIN) == 0) break;
+        ssize_t n = read(fd.fd, state->input + state->input_length, space);
+        assert(n >= 0);
+        if (n == 0) break;
+        state->input_length += n;
+        more = true;
+    }
 
+    size_t start = 0;
+    while (start < state->input_length) {
+        char *input = state->input + start;
+        size_t left = state->input_length - start;
+        if (state->pasting) {
+            size_t length = 0;
+            bool ended = false;
+            for (; length < left; length ++) {
+                // Could be the start of PASTE_END, which waits for the next read
+                size_t rest = left - length;
+                if (input[length] == ESCAPE && memcmp(input + length, PASTE_END, rest < strlen(PASTE_END) ? rest : strlen(PASTE_END)) == 0) {
+                    ended = rest >= strlen(PASTE_END);
+                    break;
+                }
+                ARRAY_ADD(state->paste, input[length]);
+            }
+            start += length;
+            if (!ended) break;
+            start += strlen(PASTE_END);
+            state->pasting = false;
+            paste(state->paste.data, state->paste.length);
+            continue;
+        }
+        int key;
+        size_t length = decode_key(input, left, more, &key);
+        if (length == 0) break;
+        if (key == paste_key) {
+            state->pasting = true;
+            state->paste.length = 0;
+        } else if (key != KEY_TRUNCATED) {
+            process_key(input, length, key);
         }
+        start += length;
     }
+    memmove(state->input, state->input + start, state->input_length - start);
+    state->input_length -= start;
 }
 
 void update() {
@@ -4541,12 +3078,16 @@ help_keys help[][100] = {
         {"r[nn]", "goto room"},
         {"s[n]", "goto switch"},
         {"p", "play (runs play.sh)"},
+        {"u/U", "undo/redo"},
         {"q", "quit"},
         {"Ctrl-?", "toggle help"},
         {"Escape", "close/cancel"},
         {"Ctrl-h", "toggle hex in debug info"},
         {"Ctrl-t", "toggle tile edit mode"},
-        {"Ctrl-d[adnopsu]", "toggle display element"},
+        {"Ctrl-d[adgnopsu]", "toggle display element"},
+        {"Ctrl-w", "cycle write compression (fast/normal/best/fit)"},
+        {"w", "view the rooms around this one"},
+        {"Paste", "paste tiles at the cursor"},
         {0},
     },
 
@@ -4554,12 +3095,15 @@ help_keys help[][100] = {
         {"0-9a-fA-F", "Enter hex nibble"},
         {"Shift+dir", "Move thing under cursor"},
         {"Alt+dir", "Stretch thing under cursor"},
-        {"Alt+S+dir", "TODO Shrink thing under cursor"},
+        {"Alt+S+dir", "Shrink thing under cursor"},
         {"Left/h", "Move cursor left"},
         {"Down/j", "Move cursor down"},
         {"Up/k", "Move cursor up"},
         {"Right/l", "Move cursor right"},
         {"R", "edit room name"},
+        {"v", "start/stop selecting"},
+        {"y", "copy selection, or the tile under cursor"},
+        {"P", "paste copy at cursor"},
         {"r[nn]", "goto room"},
         {"Ctrl-r[ktdbcef|-]", "edit room detail"},
         {"Ctrl-s[eorcs]", "create/edit switch"},
@@ -4567,16 +3111,19 @@ help_keys help[][100] = {
         {"s[n]", "goto switch"},
         {"o[n]", "goto object"},
         {"Delete/Backspace", "remove nibble; delete thing; or clear tile"},
-        {"y", "TODO copy thing"},
         {"+", "increase id of thing under cursor"},
         {"-", "decrease id of thing under cursor"},
         {"p", "play (runs play.sh)"},
+        {"u/U", "undo/redo"},
         {"q", "quit"},
         {"Ctrl-?", "toggle help"},
         {"Escape", "close/cancel"},
         {"Ctrl-h", "toggle hex in debug info"},
         {"Ctrl-t", "toggle tile edit mode"},
-        {"Ctrl-d[adnopsu]", "toggle display element"},
+        {"Ctrl-d[adgnopsu]", "toggle display element"},
+        {"Ctrl-w", "cycle write compression (fast/normal/best/fit)"},
+        {"w", "view the rooms around this one"},
+        {"Paste", "paste tiles at the cursor"},
         {0},
     },
 
@@ -4630,6 +3177,7 @@ help_keys help[][100] = {
     [TOGGLE_DISPLAY]={
         {"a", "toggle all debug info"},
         {"d", "toggle room data display"},
+        {"g", "toggle tile graphics from " GRAPHICS_FILE},
         {"n", "toggle neighbour display"},
         {"o", "toggle room object display"},
         {"p", "toggle position display"},
@@ -4642,6 +3190,17 @@ help_keys help[][100] = {
         {0},
     },
 
+    [WORLD_VIEW]={
+        {"Left/h", "Go to room on the left"},
+        {"Down/j", "Go to room below"},
+        {"Up/k", "Go to room above"},
+        {"Right/l", "Go to room on the right"},
+        {"+/-", "zoom in/out"},
+        {"w/q/Enter/ESC", "back to editing the room"},
+        {"Ctrl-?", "toggle help"},
+        {0},
+    },
+
     [EDIT_ROOMDETAILS]={
         {"g", "Edit room background"},
         {"t", "Edit room tileset"},
@@ -4866,9 +3425,19 @@ void show_help()
 }
 
 void redraw() {
+    // Done before clearing, as compressing a dirty room logs to stdout
+    size_t file_size = compressedFileSize(&state->rooms);
+    size_t room_size = compressedRoomSize(&state->rooms.arena, &state->rooms.rooms[state->current_level]);
+    validate(&state->validator, &state->rooms);
+    size_t problems = validatorCount(&state->validator, state->current_level);
+
     GOTO(0, 0);
     printf(RESET_GFX_MODE CLEAR_SCREEN);
 #define PRINTF_DATA(num) printf(state->debug.hex ? "%02X" : "%d", (num))
+    if (state->current_state == WORLD_VIEW) {
+        redraw_world();
+        goto show_help_if_needed;
+    }
 
     int offset_y = 0;
     int offset_x = 0;
@@ -4877,6 +3446,11 @@ void redraw() {
     if (state->debug.unknowns) offset_y ++;
     if (state->debug.neighbours) offset_y += 4;
     if (state->debug.objects) offset_y ++;
+    if (problems > 0) offset_y ++;
+    bool rebuilt = state->rebuilt.tv_sec != 0 && rebuild_seconds(state->rebuilt) < REBUILD_SHOWN;
+    if (rebuilt) offset_y ++;
+    bool noticed = state->noticed.tv_sec != 0 && rebuild_seconds(state->noticed) < NOTICE_SHOWN;
+    if (noticed) offset_y ++;
 
     size_t level = state->current_level;
     struct DecompresssedRoom room = state->rooms.rooms[level].data;
@@ -4930,8 +3504,8 @@ void redraw() {
     size_t obj_i = i;
     for (i = 0; i < room.num_switches; i ++) {
         struct SwitchObject *switcch = room.switches + i;
-        if (switcch->chunks.length > 0 && switcch->chunks.data[0].type == PREAMBLE &&
-                x == switcch->chunks.data[0].x && y == switcch->chunks.data[0].y) {
+        if (switcch->chunks.length > 0 && SMALL_ARRAY_DATA(switcch->chunks)[0].type == PREAMBLE &&
+                x == SMALL_ARRAY_DATA(switcch->chunks)[0].x && y == SMALL_ARRAY_DATA(switcch->chunks)[0].y) {
             sw = true;
             switch_underneath = switcch;
             break;
@@ -4942,7 +3516,7 @@ void redraw() {
         struct SwitchObject *switcch = room.switches + i;
         size_t c;
         for (c = 1; c < switcch->chunks.length; c ++) {
-            struct SwitchChunk *chunk = switcch->chunks.data + c;
+            struct SwitchChunk *chunk = SMALL_ARRAY_DATA(switcch->chunks) + c;
             if (chunk->type == TOGGLE_BLOCK) {
                 if (chunk->dir == HORIZONTAL) {
                     if (y == chunk->y && x >= chunk->x && x < chunk->x + chunk->size) {
@@ -5009,6 +3583,23 @@ void redraw() {
 
     GOTO(6, 0);
     printf("%s", state->debug.hex ? "[HEX]" : "[DEC]");
+    if (state->rebuild == REBUILD_RUNNING) printf(" \033[33m[BUILD]\033[m");
+    else if (state->rebuild == REBUILD_FAILED) printf(" \033[31;1m[BUILD FAILED]\033[m");
+
+    {
+        char budget[32];
+        long remaining = (long)MAX_ROOM_FILE_SIZE - (long)file_size;
+        int len = snprintf(budget, sizeof(budget), state->debug.hex ? "%s %zX %c%lX" : "%s %zu %c%lu",
+                COMPRESS_LEVEL(state->compress_level), room_size, remaining < 0 ? '-' : '+', (unsigned long)labs(remaining));
+        GOTO(MIN_WIDTH - len, 0);
+        if (remaining < 0) {
+            printf("\033[41;30;1m%s\033[m", budget);
+        } else if (remaining < BUDGET_WARNING) {
+            printf("\033[33;1m%s\033[m", budget);
+        } else {
+            printf("%s", budget);
+        }
+    }
 
     GOTO(MIN_WIDTH / 2 - ((room_name_len + 7) / 2), 0);
     if (state->current_state == GOTO_ROOM || state->current_state == EDIT_ROOMDETAILS_ROOM || state->current_state == EDIT_SWITCHDETAILS_CHUNK_SWITCH_DETAILS_ROOM) {
@@ -5230,8 +3821,8 @@ for (int i = C_ARRAY_LEN(neighbour_name) - 1; i >= 0; i --) { \
                 int s;
                 for (s = 0; s < room.num_switches; s ++) {
                     struct SwitchObject *switcch = room.switches + s;
-                    if (switcch->chunks.length > 0 && switcch->chunks.data[0].type == PREAMBLE &&
-                            x == switcch->chunks.data[0].x && y == switcch->chunks.data[0].y) {
+                    if (switcch->chunks.length > 0 && SMALL_ARRAY_DATA(switcch->chunks)[0].type == PREAMBLE &&
+                            x == SMALL_ARRAY_DATA(switcch->chunks)[0].x && y == SMALL_ARRAY_DATA(switcch->chunks)[0].y) {
                         found_switch = switcch;
                         break;
                     }
@@ -5255,6 +3846,8 @@ for (int i = C_ARRAY_LEN(neighbour_name) - 1; i >= 0; i --) { \
             }
         }
     } else {
+        v2 from, to;
+        bool selected = selection(&from, &to);
         for (int y = 0; y < HEIGHT_TILES; y ++) {
             for (int x = 0; x < WIDTH_TILES; x ++) {
                 uint8_t tile = room.tiles[TILE_IDX(x, y)];
@@ -5262,14 +3855,14 @@ for (int i = C_ARRAY_LEN(neighbour_name) - 1; i >= 0; i --) { \
                 if (state->debug.switches && state->current_state != GOTO_OBJECT)
                 for (int s = 0; s < room.num_switches; s ++) {
                     struct SwitchObject *sw = room.switches + s;
-                    assert(sw->chunks.length > 0 && sw->chunks.data[0].type == PREAMBLE);
-                    if (x == sw->chunks.data[0].x && y == sw->chunks.data[0].y) {
+                    assert(sw->chunks.length > 0 && SMALL_ARRAY_DATA(sw->chunks)[0].type == PREAMBLE);
+                    if (x == SMALL_ARRAY_DATA(sw->chunks)[0].x && y == SMALL_ARRAY_DATA(sw->chunks)[0].y) {
                         colored = true;
                         printf("\033[4%d;30m", (s % 3) + 4);
                         break;
                     }
                     for (size_t c = 1; !colored && c < sw->chunks.length; c ++) {
-                        struct SwitchChunk *chunk = sw->chunks.data + c;
+                        struct SwitchChunk *chunk = SMALL_ARRAY_DATA(sw->chunks) + c;
                         if (chunk->type == TOGGLE_BLOCK) {
                             if (chunk->dir == HORIZONTAL) {
                                 if (y == chunk->y && x >= chunk->x && x < chunk->x + chunk->size) {
@@ -5293,7 +3886,16 @@ for (int i = C_ARRAY_LEN(neighbour_name) - 1; i >= 0; i --) { \
                         }
                     }
                 }
-                if (colored || tile != BLANK_TILE) {
+                if (selected && inside(from, to, x, y, 1, 1)) {
+                    printf("\033[7m");
+                    colored = true;
+                }
+                size_t length = 0;
+                const char *glyph = !colored && state->graphics.shown ? tile_glyph(tile, room.tile_offset, &length) : NULL;
+                if (glyph != NULL) {
+                    GOTO(2 * x, y + 1);
+                    fwrite(glyph, 1, length, stdout);
+                } else if (colored || tile != BLANK_TILE) {
                     GOTO(2 * x, y + 1);
                     printf("%02X", tile);
                     if (colored) printf("\033[m");
@@ -5465,6 +4067,24 @@ for (int i = C_ARRAY_LEN(neighbour_name) - 1; i >= 0; i --) { \
     int bottom = HEIGHT_TILES + 1;
 
     if (debugany()) bottom ++;
+    if (problems > 0) {
+        Diagnostic *first = validatorFirst(&state->validator, level);
+        GOTO(0, bottom); bottom ++;
+        printf("\033[33;1m%s: %s\033[m", VALIDATION_RULE(first->rule), first->message);
+        if (problems > 1) printf(" (+%zu more)", problems - 1);
+    }
+    if (rebuilt) {
+        GOTO(0, bottom); bottom ++;
+        printf("Rebuilt");
+        for (size_t i = 0; i < NUM_LIBRARY_UNITS; i ++) {
+            if (state->units[i].seconds > 0) printf(" %s %.2fs,", library_units[i].source, state->units[i].seconds);
+        }
+        printf(" %.2fs in all", state->rebuild_total);
+    }
+    if (noticed) {
+        GOTO(0, bottom); bottom ++;
+        printf("%s", state->notice);
+    }
     if (state->debug.data) {
         GOTO(0, bottom); bottom ++;
         switch (state->current_state) {
@@ -5796,7 +4416,7 @@ for (int i = C_ARRAY_LEN(neighbour_name) - 1; i >= 0; i --) { \
         struct SwitchObject *switcz = switch_underneath;
         if (switcz) {
             for (size_t i = switcz - room.switches + 1; i < room.num_switches; i ++) {
-                if (room.switches[i].chunks.data[0].x == x && room.switches[i].chunks.data[0].y == y) {
+                if (SMALL_ARRAY_DATA(room.switches[i].chunks)[0].x == x && SMALL_ARRAY_DATA(room.switches[i].chunks)[0].y == y) {
                     fprintf(stderr, "%s:%d: %s: UNIMPLEMENTED: multiple switches underneath\n", __FILE__, __LINE__, __func__);
                     break;
                 }
@@ -5806,7 +4426,7 @@ for (int i = C_ARRAY_LEN(neighbour_name) - 1; i >= 0; i --) { \
         if (state->current_state != GOTO_SWITCH && switcz != NULL) {
 #define BOOL_S(b) ((b) ? "true" : "false")
             assert(switcz->chunks.length >= 1);
-            struct SwitchChunk *preamble = switcz->chunks.data;
+            struct SwitchChunk *preamble = SMALL_ARRAY_DATA(switcz->chunks);
             if (state->current_state == EDIT_SWITCHDETAILS) {
                 printf("switch ");
                 if (switcz == switch_underneath) printf("\033[4;1m");
@@ -5836,7 +4456,7 @@ for (int i = C_ARRAY_LEN(neighbour_name) - 1; i >= 0; i --) { \
                 bottom ++;
                 for (size_t i = 1; i < switcz->chunks.length; i ++) {
                     printf("    ");
-                    if ((state->current_state != EDIT_SWITCHDETAILS_SELECT_CHUNK && switcz == chunk_switch_underneath && (size_t)(chunk_underneath - switcz->chunks.data) == i) ||
+                    if ((state->current_state != EDIT_SWITCHDETAILS_SELECT_CHUNK && switcz == chunk_switch_underneath && (size_t)(chunk_underneath - SMALL_ARRAY_DATA(switcz->chunks)) == i) ||
                             (state->current_state == EDIT_SWITCHDETAILS_SELECT_CHUNK || state->current_chunk == i)) {
                         printf("\033[1;4m(");
                         PRINTF_DATA((uint16_t)i);
@@ -5851,7 +4471,7 @@ for (int i = C_ARRAY_LEN(neighbour_name) - 1; i >= 0; i --) { \
                     } else {
                         printf("type ");
                     }
-                    struct SwitchChunk *chunk = switcz->chunks.data + i;
+                    struct SwitchChunk *chunk = SMALL_ARRAY_DATA(switcz->chunks) + i;
                     switch (chunk->type) {
                         case PREAMBLE: UNREACHABLE();
                         case TOGGLE_BLOCK: {
@@ -6122,8 +4742,8 @@ for (int i = C_ARRAY_LEN(neighbour_name) - 1; i >= 0; i --) { \
         uint8_t found = 0;
         for (size_t s = 0; s < room.num_switches; s ++) {
             struct SwitchObject *sw = room.switches + s;
-            int x = sw->chunks.data[0].x;
-            int y = sw->chunks.data[0].y;
+            int x = SMALL_ARRAY_DATA(sw->chunks)[0].x;
+            int y = SMALL_ARRAY_DATA(sw->chunks)[0].y;
             if (x >= WIDTH_TILES || y >= HEIGHT_TILES) {
                 found = 1;
                 break;
@@ -6136,8 +4756,8 @@ for (int i = C_ARRAY_LEN(neighbour_name) - 1; i >= 0; i --) { \
         }
         for (size_t s = 0; s < room.num_switches; s ++) {
             struct SwitchObject *sw = room.switches + s;
-            int x = sw->chunks.data[0].x;
-            int y = sw->chunks.data[0].y;
+            int x = SMALL_ARRAY_DATA(sw->chunks)[0].x;
+            int y = SMALL_ARRAY_DATA(sw->chunks)[0].y;
             if (x >= WIDTH_TILES || y >= HEIGHT_TILES) {
                 GOTO(0, bottom); bottom ++;
 #define BOOL_S(b) ((b) ? "true" : "false")
@@ -6145,12 +4765,12 @@ for (int i = C_ARRAY_LEN(neighbour_name) - 1; i >= 0; i --) { \
                     printf("\033[1;4mswitch id ");
                     PRINTF_DATA((uint16_t)s);
                     printf("\033[m: (x,y)=");
-                    PRINTF_DATA(sw->chunks.data[0].x);
+                    PRINTF_DATA(SMALL_ARRAY_DATA(sw->chunks)[0].x);
                     printf(",");
-                    PRINTF_DATA(sw->chunks.data[0].y);
+                    PRINTF_DATA(SMALL_ARRAY_DATA(sw->chunks)[0].y);
                     printf(" (\033[1;4me\033[mntry)=%s (\033[1;4mo\033[mnce)=%s (\033[1;4ms\033[mide)=%s\n",
-                            BOOL_S(sw->chunks.data[0].room_entry), BOOL_S(sw->chunks.data[0].one_time_use),
-                            SWITCH_SIDE(sw->chunks.data[0].side));
+                            BOOL_S(SMALL_ARRAY_DATA(sw->chunks)[0].room_entry), BOOL_S(SMALL_ARRAY_DATA(sw->chunks)[0].one_time_use),
+                            SWITCH_SIDE(SMALL_ARRAY_DATA(sw->chunks)[0].side));
 
                 } else {
                     printf("switch id ");
@@ -6162,12 +4782,12 @@ for (int i = C_ARRAY_LEN(neighbour_name) - 1; i >= 0; i --) { \
                         PRINTF_DATA((uint16_t)s);
                     }
                     printf(": (x,y)=");
-                    PRINTF_DATA(sw->chunks.data[0].x);
+                    PRINTF_DATA(SMALL_ARRAY_DATA(sw->chunks)[0].x);
                     printf(",");
-                    PRINTF_DATA(sw->chunks.data[0].y);
+                    PRINTF_DATA(SMALL_ARRAY_DATA(sw->chunks)[0].y);
                     printf(" (entry)=%s (once)=%s (side)=%s\n",
-                            BOOL_S(sw->chunks.data[0].room_entry), BOOL_S(sw->chunks.data[0].one_time_use),
-                            SWITCH_SIDE(sw->chunks.data[0].side));
+                            BOOL_S(SMALL_ARRAY_DATA(sw->chunks)[0].room_entry), BOOL_S(SMALL_ARRAY_DATA(sw->chunks)[0].one_time_use),
+                            SWITCH_SIDE(SMALL_ARRAY_DATA(sw->chunks)[0].side));
                 }
 
                 bottom ++;
@@ -6193,7 +4813,7 @@ for (int i = C_ARRAY_LEN(neighbour_name) - 1; i >= 0; i --) { \
                             PRINTF_DATA((uint16_t)i);
                             printf(") ");
                         }
-                        struct SwitchChunk *chunk = sw->chunks.data + i;
+                        struct SwitchChunk *chunk = SMALL_ARRAY_DATA(sw->chunks) + i;
                         switch (chunk->type) {
                             case PREAMBLE: UNREACHABLE();
                             case TOGGLE_BLOCK: {
@@ -6326,87 +4946,380 @@ void sigwinch_handler(int arg) {
     }
 }
 
-void setup() {
-    assert(state == NULL && "Already setup");
-    printf(SAVE_CURSOR HIDE_CURSOR SAVE_SCREEN ENABLE_ALT_BUFFER);
-
-    state = calloc(1, sizeof(game_state));
-    assert(state != NULL && "Not enough memory");
-    state->size = sizeof(game_state);
-
-    debugalltoggle(state);
-    state->current_state = TILE_EDIT;
-    state->partial_byte = 0;
-
+void init_terminal() {
+    printf(SAVE_CURSOR HIDE_CURSOR SAVE_SCREEN ENABLE_ALT_BUFFER ENABLE_BRACKETED_PASTE);
     assert(tcgetattr(STDIN_FILENO, &state->original_termios) == 0);
 
     struct termios new = state->original_termios;
     new.c_lflag &= ~(ICANON | ECHO);
     new.c_iflag &= ~(IXON | IXOFF);
     assert(tcsetattr(STDIN_FILENO, TCSANOW, &new) == 0);
+}
 
-    get_screen_dimensions();
-
+void init_rooms() {
     assert(readRooms(&state->rooms) && "Check that you have ROOMS.SPL");
+}
 
+void init_cursors() {
     for (size_t i = 0; i < C_ARRAY_LEN(state->cursors); i ++) {
         state->cursors[i].x = WIDTH_TILES / 2;
         state->cursors[i].y = HEIGHT_TILES / 2;
     }
-    state->current_level = 1;
-    state->cursors[state->current_level].x = 3;
-    state->cursors[state->current_level].y = HEIGHT_TILES - 2;
+    state->cursors[1].x = 3;
+    state->cursors[1].y = HEIGHT_TILES - 2;
+}
 
+void init_current_level() { state->current_level = 1; }
+void init_current_state() { state->current_state = TILE_EDIT; }
+void init_help() { state->help = true; }
+void init_compress_level() { state->compress_level = COMPRESS_FIT; }
 
-    state->help = true;
+void init_debug() {
+    debugalltoggle(state);
     state->debug.hex = true;
 }
 
+// Release hooks get what an older build left in a field that is not kept,
+// and only free it when old_size says it is laid out as they expect
+void release_rooms(void *old, size_t old_size, int old_version) {
+    (void)old_version;
+    if (old_size == sizeof(RoomFile)) freeRoomFile(old);
+}
+
+void release_history(void *old, size_t old_size, int old_version) {
+    (void)old_version;
+    // Whatever UNDO_DEPTH was, the snapshots past history_length are empty
+    for (size_t i = 0; old_size % sizeof(RoomSnapshot) == 0 && i < old_size / sizeof(RoomSnapshot); i ++) {
+        releaseSnapshot((RoomSnapshot *)old + i);
+    }
+}
+
+void release_validator(void *old, size_t old_size, int old_version) {
+    (void)old_version;
+    if (old_size == sizeof(Validator)) freeValidator(old);
+}
+
+void release_control_fd(void *old, size_t old_size, int old_version) {
+    (void)old_version;
+    if (old_size == sizeof(int) && *(int *)old != -1) close(*(int *)old);
+}
+
+void release_control_clients(void *old, size_t old_size, int old_version) {
+    (void)old_version;
+    for (size_t i = 0; old_size % sizeof(control_client) == 0 && i < old_size / sizeof(control_client); i ++) {
+        control_client *client = (control_client *)old + i;
+        if (client->fd != 0) close(client->fd);
+        ARRAY_FREE(client->input);
+    }
+}
+
+void release_paste(void *old, size_t old_size, int old_version) {
+    (void)old_version;
+    ARRAY(char) *paste = old;
+    if (old_size == sizeof(*paste)) ARRAY_FREE(*paste);
+}
+
+void release_clipboard(void *old, size_t old_size, int old_version) {
+    (void)old_version;
+    if (old_size != sizeof(tile_clipboard)) return;
+    ARRAY_FREE(((tile_clipboard *)old)->objects);
+    ARRAY_FREE(((tile_clipboard *)old)->chunks);
+}
+
+typedef struct {
+    char *name;
+    size_t offset;
+    size_t size;
+    int version; // Bump when the field changes in a way that keeps its size
+    char *requires; // Only kept when this earlier field was as well
+    void (*init)(); // When it was not kept, in this order. NULL leaves it zeroed
+    // Given the field an older build left with another size or version, fills
+    // in state's. Returns false to drop it instead. NULL always drops it.
+    bool (*migrate)(void *old, size_t old_size, int old_version);
+    // Frees whatever a dropped field from an older build still holds
+    void (*release)(void *old, size_t old_size, int old_version);
+} state_field;
+
+#define STATE_FIELD(field, version, requires, init) STATE_FIELD_HOOKS(field, version, requires, init, NULL, NULL)
+#define STATE_FIELD_HOOKS(field, version, requires, init, migrate, release) \
+    { #field, offsetof(game_state, field), sizeof(((game_state *)NULL)->field), (version), (requires), (init), (migrate), (release) }
+
+// Every field of game_state but layout
+state_field state_fields[] = {
+    STATE_FIELD(original_termios, 0, NULL, init_terminal),
+    STATE_FIELD_HOOKS(rooms, 0, NULL, init_rooms, NULL, release_rooms),
+    STATE_FIELD(rooms_mtime, 0, "rooms", NULL),
+    STATE_FIELD_HOOKS(history, 0, "rooms", record_history, NULL, release_history),
+    STATE_FIELD(history_length, 0, "history", NULL),
+    STATE_FIELD(history_current, 0, "history", NULL),
+    STATE_FIELD_HOOKS(validator, 0, "rooms", NULL, NULL, release_validator),
+    STATE_FIELD_HOOKS(control_fd, 0, NULL, control_setup, NULL, release_control_fd),
+    STATE_FIELD_HOOKS(control_clients, 0, "control_fd", NULL, NULL, release_control_clients),
+    STATE_FIELD(current_state, 0, NULL, init_current_state),
+    STATE_FIELD(previous_state, 0, NULL, NULL),
+    STATE_FIELD(cursors, 0, NULL, init_cursors),
+    STATE_FIELD(current_level, 0, NULL, init_current_level),
+    STATE_FIELD(screen_dimensions, 0, NULL, NULL),
+    STATE_FIELD(resized, 0, NULL, NULL),
+    STATE_FIELD(help, 0, NULL, init_help),
+    STATE_FIELD(debug, 0, NULL, init_debug),
+    STATE_FIELD(partial_byte, 0, NULL, NULL),
+    STATE_FIELD(room_detail, 0, NULL, NULL),
+    STATE_FIELD(room_name, 0, NULL, NULL),
+    STATE_FIELD(roomname_length, 0, NULL, NULL),
+    STATE_FIELD(roomname_cursor, 0, NULL, NULL),
+    STATE_FIELD(current_switch, 0, NULL, NULL),
+    STATE_FIELD(current_chunk, 0, NULL, NULL),
+    STATE_FIELD(switch_on, 0, NULL, NULL),
+    STATE_FIELD(compress_level, 0, NULL, init_compress_level),
+    STATE_FIELD(rebuild, 0, NULL, NULL),
+    STATE_FIELD(units, 0, NULL, NULL),
+    STATE_FIELD(link_pid, 0, NULL, NULL),
+    STATE_FIELD(rebuild_started, 0, NULL, NULL),
+    STATE_FIELD(rebuild_total, 0, NULL, NULL),
+    STATE_FIELD(rebuilt, 0, NULL, NULL),
+    STATE_FIELD(input, 0, NULL, NULL),
+    STATE_FIELD(input_length, 0, "input", NULL),
+    STATE_FIELD(pasting, 0, NULL, NULL),
+    STATE_FIELD_HOOKS(paste, 0, "pasting", NULL, NULL, release_paste),
+    STATE_FIELD(notice, 0, NULL, NULL),
+    STATE_FIELD(noticed, 0, NULL, NULL),
+    STATE_FIELD(selecting, 0, NULL, NULL),
+    STATE_FIELD(mark, 0, "selecting", NULL),
+    STATE_FIELD(mark_level, 0, "selecting", NULL),
+    STATE_FIELD_HOOKS(clipboard, 0, NULL, NULL, NULL, release_clipboard),
+    STATE_FIELD(world, 0, "rooms", NULL),
+    STATE_FIELD(graphics, 0, NULL, NULL),
+};
+_Static_assert(C_ARRAY_LEN(state_fields) <= MAX_STATE_FIELDS, "Too many fields for state_layout");
+
+// Makes state from whatever the previous build of the library left in
+// previous, or from scratch if that is NULL. Fields with the same name, size
+// and version are moved over, so a reload that adds or changes a field keeps
+// the rooms, undo history and cursors. One that changed is kept if its
+// migrate hook can fill it in, otherwise it goes to its release hook. Fields
+// no longer in state_fields are dropped without being freed.
+void setup(void *previous) {
+    assert(state == NULL && "Already setup");
+    state_layout *old = previous;
+    if (old != NULL && old->magic != STATE_LAYOUT_MAGIC) {
+        fprintf(stderr, "State has no layout, starting again\n");
+        free(old);
+        old = NULL;
+    }
+
+    state = calloc(1, sizeof(game_state));
+    assert(state != NULL && "Not enough memory");
+    bool kept[C_ARRAY_LEN(state_fields)] = {0};
+    for (size_t i = 0; old != NULL && i < C_ARRAY_LEN(state_fields); i ++) {
+        state_field *field = &state_fields[i];
+        bool required = true;
+        if (field->requires != NULL) {
+            size_t r = 0;
+            while (r < i && strcmp(state_fields[r].name, field->requires) != 0) r ++;
+            assert(r < i && "Fields must come after the one they require");
+            required = kept[r];
+        }
+        state_field_layout *was = NULL;
+        for (size_t f = 0; was == NULL && f < old->num_fields; f ++) {
+            if (strcmp(old->fields[f].name, field->name) == 0) was = &old->fields[f];
+        }
+        if (was == NULL) continue;
+        void *from = (uint8_t *)old + was->offset;
+        if (required && was->size == field->size && was->version == field->version) {
+            memcpy((uint8_t *)state + field->offset, from, field->size);
+            kept[i] = true;
+        } else if (required && field->migrate != NULL) {
+            kept[i] = field->migrate(from, was->size, was->version);
+        }
+        if (!kept[i] && field->release != NULL) field->release(from, was->size, was->version);
+    }
+    free(old);
+
+    state->layout.magic = STATE_LAYOUT_MAGIC;
+    state->layout.num_fields = C_ARRAY_LEN(state_fields);
+    for (size_t i = 0; i < C_ARRAY_LEN(state_fields); i ++) {
+        state_field *field = &state_fields[i];
+        state_field_layout *layout = &state->layout.fields[i];
+        assert(strlen(field->name) < sizeof(layout->name));
+        strcpy(layout->name, field->name);
+        layout->offset = field->offset;
+        layout->size = field->size;
+        layout->version = field->version;
+    }
+
+    for (size_t i = 0; i < C_ARRAY_LEN(state_fields); i ++) {
+        if (!kept[i] && state_fields[i].init != NULL) state_fields[i].init();
+    }
+}
+
+// Runs command in the background with its output added to REBUILD_LOG,
+// returns 0 if it could not
+pid_t rebuild_spawn(char *command) {
+    char *shell_cmd = NULL;
+    assert(asprintf(&shell_cmd, "%s >>%s 2>&1", command, REBUILD_LOG) > 0);
+    pid_t child = fork();
+    if (child == 0) {
+        execl("/bin/sh", "sh", "-c", shell_cmd, (char *)NULL);
+        _exit(127);
+    }
+    free(shell_cmd);
+    if (child == -1) {
+        perror("fork");
+        return 0;
+    }
+    return child;
+}
+
+// Compiles the units with an object older than their sources, all at once,
+// so that editing carries on meanwhile. rebuild_poll links them into
+// library.new once they are all done.
+void rebuild_start() {
+    FILE *log = fopen(REBUILD_LOG, "w");
+    if (log != NULL) fclose(log);
+    state->rebuild = REBUILD_RUNNING;
+    assert(clock_gettime(CLOCK_MONOTONIC, &state->rebuild_started) == 0);
+    for (size_t i = 0; i < NUM_LIBRARY_UNITS; i ++) {
+        library_unit *unit = &library_units[i];
+        struct stat object_stat;
+        state->units[i].failed = false;
+        state->units[i].stale = false;
+        state->units[i].seconds = 0;
+        if (stat(unit->object, &object_stat) == 0 && !unit_newer(unit, object_stat.st_mtim)) continue;
+        char *build_cmd = NULL;
+        assert(asprintf(&build_cmd, "%s %s -o %s", UNIT_BUILD_CMD, unit->source, unit->object) > 0);
+        assert(clock_gettime(CLOCK_MONOTONIC, &state->units[i].started) == 0);
+        assert(clock_gettime(CLOCK_REALTIME, &state->units[i].source_time) == 0);
+        state->units[i].pid = rebuild_spawn(build_cmd);
+        state->units[i].failed = state->units[i].pid == 0;
+        free(build_cmd);
+    }
+}
+
+// Returns whether the child finished, failed says how
+bool rebuild_reap(pid_t *pid, bool *failed) {
+    int status;
+    pid_t ret = waitpid(*pid, &status, WNOHANG);
+    if (ret == 0) return false;
+    if (ret == -1) perror("waitpid");
+    *failed = ret == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+    *pid = 0;
+    return true;
+}
+
+// Returns true once, when library.new has been linked
+bool rebuild_poll(char *library) {
+    if (state->rebuild != REBUILD_RUNNING) return false;
+    bool compiling = false;
+    bool failed = false;
+    bool stale = false;
+    for (size_t i = 0; i < NUM_LIBRARY_UNITS; i ++) {
+        if (state->units[i].pid != 0 && rebuild_reap(&state->units[i].pid, &state->units[i].failed)) {
+            state->units[i].seconds = rebuild_seconds(state->units[i].started);
+            // Saved while it compiled, its object is newer than the source it
+            // was built from, so rebuild_start would otherwise skip it
+            if (unit_newer(&library_units[i], state->units[i].source_time)) {
+                unlink(library_units[i].object);
+                state->units[i].stale = true;
+            }
+        }
+        compiling = compiling || state->units[i].pid != 0;
+        failed = failed || state->units[i].failed;
+        stale = stale || state->units[i].stale;
+    }
+    if (compiling) return false;
+    if (stale) {
+        // Not worth linking, the loop starts the next rebuild
+        state->rebuild = REBUILD_IDLE;
+        return false;
+    }
+    if (failed) {
+        state->rebuild = REBUILD_FAILED;
+        return false;
+    }
+
+    if (state->link_pid == 0) {
+        char *link_cmd = NULL;
+        assert(asprintf(&link_cmd, "%s -o %s.new", UNIT_LINK_CMD, library) > 0);
+        for (size_t i = 0; i < NUM_LIBRARY_UNITS; i ++) {
+            char *with_object = NULL;
+            assert(asprintf(&with_object, "%s %s", link_cmd, library_units[i].object) > 0);
+            free(link_cmd);
+            link_cmd = with_object;
+        }
+        state->link_pid = rebuild_spawn(link_cmd);
+        free(link_cmd);
+        if (state->link_pid == 0) state->rebuild = REBUILD_FAILED;
+        return false;
+    }
+    if (!rebuild_reap(&state->link_pid, &failed)) return false;
+    state->rebuild = failed ? REBUILD_FAILED : REBUILD_IDLE;
+    state->rebuild_total = rebuild_seconds(state->rebuild_started);
+    assert(clock_gettime(CLOCK_MONOTONIC, &state->rebuilt) == 0);
+    return !failed;
+}
+
 typedef void *(*main_fn)(char *library, void *call_state);
 void *loop_main(char *library, void *call_state) {
+#if !defined(EDITOR_IN_PROCESS) && !defined(EDITOR_RELEASE)
     struct stat library_stat;
     assert(stat(library, &library_stat) == 0);
-    struct stat start_rooms_stat;
-    assert(stat("ROOMS.SPL", &start_rooms_stat) == 0);
+#endif
+    struct stat rooms_stat;
+    assert(stat("ROOMS.SPL", &rooms_stat) == 0);
 
-    state = call_state;
-    if (state != NULL && state->size != sizeof(game_state)) {
-        free(state);
-        state = NULL;
-    }
-    if (state == NULL) setup();
-    else get_screen_dimensions();
+    state = NULL;
+    setup(call_state);
+    get_screen_dimensions();
+    state->rooms_mtime = rooms_stat.st_mtim;
 
     signal(SIGWINCH, sigwinch_handler);
     signal(SIGINT, end);
-
+    // Scripts on CONTROL_SOCKET can hang up before reading their replies
+    signal(SIGPIPE, SIG_IGN);
+
+#if defined(EDITOR_IN_PROCESS)
+    (void)library;
+    struct timespec test_time = editor_compile.started;
+    state->rebuild = editor_compile.failed ? REBUILD_FAILED : REBUILD_IDLE;
+#elif defined(EDITOR_RELEASE)
+    (void)library;
+#else
     struct timespec test_time = library_stat.st_mtim;
+#endif
     while (true) {
-        struct stat rooms_stat;
-        if (any_source_newer(test_time)) {
-            // rebuild
-            char *build_cmd = NULL;
-            assert(asprintf(&build_cmd, "%s %s %s", LIBRARY_BUILD_CMD, library, __FILE__) > 0);
-            fprintf(stderr, "Rebuilding editor library: %s\n", build_cmd);
-            int ret = system(build_cmd);
-            if (ret == 0) {
-                fprintf(stderr, "Reloading library\n");
-                free(build_cmd);
-                return state;
-            }
-            if (ret == -1) perror("system");
-            fprintf(stderr, "--- Recompile failed not reloading (%d)---\n", ret);
-            free(build_cmd);
+#if defined(EDITOR_IN_PROCESS)
+        // Takes tens of milliseconds, so it is done between frames by editor_main_in_process
+        if (any_source_newer(test_time)) return state;
+#elif !defined(EDITOR_RELEASE)
+        // Sources changed during a build are picked up by the next one,
+        // which starts once this one is done
+        if (state->rebuild != REBUILD_RUNNING && any_source_newer(test_time)) {
             if (clock_gettime(CLOCK_REALTIME, &test_time) == -1) {
                 perror("clock_gettime");
             }
+            rebuild_start();
+        }
+        // Between frames nothing points into the library, so it is safe to swap
+        if (rebuild_poll(library) && !any_source_newer(test_time)) {
+            char *built = NULL;
+            assert(asprintf(&built, "%s.new", library) > 0);
+            bool renamed = rename(built, library) == 0;
+            if (!renamed) perror("rename");
+            free(built);
+            if (renamed) return state;
+            state->rebuild = REBUILD_FAILED;
         }
+#endif
         if (stat("ROOMS.SPL", &rooms_stat) == 0) {
-            if (TIME_NEWER(rooms_stat.st_mtim, start_rooms_stat.st_mtim)) {
+            if (TIME_NEWER(rooms_stat.st_mtim, state->rooms_mtime)) {
                 fprintf(stderr, "Reloading ROOMS.SPL\n");
-                freeRoomFile(&state->rooms);
                 assert(readRooms(&state->rooms) && "Check that you have ROOMS.SPL");
-                start_rooms_stat = rooms_stat;
+                state->rooms_mtime = rooms_stat.st_mtim;
+                validatorInvalidateAll(&state->validator);
+                memset(state->world.cached, 0, sizeof(state->world.cached));
+                // Someone else's changes, which can be undone like ours
+                record_history();
             }
         }
 
@@ -6414,6 +5327,7 @@ void *loop_main(char *library, void *call_state) {
             get_screen_dimensions();
             state->resized = false;
         }
+        control_poll();
         process_input();
         update();
         redraw();
@@ -6423,8 +5337,85 @@ void *loop_main(char *library, void *call_state) {
     return NULL;
 }
 
+#ifdef EDITOR_LIBTCC
+static void compile_error(void *opaque, const char *message) {
+    fprintf(opaque, "%s\n", message);
+}
+
+// Compiles the editor into memory, errors and the time it took go to
+// REBUILD_LOG. Returns NULL if it did not compile.
+TCCState *compile_in_process() {
+    struct timespec start;
+    assert(clock_gettime(CLOCK_MONOTONIC, &start) == 0);
+    FILE *log = fopen(REBUILD_LOG, "w");
+    if (log == NULL) log = stderr;
+    TCCState *tcc = tcc_new();
+    assert(tcc != NULL);
+    tcc_set_error_func(tcc, log, compile_error);
+    tcc_set_output_type(tcc, TCC_OUTPUT_MEMORY);
+    tcc_define_symbol(tcc, "_GNU_SOURCE", NULL);
+    tcc_define_symbol(tcc, "EDITOR_IN_PROCESS", NULL);
+    char *sources[] = { LIBRARY_SOURCES, __FILE__ };
+    bool ok = true;
+    for (size_t i = 0; ok && i < C_ARRAY_LEN(sources); i ++) {
+        ok = tcc_add_file(tcc, sources[i]) != -1;
+    }
+    ok = ok && tcc_add_symbol(tcc, "editor_compile", &editor_compile) != -1;
+#ifdef TCC_RELOCATE_AUTO
+    ok = ok && tcc_relocate(tcc, TCC_RELOCATE_AUTO) != -1;
+#else
+    ok = ok && tcc_relocate(tcc) != -1;
+#endif
+    if (ok) {
+        struct timespec end;
+        assert(clock_gettime(CLOCK_MONOTONIC, &end) == 0);
+        fprintf(log, "Compiled in %.1fms\n", ((end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9) * 1000);
+    }
+    if (log != stderr) fclose(log);
+    if (!ok) {
+        tcc_delete(tcc);
+        return NULL;
+    }
+    return tcc;
+}
+
+// Like editor_main, but with no editor.so, dlopen or compiler process. When
+// a compile fails the loop_main from before carries on.
+int editor_main_in_process() {
+    TCCState *current = NULL;
+    main_fn function = NULL;
+    void *saved_state = NULL;
+    while (true) {
+        assert(clock_gettime(CLOCK_REALTIME, &editor_compile.started) == 0);
+        TCCState *next = compile_in_process();
+        editor_compile.failed = next == NULL;
+        if (next != NULL) {
+            // The old loop_main has returned, and state points to nothing in it
+            if (current != NULL) tcc_delete(current);
+            current = next;
+            *(void **) (&function) = tcc_get_symbol(current, "loop_main");
+            assert(function != NULL && "Could not find loop_main");
+        } else if (current == NULL) {
+            fprintf(stderr, "Could not compile the editor, see %s\n", REBUILD_LOG);
+            return 1;
+        }
+        saved_state = function(NULL, saved_state);
+        if (saved_state == NULL) break;
+    }
+    tcc_delete(current);
+    return 0;
+}
+#endif
+
 // If this function is edited, then you must rebuild the application
 int editor_main() {
+#if defined(EDITOR_RELEASE)
+    // Only returns to be reloaded, which never happens here
+    loop_main(NULL, NULL);
+    return 0;
+#elif defined(EDITOR_LIBTCC)
+    return editor_main_in_process();
+#else
     char *basename = strdup(__FILE__);
     char *dot = strrchr(basename, '.');
     if (dot != NULL) *dot = '\0';
@@ -6453,4 +5444,5 @@ int editor_main() {
 
     free(library);
     return 0;
+#endif
 }
@@ -7,28 +7,14 @@ y=21
 room=0
 
 if ! ./a.out display $room |& grep 'Test room'; then
-    for idx in {0..703}; do ./a.out patch $room tile[$idx] 0; done
+    ./a.out patch $room tile[..][..] fill 0
     ./a.out patch $room name 'Test room'
 fi
-for x in {0..8}; do
-    ./a.out patch $room tile[$x][$((y-1))] $((tile+128))
-    ./a.out patch $room tile[$x][$y] $((tile+64))
-done
-for y in {0..21}; do
-    ./a.out patch $room tile[0][$y] $tile
-done
-for x in {8..16}; do
-    ./a.out patch $room tile[$x][$((y-1))] $((tile+192))
-    ./a.out patch $room tile[$x][$y] $((tile+64))
-done
-for x in {16..24}; do
-    ./a.out patch $room tile[$x][$((y-2))] $((tile+128))
-    ./a.out patch $room tile[$x][$y] $((tile+64))
-done
-for x in {0..30}; do
-    ./a.out patch $room tile[$x][$((y-1))] $tile
-    ./a.out patch $room tile[$x][$y] $((tile+64))
-done
+./a.out patch $room tile[0..8][$((y-1))] $((tile+128)) tile[0..8][$y] $((tile+64)) \
+    tile[0][..] $tile \
+    tile[8..16][$((y-1))] $((tile+192)) tile[8..16][$y] $((tile+64)) \
+    tile[16..24][$((y-2))] $((tile+128)) tile[16..24][$y] $((tile+64)) \
+    tile[0..30][$((y-1))] $tile tile[0..30][$y] $((tile+64))
 ./a.out patch $room tile_offset $offset
 ./a.out display $room
 ./a.out find_tile $tile $offset
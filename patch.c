@@ -0,0 +1,1545 @@
+#include "patch.h"
+
+#include <assert.h>
+#include <ctype.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#define DEPRECATED(str) do { fprintf(stderr, "%s:%d: DEPRECATED: %s", __FILE__, __LINE__, (str)); } while (0)
+
+typedef struct {
+    const char *name;
+    size_t offset;
+    const char *deprecated; // Printed when used
+    bool resizes; // Changes how much of the room is read after the raw room
+} RoomField;
+
+// Slots are roomFieldSlot of the name, found offline with ROOM_FIELD_SEED so
+// that no two names collide. Adding a name means finding a new seed.
+#define ROOM_FIELD_SEED 0x97f
+#define ROOM_FIELD_SLOTS 64
+static const RoomField room_fields[ROOM_FIELD_SLOTS] = {
+    [0] = { "UNKNOWN_f", offsetof(struct DecompresssedRoom, UNKNOWN_f) },
+    [4] = { "room_south", offsetof(struct DecompresssedRoom, room_south), .deprecated = "room_south is now room_down" },
+    [8] = { "room_damage", offsetof(struct DecompresssedRoom, room_damage) },
+    [10] = { "UNKNOWN_e", offsetof(struct DecompresssedRoom, _num_switches), .resizes = true },
+    [15] = { "room_east", offsetof(struct DecompresssedRoom, room_east), .deprecated = "room_east is now room_right" },
+    [18] = { "tile_offset", offsetof(struct DecompresssedRoom, tile_offset), .deprecated = "tile_offset is now tileset" },
+    [19] = { "UNKNOWN_c", offsetof(struct DecompresssedRoom, UNKNOWN_c) },
+    [20] = { "UNKNOWN[e]", offsetof(struct DecompresssedRoom, _num_switches), .resizes = true },
+    [23] = { "UNKNOWN_b", offsetof(struct DecompresssedRoom, UNKNOWN_b) },
+    [24] = { "gravity_vertical", offsetof(struct DecompresssedRoom, gravity_vertical) },
+    [27] = { "dmg", offsetof(struct DecompresssedRoom, room_damage) },
+    [29] = { "background", offsetof(struct DecompresssedRoom, background) },
+    [30] = { "tileset", offsetof(struct DecompresssedRoom, tile_offset) },
+    [31] = { "UNKNOWN[c]", offsetof(struct DecompresssedRoom, UNKNOWN_c) },
+    [32] = { "back", offsetof(struct DecompresssedRoom, background) },
+    [34] = { "UNKNOWN_a", offsetof(struct DecompresssedRoom, room_damage), .deprecated = "UNKNOWN_a is now room_damage" },
+    [37] = { "UNKNOWN[b]", offsetof(struct DecompresssedRoom, UNKNOWN_b) },
+    [39] = { "gravity_horizontal", offsetof(struct DecompresssedRoom, gravity_horizontal) },
+    [40] = { "UNKNOWN[f]", offsetof(struct DecompresssedRoom, UNKNOWN_f) },
+    [44] = { "room_up", offsetof(struct DecompresssedRoom, room_north) },
+    [46] = { "room_down", offsetof(struct DecompresssedRoom, room_south) },
+    [47] = { "room_north", offsetof(struct DecompresssedRoom, room_north), .deprecated = "room_north is now room_up" },
+    [48] = { "UNKNOWN[d]", offsetof(struct DecompresssedRoom, num_objects), .resizes = true },
+    [50] = { "room_west", offsetof(struct DecompresssedRoom, room_west), .deprecated = "room_west is now room_left" },
+    [54] = { "UNKNOWN_d", offsetof(struct DecompresssedRoom, num_objects), .resizes = true },
+    [58] = { "room_left", offsetof(struct DecompresssedRoom, room_west) },
+    [60] = { "damage", offsetof(struct DecompresssedRoom, room_damage) },
+    [63] = { "room_right", offsetof(struct DecompresssedRoom, room_east) },
+};
+
+// Case insensitive FNV-1a, mixed so the top bits depend on every character
+static size_t roomFieldSlot(const char *name) {
+    uint32_t hash = ROOM_FIELD_SEED;
+    for (; *name != '\0'; name ++) hash = (hash ^ (uint8_t)tolower(*name)) * 0x01000193;
+    hash ^= hash >> 16;
+    return (uint32_t)(hash * 0x9E3779B1) >> 26;
+}
+_Static_assert(ROOM_FIELD_SLOTS == 1 << (32 - 26), "roomFieldSlot only gives 6 bits");
+
+// Room fields with a plain name, one hash and one strcasecmp instead of a chain of them
+static const RoomField *lookupRoomField(const char *name) {
+    const RoomField *field = &room_fields[roomFieldSlot(name)];
+    if (field->name == NULL || strcasecmp(field->name, name) != 0) return NULL;
+    return field;
+}
+
+// Compiled programs are parsed without a file, so anything that would be
+// looked up in one has to be given instead
+static bool needsRooms(RoomFile *file, const char *arg) {
+    if (file != NULL) return true;
+    fprintf(stderr, "%s depends on what is in the rooms, which a compiled program can not\n", arg);
+    return false;
+}
+
+// Reads A, A..B, A.., ..B or .. up to a ], open ends go to 0 and max - 1
+static bool parseTileRange(char *str, long max, long *first, long *last, char **end) {
+    *first = 0;
+    if (isdigit(*str)) *first = strtol(str, &str, 0);
+    *last = *first;
+    if (strncmp(str, "..", 2) == 0) {
+        str += 2;
+        *last = max - 1;
+        if (isdigit(*str)) *last = strtol(str, &str, 0);
+    }
+    *end = str;
+    return *str == ']' && *first <= *last && *last < max;
+}
+
+// Parses [RANGE] or [X_RANGE][Y_RANGE] at brackets and then VALUE, fill VALUE
+// or copy-from room ROOM_ID, consuming them all. A single range runs along the
+// rows so it can take up to 3 rects.
+static bool parseTileRect(int *argc, char ***argv, char *program, RoomFile *file, PatchInstruction patch, char *brackets, long width, long height, PatchInstructionArray *patches) {
+    char *end = NULL;
+    long x0, x1, y0, y1;
+    bool two = strstr(brackets, "][") != NULL;
+    if (!parseTileRange(brackets + 1, two ? width : width * height, &x0, &x1, &end) ||
+            (two && (!parseTileRange(end + 2, height, &y0, &y1, &end))) ||
+            strcmp(end, "]") != 0) {
+        fprintf(stderr, "Invalid tile range, must be within %ldx%ld: %s\n", width, height, (*argv)[0]);
+        fprintf(stderr, "Usage: %s patch ROOM_ID ADDR VALUE [ADDR VALUE]... [FILENAME]\n", program);
+        return false;
+    }
+    int used = 2;
+    char *value_arg = (*argv)[1];
+    if (strcasecmp((*argv)[1], "fill") == 0) {
+        used = 3;
+        value_arg = *argc >= 3 ? (*argv)[2] : NULL;
+    } else if (strcasecmp((*argv)[1], "copy-from") == 0) {
+        used = 4;
+        value_arg = *argc >= 4 && strcasecmp((*argv)[2], "room") == 0 ? (*argv)[3] : NULL;
+        patch.copy = true;
+    }
+    long value = value_arg == NULL ? -1 : strtol(value_arg, &end, 0);
+    if (value_arg == NULL || errno == EINVAL || end == value_arg || *end != '\0' || value < 0 || value > 0xFF ||
+            (patch.copy && (unsigned)value >= C_ARRAY_LEN(file->rooms))) {
+        fprintf(stderr, "Invalid value for %s, expected VALUE, fill VALUE or copy-from room ROOM_ID\n", (*argv)[0]);
+        fprintf(stderr, "Usage: %s patch ROOM_ID ADDR VALUE [ADDR VALUE]... [FILENAME]\n", program);
+        return false;
+    }
+    patch.value = value;
+    if (two) {
+        patch.rect.x = x0;
+        patch.rect.y = y0;
+        patch.rect.width = x1 - x0 + 1;
+        patch.rect.height = y1 - y0 + 1;
+        SMALL_ARRAY_ADD(*patches, patch);
+    } else {
+        long row = x0 / width;
+        long last_row = x1 / width;
+        if (row == last_row || x0 % width != 0) {
+            patch.rect.x = x0 % width;
+            patch.rect.y = row;
+            patch.rect.width = (row == last_row ? x1 % width : width - 1) - x0 % width + 1;
+            patch.rect.height = 1;
+            SMALL_ARRAY_ADD(*patches, patch);
+            row ++;
+        }
+        if (row <= last_row && x1 % width != width - 1) {
+            patch.rect.x = 0;
+            patch.rect.y = last_row;
+            patch.rect.width = x1 % width + 1;
+            patch.rect.height = 1;
+            SMALL_ARRAY_ADD(*patches, patch);
+            last_row --;
+        }
+        if (row <= last_row) {
+            patch.rect.x = 0;
+            patch.rect.y = row;
+            patch.rect.width = width;
+            patch.rect.height = last_row - row + 1;
+            SMALL_ARRAY_ADD(*patches, patch);
+        }
+    }
+    *argv += used;
+    *argc -= used;
+    return true;
+}
+
+// Ranges, and fill or copy-from, need the rect forms
+static bool isTileRect(int argc, char **argv) {
+    return strstr(argv[0], "..") != NULL || (argc >= 2 && (strcasecmp(argv[1], "fill") == 0 || strcasecmp(argv[1], "copy-from") == 0));
+}
+
+bool parsePatch(int *argc, char ***argv, char *program, RoomFile *file, PatchInstructionArray *patches) {
+    char *end = NULL;
+    char *last = NULL;
+    const RoomField *field = NULL;
+    if (*argc <= 3) {
+        fprintf(stderr, "Usage: %s patch ROOM_ID ADDR VALUE [ADDR VALUE]... [FILENAME]\n", program);
+        return false;
+    }
+    long room_id = strtol((*argv)[1], &end, 0);
+    if (errno == EINVAL || end == NULL || *end != '\0') {
+        fprintf(stderr, "Invalid number: %s\n", (*argv)[1]);
+        fprintf(stderr, "Usage: %s patch ROOM_ID ADDR VALUE [ADDR VALUE]... [FILENAME]\n", program);
+        return false;
+    }
+    if (room_id < 0 || (unsigned)room_id >= C_ARRAY_LEN(file->rooms)) {
+        fprintf(stderr, "Room ID out of range 0..%lu\n", C_ARRAY_LEN(file->rooms) - 1);
+        fprintf(stderr, "Usage: %s patch ROOM_ID ADDR VALUE [ADDR VALUE]... [FILENAME]\n", program);
+        return false;
+    }
+    *argv += 2;
+    *argc -= 2;
+    while (*argc >= 2) {
+        long addr = strtol((*argv)[0], &end, 0);
+        if (errno == EINVAL || end == NULL || *end != '\0') {
+            addr = -1;
+            if (strcasecmp((*argv)[0], "tile") == 0 || strcasecmp((*argv)[0], "tiles") == 0) {
+                if (access((*argv)[1], R_OK) != 0) {
+                    fprintf(stderr, "Could not open tile file: %s\n", (*argv)[1]);
+                    fprintf(stderr, "Usage: %s patch ROOM_ID ADDR VALUE [ADDR VALUE]... [FILENAME]\n", program);
+                    return false;
+                }
+                SMALL_ARRAY_ADD(*patches, ((PatchInstruction){ .type = PATCH_TILESET, .room_id = room_id, .filename = (*argv)[1], }));
+                *argc -= 2;
+                *argv += 2;
+                continue;
+            } else if ((strncasecmp((*argv)[0], "tile[", 5) == 0 || strncasecmp((*argv)[0], "tiles[", 6) == 0) && isTileRect(*argc, *argv)) {
+                PatchInstruction patch = { .type = PATCH_TILE_RECT, .room_id = room_id };
+                if (!parseTileRect(argc, argv, program, file, patch, (*argv)[0] + ((*argv)[0][4] == '[' ? 4 : 5), WIDTH_TILES, HEIGHT_TILES, patches)) {
+                    return false;
+                }
+                continue;
+            } else if ((strncasecmp((*argv)[0], "tile[", 5) == 0 && isdigit((*argv)[0][5])) || (strncasecmp((*argv)[0], "tiles[", 6) == 0 && isdigit((*argv)[0][6]))) {
+                // Read [x][y] or [idx]
+                long idx = strtol((*argv)[0] + ((*argv)[0][4] == '[' ? 5 : 6), &end, 0);
+                if (errno == EINVAL || *end != ']') {
+                    fprintf(stderr, "Invalid tile address: %s\n", (*argv)[0]);
+                    fprintf(stderr, "Usage: %s patch ROOM_ID ADDR VALUE [ADDR VALUE]... [FILENAME]\n", program);
+                    return false;
+                }
+                if (end[1] == '[') {
+                    long y = strtol(end + 2, &end, 0);
+                    if (errno == EINVAL || strcasecmp(end, "]") != 0) {
+                        fprintf(stderr, "Invalid tile address for y: %s\n", (*argv)[0]);
+                        fprintf(stderr, "Usage: %s patch ROOM_ID ADDR VALUE [ADDR VALUE]... [FILENAME]\n", program);
+                        return false;
+                    }
+                    idx = TILE_IDX(idx, y);
+                }
+                if (idx >= WIDTH_TILES * HEIGHT_TILES) {
+                    fprintf(stderr, "Invalid tile address, too large: %s\n", (*argv)[0]);
+                    fprintf(stderr, "Usage: %s patch ROOM_ID ADDR VALUE [ADDR VALUE]... [FILENAME]\n", program);
+                    return false;
+                }
+                addr = offsetof(struct DecompresssedRoom, tiles) + idx;
+            } else if ((field = lookupRoomField((*argv)[0])) != NULL) {
+                if (field->deprecated != NULL) DEPRECATED(field->deprecated);
+                if (field->resizes) {
+                    fprintf(stderr, "WARNING: This will change how much data is looped over after main loop. You must ensure the correct data\n");
+                    // FIXME It'll probably blow the assert when writing
+                }
+                addr = field->offset;
+            } else if (strncasecmp((*argv)[0], "UNKNOWN2[", 9) == 0 && isdigit((*argv)[0][9])) {
+                long idx = strtol((*argv)[0] + 9, &end, 0);
+                if (errno == EINVAL || *end != ']') {
+                    fprintf(stderr, "Invalid UNKNOWN2 address: %s\n", (*argv)[0]);
+                    fprintf(stderr, "Usage: %s patch ROOM_ID ADDR VALUE [ADDR VALUE]... [FILENAME]\n", program);
+                    return false;
+                }
+                addr = offsetof(struct DecompresssedRoom, UNKNOWN_b) + idx;
+            } else if (strcasecmp((*argv)[0], "name") == 0) {
+                size_t len = strlen((*argv)[1]);
+                if (len > 20) {
+                    fprintf(stderr, "Invalid name. Max 20 characters: %s\n", (*argv)[1]);
+                    fprintf(stderr, "Usage: %s patch ROOM_ID ADDR VALUE [ADDR VALUE]... [FILENAME]\n", program);
+                    return false;
+                }
+                addr = offsetof(struct DecompresssedRoom, name);
+                for (size_t idx = 0; idx < 20; ++ idx) {
+                    if (idx < len) {
+                        SMALL_ARRAY_ADD(*patches, ((PatchInstruction){ .room_id = room_id, .address = addr + idx, .value = (*argv)[1][idx], }));
+                    } else {
+                        SMALL_ARRAY_ADD(*patches, ((PatchInstruction){ .room_id = room_id, .address = addr + idx, .value = ' ', }));
+                    }
+                }
+                *argv += 2;
+                *argc -= 2;
+                break;
+            } else {
+                char *arg = (*argv)[0];
+                if (arg[0] == '.') {
+                    if (last == NULL) {
+                        fprintf(stderr, "Invalid use of shortcut %s. Requires longform before\n", arg);
+                        fprintf(stderr, "Usage: %s patch ROOM_ID ADDR VALUE [ADDR VALUE]... [FILENAME]\n", program);
+                        return false;
+                    }
+                    if (arg[1] == '.') {
+                        char *last_dot = strrchr(last, '.');
+                        if (last_dot == NULL) {
+                            fprintf(stderr, "Invalid use of double shortcut %s. Requires longform before\n", arg);
+                            fprintf(stderr, "Usage: %s patch ROOM_ID ADDR VALUE [ADDR VALUE]... [FILENAME]\n", program);
+                            if (last) free(last);
+                            return false;
+                        }
+                        *last_dot = '\0';
+                        arg ++;
+                    }
+                    if (asprintf(&arg, "%s%s", last, arg) <= 0) {
+                        assert(false);
+                    }
+                }
+                if ((strncasecmp(arg, "object[", 7) == 0 && (isdigit(arg[7]) || arg[7] == ']')) || (strncasecmp(arg, "objects[", 8) == 0 && (isdigit(arg[8]) || arg[8] == ']'))) {
+                    char *str = arg + (arg[6] == '[' ? 7 : 8);
+                    long idx = strtol(str, &end, 0);
+                    if (errno == EINVAL || *end != ']') {
+                        fprintf(stderr, "Invalid object id: %s\n", arg);
+                        fprintf(stderr, "Usage: %s patch ROOM_ID ADDR VALUE [ADDR VALUE]... [FILENAME]\n", program);
+                        if (arg != (*argv)[0]) free(arg);
+                        return false;
+                    }
+                    if (end == str && !needsRooms(file, arg)) {
+                        fprintf(stderr, "Usage: %s patch ROOM_ID ADDR VALUE [ADDR VALUE]... [FILENAME]\n", program);
+                        if (arg != (*argv)[0]) free(arg);
+                        if (last != NULL) free(last);
+                        return false;
+                    }
+                    if (end == str) {
+                        idx = file->rooms[room_id].data.num_objects;
+                        fprintf(stderr, "Choosing new object[%ld] over object[]\n", idx);
+                    }
+                    addr = idx * sizeof(struct RoomObject);
+                    long value = 0xFFFF;
+                    if (strcasecmp(end, "].tiles") == 0) {
+                        if (access((*argv)[1], R_OK) != 0) {
+                            fprintf(stderr, "Could not open tile file: %s\n", (*argv)[1]);
+                            fprintf(stderr, "Usage: %s patch ROOM_ID ADDR VALUE [ADDR VALUE]... [FILENAME]\n", program);
+                            if (arg != (*argv)[0]) free(arg);
+                            return false;
+                        }
+                        SMALL_ARRAY_ADD(*patches, ((PatchInstruction){ .type = PATCH_OBJECT_TILESET, .room_id = room_id, .object_id = idx, .filename = (*argv)[1], }));
+                        *argc -= 2;
+                        *argv += 2;
+                        continue;
+                    }
+                    if (strcasecmp(end, "].x") == 0) {
+                        addr += offsetof(struct RoomObject, x);
+                    } else if (strcasecmp(end, "].y") == 0) {
+                        addr += offsetof(struct RoomObject, y);
+                    } else if (strcasecmp(end, "].width") == 0) {
+                        addr += offsetof(struct RoomObject, block.width);
+                    } else if (strcasecmp(end, "].sprite") == 0) {
+                        addr += offsetof(struct RoomObject, sprite.type);
+                        _Static_assert(NUM_SPRITE_TYPES == 8, "Unexpected number of sprite types");
+
+                        if (strcasecmp((*argv)[1], "SHARK") == 0) {
+                            value = SHARK;
+                        } else if (strcasecmp((*argv)[1], "MUMMY") == 0) {
+                            value = MUMMY;
+                        } else if (strcasecmp((*argv)[1], "BLUE_MAN") == 0) {
+                            value = BLUE_MAN;
+                        } else if (strcasecmp((*argv)[1], "WOLF") == 0) {
+                            value = WOLF;
+                        } else if (strcasecmp((*argv)[1], "R2D2") == 0) {
+                            value = R2D2;
+                        } else if (strcasecmp((*argv)[1], "DINOSAUR") == 0) {
+                            value = DINOSAUR;
+                        } else if (strcasecmp((*argv)[1], "RAT") == 0) {
+                            value = RAT;
+                        } else if (strcasecmp((*argv)[1], "SHOTGUN_LADY") == 0) {
+                            value = SHOTGUN_LADY;
+                        } else {
+                            value = strtol((*argv)[1], &end, 0);
+                            if (value < 0 || value >= NUM_SPRITE_TYPES || errno == EINVAL || end == NULL || *end != '\0') {
+                                fprintf(stderr, "Invalid sprite type: %s\n", (*argv)[1]);
+                                fprintf(stderr, "Usage: %s patch ROOM_ID ADDR VALUE [ADDR VALUE]... [FILENAME]\n", program);
+                                if (arg != (*argv)[0]) free(arg);
+                                return false;
+                            }
+                        }
+                    } else if (strcasecmp(end, "].height") == 0) {
+                        addr += offsetof(struct RoomObject, block.height);
+                    } else if (strcasecmp(end, "].damage") == 0) {
+                        addr += offsetof(struct RoomObject, sprite.damage);
+                    } else if (strcasecmp(end, "].type") == 0) {
+                        addr += offsetof(struct RoomObject, type);
+                        if (strcasecmp((*argv)[1], "static") == 0 || strcasecmp((*argv)[1], "block") == 0) {
+                            value = BLOCK;
+                        } else if (strcasecmp((*argv)[1], "enemy") == 0 || strcasecmp((*argv)[1], "sprite") == 0) {
+                            value = SPRITE;
+                        } else {
+                            fprintf(stderr, "Invalid object type: %s\n", (*argv)[1]);
+                            fprintf(stderr, "Usage: %s patch ROOM_ID ADDR VALUE [ADDR VALUE]... [FILENAME]\n", program);
+                            if (last != NULL) free(last);
+                            if (arg != (*argv)[0]) free(arg);
+                            return false;
+                        }
+                    } else if ((strncasecmp(end, "].tile[", 7) == 0 || strncasecmp(end, "].tiles[", 8) == 0) && isTileRect(*argc, *argv)) {
+                        PatchInstruction patch = { .type = PATCH_OBJECT_TILE_RECT, .room_id = room_id, .object_id = idx };
+                        char *given = (*argv)[0];
+                        // Open ranges go to the edge of the block as it is now
+                        long width = MAX_BLOCK_WIDTH;
+                        long height = MAX_BLOCK_HEIGHT;
+                        if (strstr(end, "..]") != NULL && !needsRooms(file, arg)) {
+                            fprintf(stderr, "Usage: %s patch ROOM_ID ADDR VALUE [ADDR VALUE]... [FILENAME]\n", program);
+                            if (arg != given) free(arg);
+                            if (last != NULL) free(last);
+                            return false;
+                        }
+                        if (file != NULL && idx < file->rooms[room_id].data.num_objects && file->rooms[room_id].data.objects[idx].type == BLOCK) {
+                            width = file->rooms[room_id].data.objects[idx].block.width;
+                            height = file->rooms[room_id].data.objects[idx].block.height;
+                        }
+                        bool ok = parseTileRect(argc, argv, program, file, patch, end + (end[6] == '[' ? 6 : 7), width, height, patches);
+                        if (last != NULL) free(last);
+                        last = NULL;
+                        if (ok && asprintf(&last, "object[%ld]", idx) <= 0) {
+                            assert(false);
+                        }
+                        if (arg != given) free(arg);
+                        if (!ok) return false;
+                        continue;
+                    } else if (strncasecmp(end, "].tile[", 7) == 0 || strncasecmp(end, "].tiles[", 8) == 0) {
+                        // Read [x][y] or [idx]
+                        addr += offsetof(struct RoomObject, tiles);
+                        idx = strtol(end + (end[6] == '[' ? 7 : 8), &end, 0);
+                        if (errno == EINVAL || *end != ']') {
+                            fprintf(stderr, "Invalid tile address: %s\n", (*argv)[0]);
+                            fprintf(stderr, "Usage: %s patch ROOM_ID ADDR VALUE [ADDR VALUE]... [FILENAME]\n", program);
+                            if (arg != (*argv)[0]) free(arg);
+                            if (last != NULL) free(last);
+                            return false;
+                        }
+                        if (end[1] == '[') {
+                            long y = strtol(end + 2, &end, 0);
+                            if (errno == EINVAL || strcasecmp(end, "]") != 0) {
+                                fprintf(stderr, "Invalid tile address for y: %s\n", (*argv)[0]);
+                                fprintf(stderr, "Usage: %s patch ROOM_ID ADDR VALUE [ADDR VALUE]... [FILENAME]\n", program);
+                                if (last != NULL) free(last);
+                                if (arg != (*argv)[0]) free(arg);
+                                return false;
+                            }
+                            idx = TILE_IDX(idx, y);
+                        }
+                        if (idx >= WIDTH_TILES * HEIGHT_TILES) {
+                            fprintf(stderr, "Invalid tile address, too large: %s\n", (*argv)[0]);
+                            fprintf(stderr, "Usage: %s patch ROOM_ID ADDR VALUE [ADDR VALUE]... [FILENAME]\n", program);
+                            if (last != NULL) free(last);
+                            if (arg != (*argv)[0]) free(arg);
+                            return false;
+                        }
+                        value = strtol((*argv)[1], &end, 0);
+                        if (errno == EINVAL || end == NULL || *end != '\0') {
+                            fprintf(stderr, "Invalid number: %s\n", (*argv)[1]);
+                            fprintf(stderr, "Usage: %s patch ROOM_ID ADDR VALUE [ADDR VALUE]... [FILENAME]\n", program);
+                            if (last != NULL) free(last);
+                            if (arg != (*argv)[0]) free(arg);
+                            return false;
+                        }
+                        if (value < 0 || value > 0xFF) {
+                            fprintf(stderr, "Value must be in the range 0..255\n");
+                            fprintf(stderr, "Usage: %s patch ROOM_ID ADDR VALUE [ADDR VALUE]... [FILENAME]\n", program);
+                            if (arg != (*argv)[0]) free(arg);
+                            if (last != NULL) free(last);
+                            return false;
+                        }
+                        value = idx << 8 | value;
+                    } else {
+                        fprintf(stderr, "Invalid object field: %s\n", arg);
+                        fprintf(stderr, "Usage: %s patch ROOM_ID ADDR VALUE [ADDR VALUE]... [FILENAME]\n", program);
+                        if (arg != (*argv)[0]) free(arg);
+                        if (last != NULL) free(last);
+                        return false;
+                    }
+
+                    if (value == 0xFFFF) {
+                        value = strtol((*argv)[1], &end, 0);
+                        if (errno == EINVAL || end == NULL || *end != '\0') {
+                            fprintf(stderr, "Invalid number: %s\n", (*argv)[1]);
+                            fprintf(stderr, "Usage: %s patch ROOM_ID ADDR VALUE [ADDR VALUE]... [FILENAME]\n", program);
+                            if (arg != (*argv)[0]) free(arg);
+                            if (last != NULL) free(last);
+                            return false;
+                        }
+                        if (value < 0 || value > 0xFF) {
+                            fprintf(stderr, "Value must be in the range 0..255\n");
+                            fprintf(stderr, "Usage: %s patch ROOM_ID ADDR VALUE [ADDR VALUE]... [FILENAME]\n", program);
+                            if (arg != (*argv)[0]) free(arg);
+                            if (last != NULL) free(last);
+                            return false;
+                        }
+                    }
+                    if (last != NULL) free(last);
+                    if (idx < 0) {
+                        if (asprintf(&last, "object[]") <= 0) {
+                            assert(false);
+                        }
+                    } else {
+                        if (asprintf(&last, "object[%ld]", idx) <= 0) {
+                            assert(false);
+                        }
+                    }
+                    if (arg != (*argv)[0]) free(arg);
+
+                    SMALL_ARRAY_ADD(*patches, ((PatchInstruction){ .type = PATCH_OBJECT, .room_id = room_id, .address = addr, .value = value, }));
+                    *argv += 2;
+                    *argc -= 2;
+                    continue;
+                } else if ((strncasecmp(arg, "switch[", 7) == 0 && (isdigit(arg[7]) || arg[7] == ']')) || (strncasecmp(arg, "switchs[", 8) == 0 && (isdigit(arg[8]) || arg[8] == ']')) || (strncasecmp(arg, "switches[", 9) == 0 && (isdigit(arg[9]) || arg[9] == ']'))) {
+                    char *str = arg + (arg[6] == '[' ? 7 : (arg[7] == '[' ? 8 : 9));
+                    long idx = strtol(str, &end, 0);
+                    if (errno == EINVAL || *end != ']') {
+                        fprintf(stderr, "Invalid switch id: %s\n", arg);
+                        fprintf(stderr, "Usage: %s patch ROOM_ID ADDR VALUE [ADDR VALUE]... [FILENAME]\n", program);
+                        if (arg != (*argv)[0]) free(arg);
+                        return false;
+                    }
+                    if (end == str && !needsRooms(file, arg)) {
+                        fprintf(stderr, "Usage: %s patch ROOM_ID ADDR VALUE [ADDR VALUE]... [FILENAME]\n", program);
+                        if (arg != (*argv)[0]) free(arg);
+                        if (last != NULL) free(last);
+                        return false;
+                    }
+                    if (end == str) {
+                        idx = file->rooms[room_id].data.num_switches;
+                        fprintf(stderr, "Choosing new switch[%ld] over switch[]\n", idx);
+                    }
+                    addr = (idx + 1) * sizeof(struct SwitchObject);
+                    long value = 0xFFFF;
+                    long chunk_idx = -1;
+                    if (strcasecmp(end, "].x") == 0) {
+                        // Do it on chunks[0].x
+                        addr <<= 8;
+                        addr += offsetof(struct SwitchChunk, preamble.x);
+                    } else if (strcasecmp(end, "].y") == 0) {
+                        // Do it on chunks[0].y
+                        addr <<= 8;
+                        addr += offsetof(struct SwitchChunk, preamble.y);
+                    } else if (strcasecmp(end, "].room_entry") == 0) {
+                        // Do it on chunks[0].room_entry
+                        addr <<= 8;
+                        addr += offsetof(struct SwitchChunk, preamble.room_entry);
+                        if (strcasecmp((*argv)[1], "false") == 0) {
+                            value = 0;
+                        } else if (strcasecmp((*argv)[1], "true") == 0) {
+                            value = 1;
+                        }
+                    } else if (strcasecmp(end, "].one_time_use") == 0) {
+                        // Do it on chunks[0].one_time_use
+                        addr <<= 8;
+                        addr += offsetof(struct SwitchChunk, preamble.one_time_use);
+                        if (strcasecmp((*argv)[1], "false") == 0) {
+                            value = 0;
+                        } else if (strcasecmp((*argv)[1], "true") == 0) {
+                            value = 1;
+                        }
+                    } else if (strcasecmp(end, "].side") == 0) {
+                        // Do it on chunks[0].side
+                        addr <<= 8;
+                        addr += offsetof(struct SwitchChunk, preamble.side);
+                        if (strcasecmp((*argv)[1], "top") == 0 || strcasecmp((*argv)[1], "up") == 0) {
+                            value = TOP;
+                        } else if (strcasecmp((*argv)[1], "bottom") == 0 || strcasecmp((*argv)[1], "down") == 0) {
+                            value = BOTTOM;
+                        } else if (strcasecmp((*argv)[1], "left") == 0) {
+                            value = LEFT;
+                        } else if (strcasecmp((*argv)[1], "right") == 0) {
+                            value = RIGHT;
+                        } else {
+                            fprintf(stderr, "Invalid side: %s\n", (*argv)[1]);
+                            fprintf(stderr, "Usage: %s patch ROOM_ID ADDR VALUE [ADDR VALUE]... [FILENAME]\n", program);
+                            if (arg != (*argv)[0]) free(arg);
+                            if (last != NULL) free(last);
+                            return false;
+                        }
+                    } else if ((strncasecmp(end, "].chunk[", 8) == 0 && (isdigit(end[8]) || end[8] == ']')) || (strncasecmp(end, "].chunks[", 9) == 0 && (isdigit(end[9]) || end[9] == ']'))) {
+                        char *str = end + (end[7] == '[' ? 8 : 9);
+                        chunk_idx = strtol(str, &end, 0);
+                        if (errno == EINVAL || *end != ']') {
+                            fprintf(stderr, "Invalid chunk index: %s\n", arg);
+                            fprintf(stderr, "Usage: %s patch ROOM_ID ADDR VALUE [ADDR VALUE]... [FILENAME]\n", program);
+                            if (arg != (*argv)[0]) free(arg);
+                            return false;
+                        }
+                        if (end == str && !needsRooms(file, arg)) {
+                            fprintf(stderr, "Usage: %s patch ROOM_ID ADDR VALUE [ADDR VALUE]... [FILENAME]\n", program);
+                            if (arg != (*argv)[0]) free(arg);
+                            if (last != NULL) free(last);
+                            return false;
+                        }
+                        if (end == str) {
+                            if (idx >= file->rooms[room_id].data.num_switches) {
+                                // This may have issues if we do .switches[].chunks[] ..chunks[]. Intention would likely be chunks[0] and chunks[1] on switches[last]
+                                chunk_idx = 1;
+                            } else {
+                                struct SwitchObject *sw = file->rooms[room_id].data.switches + idx;
+                                chunk_idx = sw->chunks.length;
+                            }
+                            fprintf(stderr, "Choosing new chunk[%ld] over chunk[]\n", chunk_idx);
+                        }
+                        addr <<= 8;
+                        addr += chunk_idx * sizeof(struct SwitchChunk);
+                        if (strcasecmp(end, "].x") == 0) {
+                            addr += offsetof(struct SwitchChunk, toggle_block.x);
+                        } else if (strcasecmp(end, "].y") == 0) {
+                            addr += offsetof(struct SwitchChunk, toggle_block.y);
+                        } else if (strcasecmp(end, "].size") == 0 || strcasecmp(end, "].height") == 0 || strcasecmp(end, "].width") == 0) {
+                            addr += offsetof(struct SwitchChunk, toggle_block.size);
+                        } else if (strcasecmp(end, "].off") == 0) {
+                            addr += offsetof(struct SwitchChunk, toggle_block.off);
+                        } else if (strcasecmp(end, "].on") == 0) {
+                            addr += offsetof(struct SwitchChunk, toggle_block.on);
+                        } else if (strcasecmp(end, "].dir") == 0) {
+                            addr += offsetof(struct SwitchChunk, toggle_block.dir);
+                            if (strcasecmp((*argv)[1], "VERTICAL") == 0) {
+                                value = VERTICAL;
+                            } else if (strcasecmp((*argv)[1], "HORIZONTAL") == 0) {
+                                value = HORIZONTAL;
+                            } else {
+                                value = strtol((*argv)[1], &end, 0);
+                                if (value == 0x20) value = VERTICAL;
+                                if (value < 0 || value >= 2 || errno == EINVAL || end == NULL || *end != '\0') {
+                                    fprintf(stderr, "Invalid direction type: %s\n", (*argv)[1]);
+                                    fprintf(stderr, "Usage: %s patch ROOM_ID ADDR VALUE [ADDR VALUE]... [FILENAME]\n", program);
+                                    if (arg != (*argv)[0]) free(arg);
+                                    if (last != NULL) free(last);
+                                    return false;
+                                }
+                                if (arg != (*argv)[0]) free(arg);
+                                if (last != NULL) free(last);
+                                return false;
+                            }
+                        } else if (strcasecmp(end, "].msb") == 0 || strcasecmp(end, "].msb_without_y") == 0 || strcasecmp(end, "].msb_without_y_and_one_time_use") == 0) {
+                            addr += offsetof(struct SwitchChunk, preamble.msb);
+                        } else if (strcasecmp(end, "].index") == 0) {
+                            addr += offsetof(struct SwitchChunk, toggle_bit.index);
+                        } else if (strcasecmp(end, "].bitmask") == 0) {
+                            addr += offsetof(struct SwitchChunk, toggle_bit.bitmask);
+                        } else if (strcasecmp(end, "].test") == 0) {
+                            addr += offsetof(struct SwitchChunk, toggle_object.test);
+                        } else if (strcasecmp(end, "].value") == 0) {
+                            addr += offsetof(struct SwitchChunk, toggle_object.value);
+                            if (strcasecmp((*argv)[1], "") == 0 || strcasecmp((*argv)[1], "stop") == 0 || strcasecmp((*argv)[1], "stopped") == 0 || strcasecmp((*argv)[1], "stationary") == 0 || strcasecmp((*argv)[1], "stationery") == 0) {
+                                value = 0;
+                            } else if (strcasecmp((*argv)[1], "up") == 0) {
+                                value = MOVE_UP;
+                            } else if (strcasecmp((*argv)[1], "down") == 0) {
+                                value = MOVE_DOWN;
+                            } else if (strcasecmp((*argv)[1], "left") == 0) {
+                                value = MOVE_LEFT;
+                            } else if (strcasecmp((*argv)[1], "right") == 0) {
+                                value = MOVE_RIGHT;
+                            } else if (strcasecmp((*argv)[1], "up+left") == 0 || strcasecmp((*argv)[1], "left+up") == 0) {
+                                value = MOVE_UP | MOVE_LEFT;
+                            } else if (strcasecmp((*argv)[1], "up+right") == 0 || strcasecmp((*argv)[1], "right+up") == 0) {
+                                value = MOVE_UP | MOVE_RIGHT;
+                            } else if (strcasecmp((*argv)[1], "down+left") == 0 || strcasecmp((*argv)[1], "left+down") == 0) {
+                                value = MOVE_DOWN | MOVE_LEFT;
+                            } else if (strcasecmp((*argv)[1], "down+right") == 0 || strcasecmp((*argv)[1], "right+down") == 0) {
+                                value = MOVE_DOWN | MOVE_RIGHT;
+                            }
+                        } else if (strcasecmp(end, "].room_entry") == 0) {
+                            addr += offsetof(struct SwitchChunk, preamble.room_entry);
+                            if (strcasecmp((*argv)[1], "false") == 0) {
+                                value = 0;
+                            } else if (strcasecmp((*argv)[1], "true") == 0) {
+                                value = 1;
+                            }
+                        } else if (strcasecmp(end, "].side") == 0) {
+                            addr += offsetof(struct SwitchChunk, preamble.side);
+                            if (strcasecmp((*argv)[1], "top") == 0 || strcasecmp((*argv)[1], "up") == 0) {
+                                value = TOP;
+                            } else if (strcasecmp((*argv)[1], "bottom") == 0 || strcasecmp((*argv)[1], "down") == 0) {
+                                value = BOTTOM;
+                            } else if (strcasecmp((*argv)[1], "left") == 0) {
+                                value = LEFT;
+                            } else if (strcasecmp((*argv)[1], "right") == 0) {
+                                value = RIGHT;
+                            } else {
+                                fprintf(stderr, "Invalid side: %s\n", (*argv)[1]);
+                                fprintf(stderr, "Usage: %s patch ROOM_ID ADDR VALUE [ADDR VALUE]... [FILENAME]\n", program);
+                                if (arg != (*argv)[0]) free(arg);
+                                if (last != NULL) free(last);
+                                return false;
+                            }
+                        } else if (strcasecmp(end, "].type") == 0) {
+                            addr += offsetof(struct SwitchChunk, type);
+                            _Static_assert(NUM_CHUNK_TYPES == 4, "Unexpected number of chunk types");
+                            if (strcasecmp((*argv)[1], "PREAMBLE") == 0) {
+                                if (chunk_idx != 0) {
+                                    fprintf(stderr, "PREAMBLE type is only valid for chunk 0\n");
+                                    fprintf(stderr, "Usage: %s patch ROOM_ID ADDR VALUE [ADDR VALUE]... [FILENAME]\n", program);
+                                    if (arg != (*argv)[0]) free(arg);
+                                    if (last != NULL) free(last);
+                                    return false;
+                                }
+                                value = PREAMBLE;
+                            } else if (strcasecmp((*argv)[1], "TOGGLE_BLOCK") == 0 || strcasecmp((*argv)[1], "block") == 0) {
+                                value = TOGGLE_BLOCK;
+                            } else if (strcasecmp((*argv)[1], "TOGGLE_BIT") == 0 || strcasecmp((*argv)[1], "bit") == 0) {
+                                value = TOGGLE_BIT;
+                            } else if (strcasecmp((*argv)[1], "TOGGLE_OBJECT") == 0 || strcasecmp((*argv)[1], "obj") == 0 || strcasecmp((*argv)[1], "object") == 0) {
+                                value = TOGGLE_OBJECT;
+                            } else {
+                                value = strtol((*argv)[1], &end, 0);
+                                if (value < 0 || value >= NUM_CHUNK_TYPES || errno == EINVAL || end == NULL || *end != '\0') {
+                                    fprintf(stderr, "Invalid chunk type: %s\n", (*argv)[1]);
+                                    fprintf(stderr, "Usage: %s patch ROOM_ID ADDR VALUE [ADDR VALUE]... [FILENAME]\n", program);
+                                    if (arg != (*argv)[0]) free(arg);
+                                    if (last != NULL) free(last);
+                                    return false;
+                                }
+                                if (value == PREAMBLE && idx != 0) {
+                                    fprintf(stderr, "PREAMBLE type is only valid for chunk 0\n");
+                                    fprintf(stderr, "Usage: %s patch ROOM_ID ADDR VALUE [ADDR VALUE]... [FILENAME]\n", program);
+                                    if (arg != (*argv)[0]) free(arg);
+                                    if (last != NULL) free(last);
+                                    return false;
+                                }
+                                if (arg != (*argv)[0]) free(arg);
+                                if (last != NULL) free(last);
+                                return false;
+                            }
+                        } else {
+                            fprintf(stderr, "Invalid chunk field: %s\n", arg);
+                            fprintf(stderr, "Usage: %s patch ROOM_ID ADDR VALUE [ADDR VALUE]... [FILENAME]\n", program);
+                            if (arg != (*argv)[0]) free(arg);
+                            if (last != NULL) free(last);
+                            return false;
+                        }
+                    } else {
+                        fprintf(stderr, "end: %s\n", end);
+                        fprintf(stderr, "Invalid switch field: %s\n", arg);
+                        fprintf(stderr, "Usage: %s patch ROOM_ID ADDR VALUE [ADDR VALUE]... [FILENAME]\n", program);
+                        if (arg != (*argv)[0]) free(arg);
+                        if (last != NULL) free(last);
+                        return false;
+                    }
+
+                    if (value == 0xFFFF) {
+                        value = strtol((*argv)[1], &end, 0);
+                        if (errno == EINVAL || end == NULL || *end != '\0') {
+                            fprintf(stderr, "Invalid number: %s\n", (*argv)[1]);
+                            fprintf(stderr, "Usage: %s patch ROOM_ID ADDR VALUE [ADDR VALUE]... [FILENAME]\n", program);
+                            if (arg != (*argv)[0]) free(arg);
+                            if (last != NULL) free(last);
+                            return false;
+                        }
+                    }
+                    if (value < 0 || value > 0xFF) {
+                        fprintf(stderr, "Value must be in the range 0..255\n");
+                        fprintf(stderr, "Usage: %s patch ROOM_ID ADDR VALUE [ADDR VALUE]... [FILENAME]\n", program);
+                        if (arg != (*argv)[0]) free(arg);
+                        if (last != NULL) free(last);
+                        return false;
+                    }
+                    if (last != NULL) free(last);
+                    if (chunk_idx != -1) {
+                        if (asprintf(&last, "switch[%ld].chunk[%ld]", idx, chunk_idx) <= 0) {
+                            assert(false);
+                        }
+                    } else {
+                        if (asprintf(&last, "switch[%ld]", idx) <= 0) {
+                            assert(false);
+                        }
+                    }
+                    if (arg != (*argv)[0]) free(arg);
+
+                    SMALL_ARRAY_ADD(*patches, ((PatchInstruction){ .type = PATCH_SWITCH, .room_id = room_id, .address = addr, .value = value, }));
+                    *argv += 2;
+                    *argc -= 2;
+                    continue;
+                }
+                if (addr == -1) {
+                    fprintf(stderr, "Invalid address: %s\n", arg);
+                    fprintf(stderr, "Usage: %s patch ROOM_ID ADDR VALUE [ADDR VALUE]... [FILENAME]\n", program);
+                    if (arg != (*argv)[0]) free(arg);
+                    if (last != NULL) free(last);
+                    return false;
+                }
+                if (arg != (*argv)[0]) free(arg);
+            }
+        }
+        if (addr < 0) {
+            fprintf(stderr, "Address must be positive\n");
+            fprintf(stderr, "Usage: %s patch ROOM_ID ADDR VALUE [ADDR VALUE]... [FILENAME]\n", program);
+            if (last != NULL) free(last);
+            return false;
+        }
+
+        long value = strtol((*argv)[1], &end, 0);
+        if (errno == EINVAL || end == NULL || *end != '\0') {
+            fprintf(stderr, "Invalid number: %s\n", (*argv)[1]);
+            fprintf(stderr, "Usage: %s patch ROOM_ID ADDR VALUE [ADDR VALUE]... [FILENAME]\n", program);
+            if (last != NULL) free(last);
+            return false;
+        }
+        if (value < 0 || value > 0xFF) {
+            fprintf(stderr, "Value must be in the range 0..255\n");
+            fprintf(stderr, "Usage: %s patch ROOM_ID ADDR VALUE [ADDR VALUE]... [FILENAME]\n", program);
+            if (last != NULL) free(last);
+            return false;
+        }
+
+        SMALL_ARRAY_ADD(*patches, ((PatchInstruction){ .room_id = room_id, .address = addr, .value = value, }));
+        *argv += 2;
+        *argc -= 2;
+    }
+    if (last != NULL) free(last);
+
+    return true;
+}
+
+bool parseDelete(int *argc, char ***argv, char *program, RoomFile *file, PatchInstructionArray *patches) {
+    char *end = NULL;
+    if (*argc <= 2) {
+        fprintf(stderr, "Usage: %s delete ROOM_ID (switch[i]|switch[x].chunk[i]|object[i])... [FILENAME]\n", program);
+        return false;
+    }
+    long room_id = strtol((*argv)[1], &end, 0);
+    if (errno == EINVAL || end == NULL || *end != '\0') {
+        fprintf(stderr, "Invalid number: %s\n", (*argv)[1]);
+        fprintf(stderr, "Usage: %s delete ROOM_ID (switch[i]|switch[x].chunk[i]|object[i])... [FILENAME]\n", program);
+        return false;
+    }
+    if (room_id < 0 || (unsigned)room_id >= C_ARRAY_LEN(file->rooms)) {
+        fprintf(stderr, "Room ID out of range 0..%lu\n", C_ARRAY_LEN(file->rooms) - 1);
+        fprintf(stderr, "Usage: %s delete ROOM_ID (switch[i]|switch[x].chunk[i]|object[i])... [FILENAME]\n", program);
+        return false;
+    }
+    *argv += 2;
+    *argc -= 2;
+    while (*argc >= 1) {
+        long addr = 0xFFFF;
+        if ((strncasecmp((*argv)[0], "object[", 7) == 0 && (isdigit((*argv)[0][7]) || (*argv)[0][7] == ']')) || (strncasecmp((*argv)[0], "objects[", 8) == 0 && (isdigit((*argv)[0][8]) || (*argv)[0][8] == ']'))) {
+            char *str = (*argv)[0] + ((*argv)[0][6] == '[' ? 7 : 8);
+            long idx = strtol(str, &end, 0);
+            if (errno == EINVAL || *end != ']') {
+                fprintf(stderr, "Invalid object id: %s\n", (*argv)[0]);
+                fprintf(stderr, "Usage: %s delete ROOM_ID (switch[i]|switch[x].chunk[i]|object[i])... [FILENAME]\n", program);
+                return false;
+            }
+            if (end == str && !needsRooms(file, (*argv)[0])) {
+                fprintf(stderr, "Usage: %s delete ROOM_ID (switch[i]|switch[x].chunk[i]|object[i])... [FILENAME]\n", program);
+                return false;
+            }
+            if (end == str) {
+                if (file->rooms[room_id].data.num_objects == 0) {
+                    fprintf(stderr, "No objects left to match object[]\n");
+                    fprintf(stderr, "Usage: %s delete ROOM_ID (switch[i]|switch[x].chunk[i]|object[i])... [FILENAME]\n", program);
+                    return false;
+                }
+                idx = file->rooms[room_id].data.num_objects - 1;
+                fprintf(stderr, "Choosing object[%ld] over object[]\n", idx);
+            }
+            addr = idx * sizeof(struct RoomObject);
+            SMALL_ARRAY_ADD(*patches, ((PatchInstruction){ .type = PATCH_OBJECT, .room_id = room_id, .address = addr, .delete = true }));
+        } else if ((strncasecmp((*argv)[0], "switch[", 7) == 0 && (isdigit((*argv)[0][7]) || (*argv)[0][7] == ']')) || (strncasecmp((*argv)[0], "switchs[", 8) == 0 && (isdigit((*argv)[0][8]) || (*argv)[0][8] == ']')) || (strncasecmp((*argv)[0], "switches[", 9) == 0 && (isdigit((*argv)[0][9]) || (*argv)[0][9] == ']'))) {
+            char *str = (*argv)[0] + ((*argv)[0][6] == '[' ? 7 : ((*argv)[0][7] == '[' ? 8 : 9));
+            long idx = strtol(str, &end, 0);
+            if (errno == EINVAL || *end != ']') {
+                fprintf(stderr, "Invalid switch id: %s\n", (*argv)[0]);
+                fprintf(stderr, "Usage: %s delete ROOM_ID (switch[i]|switch[x].chunk[i]|object[i])... [FILENAME]\n", program);
+                return false;
+            }
+            if (end == str && !needsRooms(file, (*argv)[0])) {
+                fprintf(stderr, "Usage: %s delete ROOM_ID (switch[i]|switch[x].chunk[i]|object[i])... [FILENAME]\n", program);
+                return false;
+            }
+            if (end == str) {
+                if (file->rooms[room_id].data.num_switches == 0) {
+                    fprintf(stderr, "No switches left to match switch[]\n");
+                    fprintf(stderr, "Usage: %s delete ROOM_ID (switch[i]|switch[x].chunk[i]|object[i])... [FILENAME]\n", program);
+                    return false;
+                }
+                idx = file->rooms[room_id].data.num_switches - 1;
+                fprintf(stderr, "Choosing switch[%ld] over switch[]\n", idx);
+            }
+            addr = (idx + 1) * sizeof(struct SwitchObject);
+            if ((strncasecmp(end, "].chunk[", 8) == 0 && (isdigit(end[8]) || end[8] == ']')) || (strncasecmp(end, "].chunks[", 9) == 0) || (isdigit(end[9]) || end[9] == ']')) {
+                char *str = end + (end[7] == '[' ? 8 : 9);
+                long chunk_idx = strtol(str, &end, 0);
+                if (errno == EINVAL || *end != ']') {
+                    fprintf(stderr, "Invalid chunk index: %s\n", (*argv)[0]);
+                    fprintf(stderr, "Usage: %s delete ROOM_ID (switch[i]|switch[x].chunk[i]|object[i])... [FILENAME]\n", program);
+                    return false;
+                }
+                if (end == str && !needsRooms(file, (*argv)[0])) {
+                    fprintf(stderr, "Usage: %s delete ROOM_ID (switch[i]|switch[x].chunk[i]|object[i])... [FILENAME]\n", program);
+                    return false;
+                }
+                if (end == str) {
+                    if (file->rooms[room_id].data.switches[idx].chunks.length == 0) {
+                        fprintf(stderr, "No chunks left to match chunk[]\n");
+                        fprintf(stderr, "Usage: %s delete ROOM_ID (switch[i]|switch[x].chunk[i]|object[i])... [FILENAME]\n", program);
+                        return false;
+                    }
+                    chunk_idx = file->rooms[room_id].data.switches[idx].chunks.length - 1;
+                    fprintf(stderr, "Choosing chunk[%ld] over chunk[]\n", chunk_idx);
+                }
+                addr <<= 8;
+                addr += chunk_idx * sizeof(struct SwitchChunk);
+            }
+            SMALL_ARRAY_ADD(*patches, ((PatchInstruction){ .type = PATCH_SWITCH, .room_id = room_id, .address = addr, .delete = true }));
+        }
+        *argv += 1;
+        *argc -= 1;
+    }
+
+    return true;
+}
+
+bool applyPatches(RoomFile *file, PatchInstructionArray *patches, char *program, uint8_array *rooms) {
+    FILE *fp = NULL;
+    bool ret = true;
+#define defer_return(code) { ret = code; goto defer; }
+    for (size_t i = 0; i < patches->length; i ++) {
+        PatchInstruction patch = SMALL_ARRAY_DATA(*patches)[i];
+        file->rooms[patch.room_id].compressed.length = 0;
+        roomChanged(file, patch.room_id);
+        file->rooms[patch.room_id].valid = true;
+        bool found = false;
+        for (size_t r = 0; r < rooms->length; r ++) {
+            if (patch.room_id == rooms->data[r]) {
+                found = true;
+                break;
+            }
+        }
+        if (!found) {
+            ARRAY_ADD(*rooms, patch.room_id);
+        }
+        _Static_assert(NUM_PATCH_TYPES == 7, "Unexpected number of patch types");
+        switch (patch.type) {
+            case PATCH_NORMAL:
+                assert(patch.delete == false);
+                if ((unsigned)patch.address >= offsetof(struct DecompresssedRoom, end_marker) || (unsigned)patch.address >= sizeof(file->rooms[patch.room_id].data)) {
+                    fprintf(stderr, "%s:%d: WARNING: Patching *rest* may not be stable currently\n", __FILE__, __LINE__);
+                    if (patch.address - sizeof(file->rooms[patch.room_id].data) >= file->rooms[patch.room_id].rest.length) {
+                        fprintf(stderr, "Address %d invalid\n", patch.address);
+                        fprintf(stderr, "Usage: %s patch ROOM_ID ADDR VALUE [ADDR VALUE]... [FILENAME]\n", program);
+                        defer_return(false);
+                    }
+                    file->rooms[patch.room_id].rest.data[patch.address - sizeof(file->rooms[patch.room_id].data)] = patch.value;
+                } else {
+                    fprintf(stderr, "Writing at %d with %02x (was %02x)\n", patch.address, patch.value,
+                            ((uint8_t *)&file->rooms[patch.room_id].data)[patch.address]);
+                    ((uint8_t *)&file->rooms[patch.room_id].data)[patch.address] = patch.value;
+                }
+                break;
+
+            case PATCH_OBJECT: {
+                int idx = patch.address / sizeof(struct RoomObject);
+                if (patch.address <= -1) {
+                    Room *room = &file->rooms[patch.room_id];
+                    if (patch.delete) {
+                        if (room->data.num_objects == 0) {
+                            fprintf(stderr, "Object id [] for room %d is out of bounds for deletion\n", patch.room_id);
+                            defer_return(false);
+                        }
+                        idx = room->data.num_objects - 1;
+                    } else {
+                        idx = room->data.num_objects;
+                        patch.address += sizeof(struct RoomObject);
+                    }
+                    fprintf(stderr, "Picking object id %d in place of [] for room %d is out of bounds for deletion\n", idx, patch.room_id);
+                    fprintf(stderr, "addr = %d\n", patch.address);
+                }
+                if (idx < 0) {
+                    fprintf(stderr, "Object id %d for room %d is out of bounds\n", idx, patch.room_id);
+                    defer_return(false);
+                }
+                if (patch.delete) {
+                    Room *room = &file->rooms[patch.room_id];
+                    if (idx >= file->rooms[patch.room_id].data.num_objects) {
+                        fprintf(stderr, "Object id %d for room %d is out of bounds\n", idx, patch.room_id);
+                        defer_return(false);
+                    }
+                    fprintf(stderr, "Deleting object %d at from room %d\n", idx, patch.room_id);
+                    memmove(room->data.objects + idx, room->data.objects + idx + 1, (room->data.num_objects - idx - 1) * sizeof(*room->data.objects));
+                    room->data.num_objects --;
+                } else {
+                    if (idx >= file->rooms[patch.room_id].data.num_objects) {
+                        Room *room = &file->rooms[patch.room_id];
+                        room->data.objects = arenaRealloc(&file->arena, room->data.objects, room->data.num_objects * sizeof(struct RoomObject), (idx + 1) * sizeof(struct RoomObject));
+                        room->data.num_objects = idx + 1;
+                    }
+                    int addr = patch.address % sizeof(struct RoomObject);
+                    struct RoomObject *object = file->rooms[patch.room_id].data.objects + idx;
+                    fprintf(stderr, "addr %d idx %d\n", addr, idx);
+                    if (addr == offsetof(struct RoomObject, tiles)) {
+                        assert(object->type == BLOCK);
+                        uint8_t value = patch.value & 0xFF;
+                        int tile_idx = patch.value >> 8;
+                        int x = tile_idx % WIDTH_TILES;
+                        int y = tile_idx / WIDTH_TILES;
+                        tile_idx = y * object->block.width + x;
+                        fprintf(stderr, "Writing object %d tiles[%d][%d] with %02x\n", idx, x, y, value);
+                        assert(tile_idx < object->block.width * object->block.height);
+                        object->tiles[tile_idx] = value;
+                    } else {
+                        if (object->type == BLOCK) {
+                            if ((addr == offsetof(struct RoomObject, block.width) && patch.value > MAX_BLOCK_WIDTH) ||
+                                    (addr == offsetof(struct RoomObject, block.height) && patch.value > MAX_BLOCK_HEIGHT)) {
+                                fprintf(stderr, "Object %d can be at most %dx%d\n", idx, MAX_BLOCK_WIDTH, MAX_BLOCK_HEIGHT);
+                                defer_return(false);
+                            }
+                        } else if (addr == offsetof(struct RoomObject, type) && patch.value == BLOCK) {
+                            memset(object->tiles, BLANK_TILE, sizeof(object->tiles));
+                        }
+                        fprintf(stderr, "Writing object %d at %d with %02x\n", idx, addr, patch.value);
+                        ((uint8_t *)object)[addr] = patch.value;
+                    }
+                }
+            }; break;
+
+            case PATCH_OBJECT_TILESET: {
+                if (patch.object_id == -1) {
+                    fprintf(stderr, "%s:%d: UNIMPLEMENTED: object tileset patch is -ve", __FILE__, __LINE__);
+                    defer_return(false);
+                }
+                fp = fopen(patch.filename, "r");
+                if (fp == NULL) {
+                    fprintf(stderr, "Could not open file for reading: %s: %s", patch.filename, strerror(errno));
+                    defer_return(false);
+                }
+
+                assert(fseek(fp, 0L, SEEK_END) == 0);
+                long ftold = ftell(fp);
+                assert(ftold != -1);
+                size_t filesize = ftold;
+                assert(fseek(fp, 0L, SEEK_SET) == 0);
+
+                char *data = malloc(filesize);
+                assert(data != NULL);
+
+                if (fread(data, sizeof(char), filesize, fp) != (size_t)filesize) {
+                    free(data);
+                    fprintf(stderr, "Could read file fully: %s: %s", patch.filename, strerror(errno));
+                    defer_return(false);
+                }
+
+                // Parsed as big as a room, so a too big object can say how big it is
+                uint8_t tiles[WIDTH_TILES * HEIGHT_TILES];
+                size_t width, height;
+                char error[80];
+                bool parsed = parseTiles(data, filesize, patch.filename, tiles, WIDTH_TILES, HEIGHT_TILES, &width, &height, error, sizeof(error));
+                free(data);
+                if (!parsed) {
+                    fprintf(stderr, "%s\n", error);
+                    defer_return(false);
+                }
+                if (width == 0 || height == 0) {
+                    fprintf(stderr, "No object tiles in %s\n", patch.filename);
+                    defer_return(false);
+                }
+                if (width > MAX_BLOCK_WIDTH || height > MAX_BLOCK_HEIGHT) {
+                    fprintf(stderr, "Object tiles in %s are %zux%zu, objects can be at most %dx%d\n",
+                            patch.filename, width, height, MAX_BLOCK_WIDTH, MAX_BLOCK_HEIGHT);
+                    defer_return(false);
+                }
+                struct RoomObject *object = file->rooms[patch.room_id].data.objects + patch.object_id;
+                object->type = BLOCK;
+                object->block.width = width;
+                object->block.height = height;
+                for (size_t y = 0; y < height; y ++) {
+                    memcpy(object->tiles + y * width, tiles + y * WIDTH_TILES, width);
+                }
+
+                fclose(fp);
+                fp = NULL;
+            }; break;
+
+            case PATCH_SWITCH: {
+                if (patch.address >= (0x1 << 8)) {
+                    int addr = patch.address & ((0x1 << 8) - 1);
+                    int idx = (patch.address >> 8) / sizeof(struct SwitchObject) - 1;
+                    int chunk_idx = addr / sizeof(struct SwitchChunk);
+                    addr %= sizeof(struct SwitchChunk);
+                    if (idx < 0) {
+                        fprintf(stderr, "Switch id %d for room %d is out of bounds\n", idx, patch.room_id);
+                        defer_return(false);
+                    }
+                    if (idx >= file->rooms[patch.room_id].data.num_switches) {
+                        Room *room = &file->rooms[patch.room_id];
+                        room->data.switches = arenaRealloc(&file->arena, room->data.switches, room->data.num_switches * sizeof(struct SwitchObject), (idx + 1) * sizeof(struct SwitchObject));
+                        room->data.num_switches = idx + 1;
+                    }
+                    struct SwitchObject *sw = file->rooms[patch.room_id].data.switches + idx;
+                    if (chunk_idx < 0) {
+                        fprintf(stderr, "Chunk id %d for switch %d in room %d is out of bounds\n", chunk_idx, idx, patch.room_id);
+                        defer_return(false);
+                    }
+                    if (patch.delete) {
+                        if ((unsigned)chunk_idx >= sw->chunks.length) {
+                            fprintf(stderr, "Chunk id %d for switch %d in room %d is out of bounds\n", chunk_idx, idx, patch.room_id);
+                            defer_return(false);
+                        }
+                        fprintf(stderr, "Deleting chunk %d for switch %d from room %d\n", chunk_idx, idx, patch.room_id);
+                        memmove(SMALL_ARRAY_DATA(sw->chunks) + chunk_idx, SMALL_ARRAY_DATA(sw->chunks) + chunk_idx + 1, (sw->chunks.length - chunk_idx - 1) * sizeof(struct SwitchChunk));
+                        sw->chunks.length --;
+                    } else {
+                        if ((unsigned)chunk_idx >= sw->chunks.length) {
+                            ARENA_SMALL_ARRAY_ENSURE(&file->arena, sw->chunks, (unsigned)chunk_idx + 1);
+                            sw->chunks.length = chunk_idx + 1;
+                        }
+                        fprintf(stderr, "Writing switch %d chunk[%d] at %d with %02x\n", idx, chunk_idx, addr, patch.value);
+                        ((uint8_t *)&SMALL_ARRAY_DATA(sw->chunks)[chunk_idx])[addr] = patch.value;
+                    }
+                } else {
+                    if (!patch.delete) {
+                        fprintf(stderr, "%s:%d: UNREACHABLE: switches now only have chunks, and no local fields\n", __FILE__, __LINE__);
+                        exit(1);
+                    }
+
+                    int idx = patch.address / sizeof(struct SwitchObject) - 1;
+                    if (idx < 0) {
+                        fprintf(stderr, "Switch id %d for room %d is out of bounds\n", idx, patch.room_id);
+                        defer_return(false);
+                    }
+                    if (patch.delete) {
+                        Room *room = &file->rooms[patch.room_id];
+                        if (idx >= file->rooms[patch.room_id].data.num_switches) {
+                            fprintf(stderr, "Switch id %d for room %d is out of bounds\n", idx, patch.room_id);
+                            defer_return(false);
+                        }
+                        fprintf(stderr, "Deleting switch %d from room %d\n", idx, patch.room_id);
+                        memmove(room->data.switches + idx, room->data.switches + idx + 1, (room->data.num_switches - idx - 1) * sizeof(*room->data.switches));
+                        room->data.num_switches --;
+                    } else {
+                        if (idx >= file->rooms[patch.room_id].data.num_switches) {
+                            Room *room = &file->rooms[patch.room_id];
+                            room->data.switches = arenaRealloc(&file->arena, room->data.switches, room->data.num_switches * sizeof(struct SwitchObject), (idx + 1) * sizeof(struct SwitchObject));
+                            room->data.num_switches = idx + 1;
+                        }
+                        int addr = patch.address % sizeof(struct SwitchObject);
+                        struct SwitchObject *sw = file->rooms[patch.room_id].data.switches + idx;
+                        fprintf(stderr, "Writing switch %d at %d with %02x\n", idx, addr, patch.value);
+                        ((uint8_t *)sw)[addr] = patch.value;
+                    }
+                }
+            }; break;
+
+            case PATCH_TILE_RECT:
+            case PATCH_OBJECT_TILE_RECT: {
+                Room *room = &file->rooms[patch.room_id];
+                Room *source = &file->rooms[patch.value];
+                uint8_t *tiles = room->data.tiles;
+                uint8_t *source_tiles = source->data.tiles;
+                int width = WIDTH_TILES;
+                int height = HEIGHT_TILES;
+                if (patch.type == PATCH_OBJECT_TILE_RECT) {
+                    if (patch.object_id >= room->data.num_objects || room->data.objects[patch.object_id].type != BLOCK ||
+                            (patch.copy && (patch.object_id >= source->data.num_objects || source->data.objects[patch.object_id].type != BLOCK))) {
+                        fprintf(stderr, "Object %d in room %d is not a block\n", patch.object_id, patch.room_id);
+                        defer_return(false);
+                    }
+                    struct RoomObject *object = room->data.objects + patch.object_id;
+                    tiles = object->tiles;
+                    width = object->block.width;
+                    height = object->block.height;
+                    if (patch.copy) {
+                        struct RoomObject *source_object = source->data.objects + patch.object_id;
+                        source_tiles = source_object->tiles;
+                        if (source_object->block.width != width || source_object->block.height != height) {
+                            fprintf(stderr, "Object %d in room %d is not the same size as in room %d\n", patch.object_id, patch.value, patch.room_id);
+                            defer_return(false);
+                        }
+                    }
+                }
+                if (patch.rect.x + patch.rect.width > width || patch.rect.y + patch.rect.height > height) {
+                    fprintf(stderr, "Tiles [%d..%d][%d..%d] are outside of %dx%d\n", patch.rect.x, patch.rect.x + patch.rect.width - 1,
+                            patch.rect.y, patch.rect.y + patch.rect.height - 1, width, height);
+                    defer_return(false);
+                }
+                if (patch.copy && !source->valid) {
+                    fprintf(stderr, "Can not copy from room %d, it is not valid\n", patch.value);
+                    defer_return(false);
+                }
+                if (patch.copy) {
+                    fprintf(stderr, "Copying tiles [%d..%d][%d..%d] from room %d\n", patch.rect.x, patch.rect.x + patch.rect.width - 1,
+                            patch.rect.y, patch.rect.y + patch.rect.height - 1, patch.value);
+                } else {
+                    fprintf(stderr, "Filling tiles [%d..%d][%d..%d] with %02x\n", patch.rect.x, patch.rect.x + patch.rect.width - 1,
+                            patch.rect.y, patch.rect.y + patch.rect.height - 1, patch.value);
+                }
+                for (int y = patch.rect.y; y < patch.rect.y + patch.rect.height; y ++) {
+                    if (patch.copy) {
+                        memmove(tiles + y * width + patch.rect.x, source_tiles + y * width + patch.rect.x, patch.rect.width);
+                    } else {
+                        memset(tiles + y * width + patch.rect.x, patch.value, patch.rect.width);
+                    }
+                }
+            }; break;
+
+            case PATCH_TILESET: {
+                fp = fopen(patch.filename, "r");
+                if (fp == NULL) {
+                    fprintf(stderr, "Could not open file for reading: %s: %s", patch.filename, strerror(errno));
+                    defer_return(false);
+                }
+                Room *room = &file->rooms[patch.room_id];
+                if (!readRoomFromFile(room, fp, patch.filename)) defer_return(false);
+                fclose(fp);
+                fp = NULL;
+            }; break;
+
+            default:
+                fprintf(stderr, "%s:%d: UNREACHABLE: Unexpected patch type %d\n", __FILE__, __LINE__, patch.type);
+                exit(1);
+                break;
+        }
+    }
+
+defer:
+#undef defer_return
+    if (fp) { fclose(fp); fp = NULL; }
+    return ret;
+}
+
+bool readPatchField(RoomFile *file, PatchInstruction *patch, uint8_t *value) {
+    Room *room = &file->rooms[patch->room_id];
+    if (patch->type != PATCH_NORMAL || !room->valid) {
+        fprintf(stderr, "Can only read room fields of valid rooms\n");
+        return false;
+    }
+    if ((size_t)patch->address < offsetof(struct DecompresssedRoom, end_marker)) {
+        *value = ((uint8_t *)&room->data)[patch->address];
+    } else if ((size_t)patch->address >= sizeof(room->data) && patch->address - sizeof(room->data) < room->rest.length) {
+        *value = room->rest.data[patch->address - sizeof(room->data)];
+    } else {
+        fprintf(stderr, "Address %d invalid\n", patch->address);
+        return false;
+    }
+    return true;
+}
+
+typedef enum {
+    WHERE_EQ,
+    WHERE_NE,
+    WHERE_LT,
+    WHERE_LE,
+    WHERE_GT,
+    WHERE_GE,
+} WhereOp;
+
+typedef struct {
+    char *field;
+    WhereOp op;
+    long value;
+} WhereClause;
+
+// Splits FIELD=VALUE in place, op is NULL if arg has none of =, !=, <, <=, >, >=
+static char *splitClause(char *arg, WhereOp *op) {
+    char *sep = strpbrk(arg, "=!<>");
+    if (sep == NULL || sep == arg) return NULL;
+    char *value = sep + 1;
+    switch (*sep) {
+        case '=': *op = WHERE_EQ; break;
+        case '!': *op = WHERE_NE; if (*value++ != '=') return NULL; break;
+        case '<': *op = WHERE_LT; if (*value == '=') { *op = WHERE_LE; value ++; } break;
+        case '>': *op = WHERE_GT; if (*value == '=') { *op = WHERE_GE; value ++; } break;
+    }
+    *sep = '\0';
+    return value;
+}
+
+// Parses ROOMS like 1..62, 5 or 1,3,7..9 into selected
+static bool parseRoomSet(char *arg, RoomFile *file, bool *selected) {
+    char *end = NULL;
+    if (strcasecmp(arg, "all") == 0) {
+        for (size_t i = 0; i < C_ARRAY_LEN(file->rooms); i ++) selected[i] = true;
+        return true;
+    }
+    while (true) {
+        long first = strtol(arg, &end, 0);
+        if (end == arg) return false;
+        long last = first;
+        if (strncmp(end, "..", 2) == 0) {
+            arg = end + 2;
+            last = strtol(arg, &end, 0);
+            if (end == arg) return false;
+        }
+        if (first < 0 || last < first || (unsigned)last >= C_ARRAY_LEN(file->rooms)) {
+            fprintf(stderr, "Room ID out of range 0..%lu\n", C_ARRAY_LEN(file->rooms) - 1);
+            return false;
+        }
+        for (long i = first; i <= last; i ++) selected[i] = true;
+        if (*end == '\0') return true;
+        if (*end != ',') return false;
+        arg = end + 1;
+    }
+}
+
+bool parseUpdate(int *argc, char ***argv, char *program, RoomFile *file, PatchInstructionArray *patches) {
+    bool selected[C_ARRAY_LEN(file->rooms)] = {0};
+    if (*argc <= 3 || strcasecmp((*argv)[1], "rooms") != 0 || !parseRoomSet((*argv)[2], file, selected)) {
+        fprintf(stderr, "Usage: %s update rooms ROOMS [set FIELD=VALUE...] [clear switches|objects] [where FIELD(=|!=|<|<=|>|>=)VALUE...] [FILENAME]\n", program);
+        return false;
+    }
+    if (!needsRooms(file, "update")) return false;
+    *argv += 3;
+    *argc -= 3;
+
+    ARRAY(char *) sets = {0};
+    ARRAY(WhereClause) wheres = {0};
+    bool clear_switches = false;
+    bool clear_objects = false;
+    bool ret = true;
+#define defer_return(code) { ret = code; goto defer; }
+    char *clause = NULL;
+    while (*argc > 0) {
+        char *arg = (*argv)[0];
+        WhereOp op = WHERE_EQ;
+        char *value = NULL;
+        if (strcasecmp(arg, "set") == 0 || strcasecmp(arg, "clear") == 0 || strcasecmp(arg, "where") == 0) {
+            clause = arg;
+        } else if (clause != NULL && strcasecmp(clause, "clear") == 0 && (strcasecmp(arg, "switches") == 0 || strcasecmp(arg, "switch") == 0)) {
+            clear_switches = true;
+        } else if (clause != NULL && strcasecmp(clause, "clear") == 0 && (strcasecmp(arg, "objects") == 0 || strcasecmp(arg, "object") == 0)) {
+            clear_objects = true;
+        } else if (clause != NULL && strcasecmp(clause, "set") == 0 && (value = splitClause(arg, &op)) != NULL && op == WHERE_EQ) {
+            ARRAY_ADD(sets, arg);
+            ARRAY_ADD(sets, value);
+        } else if (clause != NULL && strcasecmp(clause, "where") == 0 && (value = splitClause(arg, &op)) != NULL) {
+            char *end = NULL;
+            long number = strtol(value, &end, 0);
+            if (errno == EINVAL || end == value || *end != '\0') {
+                fprintf(stderr, "Invalid number: %s\n", value);
+                defer_return(false);
+            }
+            ARRAY_ADD(wheres, ((WhereClause){ .field = arg, .op = op, .value = number }));
+        } else {
+            break; // The next subcommand or the filename
+        }
+        *argv += 1;
+        *argc -= 1;
+    }
+
+    size_t matched = 0;
+    for (size_t room_id = 0; room_id < C_ARRAY_LEN(file->rooms); room_id ++) {
+        Room *room = &file->rooms[room_id];
+        if (!selected[room_id] || !room->valid) continue;
+        char room_arg[8];
+        snprintf(room_arg, sizeof(room_arg), "%zu", room_id);
+
+        bool match = true;
+        for (size_t i = 0; match && i < wheres.length; i ++) {
+            WhereClause where = wheres.data[i];
+            long actual = 0;
+            if (strcasecmp(where.field, "switches") == 0) {
+                actual = room->data.num_switches;
+            } else if (strcasecmp(where.field, "objects") == 0) {
+                actual = room->data.num_objects;
+            } else {
+                PatchInstructionArray field = {0};
+                char *patch_argv[] = { "patch", room_arg, where.field, "0" };
+                int patch_argc = C_ARRAY_LEN(patch_argv);
+                char **patch_args = patch_argv;
+                uint8_t value = 0;
+                bool ok = parsePatch(&patch_argc, &patch_args, program, file, &field) &&
+                    field.length == 1 && readPatchField(file, &SMALL_ARRAY_DATA(field)[0], &value);
+                SMALL_ARRAY_FREE(field);
+                if (!ok) {
+                    fprintf(stderr, "Can not compare %s\n", where.field);
+                    defer_return(false);
+                }
+                actual = value;
+            }
+            switch (where.op) {
+                case WHERE_EQ: match = actual == where.value; break;
+                case WHERE_NE: match = actual != where.value; break;
+                case WHERE_LT: match = actual < where.value; break;
+                case WHERE_LE: match = actual <= where.value; break;
+                case WHERE_GT: match = actual > where.value; break;
+                case WHERE_GE: match = actual >= where.value; break;
+            }
+        }
+        if (!match) continue;
+        matched ++;
+
+        for (size_t i = 0; i < sets.length; i += 2) {
+            char *patch_argv[] = { "patch", room_arg, sets.data[i], sets.data[i + 1] };
+            int patch_argc = C_ARRAY_LEN(patch_argv);
+            char **patch_args = patch_argv;
+            if (!parsePatch(&patch_argc, &patch_args, program, file, patches)) defer_return(false);
+        }
+        // Always deleting [0] leaves nothing to shift by the time applyPatches gets to them
+        for (size_t i = 0; clear_switches && i < room->data.num_switches; i ++) {
+            SMALL_ARRAY_ADD(*patches, ((PatchInstruction){ .type = PATCH_SWITCH, .room_id = room_id, .address = sizeof(struct SwitchObject), .delete = true }));
+        }
+        for (size_t i = 0; clear_objects && i < room->data.num_objects; i ++) {
+            SMALL_ARRAY_ADD(*patches, ((PatchInstruction){ .type = PATCH_OBJECT, .room_id = room_id, .address = 0, .delete = true }));
+        }
+    }
+    fprintf(stderr, "Updating %zu rooms\n", matched);
+
+defer:
+#undef defer_return
+    ARRAY_FREE(sets);
+    ARRAY_FREE(wheres);
+    return ret;
+}
+
+// Splits line in place on whitespace, "double quotes" keep spaces
+size_t splitPatchLine(char *line, char **args, size_t max_args) {
+    size_t n = 0;
+    while (*line != '\0') {
+        while (isspace((unsigned char)*line)) line ++;
+        if (*line == '\0') break;
+        if (n == max_args) return max_args + 1;
+        bool quoted = *line == '"';
+        if (quoted) line ++;
+        args[n ++] = line;
+        while (*line != '\0' && (quoted ? *line != '"' : !isspace((unsigned char)*line))) line ++;
+        if (*line != '\0') *line++ = '\0';
+    }
+    return n;
+}
+
+bool parsePatchScript(FILE *fp, const char *script, char *program, RoomFile *file, PatchInstructionArray *patches, uint8_array *text) {
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+        for (size_t i = 0; i < n; i ++) ARRAY_ADD(*text, buf[i]);
+    }
+    ARRAY_ADD(*text, '\0');
+    if (ferror(fp)) {
+        fprintf(stderr, "Could not read %s: %s\n", script, strerror(errno));
+        return false;
+    }
+
+    char *line = (char *)text->data;
+    for (size_t line_number = 1; line != NULL && *line != '\0'; line_number ++) {
+        char *next = strchr(line, '\n');
+        if (next != NULL) *next++ = '\0';
+        char *args[256];
+        size_t argc = splitPatchLine(line, args, C_ARRAY_LEN(args));
+        line = next;
+        if (argc == 0 || args[0][0] == '#') continue;
+
+        bool ok = false;
+        int left = argc;
+        char **rest = args;
+        if (argc > C_ARRAY_LEN(args)) {
+            fprintf(stderr, "Too many arguments\n");
+        } else if (strcasecmp(args[0], "patch") == 0) {
+            ok = parsePatch(&left, &rest, program, file, patches);
+        } else if (strcasecmp(args[0], "delete") == 0) {
+            ok = parseDelete(&left, &rest, program, file, patches);
+        } else if (strcasecmp(args[0], "update") == 0) {
+            ok = parseUpdate(&left, &rest, program, file, patches);
+        } else {
+            fprintf(stderr, "Unknown command: %s\n", args[0]);
+        }
+        if (ok && left != 0) {
+            fprintf(stderr, "Unexpected argument: %s\n", rest[0]);
+            ok = false;
+        }
+        if (!ok) {
+            fprintf(stderr, "%s:%zu: Could not compile line\n", script, line_number);
+            return false;
+        }
+    }
+    return true;
+}
+
+#define PATCH_PROGRAM_MAGIC "SPLPATCH"
+#define PATCH_PROGRAM_VERSION 1
+// Each instruction is written as
+//     type, room_id, flags (PATCH_PROGRAM_*), rect x, y, width, height,
+//     address (4), value (2), object_id (4), then with PATCH_PROGRAM_FILENAME
+//     the length (2) of filename including its NUL, and filename
+// with everything little endian.
+#define PATCH_PROGRAM_DELETE 0x1
+#define PATCH_PROGRAM_COPY 0x2
+#define PATCH_PROGRAM_FILENAME 0x4
+
+static void putLE(uint8_array *out, uint32_t value, size_t bytes) {
+    for (size_t i = 0; i < bytes; i ++) ARRAY_ADD(*out, (value >> (8 * i)) & 0xFF);
+}
+
+static uint32_t getLE(const uint8_t *in, size_t bytes) {
+    uint32_t value = 0;
+    for (size_t i = 0; i < bytes; i ++) value |= (uint32_t)in[i] << (8 * i);
+    return value;
+}
+
+bool writePatchProgram(PatchInstructionArray *patches, FILE *fp) {
+    uint8_array out = {0};
+    for (size_t i = 0; i < strlen(PATCH_PROGRAM_MAGIC); i ++) ARRAY_ADD(out, PATCH_PROGRAM_MAGIC[i]);
+    putLE(&out, PATCH_PROGRAM_VERSION, 1);
+    putLE(&out, patches->length, 4);
+    for (size_t i = 0; i < patches->length; i ++) {
+        PatchInstruction *patch = &SMALL_ARRAY_DATA(*patches)[i];
+        uint8_t flags = (patch->delete ? PATCH_PROGRAM_DELETE : 0) |
+            (patch->copy ? PATCH_PROGRAM_COPY : 0) |
+            (patch->filename != NULL ? PATCH_PROGRAM_FILENAME : 0);
+        putLE(&out, patch->type, 1);
+        putLE(&out, patch->room_id, 1);
+        putLE(&out, flags, 1);
+        putLE(&out, patch->rect.x, 1);
+        putLE(&out, patch->rect.y, 1);
+        putLE(&out, patch->rect.width, 1);
+        putLE(&out, patch->rect.height, 1);
+        putLE(&out, patch->address, 4);
+        putLE(&out, patch->value, 2);
+        putLE(&out, patch->object_id, 4);
+        if (patch->filename != NULL) {
+            size_t length = strlen(patch->filename) + 1;
+            putLE(&out, length, 2);
+            for (size_t c = 0; c < length; c ++) ARRAY_ADD(out, patch->filename[c]);
+        }
+    }
+    bool ret = fwrite(out.data, 1, out.length, fp) == out.length;
+    ARRAY_FREE(out);
+    return ret;
+}
+
+bool readPatchProgram(FILE *fp, const char *path, PatchInstructionArray *patches, uint8_array *data) {
+    uint8_t buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+        for (size_t i = 0; i < n; i ++) ARRAY_ADD(*data, buf[i]);
+    }
+    size_t header = strlen(PATCH_PROGRAM_MAGIC) + 1 + 4;
+    if (data->length < header || memcmp(data->data, PATCH_PROGRAM_MAGIC, strlen(PATCH_PROGRAM_MAGIC)) != 0) {
+        fprintf(stderr, "%s is not a compiled patch program\n", path);
+        return false;
+    }
+    if (data->data[strlen(PATCH_PROGRAM_MAGIC)] != PATCH_PROGRAM_VERSION) {
+        fprintf(stderr, "%s is version %d, expected %d\n", path, data->data[strlen(PATCH_PROGRAM_MAGIC)], PATCH_PROGRAM_VERSION);
+        return false;
+    }
+    uint32_t count = getLE(data->data + strlen(PATCH_PROGRAM_MAGIC) + 1, 4);
+    size_t at = header;
+    for (uint32_t i = 0; i < count; i ++) {
+        const size_t size = 7 + 4 + 2 + 4;
+        if (at + size > data->length) break;
+        uint8_t *in = data->data + at;
+        PatchInstruction patch = {
+            .type = in[0],
+            .room_id = in[1],
+            .delete = (in[2] & PATCH_PROGRAM_DELETE) != 0,
+            .copy = (in[2] & PATCH_PROGRAM_COPY) != 0,
+            .rect = { in[3], in[4], in[5], in[6] },
+            .address = (int32_t)getLE(in + 7, 4),
+            .value = getLE(in + 11, 2),
+            .object_id = (int32_t)getLE(in + 13, 4),
+        };
+        at += size;
+        if (in[2] & PATCH_PROGRAM_FILENAME) {
+            if (at + 2 > data->length) break;
+            size_t length = getLE(data->data + at, 2);
+            at += 2;
+            if (length == 0 || at + length > data->length || data->data[at + length - 1] != '\0') break;
+            patch.filename = (char *)data->data + at; // data is not added to after this, so it stays put
+            at += length;
+        }
+        if (patch.type >= NUM_PATCH_TYPES || patch.room_id >= C_ARRAY_LEN(((RoomFile *)NULL)->rooms)) break;
+        SMALL_ARRAY_ADD(*patches, patch);
+    }
+    if (patches->length != count || at != data->length) {
+        fprintf(stderr, "%s is truncated or corrupt at byte %zu\n", path, at);
+        return false;
+    }
+    return true;
+}
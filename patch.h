@@ -0,0 +1,70 @@
+#ifndef PATCH_H
+#define PATCH_H
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "array.h"
+#include "room.h"
+
+typedef enum {
+    PATCH_NORMAL,
+    PATCH_OBJECT,
+    PATCH_SWITCH,
+    PATCH_TILESET,
+    PATCH_OBJECT_TILESET,
+    PATCH_TILE_RECT,
+    PATCH_OBJECT_TILE_RECT,
+
+    NUM_PATCH_TYPES // _Static_asserts depend on this being the last entry
+} PatchType;
+
+typedef struct {
+    PatchType type;
+    uint8_t room_id;
+    int address;
+    uint16_t value;
+    int object_id;
+    bool delete;
+    char *filename;
+    struct { // PATCH_TILE_RECT, PATCH_OBJECT_TILE_RECT
+        uint8_t x;
+        uint8_t y;
+        uint8_t width;
+        uint8_t height;
+    } rect;
+    bool copy; // rect is copied from the same place in room value, instead of filled with value
+} PatchInstruction;
+
+// Most patch commands only have a few ADDR VALUE pairs
+typedef SMALL_ARRAY(PatchInstruction, 8) PatchInstructionArray;
+
+// Both parse a patch/delete command starting at (*argv)[0] and add its
+// instructions to patches, consuming the arguments they used. Nothing is
+// changed in file until applyPatches. With a NULL file, as when compiling,
+// anything that would be looked up in it, like object[], is an error.
+bool parsePatch(int *argc, char ***argv, char *program, RoomFile *file, PatchInstructionArray *patches);
+bool parseDelete(int *argc, char ***argv, char *program, RoomFile *file, PatchInstructionArray *patches);
+// update rooms ROOMS [set FIELD=VALUE...] [clear switches|objects] [where FIELD<op>VALUE...]
+// Selects rooms against file as it is now, before any patches are applied,
+// and adds the same instructions patch/delete would for each of them. It
+// needs a file, so can not be compiled.
+bool parseUpdate(int *argc, char ***argv, char *program, RoomFile *file, PatchInstructionArray *patches);
+// Reads the byte a PATCH_NORMAL instruction would write
+bool readPatchField(RoomFile *file, PatchInstruction *patch, uint8_t *value);
+// Splits line in place into at most max_args args, returns max_args + 1 if there are more
+size_t splitPatchLine(char *line, char **args, size_t max_args);
+
+// A script is patch, delete and update lines, as on the command line, with #
+// comments. Its text is read into text, which the instructions point into.
+// file can be NULL, as for parsePatch.
+bool parsePatchScript(FILE *fp, const char *script, char *program, RoomFile *file, PatchInstructionArray *patches, uint8_array *text);
+// Compiled programs are the parsed instructions, so they apply to any file
+// without parsing again. They are parsed without a file, so every instruction
+// means the same whatever it is applied to. The instructions read point into
+// data.
+bool writePatchProgram(PatchInstructionArray *patches, FILE *fp);
+bool readPatchProgram(FILE *fp, const char *path, PatchInstructionArray *patches, uint8_array *data);
+// rooms gets each room that was patched, once, in order
+bool applyPatches(RoomFile *file, PatchInstructionArray *patches, char *program, uint8_array *rooms);
+
+#endif // PATCH_H
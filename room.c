@@ -12,6 +12,8 @@
 /* Only for ntohs, perhaps write our own? */
 #include <arpa/inet.h>
 
+#include <time.h>
+
 #include <stdio.h>
 long filesize(FILE *fp) {
     long tell = ftell(fp);
@@ -31,30 +33,13 @@ typedef struct {
     uint16_t filesize;
 } Header;
 
-void freeRoom(Room *room) {
-    if (room == NULL) return;
-    if (room->data.objects) {
-        for (size_t i = 0; i < room->data.num_objects; i ++) {
-            if (room->data.objects[i].tiles) free(room->data.objects[i].tiles);
-        }
-        free(room->data.objects);
-    }
-    if (room->data.switches) {
-        for (size_t i = 0; i < room->data.num_switches; i ++) {
-            ARRAY_FREE(room->data.switches[i].chunks);
-        }
-        free(room->data.switches);
-    }
-    ARRAY_FREE(room->rest);
-    ARRAY_FREE(room->compressed);
-    ARRAY_FREE(room->decompressed);
-}
-
 void freeRoomFile(RoomFile *file) {
     if (file == NULL) return;
-    for (size_t i = 0; i < C_ARRAY_LEN(file->rooms); i ++) {
-        freeRoom(&file->rooms[i]);
+    for (size_t idx = 0; idx < C_ARRAY_LEN(file->versions); idx ++) {
+        roomChanged(file, idx);
     }
+    arenaFree(&file->arena);
+    memset(file->rooms, 0, sizeof(file->rooms));
 }
 
 void dumpHeader(Header *head) {
@@ -118,7 +103,6 @@ void dumpRoom(Room *room, RoomFile *file) {
 
                         printf("\033[3%ldm", (o % 7) + 1);
                         colored = true;
-                        assert(object->tiles != NULL);
                         int o_x = x - object->x;
                         int o_y = y - object->y;
                         tile = object->tiles[o_y * object->block.width + o_x];
@@ -138,14 +122,14 @@ void dumpRoom(Room *room, RoomFile *file) {
         }
         for (size_t s = 0; s < room->data.num_switches; s ++) {
             struct SwitchObject *sw = room->data.switches + s;
-            assert(sw->chunks.length > 0 && sw->chunks.data[0].type == PREAMBLE);
-            if (x == sw->chunks.data[0].x && y == sw->chunks.data[0].y) {
+            assert(sw->chunks.length > 0 && SMALL_ARRAY_DATA(sw->chunks)[0].type == PREAMBLE);
+            if (x == SMALL_ARRAY_DATA(sw->chunks)[0].x && y == SMALL_ARRAY_DATA(sw->chunks)[0].y) {
                 printf("\033[4%ld;30m", (s % 3) + 4);
                 colored = true;
                 break;
             }
             for (size_t c = 1; !colored && c < sw->chunks.length; c ++) {
-                struct SwitchChunk *chunk = sw->chunks.data + c;
+                struct SwitchChunk *chunk = SMALL_ARRAY_DATA(sw->chunks) + c;
                 if (chunk->type == TOGGLE_BLOCK) {
                     if (chunk->dir == HORIZONTAL) {
                         if (y == chunk->y && x >= chunk->x && x < chunk->x + chunk->size) {
@@ -261,14 +245,14 @@ for (int i = C_ARRAY_LEN(neighbour_name) - 1; i >= 0; i --) { \
     printf("  Switches (length=%u):\n", room->data.num_switches);
     for (size_t i = 0; i < room->data.num_switches; i ++) {
         printf("    \033[4%ld;30;1m", (i % 3) + 4);
-        assert(room->data.switches[i].chunks.length > 0 && room->data.switches[i].chunks.data[0].type == PREAMBLE);
+        assert(room->data.switches[i].chunks.length > 0 && SMALL_ARRAY_DATA(room->data.switches[i].chunks)[0].type == PREAMBLE);
         printf("[idx=%ld]{.x = %d, .y = %d, .room_entry = %s, .one_time_use = %s, .side = %s", i,
-                room->data.switches[i].chunks.data[0].x, room->data.switches[i].chunks.data[0].y, BOOL_S(room->data.switches[i].chunks.data[0].room_entry), BOOL_S(room->data.switches[i].chunks.data[0].one_time_use), SWITCH_SIDE(room->data.switches[i].chunks.data[0].side));
+                SMALL_ARRAY_DATA(room->data.switches[i].chunks)[0].x, SMALL_ARRAY_DATA(room->data.switches[i].chunks)[0].y, BOOL_S(SMALL_ARRAY_DATA(room->data.switches[i].chunks)[0].room_entry), BOOL_S(SMALL_ARRAY_DATA(room->data.switches[i].chunks)[0].one_time_use), SWITCH_SIDE(SMALL_ARRAY_DATA(room->data.switches[i].chunks)[0].side));
         printf(", .chunks (num=%lu) = [", room->data.switches[i].chunks.length);
         for (size_t c = 0; c < room->data.switches[i].chunks.length; c ++) {
             printf("\033[m\n        ");
             /* printf("\033[m\n        \033[4%ld;30;1m", (i % 3) + 4); */
-            struct SwitchChunk *chunk = room->data.switches[i].chunks.data + c;
+            struct SwitchChunk *chunk = SMALL_ARRAY_DATA(room->data.switches[i].chunks) + c;
             _Static_assert(NUM_CHUNK_TYPES == 4, "Unexpected number of chunk types");
             switch (chunk->type) {
                 case PREAMBLE:
@@ -371,7 +355,187 @@ for (int i = C_ARRAY_LEN(neighbour_name) - 1; i >= 0; i --) { \
     printf("]\n");
 }
 
-bool readRoom(Room *room, Header *head, size_t idx, FILE *fp) {
+// Decompresses into a caller owned buffer, readRoom and the bench subcommand share this.
+// With prefix it stops once the buffer is full instead of failing, for partial loads.
+static inline DecompressError decompress(const uint8_t *compressed, size_t c_len, uint8_t *decompressed, size_t capacity, size_t *d_len, bool prefix) {
+    // The source reads the first two words into 0x1d1d-0x1d20 (including marker and these tile markers)
+    if (c_len < 4) return DECOMPRESS_TRUNCATED;
+    if (compressed[0] != 0x8F) return DECOMPRESS_BAD_MARKER;
+    const uint8_t *src = compressed + 4;
+    const uint8_t *src_end = compressed + c_len;
+    uint8_t *dst = decompressed;
+    uint8_t *dst_end = decompressed + capacity;
+    uint8_t m0 = compressed[0], m1 = compressed[1], m2 = compressed[2], m3 = compressed[3];
+
+    while (src < src_end && !(prefix && dst == dst_end)) {
+        uint8_t val = *src++;
+        if (val != m1 && val != m2 && val != m3) {
+            if (dst == dst_end) return DECOMPRESS_OVERFLOW;
+            *dst++ = val;
+            continue;
+        }
+
+        // A marker is always followed by at least one byte
+        if (src == src_end) return DECOMPRESS_TRUNCATED;
+        uint8_t next = *src++;
+        if (next == 0x80) {
+            // Escaped marker, add it as is
+            if (dst == dst_end) return DECOMPRESS_OVERFLOW;
+            *dst++ = val;
+            continue;
+        }
+        size_t length;
+        size_t back;
+        if (val == m1) {
+            if (next < 0x80) {
+                // RLE, get last byte, store that byte (next + 2) times
+                length = next + 2;
+                back = 1;
+            } else {
+                // copy abs(next) bytes from dst - 0x20 to dst
+                length = -(int8_t)next;
+                back = 0x20;
+            }
+        } else if (val == m2 && next < 0x80) {
+            // Store start of room marker next + 2 times
+            length = next + 2;
+            if (length > (size_t)(dst_end - dst)) {
+                if (!prefix) return DECOMPRESS_OVERFLOW;
+                length = dst_end - dst;
+            }
+            for (; length > 0; length --) *dst++ = m0;
+            continue;
+        } else {
+            if (src == src_end) return DECOMPRESS_TRUNCATED;
+            back = *src++;
+            if (val == m2) {
+                // LZ, copy abs(next) + 1 bytes from dst - back to dst
+                length = -(int8_t)next + 1;
+            } else if (next < 0x80) {
+                // Larger backindex LZ's
+                length = next + 2;
+                back |= 0x200;
+            } else {
+                length = -(int8_t)next + 1;
+                back |= 0x100;
+            }
+        }
+
+        // Copies may overlap their own output, so go byte by byte
+        if (back == 0 || back > (size_t)(dst - decompressed)) return DECOMPRESS_BAD_BACKREF;
+        if (length > (size_t)(dst_end - dst)) {
+            if (!prefix) return DECOMPRESS_OVERFLOW;
+            length = dst_end - dst;
+        }
+        for (; length > 0; length --, dst ++) *dst = dst[-back];
+    }
+
+    *d_len = dst - decompressed;
+    return DECOMPRESS_OK;
+}
+
+DecompressError decompressRoom(const uint8_t *compressed, size_t c_len, uint8_t *decompressed, size_t capacity, size_t *d_len) {
+    return decompress(compressed, c_len, decompressed, capacity, d_len, false);
+}
+
+DecompressError decompressRoomPrefix(const uint8_t *compressed, size_t c_len, uint8_t *decompressed, size_t capacity, size_t *d_len) {
+    return decompress(compressed, c_len, decompressed, capacity, d_len, true);
+}
+
+static const uint8_t switch_bitmasks[] = {0x01, 0x04, 0x10, 0x40};
+
+static inline int switchBitmaskIndex(uint8_t bitmask) {
+    for (size_t i = 0; i < C_ARRAY_LEN(switch_bitmasks); i ++) {
+        if (switch_bitmasks[i] == bitmask) return i;
+    }
+    return -1;
+}
+
+size_t decodeSwitchChunk(const uint8_t *bytes, size_t length, bool preamble, struct SwitchChunk *chunk) {
+    if (length < 2) return 0;
+    uint8_t msb = bytes[0];
+    uint8_t lsb = bytes[1];
+    _Static_assert(NUM_CHUNK_TYPES == 4, "Unexpected number of chunk types");
+    if (preamble) {
+        *chunk = (struct SwitchChunk){ .type = PREAMBLE, .x = lsb & 0x1f, .y = msb & 0x1f, .room_entry = (lsb & 0x80) == 0x00, .one_time_use = (msb & 0x20) != 0x00, .side = (lsb & 0x60) >> 5, .msb = msb, .lsb = lsb };
+        return 2;
+    }
+    switch (msb & 0xc0) {
+        case 0x80: {
+            if (length < 4) return 0;
+            uint8_t size = ((lsb >> 5) & 0x7) + 1;
+            enum SwitchChunkDirection dir = ((msb & 0x20) == 0) ? HORIZONTAL : VERTICAL;
+            // All bits accounted for
+            *chunk = (struct SwitchChunk){ .type = TOGGLE_BLOCK, .x = lsb & 0x1f, .y = msb & 0x1f, .size = size, .dir = dir, .off = bytes[2], .on = bytes[3] };
+            return 4;
+        };
+
+        case 0x40: {
+            // Only does this if switch_structs[unknown(f) + i / 3] has {0x2, 0x8, 0x20, 0x80}[i] set
+            uint8_t on = (msb >> 4) & 0x3;
+            uint8_t off = (msb >> 2) & 0x3;
+            uint8_t bitmask = switch_bitmasks[msb & 0x3];
+            // removes bit, sets bit << 1
+            // Note that this static array index is based purely on byte, not on switch index
+            uint8_t index = lsb;
+            // This seems to be the index that is set, not the index that is checked
+            *chunk = (struct SwitchChunk){ .type = TOGGLE_BIT, .on = on, .off = off, .bitmask = bitmask, .index = index };
+            return 2;
+        };
+
+        case 0xc0: {
+            // Only does this if switch_structs[unknown(f) + i / 3] has {0x2, 0x8, 0x20, 0x80}[i] set
+            // 0b00110000 is tested against *0x1d13
+            // msb & 0xf is index into objects
+            // if object is block, set movertab[2] = lsb
+            // if sprite, set movertab[2] = lsb & 0xf8, maybe | 0x80 if movertab[2] & 0x2 != 0
+            uint8_t test = msb & 0x30;
+            uint8_t index = msb & 0xf;
+            *chunk = (struct SwitchChunk){ .type = TOGGLE_OBJECT, .index = index, .test = test, .value = lsb };
+            return 2;
+        };
+
+        default:
+            fprintf(stderr, "%s:%d: UNREACHABLE: Unexpected chunk type 0x%02x\n", __FILE__, __LINE__, msb);
+            exit(1);
+    }
+}
+
+size_t encodeSwitchChunk(const struct SwitchChunk *chunk, uint8_t *bytes) {
+    _Static_assert(NUM_CHUNK_TYPES == 4, "Unexpected number of chunk types");
+    switch (chunk->type) {
+        case PREAMBLE:
+            bytes[0] = (chunk->y & 0x1f) | (chunk->one_time_use ? 0x20 : 0x00);
+            bytes[1] = (chunk->x & 0x1f) | (chunk->room_entry ? 0x00 : 0x80) | (chunk->side << 5);
+            return 2;
+
+        case TOGGLE_BLOCK:
+            bytes[0] = 0x80 | (chunk->y & 0x1f) | (chunk->dir == VERTICAL ? 0x20 : 0);
+            bytes[1] = (chunk->x & 0x1f) | ((chunk->size - 1) << 5);
+            bytes[2] = chunk->off;
+            bytes[3] = chunk->on;
+            return 4;
+
+        case TOGGLE_BIT: {
+            int mask_idx = switchBitmaskIndex(chunk->bitmask);
+            assert(mask_idx >= 0);
+            bytes[0] = 0x40 | ((chunk->on & 0x3) << 4) | ((chunk->off & 0x3) << 2) | (mask_idx & 0x3);
+            bytes[1] = chunk->index;
+            return 2;
+        };
+
+        case TOGGLE_OBJECT:
+            bytes[0] = 0xc0 | (chunk->test & 0x30) | (chunk->index & 0xf);
+            bytes[1] = chunk->value;
+            return 2;
+
+        default:
+            fprintf(stderr, "%s:%d: UNREACHABLE: Unexpected chunk type %d\n", __FILE__, __LINE__, chunk->type);
+            exit(1);
+    }
+}
+
+bool readRoom(Arena *arena, Room *room, Header *head, size_t idx, FILE *fp, RoomLoad load) {
     if (head == NULL) return false;
     if (idx >= C_ARRAY_LEN(head->definitions)) return false;
     if (fp == NULL) return false;
@@ -387,165 +551,59 @@ bool readRoom(Room *room, Header *head, size_t idx, FILE *fp) {
     Room tmp = {
         .index = idx,
         .address = seek,
+        // Compressed by the game, assume it is no worse than our greedy compression
+        .level = COMPRESS_NORMAL,
+        .loaded = load,
         .decompressed = {0},
         .compressed = {0},
     };
 
 /* #define log(...) printf(__VA_ARGS__) */
 #define log(...) do {} while (false)
-#define read_next(dst, fp) { \
-        int next_val = fgetc((fp)); \
-        if (next_val == EOF) { \
-            log("%s:%d: Unexpected end of file @ 0x%lx4x\n", \
-                    __FILE__, __LINE__, ftell(fp)); \
-            freeRoom(&tmp); \
-            return false; \
-        } \
-        size --; \
-        if (isprint(next_val)) log("%s:%d: READ 0x%02x (%hhd, '%c') @ 0x%lx, %zu left, decompressed %zu so far\n", __FILE__, __LINE__, next_val, next_val, next_val, ftell(fp), size, tmp.decompressed.length); \
-        else log("%s:%d: READ 0x%02x (%hhd) @ 0x%lx, %zu left, decompressed %zu so far\n", __FILE__, __LINE__, next_val, next_val, ftell(fp), size, tmp.decompressed.length); \
-        ARRAY_ADD(tmp.compressed, next_val); \
-        dst = next_val; \
-}
-
-// The source reads the first two words into 0x1d1d-0x1d20 (including marker and these tile markers)
-    uint8_t markers[4];
     log("%s:%d: Starting read at 0x%lx\n", __FILE__, __LINE__, ftell(fp));
-    read_next(markers[0], fp);
-    if (markers[0] != 0x8F) {
-        log("Expected room to start with 0x8F, found %02X\n", markers[0]);
-        freeRoom(&tmp);
+    ARENA_ARRAY_ENSURE(arena, tmp.compressed, (size_t)size);
+    tmp.compressed.length = fread(tmp.compressed.data, sizeof(uint8_t), size, fp);
+    if (tmp.compressed.length != (size_t)size) {
+        log("%s:%d: Unexpected end of file @ 0x%lx\n", __FILE__, __LINE__, ftell(fp));
         return false;
     }
-    for (size_t i = 1; i < C_ARRAY_LEN(markers); i ++) {
-        read_next(markers[i], fp);
-    }
 
-    while (size) {
-        uint8_t val;
-        read_next(val, fp);
-        if (val == markers[1]) {
-            // RLE
-            uint8_t next;
-            read_next(next, fp);
-            if (next < 0x80) {
-                // get last byte, store that byte (next + 2) times)
-                if (tmp.decompressed.length < 1) {
-                    log("%s:%d: Corrupt RLE state @ 0x%lx4x\n",
-                            __FILE__, __LINE__, ftell(fp));
-                    freeRoom(&tmp);
-                    return false;
-                }
-                uint8_t copy = tmp.decompressed.data[tmp.decompressed.length - 1];
-                log("%s:%d: Copying 0x%02x %d times\n",
-                        __FILE__, __LINE__, copy, next + 2);
-                for (int i = 0; i < next + 2; i ++) {
-                    ARRAY_ADD(tmp.decompressed, copy);
-                }
-            } else if (next != 0x80) {
-                // copy abs(next) bytes from dst - 0x20 to dst
-                if (tmp.decompressed.length < 0x20) {
-                    log("%s:%d: Corrupt RLE state @ 0x%lx4x\n",
-                            __FILE__, __LINE__, ftell(fp));
-                    freeRoom(&tmp);
-                    return false;
-                }
-                log("%s:%d: Copying from behind 0x%02x, %d times\n",
-                        __FILE__, __LINE__, 0x20, -(int8_t)next);
-                for (int i = 0; i < -(int8_t)next; i ++) {
-                    uint8_t copy = tmp.decompressed.data[tmp.decompressed.length - 0x20];
-                    ARRAY_ADD(tmp.decompressed, copy);
-                }
-            } else {
-                log("%s:%d: Output 0x%02x as is @ %lu\n", __FILE__, __LINE__, val, tmp.decompressed.length);
-                ARRAY_ADD(tmp.decompressed, val);
-            }
-        } else if (val == markers[2]) {
-            // LZ
-            uint8_t next;
-            read_next(next, fp);
-            if (next < 0x80) {
-                // Store start of room marker next + 2 times
-                log("%s:%d: Copying 0x%02x %d times\n",
-                        __FILE__, __LINE__, markers[0], next + 2);
-                for (int i = 0; i < next + 2; i ++) {
-                    ARRAY_ADD(tmp.decompressed, markers[0]);
-                }
-            } else if (next != 0x80) {
-                // copy abs(next) + 1 bytes from dst - read() to dst
-                uint8_t back;
-                read_next(back, fp);
-                if (tmp.decompressed.length < back) {
-                    log("%s:%d: Corrupt RLE state @ 0x%lx4x\n",
-                            __FILE__, __LINE__, ftell(fp));
-                    freeRoom(&tmp);
-                    return false;
-                }
-                log("%s:%d: Copying from behind 0x%02x, %d times\n",
-                        __FILE__, __LINE__, back, -(int8_t)next + 1);
-                for (int i = 0; i < -(int8_t)next + 1; i ++) {
-                    uint8_t copy = tmp.decompressed.data[tmp.decompressed.length - back];
-                    ARRAY_ADD(tmp.decompressed, copy);
-                }
-            } else {
-                log("%s:%d: Output 0x%02x as is @ %lu\n", __FILE__, __LINE__, val, tmp.decompressed.length);
-                ARRAY_ADD(tmp.decompressed, val);
-            }
-        } else if (val == markers[3]) {
-            // Larger backindex LZ's
-            uint8_t next;
-            read_next(next, fp);
-            if (next < 0x80) {
-                uint16_t back;
-                read_next(back, fp);
-                back |= 0x200;
-                if (tmp.decompressed.length < back) {
-                    log("%s:%d: Corrupt RLE state @ 0x%lx4x\n",
-                            __FILE__, __LINE__, ftell(fp));
-                    freeRoom(&tmp);
-                    return false;
-                }
-                log("%s:%d: Copying from behind 0x%02x, %d times\n",
-                        __FILE__, __LINE__, back, next + 2);
-                for (int i = 0; i < next + 2; i ++) {
-                    uint8_t copy = tmp.decompressed.data[tmp.decompressed.length - back];
-                    ARRAY_ADD(tmp.decompressed, copy);
-                }
-            } else if (next != 0x80) {
-                uint16_t back;
-                read_next(back, fp);
-                back |= 0x100;
-                if (tmp.decompressed.length < back) {
-                    log("%s:%d: Corrupt RLE state @ 0x%lx4x\n",
-                            __FILE__, __LINE__, ftell(fp));
-                    freeRoom(&tmp);
-                    return false;
-                }
-                log("%s:%d: Copying from behind 0x%02x, %d times\n",
-                        __FILE__, __LINE__, back, -(int8_t)next + 1);
-                for (int i = 0; i < -(int8_t)next + 1; i ++) {
-                    uint8_t copy = tmp.decompressed.data[tmp.decompressed.length - back];
-                    ARRAY_ADD(tmp.decompressed, copy);
-                }
-            } else {
-                log("%s:%d: Output 0x%02x as is @ %lu\n", __FILE__, __LINE__, val, tmp.decompressed.length);
-                ARRAY_ADD(tmp.decompressed, val);
-            }
-        } else {
-            // Just add it as is then get next
-            log("%s:%d: Output 0x%02x as is @ %lu\n", __FILE__, __LINE__, val, tmp.decompressed.length);
-            ARRAY_ADD(tmp.decompressed, val);
-        }
+    // Partial loads only decode as far as they parse, and parse straight from the stack
+    uint8_t decompressed[MAX_DECOMPRESSED_ROOM_SIZE];
+    size_t d_len = 0;
+    DecompressError err;
+    switch (load) {
+        case LOAD_HEADER:
+            err = decompressRoomPrefix(tmp.compressed.data, tmp.compressed.length, decompressed, offsetof(struct DecompresssedRoom, end_marker), &d_len);
+            break;
+        case LOAD_TILES:
+            // num_objects is at most 0xFF, each being an msb and lsb
+            err = decompressRoomPrefix(tmp.compressed.data, tmp.compressed.length, decompressed, offsetof(struct DecompresssedRoom, end_marker) + 2 * UINT8_MAX, &d_len);
+            break;
+        case LOAD_ALL:
+            err = decompressRoom(tmp.compressed.data, tmp.compressed.length, decompressed, sizeof(decompressed), &d_len);
+            break;
+        default:
+            fprintf(stderr, "%s:%d: UNREACHABLE: Unexpected load %d\n", __FILE__, __LINE__, load);
+            exit(1);
     }
+    if (err != DECOMPRESS_OK) {
+        log("%s:%d: Could not decompress room %zu: %s\n", __FILE__, __LINE__, idx, DECOMPRESS_ERROR(err));
+        return false;
+    }
+    if (load == LOAD_ALL) {
+        ARENA_ARRAY_ENSURE(arena, tmp.decompressed, d_len);
+        memcpy(tmp.decompressed.data, decompressed, d_len);
+        tmp.decompressed.length = d_len;
+    }
+    uint8_array stream = { .data = decompressed, .length = d_len };
     log("%s:%d: Finishing read at 0x%lx\n", __FILE__, __LINE__, ftell(fp));
-#undef read_next
 
     size_t data_idx = 0;
 #define read_next(dst, a) { \
         if (data_idx == (a).length) { \
             log("%s:%d: Not enough compressed data at %lu bytes long\n", \
                     __FILE__, __LINE__, (a).length); \
-            freeRoom(&tmp); \
             return false; \
         } \
         int next_val = (a).data[data_idx++]; \
@@ -555,151 +613,124 @@ bool readRoom(Room *room, Header *head, size_t idx, FILE *fp) {
 }
 
     for (size_t i = 0; i < C_ARRAY_LEN(tmp.data.tiles); i ++) {
-        read_next(tmp.data.tiles[i], tmp.decompressed);
+        read_next(tmp.data.tiles[i], stream);
     }
-    read_next(tmp.data.tile_offset, tmp.decompressed);
-    read_next(tmp.data.background, tmp.decompressed);
-    read_next(tmp.data.room_north, tmp.decompressed);
-    read_next(tmp.data.room_east, tmp.decompressed);
-    read_next(tmp.data.room_south, tmp.decompressed);
-    read_next(tmp.data.room_west, tmp.decompressed);
-
-    read_next(tmp.data.room_damage, tmp.decompressed);
-
-    read_next(tmp.data.gravity_vertical, tmp.decompressed);
-    read_next(tmp.data.gravity_horizontal, tmp.decompressed);
-
-    read_next(tmp.data.UNKNOWN_b, tmp.decompressed);
-    read_next(tmp.data.UNKNOWN_c, tmp.decompressed);
-    read_next(tmp.data.num_objects, tmp.decompressed);
-    read_next(tmp.data._num_switches, tmp.decompressed);
+    read_next(tmp.data.tile_offset, stream);
+    read_next(tmp.data.background, stream);
+    read_next(tmp.data.room_north, stream);
+    read_next(tmp.data.room_east, stream);
+    read_next(tmp.data.room_south, stream);
+    read_next(tmp.data.room_west, stream);
+
+    read_next(tmp.data.room_damage, stream);
+
+    read_next(tmp.data.gravity_vertical, stream);
+    read_next(tmp.data.gravity_horizontal, stream);
+
+    read_next(tmp.data.UNKNOWN_b, stream);
+    read_next(tmp.data.UNKNOWN_c, stream);
+    read_next(tmp.data.num_objects, stream);
+    read_next(tmp.data._num_switches, stream);
     tmp.data.num_switches = tmp.data._num_switches >> 2;
-    read_next(tmp.data.UNKNOWN_f, tmp.decompressed);
+    read_next(tmp.data.UNKNOWN_f, stream);
 
     log("%s:%d: Reading name at %04lu\n", __FILE__, __LINE__, data_idx);
     for (size_t i = 0; i < C_ARRAY_LEN(tmp.data.name); i ++) {
-        read_next(tmp.data.name[i], tmp.decompressed);
+        read_next(tmp.data.name[i], stream);
+    }
+
+    if (load == LOAD_HEADER) {
+        *room = tmp;
+        return true;
     }
 
     log("%s:%d: Reading %u moving objects at %04lu\n", __FILE__, __LINE__, tmp.data.UNKNOWN_d, data_idx);
-    tmp.data.objects = calloc(tmp.data.num_objects, sizeof(struct RoomObject));
-    assert(tmp.data.objects != NULL);
-    struct RoomObject *objects = tmp.data.objects;
+    // LOAD_TILES still walks the objects to cut blocks out of the tiles, but keeps none of them
+    struct RoomObject *objects = NULL;
+    struct RoomObject scratch = {0};
+    if (load == LOAD_ALL) {
+        tmp.data.objects = arenaAlloc(arena, tmp.data.num_objects * sizeof(struct RoomObject));
+        objects = tmp.data.objects;
+    }
     for (size_t i = 0; i < tmp.data.num_objects; i ++) {
+        struct RoomObject *object = objects ? objects + i : &scratch;
         uint8_t msb, lsb;
-        read_next(msb, tmp.decompressed);
-        read_next(lsb, tmp.decompressed);
+        read_next(msb, stream);
+        read_next(lsb, stream);
         if ((msb & 0x80) == 0) {
-            objects[i].type = BLOCK;
-            objects[i].x = lsb & 0x1f;
-            objects[i].y = msb & 0x1f;
-            objects[i].block.width = ((lsb & 0xe0) >> 5) + 1;
-            objects[i].block.height = ((msb & 0x60) >> 5) + 1;
-            assert(objects[i].x < WIDTH_TILES);
-            assert(objects[i].block.width < WIDTH_TILES);
-            assert(objects[i].x + objects[i].block.width <= WIDTH_TILES);
-            if (!(objects[i].y < HEIGHT_TILES)) {
+            object->type = BLOCK;
+            object->x = lsb & 0x1f;
+            object->y = msb & 0x1f;
+            object->block.width = ((lsb & 0xe0) >> 5) + 1;
+            object->block.height = ((msb & 0x60) >> 5) + 1;
+            assert(object->x < WIDTH_TILES);
+            assert(object->block.width < WIDTH_TILES);
+            assert(object->x + object->block.width <= WIDTH_TILES);
+            if (!(object->y < HEIGHT_TILES)) {
                 fprintf(stderr, "WARNING: Room %ld (%s) object %zu y is out of bounds (%u >= %u)\n",
-                        idx, tmp.data.name, i, objects[i].y, HEIGHT_TILES);
+                        idx, tmp.data.name, i, object->y, HEIGHT_TILES);
                 continue;
             }
-            assert(objects[i].y < HEIGHT_TILES);
-            assert(objects[i].block.height < HEIGHT_TILES);
-            if (!(objects[i].y + objects[i].block.height <= HEIGHT_TILES)) {
+            assert(object->y < HEIGHT_TILES);
+            assert(object->block.height < HEIGHT_TILES);
+            if (!(object->y + object->block.height <= HEIGHT_TILES)) {
                 fprintf(stderr, "WARNING: Room %ld (%s) object %zu y+height is out of bounds (%u >= %u)\n",
-                        idx, tmp.data.name, i, objects[i].y + objects[i].block.height, HEIGHT_TILES);
+                        idx, tmp.data.name, i, object->y + object->block.height, HEIGHT_TILES);
                 continue;
             }
-            objects[i].tiles = malloc(objects[i].block.width * objects[i].block.height);
-            assert(objects[i].tiles != NULL);
-            for (size_t y = objects[i].y; y < objects[i].y + objects[i].block.height; y ++) {
-                memcpy(
-                        objects[i].tiles + (y - objects[i].y) * objects[i].block.width,
-                        tmp.data.tiles + TILE_IDX(objects[i].x, y),
-                        objects[i].block.width
-                      );
+            for (size_t y = object->y; y < object->y + object->block.height; y ++) {
+                if (objects) {
+                    memcpy(
+                            object->tiles + (y - object->y) * object->block.width,
+                            tmp.data.tiles + TILE_IDX(object->x, y),
+                            object->block.width
+                          );
+                }
                 memset(
-                        tmp.data.tiles + TILE_IDX(objects[i].x, y),
+                        tmp.data.tiles + TILE_IDX(object->x, y),
                         '\0',
-                        objects[i].block.width
+                        object->block.width
                       );
 
             }
         } else {
-            objects[i].type = SPRITE;
-            objects[i].x = lsb & 0x1f;
-            objects[i].y = msb & 0x1f;
+            object->type = SPRITE;
+            object->x = lsb & 0x1f;
+            object->y = msb & 0x1f;
 
-            objects[i].sprite.type = (((lsb & 0xe0) >> 5) + 1) % NUM_SPRITE_TYPES;
-            objects[i].sprite.damage = ((msb & 0x60) >> 5) + 1;
+            object->sprite.type = (((lsb & 0xe0) >> 5) + 1) % NUM_SPRITE_TYPES;
+            object->sprite.damage = ((msb & 0x60) >> 5) + 1;
         }
     }
 
+    if (load == LOAD_TILES) {
+        *room = tmp;
+        return true;
+    }
+
     log("%s:%d: Reading %u switches at %04lu\n", __FILE__, __LINE__, tmp.data.UNKNOWN_d, data_idx);
-    tmp.data.switches = calloc(tmp.data.num_switches, sizeof(struct SwitchObject));
-    assert(tmp.data.switches != NULL);
+    tmp.data.switches = arenaAlloc(arena, tmp.data.num_switches * sizeof(struct SwitchObject));
     struct SwitchObject *switches = tmp.data.switches;
     for (size_t i = 0; i < tmp.data.num_switches; i ++) {
-        uint8_t msb, lsb;
-        read_next(msb, tmp.decompressed);
-        read_next(lsb, tmp.decompressed);
-        uint8_t y = msb & 0x1f;
-        uint8_t x = lsb & 0x1f;
-        _Static_assert(NUM_CHUNK_TYPES == 4, "Unexpected number of chunk types");
-        ARRAY_ADD(switches[i].chunks, ((struct SwitchChunk){ .type = PREAMBLE, .x = x, .y = y, .room_entry = (lsb & 0x80) == 0x00, .one_time_use = (msb & 0x20) != 0x00, .side = (lsb & 0x60) >> 5, .msb = msb, .lsb = lsb }));
-
-        while (data_idx < tmp.decompressed.length && (tmp.decompressed.data[data_idx] & 0xc0) != 0x00) {
-            read_next(msb, tmp.decompressed);
-            read_next(lsb, tmp.decompressed);
-            switch (msb & 0xc0) {
-                case 0x80: {
-                    x = lsb & 0x1f;
-                    y = msb & 0x1f;
-                    uint8_t size = ((lsb >> 5) & 0x7) + 1;
-                    uint8_t off, on;
-                    enum SwitchChunkDirection dir = ((msb & 0x20) == 0) ? HORIZONTAL : VERTICAL;
-                    read_next(off, tmp.decompressed);
-                    read_next(on, tmp.decompressed);
-                    // All bits accounted for
-                    ARRAY_ADD(switches[i].chunks, ((struct SwitchChunk){ .type = TOGGLE_BLOCK, .x = x, .y = y, .size = size, .dir = dir, .off = off, .on = on }));
-                }; break;
-
-                case 0x40: {
-                    // Only does this if switch_structs[unknown(f) + i / 3] has {0x2, 0x8, 0x20, 0x80}[i] set
-                    uint8_t on = (msb >> 4) & 0x3;
-                    uint8_t off = (msb >> 2) & 0x3;
-                    uint8_t bitmask = (uint8_t[]){0x01, 0x04, 0x10, 0x40}[msb & 0x3];
-                    // removes bit, sets bit << 1
-                    // Note that this static array index is based purely on byte, not on switch index
-                    uint8_t index = lsb;
-                    // This seems to be the index that is set, not the index that is checked
-                    ARRAY_ADD(switches[i].chunks, ((struct SwitchChunk){ .type = TOGGLE_BIT, .on = on, .off = off, .bitmask = bitmask, .index = index }));
-                }; break;
-
-                case 0xc0: {
-                    // Only does this if switch_structs[unknown(f) + i / 3] has {0x2, 0x8, 0x20, 0x80}[i] set
-                    // 0b00110000 is tested against *0x1d13
-                    // msb & 0xf is index into objects
-                    // if object is block, set movertab[2] = lsb
-                    // if sprite, set movertab[2] = lsb & 0xf8, maybe | 0x80 if movertab[2] & 0x2 != 0
-                    uint8_t test = msb & 0x30;
-                    uint8_t index = msb & 0xf;
-                    ARRAY_ADD(switches[i].chunks, ((struct SwitchChunk){ .type = TOGGLE_OBJECT, .index = index, .test = test, .value = lsb }));
-
-                }; break;
-
-                default:
-                    fprintf(stderr, "%s:%d: UNREACHABLE: Unexpected chunk type 0x%02x\n", __FILE__, __LINE__, msb);
-                    exit(1);
+        bool preamble = true;
+        do {
+            struct SwitchChunk chunk;
+            size_t n = decodeSwitchChunk(stream.data + data_idx, stream.length - data_idx, preamble, &chunk);
+            if (n == 0) {
+                log("%s:%d: Not enough compressed data at %lu bytes long\n", __FILE__, __LINE__, stream.length);
+                return false;
             }
-        }
+            data_idx += n;
+            ARENA_SMALL_ARRAY_ADD(arena, switches[i].chunks, chunk);
+            preamble = false;
+        } while (data_idx < stream.length && (stream.data[data_idx] & 0xc0) != 0x00);
     }
 
     // then stuff that controls enemy placement, switch actions, etc
-    while (data_idx != tmp.decompressed.length) {
+    while (data_idx != stream.length) {
         uint8_t val;
-        read_next(val, tmp.decompressed);
-        ARRAY_ADD(tmp.rest, val);
+        read_next(val, stream);
+        ARENA_ARRAY_ADD(arena, tmp.rest, val);
     }
 
     /* fprintf(stderr, "%s:%d: UNIMPLEMENTED\n", __FILE__, __LINE__); return false; */
@@ -717,65 +748,65 @@ bool readRoomFromFile(Room *room, FILE *fp, const char *filename) {
     size_t filesize = ftold;
     assert(fseek(fp, 0L, SEEK_SET) == 0);
 
-    uint8_t *data = malloc(filesize);
+    char *data = malloc(filesize);
     assert(data != NULL);
 
-    if (fread(data, sizeof(uint8_t), filesize, fp) != (size_t)filesize) {
+    if (fread(data, sizeof(char), filesize, fp) != (size_t)filesize) {
         free(data);
         fprintf(stderr, "Could read file fully: %s: %s", filename, strerror(errno));
         return false;
     }
 
-    size_t tile_idx = 0;
-    size_t data_idx = 0;
-    uint16_t fullbyte = 0;
-    while (tile_idx < sizeof(room->data.tiles)) {
-        if (data_idx >= (size_t)filesize) {
-            free(data);
-            fprintf(stderr, "Could read full tileset from file: %s: Read %ld tiles\n", filename, tile_idx);
-            return false;
-        }
+    size_t width, height;
+    char error[80];
+    bool parsed = parseTiles(data, filesize, filename, room->data.tiles, WIDTH_TILES, HEIGHT_TILES, &width, &height, error, sizeof(error));
+    free(data);
+    if (!parsed) {
+        fprintf(stderr, "%s\n", error);
+        return false;
+    }
+    if (height < HEIGHT_TILES) {
+        fprintf(stderr, "Could read full tileset from file: %s: Read %zu rows\n", filename, height);
+        return false;
+    }
+    return true;
+}
 
-        char c = data[data_idx++];
+bool parseTiles(const char *text, size_t length, const char *name, uint8_t *tiles, size_t max_width, size_t max_height, size_t *width, size_t *height, char *error, size_t error_size) {
+    memset(tiles, 0, max_width * max_height);
+    *width = 0;
+    *height = 0;
+    size_t row = 0;
+    size_t column = 0;
+    bool line_empty = true;
+    uint16_t fullbyte = 0;
+    for (size_t idx = 0; idx < length; idx ++) {
+        char c = text[idx];
         if (c == '\033') {
-            if (data_idx >= filesize) {
-                free(data);
-                fprintf(stderr, "Incomplete escape sequence at EOF: %s\n", filename);
-                return false;
-            }
-
-            if (data[data_idx] != '[') {
-                free(data);
-                fprintf(stderr, "Invalid escape sequence at %ld: %s\n", data_idx, filename);
+            if (idx + 1 >= length || text[idx + 1] != '[') {
+                snprintf(error, error_size, "Invalid escape sequence at %zu: %s", idx, name);
                 return false;
             }
-            while (data_idx < filesize && !isalpha(data[data_idx])) data_idx ++;
-            if (data_idx >= filesize) {
-                free(data);
-                fprintf(stderr, "Incomplete escape sequence at EOF: %s\n", filename);
+            idx += 2;
+            while (idx < length && !isalpha(text[idx])) idx ++;
+            if (idx >= length) {
+                snprintf(error, error_size, "Incomplete escape sequence at end: %s", name);
                 return false;
             }
-            data_idx++;
-        } else if (c == '\n') {
+        } else if (c == '\r' || c == '\n') {
+            if (c == '\r' && idx + 1 < length && text[idx + 1] == '\n') idx ++;
             if ((fullbyte & 0xFF00) != 0) {
-                free(data);
-                fprintf(stderr, "Unexpected newline at %ld: %s\n", data_idx - 1, filename);
+                snprintf(error, error_size, "Unexpected newline at %zu: %s", idx, name);
                 return false;
             }
-            if (tile_idx == 0 || (data_idx >= 2 && data[data_idx - 2] == '\n')) {
-                room->data.tiles[tile_idx++] = 0;
-            }
-            while (tile_idx < WIDTH_TILES * HEIGHT_TILES && (tile_idx % WIDTH_TILES) != 0) {
-                room->data.tiles[tile_idx++] = 0;
-            }
-            assert(tile_idx % WIDTH_TILES == 0);
+            row ++;
+            column = 0;
+            line_empty = true;
         } else {
             if (c != ' ' && !isxdigit(c)) {
-                free(data);
-                fprintf(stderr, "Invalid hex digit at %ld: %s\n", data_idx - 1, filename);
+                snprintf(error, error_size, "Invalid hex digit at %zu: %s", idx, name);
                 return false;
             }
-
             uint8_t b = 0;
             if (c == ' ') b = 0;
             else if (isdigit(c)) b = c - '0';
@@ -783,22 +814,34 @@ bool readRoomFromFile(Room *room, FILE *fp, const char *filename) {
 
             if ((fullbyte & 0xFF00) == 0) {
                 fullbyte = 0xFF00 | (b << 4);
-            } else {
-                fullbyte = (fullbyte & 0xF0) | b;
-                room->data.tiles[tile_idx++] = fullbyte;
+                continue;
+            }
+            if (row >= max_height || column >= max_width) {
+                snprintf(error, error_size, "More than %zux%zu tiles at %zu: %s", max_width, max_height, idx, name);
+                return false;
             }
+            tiles[row * max_width + column ++] = (fullbyte & 0xF0) | b;
+            fullbyte = 0;
+            line_empty = false;
+            if (column > *width) *width = column;
         }
     }
-
-    if (data_idx < filesize) {
-        fprintf(stderr, "WARNING: Still more file to read at %ld: %s\n", data_idx, filename);
+    if ((fullbyte & 0xFF00) != 0) {
+        snprintf(error, error_size, "Half a tile at end: %s", name);
+        return false;
     }
-
-    free(data);
+    // A last newline does not start another row
+    *height = line_empty ? row : row + 1;
     return true;
 }
 
 bool readFile(RoomFile *file, FILE *fp) {
+    return readFilePartial(file, fp, LOAD_ALL);
+}
+
+// Read only queries such as listing rooms or finding tiles can stop short of
+// objects and switches, see RoomLoad
+bool readFilePartial(RoomFile *file, FILE *fp, RoomLoad load) {
     if (file == NULL) return false;
     if (fp == NULL) return false;
     if (fseek(fp, 0L, SEEK_SET) < 0) {
@@ -821,8 +864,15 @@ bool readFile(RoomFile *file, FILE *fp) {
         return false;
     }
 
+    // Reading again (such as the editor reloading) reuses the arena's blocks
+    for (size_t idx = 0; idx < C_ARRAY_LEN(file->versions); idx ++) {
+        roomChanged(file, idx);
+    }
+    arenaReset(&file->arena);
+    memset(file->rooms, 0, sizeof(file->rooms));
     for (size_t idx = 0; idx < C_ARRAY_LEN(head.definitions); idx ++) {
-        if (!readRoom(&file->rooms[idx], &head, idx, fp)) {
+        file->rooms[idx].loaded = load;
+        if (!readRoom(&file->arena, &file->rooms[idx], &head, idx, fp, load)) {
             file->rooms[idx].valid = false;
             /* fprintf(stderr, "Could not read room %lu\n", idx); */
             continue;
@@ -831,33 +881,33 @@ bool readFile(RoomFile *file, FILE *fp) {
         /* dumpRoom(&file->rooms[idx]); */
     }
 
-    uint16_t index = 0;
-    uint8_t mask = 0;
-    uint8_t bitmasks[] = {0x01, 0x04, 0x10, 0x40};
+    if (load != LOAD_ALL) return true;
 
+    // Every switch owns one bit of the switch flags, 4 to an index, in room
+    // then switch order, so find each bit's owner once and link in one pass
+    struct { uint8_t room_idx; uint8_t switch_idx; } owners[0x100 * C_ARRAY_LEN(switch_bitmasks)] = {0};
+    size_t bit = 0;
+    for (size_t idx = 0; idx < C_ARRAY_LEN(head.definitions); idx ++) {
+        Room *r = file->rooms + idx;
+        if (!r->valid) continue;
+        for (size_t sw = 0; sw < r->data.num_switches && bit < C_ARRAY_LEN(owners); sw ++, bit ++) {
+            owners[bit].room_idx = idx;
+            owners[bit].switch_idx = sw;
+        }
+    }
     for (size_t idx = 0; idx < C_ARRAY_LEN(head.definitions); idx ++) {
         Room *r = file->rooms + idx;
         if (!r->valid) continue;
         for (size_t sw = 0; sw < r->data.num_switches; sw ++) {
-            for (size_t _idx = 0; _idx < C_ARRAY_LEN(head.definitions); _idx ++) {
-                Room *_r = file->rooms + _idx;
-                if (!_r->valid) continue;
-                for (size_t _sw = 0; _sw < _r->data.num_switches; _sw ++) {
-                    struct SwitchObject *switcch = _r->data.switches + _sw;
-                    for (size_t c = 1; c < switcch->chunks.length; c ++) {
-                        struct SwitchChunk *chunk = switcch->chunks.data + c;
-                        if (chunk->type != TOGGLE_BIT) continue;
-                        if (chunk->index == index && chunk->bitmask == bitmasks[mask]) {
-                            chunk->room_idx = idx;
-                            chunk->switch_idx = sw;
-                        }
-                    }
-                }
-            }
-            mask ++;
-            if (mask == C_ARRAY_LEN(bitmasks)) {
-                mask = 0;
-                index ++;
+            struct SwitchObject *switcch = r->data.switches + sw;
+            for (size_t c = 1; c < switcch->chunks.length; c ++) {
+                struct SwitchChunk *chunk = SMALL_ARRAY_DATA(switcch->chunks) + c;
+                if (chunk->type != TOGGLE_BIT) continue;
+                struct SwitchToggleBit *toggle = chunkToggleBit(chunk);
+                int mask = switchBitmaskIndex(toggle->bitmask);
+                if (mask < 0) continue;
+                toggle->room_idx = owners[toggle->index * C_ARRAY_LEN(switch_bitmasks) + mask].room_idx;
+                toggle->switch_idx = owners[toggle->index * C_ARRAY_LEN(switch_bitmasks) + mask].switch_idx;
             }
         }
     }
@@ -865,28 +915,132 @@ bool readFile(RoomFile *file, FILE *fp) {
     return true;
 }
 
-#define MAX_ROOM_FILE_SIZE 0x3000
-// there is also a MAX_ROOM_SIZE, unknown yet, add a few switches to midnight and it will corrupt
+// Optimal parse used for COMPRESS_BEST. Works backwards from the end so that
+// cost[i] is the fewest bytes that can encode decompressed[i..d_len), trying
+// every option writeRoom knows about (see the list in compressRoom).
+// compressed[0..3] must already hold the markers, returns the new c_len.
+static size_t compressBest(const uint8_t *decompressed, size_t d_len, uint8_t *compressed, size_t c_len) {
+    enum { LITERAL, RLE, STRIDE, MARKER_RUN, LZ };
+    uint16_t cost[960 + 1];
+    uint8_t op[960];
+    uint8_t len[960];
+    uint16_t back[960];
+    assert(d_len < C_ARRAY_LEN(op));
+
+#define TRY(_op, _len, _back, _cost) do { \
+    if ((_cost) + cost[i + (_len)] < cost[i]) { \
+        cost[i] = (_cost) + cost[i + (_len)]; \
+        op[i] = (_op); \
+        len[i] = (_len); \
+        back[i] = (_back); \
+    } \
+} while (false)
+    cost[d_len] = 0;
+    for (size_t i = d_len; i -- > 0;) {
+        uint8_t byte = decompressed[i];
+        size_t left = d_len - i;
+        size_t length;
+
+        // 1,4,7,10- Output as is, or escaped if one of the markers
+        bool escaped = byte == compressed[1] || byte == compressed[2] || byte == compressed[3];
+        cost[i] = cost[i + 1] + (escaped ? 2 : 1);
+        op[i] = LITERAL;
+        len[i] = 1;
+
+        // 2- RLE, last decompressed byte 2..0x81 times
+        if (i >= 1) {
+            for (length = 0; length < left && length < 0x81 && decompressed[i + length] == decompressed[i - 1]; length ++);
+            for (size_t l = 2; l <= length; l ++) TRY(RLE, l, 0, 2);
+        }
 
-bool writeRoom(Room *room, FILE *fp) {
-    if (fp == NULL || room == NULL || !room->valid) return false;
+        // 3- Fixed size block, 1..0x7f bytes from 0x20 behind
+        if (i >= 0x20) {
+            for (length = 0; length < left && length < 0x7f && decompressed[i + length] == decompressed[i + length - 0x20]; length ++);
+            for (size_t l = 1; l <= length; l ++) TRY(STRIDE, l, 0, 2);
+        }
 
-    if (room->compressed.length > 0) {
-#if 0
-        /* printf("Writing already compressed room %d \"%s\" at %ld.\n", room->index, room->data.name, ftell(fp)); */
-        size_t written = 0;
-        do {
-            size_t write_ret = fwrite(room->compressed.data + written, sizeof(uint8_t), room->compressed.length - written, fp);
-            if (write_ret == 0) return false;
-            written += write_ret;
-        } while (written < room->compressed.length);
-        return true;
-#else
-        room->compressed.length = 0; // reset it
-#endif
+        // 5- Room marker 2..0x81 times
+        for (length = 0; length < left && length < 0x81 && decompressed[i + length] == compressed[0]; length ++);
+        for (size_t l = 2; l <= length; l ++) TRY(MARKER_RUN, l, 0, 2);
+
+        // 6,8,9- LZ, all cost the same so only the longest match matters.
+        // Any shorter length can use the same backindex.
+        size_t best = 0;
+        size_t best_back = 0;
+        size_t longest = left < 0x80 ? left : 0x80;
+        for (size_t b = 1; b <= i && b < 0x300 && best < longest; b ++) {
+            size_t max = b < 0x200 ? 0x80 : 0x81;
+            if (best > 0 && (best >= max || best >= left || decompressed[i + best] != decompressed[i + best - b])) continue;
+            for (length = 0; length < left && length < max && decompressed[i + length] == decompressed[i + length - b]; length ++);
+            if (length > best) {
+                best = length;
+                best_back = b;
+            }
+        }
+        for (size_t l = 2; l <= best; l ++) TRY(LZ, l, best_back, 3);
     }
+#undef TRY
+
+    for (size_t i = 0; i < d_len; i += len[i]) {
+        switch (op[i]) {
+            case LITERAL:
+                if (decompressed[i] == compressed[1] || decompressed[i] == compressed[2] || decompressed[i] == compressed[3]) {
+                    compressed[c_len++] = decompressed[i];
+                    compressed[c_len++] = 0x80;
+                } else {
+                    compressed[c_len++] = decompressed[i];
+                }
+                break;
+
+            case RLE:
+                compressed[c_len++] = compressed[1];
+                compressed[c_len++] = len[i] - 2;
+                break;
+
+            case STRIDE:
+                compressed[c_len++] = compressed[1];
+                compressed[c_len++] = -(int8_t)len[i];
+                break;
+
+            case MARKER_RUN:
+                compressed[c_len++] = compressed[2];
+                compressed[c_len++] = len[i] - 2;
+                break;
+
+            case LZ:
+                if (back[i] < 0x100) {
+                    compressed[c_len++] = compressed[2];
+                    compressed[c_len++] = -(int8_t)(len[i] - 1);
+                } else if (back[i] < 0x200) {
+                    compressed[c_len++] = compressed[3];
+                    compressed[c_len++] = -(int8_t)(len[i] - 1);
+                } else {
+                    compressed[c_len++] = compressed[3];
+                    compressed[c_len++] = len[i] - 2;
+                }
+                compressed[c_len++] = (uint8_t)(back[i] & 0xFF);
+                break;
+
+            default:
+                fprintf(stderr, "%s:%d: UNREACHABLE: Unexpected op %d\n", __FILE__, __LINE__, op[i]);
+                exit(1);
+        }
+        assert(c_len < 960);
+    }
+
+    return c_len;
+}
+
+// Compresses the room into room->compressed, which is kept as a cache until
+// the room is edited (callers set room->compressed.length = 0 to invalidate it)
+bool compressRoom(Arena *arena, Room *room, CompressLevel level) {
+    if (room == NULL || !room->valid) return false;
+    assert(level < COMPRESS_FIT && "COMPRESS_FIT is for compressRooms");
+    assert(room->loaded == LOAD_ALL && "Partially loaded rooms are read only");
 
-    printf("Compressing and writing Room %d \"%s\" at %ld.\n", room->index, room->data.name, ftell(fp));
+    room->compressed.length = 0; // reset it
+    room->level = level;
+    fprintf(stderr, "Compressing Room %d \"%s\" (%s).\n", room->index, room->data.name, COMPRESS_LEVEL(level));
 
 /* #define log(...) printf(__VA_ARGS__) */
 #define log(...) do {} while (false)
@@ -899,7 +1053,6 @@ bool writeRoom(Room *room, FILE *fp) {
     // Copy the object tile data back
     for (size_t i = 0; i < room->data.num_objects; i ++) {
         if (room->data.objects[i].type == SPRITE) continue; // No tile data
-        if (room->data.objects[i].tiles == NULL) continue;
         /* if(room->data.objects[i].y < HEIGHT_TILES && room->data.objects[i].y + room->data.objects[i].block.height >= HEIGHT_TILES) continue; */
         assert(room->data.objects[i].y + room->data.objects[i].block.height <= HEIGHT_TILES);
         for (size_t y = room->data.objects[i].y; y < room->data.objects[i].y + room->data.objects[i].block.height; y ++) {
@@ -956,47 +1109,11 @@ bool writeRoom(Room *room, FILE *fp) {
     }
     for (size_t i = 0; i < room->data.num_switches; i ++) {
         struct SwitchObject *sw = room->data.switches + i;
-        assert(sw->chunks.length > 0 && sw->chunks.data[0].type == PREAMBLE);
+        assert(sw->chunks.length > 0 && SMALL_ARRAY_DATA(sw->chunks)[0].type == PREAMBLE);
         for (size_t c = 0; c < sw->chunks.length; c ++) {
-            struct SwitchChunk *chunk = sw->chunks.data + c;
-            _Static_assert(NUM_CHUNK_TYPES == 4, "Unexpected number of chunk types");
-            switch (chunk->type) {
-                case PREAMBLE:
-                    assert(c == 0);
-                    decompressed[d_len++] = (chunk->y & 0x1f) | (chunk->one_time_use ? 0x20 : 0x00);
-                    decompressed[d_len++] = (chunk->x & 0x1f) | (chunk->room_entry ? 0x00 : 0x80) | (chunk->side << 5);
-                    break;
-
-                case TOGGLE_BLOCK:
-                    decompressed[d_len++] = 0x80 | (chunk->y & 0x1f) | (chunk->dir == VERTICAL ? 0x20 : 0);
-                    decompressed[d_len++] = (chunk->x & 0x1f) | ((chunk->size - 1) << 5);
-                    decompressed[d_len++] = chunk->off;
-                    decompressed[d_len++] = chunk->on;
-                    break;
-
-                case TOGGLE_BIT: {
-                    uint8_t mask_idx = 4;
-                    switch(chunk->bitmask) {
-                        case 0x01: mask_idx = 0; break;
-                        case 0x04: mask_idx = 1; break;
-                        case 0x10: mask_idx = 2; break;
-                        case 0x40: mask_idx = 3; break;
-                    }
-                    assert(mask_idx < 4);
-                    decompressed[d_len++] = 0x40 | ((chunk->on & 0x3) << 4) | ((chunk->off & 0x3) << 2) | (mask_idx & 0x3);
-                    decompressed[d_len++] = chunk->index;
-                }; break;
-
-                case TOGGLE_OBJECT:
-                    decompressed[d_len++] = 0xc0 | (chunk->test & 0x30) | (chunk->index & 0xf);
-                    decompressed[d_len++] = chunk->value;
-                    break;
-
-                default:
-                    fprintf(stderr, "%s:%d: UNREACHABLE: Unexpected chunk type %d\n", __FILE__, __LINE__, chunk->type);
-                    exit(1);
-                    break;
-            }
+            struct SwitchChunk *chunk = SMALL_ARRAY_DATA(sw->chunks) + c;
+            assert(c == 0 || chunk->type != PREAMBLE);
+            d_len += encodeSwitchChunk(chunk, decompressed + d_len);
         }
     }
     // then stuff that controls enemy placement, switch actions, etc
@@ -1074,6 +1191,10 @@ bool writeRoom(Room *room, FILE *fp) {
     // 8- LZ Far output, send marker[3] and length < 0x80 and backindex. Copy 0x200 | backindex bytes length + 2 times
     // 9- LZ Mid output, send marker[3] and (int8_t)length < 0 != 0x80 and backindex. Copy 0x100 | backindex bytes -(int8_t)length + 1 times
     // 10- Output marker[3], send marker[3] and 0x80
+    if (level == COMPRESS_BEST) {
+        c_len = compressBest(decompressed, d_len, compressed, c_len);
+        d_idx = d_len;
+    }
     while (d_idx < d_len) {
         uint8_t byte = decompressed[d_idx++];
         uint8_t length = 1;
@@ -1081,7 +1202,8 @@ bool writeRoom(Room *room, FILE *fp) {
                 __FILE__, __LINE__, byte, d_idx - 1, c_len);
         uint8_t best = 0;
         uint16_t best_back = 0;
-        for (size_t back = 1; back < d_idx - 1 && back < 0x300; back ++) {
+        // COMPRESS_FAST only uses RLE and fixed size blocks
+        for (size_t back = 1; level != COMPRESS_FAST && back < d_idx - 1 && back < 0x300; back ++) {
             if (decompressed[d_idx - back - 1] == byte) {
                 length = 1;
                 while (d_idx + length - 1 < d_len && length - 1 < 0x7e) {
@@ -1218,14 +1340,78 @@ bool writeRoom(Room *room, FILE *fp) {
     /* } */
     /* printf("]\n"); */
 
+    ARENA_ARRAY_ENSURE(arena, room->compressed, c_len);
+    memcpy(room->compressed.data, compressed, c_len);
+    room->compressed.length = c_len;
+
+#undef log
+    return true;
+}
+
+size_t compressedRoomSize(Arena *arena, Room *room) {
+    if (room == NULL || !room->valid) return 0;
+    if (room->compressed.length == 0 && !compressRoom(arena, room, COMPRESS_NORMAL)) return 0;
+    return room->compressed.length;
+}
+
+static double elapsed(struct timespec start) {
+    struct timespec now;
+    if (clock_gettime(CLOCK_MONOTONIC, &now) == -1) return 0;
+    return (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+// Compresses all rooms without a cached compressed form. For COMPRESS_FIT
+// they start at COMPRESS_FAST, then the largest rooms are recompressed one
+// level higher until the file fits in limit, or seconds have passed.
+// Returns whether the file fits.
+bool compressRooms(RoomFile *file, CompressLevel level, size_t limit, double seconds) {
+    struct timespec start;
+    if (clock_gettime(CLOCK_MONOTONIC, &start) == -1) return false;
+
+    for (size_t i = 0; i < C_ARRAY_LEN(file->rooms); i ++) {
+        Room *room = &file->rooms[i];
+        if (!room->valid || room->compressed.length > 0) continue;
+        if (!compressRoom(&file->arena, room, level == COMPRESS_FIT ? COMPRESS_FAST : level)) return false;
+    }
+
+    size_t size = compressedFileSize(file);
+    while (level == COMPRESS_FIT && size > limit && elapsed(start) < seconds) {
+        Room *largest = NULL;
+        for (size_t i = 0; i < C_ARRAY_LEN(file->rooms); i ++) {
+            Room *room = &file->rooms[i];
+            if (!room->valid || room->level >= COMPRESS_BEST) continue;
+            if (largest == NULL || room->compressed.length > largest->compressed.length) largest = room;
+        }
+        if (largest == NULL) break;
+        size -= largest->compressed.length;
+        if (!compressRoom(&file->arena, largest, largest->level + 1)) return false;
+        size += largest->compressed.length;
+    }
+
+    return size <= limit;
+}
+
+size_t compressedFileSize(RoomFile *file) {
+    size_t size = sizeof(Header);
+    for (size_t i = 0; i < C_ARRAY_LEN(file->rooms); i ++) {
+        size += compressedRoomSize(&file->arena, &file->rooms[i]);
+    }
+    return size;
+}
+
+bool writeRoom(Arena *arena, Room *room, FILE *fp) {
+    if (fp == NULL || room == NULL || !room->valid) return false;
+
+    if (room->compressed.length == 0 && !compressRoom(arena, room, COMPRESS_NORMAL)) return false;
+
+    /* printf("Writing compressed room %d \"%s\" at %ld.\n", room->index, room->data.name, ftell(fp)); */
     size_t written = 0;
     do {
-        size_t write_ret = fwrite(compressed + written, sizeof(uint8_t), c_len - written, fp);
+        size_t write_ret = fwrite(room->compressed.data + written, sizeof(uint8_t), room->compressed.length - written, fp);
         if (write_ret == 0) return false;
         written += write_ret;
-    } while (written < c_len);
+    } while (written < room->compressed.length);
 
-#undef log
     return true;
 }
 
@@ -1243,7 +1429,7 @@ bool writeFile(RoomFile *file, FILE *fp) {
 
     for (size_t i = 0; i < C_ARRAY_LEN(file->rooms); i ++) {
         head.definitions[i] = htons(offset);
-        if (!writeRoom(&file->rooms[i], fp)) {
+        if (!writeRoom(&file->arena, &file->rooms[i], fp)) {
             /* fprintf(stderr, "%s:%d: Not writing room %ld\n", __FILE__, __LINE__, i); */
             continue;
         }
@@ -1264,6 +1450,106 @@ bool writeFile(RoomFile *file, FILE *fp) {
     return true;
 }
 
+// Copies everything src points to into data, which has to have room for the
+// size returned when data is NULL. Spilled chunks go back inline if they fit.
+static size_t copyRoom(Room *dst, const Room *src, uint8_t *data) {
+    size_t used = 0;
+    Room scratch;
+    if (data == NULL) dst = &scratch;
+#define copy_out(dst_ptr, src_ptr, size) do { \
+        size_t _size = (size); \
+        if ((src_ptr) != NULL && data != NULL) { \
+            memcpy(data + used, (src_ptr), _size); \
+            (dst_ptr) = (void *)(data + used); \
+        } \
+        used += ARENA_ALIGNED(_size); \
+    } while (false)
+
+    if (data != NULL) *dst = *src;
+    copy_out(dst->data.objects, src->data.objects, src->data.num_objects * sizeof(struct RoomObject));
+    copy_out(dst->data.switches, src->data.switches, src->data.num_switches * sizeof(struct SwitchObject));
+    for (size_t i = 0; src->data.switches != NULL && i < src->data.num_switches; i ++) {
+        const struct SwitchObject *sw = src->data.switches + i;
+        if (sw->chunks.heap == NULL) continue;
+        if (sw->chunks.length <= C_ARRAY_LEN(sw->chunks.small)) {
+            if (data == NULL) continue;
+            struct SwitchObject *dst_sw = dst->data.switches + i;
+            memcpy(dst_sw->chunks.small, sw->chunks.heap, sw->chunks.length * sizeof(struct SwitchChunk));
+            dst_sw->chunks.heap = NULL;
+            dst_sw->chunks.capacity = 0;
+            continue;
+        }
+        struct SwitchChunk *heap = NULL;
+        copy_out(heap, sw->chunks.heap, sw->chunks.length * sizeof(struct SwitchChunk));
+        if (data != NULL) {
+            dst->data.switches[i].chunks.heap = heap;
+            dst->data.switches[i].chunks.capacity = sw->chunks.length;
+        }
+    }
+    uint8_array *dst_arrays[] = { &dst->rest, &dst->compressed, &dst->decompressed };
+    const uint8_array *src_arrays[] = { &src->rest, &src->compressed, &src->decompressed };
+    for (size_t i = 0; i < C_ARRAY_LEN(src_arrays); i ++) {
+        if (src_arrays[i]->length == 0) {
+            if (data != NULL) *dst_arrays[i] = (uint8_array){0};
+            continue;
+        }
+        copy_out(dst_arrays[i]->data, src_arrays[i]->data, src_arrays[i]->length);
+        if (data != NULL) dst_arrays[i]->capacity = src_arrays[i]->length;
+    }
+#undef copy_out
+    return used;
+}
+
+static void releaseVersion(RoomVersion *version) {
+    if (version == NULL) return;
+    assert(version->refs > 0);
+    if (-- version->refs == 0) free(version);
+}
+
+void roomChanged(RoomFile *file, size_t idx) {
+    assert(idx < C_ARRAY_LEN(file->versions));
+    releaseVersion(file->versions[idx]);
+    file->versions[idx] = NULL;
+}
+
+void takeSnapshot(RoomFile *file, RoomSnapshot *snapshot) {
+    for (size_t idx = 0; idx < C_ARRAY_LEN(file->rooms); idx ++) {
+        RoomVersion *version = file->versions[idx];
+        if (version == NULL) {
+            size_t size = copyRoom(NULL, &file->rooms[idx], NULL);
+            version = malloc(sizeof(RoomVersion) + size);
+            assert(version != NULL);
+            version->refs = 1; // file->versions
+            copyRoom(&version->room, &file->rooms[idx], version->data);
+            file->versions[idx] = version;
+        }
+        version->refs ++;
+        snapshot->rooms[idx] = version;
+    }
+}
+
+void releaseSnapshot(RoomSnapshot *snapshot) {
+    for (size_t idx = 0; idx < C_ARRAY_LEN(snapshot->rooms); idx ++) {
+        releaseVersion(snapshot->rooms[idx]);
+        snapshot->rooms[idx] = NULL;
+    }
+}
+
+// Rooms that are still the same version as the snapshot are left alone, the
+// others are copied into the file's arena, which only gives the old space back
+// on the next read.
+void restoreSnapshot(RoomFile *file, RoomSnapshot *snapshot) {
+    for (size_t idx = 0; idx < C_ARRAY_LEN(file->rooms); idx ++) {
+        RoomVersion *version = snapshot->rooms[idx];
+        if (version == NULL || file->versions[idx] == version) continue;
+        uint8_t *data = arenaAlloc(&file->arena, copyRoom(NULL, &version->room, NULL));
+        copyRoom(&file->rooms[idx], &version->room, data);
+        roomChanged(file, idx);
+        version->refs ++;
+        file->versions[idx] = version;
+    }
+}
+
 bool readRooms(RoomFile *file) {
     FILE *fp = fopen(ROOMS_FILE, "rb");
     if (fp == NULL) {
@@ -1275,47 +1561,103 @@ bool readRooms(RoomFile *file) {
     return ret;
 }
 
-bool writeRooms(RoomFile *file) {
+// See GRAPHICS_FILE for the layout. A shorter file gives fewer tiles, any
+// part of a tile at the end is dropped.
+bool readTileGraphics(TileGraphics *graphics, FILE *fp) {
+    if (graphics == NULL) return false;
+    if (fp == NULL) return false;
+    long length = filesize(fp);
+    if (length < 0) {
+        perror("Could not get filesize");
+        return false;
+    }
+    size_t tile_size = 4 * TILE_PIXELS;
+    size_t num_tiles = (size_t)length / tile_size;
+    if (num_tiles == 0 || num_tiles > MAX_GRAPHICS_TILES) {
+        fprintf(stderr, "Unexpected graphics filesize %ld, expected up to 0x%zx\n", length, MAX_GRAPHICS_TILES * tile_size);
+        return false;
+    }
+    graphics->num_tiles = 0;
+    for (size_t t = 0; t < num_tiles; t ++) {
+        uint8_t planes[4][TILE_PIXELS];
+        if (fread(planes, sizeof(planes), 1, fp) != 1) {
+            perror("Could not read tile");
+            return false;
+        }
+        for (size_t y = 0; y < TILE_PIXELS; y ++) {
+            for (size_t x = 0; x < TILE_PIXELS; x ++) {
+                uint8_t colour = 0;
+                for (size_t p = 0; p < 4; p ++) {
+                    if (planes[p][y] & (0x80 >> x)) colour |= 1 << p;
+                }
+                graphics->pixels[t][y][x] = colour;
+            }
+        }
+    }
+    graphics->num_tiles = num_tiles;
+    return true;
+}
+
+bool readGraphics(TileGraphics *graphics) {
+    FILE *fp = fopen(GRAPHICS_FILE, "rb");
+    if (fp == NULL) {
+        fprintf(stderr, "Could not open %s for reading.\n", GRAPHICS_FILE);
+        return false;
+    }
+    bool ret = readTileGraphics(graphics, fp);
+    fclose(fp);
+    return ret;
+}
+
+// Rooms whose TOGGLE_BIT chunks change are left to be compressed again, so
+// call before compressRooms. Fails if a chunk points at a switch that is gone.
+bool relinkSwitchBits(RoomFile *file) {
+    // First switch flag bit of each room, see the linking in readFilePartial
+    size_t first_bit[C_ARRAY_LEN(file->rooms)] = {0};
+    size_t bit = 0;
+    for (size_t idx = 0; idx < C_ARRAY_LEN(file->rooms); idx ++) {
+        first_bit[idx] = bit;
+        if (file->rooms[idx].valid) bit += file->rooms[idx].data.num_switches;
+    }
     for (size_t idx = 0; idx < C_ARRAY_LEN(file->rooms); idx ++) {
         Room *r = file->rooms + idx;
         if (!r->valid) continue;
         for (size_t sw = 0; sw < r->data.num_switches; sw ++) {
             struct SwitchObject *switcch = r->data.switches + sw;
             for (size_t c = 1; c < switcch->chunks.length; c ++) {
-                struct SwitchChunk *chunk = switcch->chunks.data + c;
+                struct SwitchChunk *chunk = SMALL_ARRAY_DATA(switcch->chunks) + c;
                 if (chunk->type != TOGGLE_BIT) continue;
-                uint16_t index = 0;
-                uint8_t mask = 0;
-                uint8_t bitmasks[] = {0x01, 0x04, 0x10, 0x40};
-
-                for (size_t _idx = 0; _idx < C_ARRAY_LEN(file->rooms); _idx ++) {
-                    Room *_r = file->rooms + _idx;
-                    if (!_r->valid) continue;
-                    for (size_t _sw = 0; _sw < _r->data.num_switches; _sw ++) {
-                        if (chunk->room_idx == _idx && chunk->switch_idx == _sw) {
-                            chunk->index = index;
-                            chunk->bitmask = bitmasks[mask];
-                            goto next;
-                        }
-                        mask ++;
-                        if (mask == C_ARRAY_LEN(bitmasks)) {
-                            mask = 0;
-                            index ++;
-                        }
-                    }
+                struct SwitchToggleBit *toggle = chunkToggleBit(chunk);
+                uint8_t index = 0;
+                uint8_t bitmask = switch_bitmasks[0];
+                if (toggle->room_idx < C_ARRAY_LEN(file->rooms) && file->rooms[toggle->room_idx].valid &&
+                        toggle->switch_idx < file->rooms[toggle->room_idx].data.num_switches) {
+                    size_t target = first_bit[toggle->room_idx] + toggle->switch_idx;
+                    index = target / C_ARRAY_LEN(switch_bitmasks);
+                    bitmask = switch_bitmasks[target % C_ARRAY_LEN(switch_bitmasks)];
+                } else if (toggle->room_idx != 0 || toggle->switch_idx != 0) {
+                    fprintf(stderr, "Could not find switch for room %lu switch %lu chunk %lu pointing to room %u switch %u\n", idx, sw, c, toggle->room_idx, toggle->switch_idx);
+                    return false;
                 }
-                if (chunk->room_idx == 0 && chunk->switch_idx == 0) {
-                    chunk->index = 0;
-                    chunk->bitmask = 0x1;
-                    goto next;
+                if (toggle->index != index || toggle->bitmask != bitmask) {
+                    r->compressed.length = 0;
+                    roomChanged(file, idx);
                 }
-                fprintf(stderr, "Could not find switch for room %lu switch %lu chunk %lu pointing to room %u switch %u\n", idx, sw, c, chunk->room_idx, chunk->switch_idx);
-                return false;
-next:
-                {}
+                toggle->index = index;
+                toggle->bitmask = bitmask;
             }
         }
     }
+    return true;
+}
+
+// Rooms not compressed yet are compressed at level, as compressRooms would
+bool writeRooms(RoomFile *file, CompressLevel level) {
+    if (!compressRooms(file, level, MAX_ROOM_FILE_SIZE, 0)) {
+        size_t size = compressedFileSize(file);
+        fprintf(stderr, "Not writing %s, 0x%04zx bytes is over the 0x%04x limit.\n", ROOMS_FILE, size, MAX_ROOM_FILE_SIZE);
+        return false;
+    }
 
     FILE *fp = fopen(ROOMS_FILE, "wb");
     if (fp == NULL) {
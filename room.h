@@ -1,6 +1,8 @@
 #ifndef ROOM_H
 #define ROOM_H
+#include <assert.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 
@@ -12,6 +14,7 @@
 #define TILE_IDX(x, y) ((y) * WIDTH_TILES + (x))
 
 #include "array.h"
+#include "arena.h"
 
 #define BLANK_TILE 0x00
 
@@ -135,6 +138,10 @@ enum SwitchSide {
     "LEFT", \
 }[(size_t)(s)]
 
+// readRoom decodes a block's width from 3 bits and height from 2 bits
+#define MAX_BLOCK_WIDTH 8
+#define MAX_BLOCK_HEIGHT 4
+
 struct RoomObject {
     // written as ((x << 8) | y) | ((width << 5) << 8) | (height << 5)
     uint8_t x;
@@ -151,34 +158,122 @@ struct RoomObject {
     };
 
     enum RoomObjectType type;
-    uint8_t *tiles;
+    uint8_t tiles[MAX_BLOCK_WIDTH * MAX_BLOCK_HEIGHT]; // width * height of them for BLOCK, row by row
 };
 
-struct SwitchChunk {
-    enum SwitchChunkType type;
+// The fields of each chunk type, laid out as they are in SwitchChunk
+struct SwitchPreamble {
+    uint8_t x;
+    uint8_t y;
+    uint8_t side; // enum SwitchSide
+    bool room_entry;
+    bool one_time_use;
     uint8_t msb;
     uint8_t lsb;
+};
 
-    bool room_entry;
+struct SwitchToggleBlock {
     uint8_t x;
     uint8_t y;
     uint8_t size;
-    enum SwitchChunkDirection dir;
+    uint8_t dir; // enum SwitchChunkDirection
     uint8_t off;
     uint8_t on;
+};
+
+struct SwitchToggleBit {
+    uint8_t index;
     uint8_t bitmask;
+    uint8_t room_idx; // Linked by readFile, written back to index and bitmask by relinkSwitchBits
+    uint8_t switch_idx;
+    uint8_t off;
+    uint8_t on;
+};
+
+struct SwitchToggleObject {
     uint8_t index;
     uint8_t test;
     uint8_t value;
-    enum SwitchSide side;
-    bool one_time_use;
+};
 
-    uint16_t room_idx;
-    uint16_t switch_idx;
+// Tagged by type, the fields of the other types share the same bytes so only
+// touch the ones for the chunk's type. The chunkToggleBlock etc. accessors
+// check the type, the flat fields are there for code that already has.
+struct SwitchChunk {
+    uint8_t type; // enum SwitchChunkType
+    union {
+        struct SwitchPreamble preamble;
+        struct SwitchToggleBlock toggle_block;
+        struct SwitchToggleBit toggle_bit;
+        struct SwitchToggleObject toggle_object;
+        struct {
+            union {
+                uint8_t x; // PREAMBLE, TOGGLE_BLOCK
+                uint8_t index; // TOGGLE_BIT, TOGGLE_OBJECT
+            };
+            union {
+                uint8_t y; // PREAMBLE, TOGGLE_BLOCK
+                uint8_t bitmask; // TOGGLE_BIT
+                uint8_t test; // TOGGLE_OBJECT
+            };
+            union {
+                struct { // PREAMBLE
+                    uint8_t side; // enum SwitchSide
+                    bool room_entry;
+                    bool one_time_use;
+                    uint8_t msb;
+                    uint8_t lsb;
+                };
+                struct { // TOGGLE_BLOCK, TOGGLE_BIT
+                    union {
+                        struct {
+                            uint8_t size;
+                            uint8_t dir; // enum SwitchChunkDirection
+                        };
+                        struct {
+                            uint8_t room_idx;
+                            uint8_t switch_idx;
+                        };
+                    };
+                    uint8_t off;
+                    uint8_t on;
+                };
+                uint8_t value; // TOGGLE_OBJECT
+            };
+        };
+    };
 };
+_Static_assert(sizeof(struct SwitchChunk) == 8, "SwitchChunk is no longer compact");
+_Static_assert(offsetof(struct SwitchChunk, toggle_block.on) == offsetof(struct SwitchChunk, on), "Chunk types are laid out differently");
+_Static_assert(offsetof(struct SwitchChunk, toggle_bit.switch_idx) == offsetof(struct SwitchChunk, switch_idx), "Chunk types are laid out differently");
+_Static_assert(offsetof(struct SwitchChunk, toggle_object.value) == offsetof(struct SwitchChunk, value), "Chunk types are laid out differently");
+_Static_assert(offsetof(struct SwitchChunk, preamble.lsb) == offsetof(struct SwitchChunk, lsb), "Chunk types are laid out differently");
+
+static inline struct SwitchPreamble *chunkPreamble(struct SwitchChunk *chunk) {
+    assert(chunk->type == PREAMBLE);
+    return &chunk->preamble;
+}
+
+static inline struct SwitchToggleBlock *chunkToggleBlock(struct SwitchChunk *chunk) {
+    assert(chunk->type == TOGGLE_BLOCK);
+    return &chunk->toggle_block;
+}
+
+static inline struct SwitchToggleBit *chunkToggleBit(struct SwitchChunk *chunk) {
+    assert(chunk->type == TOGGLE_BIT);
+    return &chunk->toggle_bit;
+}
+
+static inline struct SwitchToggleObject *chunkToggleObject(struct SwitchChunk *chunk) {
+    assert(chunk->type == TOGGLE_OBJECT);
+    return &chunk->toggle_object;
+}
+
+// Switches in the game have 3 or 4 chunks including the PREAMBLE
+#define SWITCH_SMALL_CHUNKS 4
 
 struct SwitchObject {
-    ARRAY(struct SwitchChunk) chunks;
+    SMALL_ARRAY(struct SwitchChunk, SWITCH_SMALL_CHUNKS) chunks;
 };
 
 struct __attribute__((__packed__)) DecompresssedRoom {
@@ -219,27 +314,133 @@ struct __attribute__((__packed__)) DecompresssedRoom {
 };
 _Static_assert(offsetof(struct DecompresssedRoom, end_marker) == 742, "Size of room is unexpected");
 
+typedef enum {
+    COMPRESS_FAST,   // RLE and fixed size blocks only, for interactive saves
+    COMPRESS_NORMAL, // Greedy LZ
+    COMPRESS_BEST,   // Optimal parse over all encodings, for final builds
+    COMPRESS_FIT,    // Not a level of its own, see compressRooms
+
+    NUM_COMPRESS_LEVELS // _Static_asserts depend on this being the last entry
+} CompressLevel;
+
+#define COMPRESS_LEVEL(l) (const char *[]){ \
+    "fast", \
+    "normal", \
+    "best", \
+    "fit", \
+}[(size_t)(l)]
+
+// How far readFilePartial goes into each room, anything less than LOAD_ALL is read only
+typedef enum {
+    LOAD_HEADER, // Tiles, room fields and name. Block objects are still in the tiles
+    LOAD_TILES,  // As above, with block objects cut out of the tiles like a full load
+    LOAD_ALL,    // Objects, switches, the rest and linked TOGGLE_BIT chunks
+
+    NUM_ROOM_LOADS // _Static_asserts depend on this being the last entry
+} RoomLoad;
+
 typedef ARRAY(uint8_t) uint8_array;
 typedef struct {
     uint8_t index;
     uint16_t address;
     bool valid;
+    RoomLoad loaded;
     struct DecompresssedRoom data;
     uint8_array rest;
     uint8_array compressed;
+    CompressLevel level; // of compressed
     uint8_array decompressed;
 } Room;
 
+// A read only copy of a room, shared by the snapshots (and the RoomFile) that
+// saw the room like this. Freed along with the last reference.
+typedef struct {
+    size_t refs;
+    Room room; // Points into data
+    _Alignas(ARENA_ALIGN) uint8_t data[];
+} RoomVersion;
+
+// Taking one is 64 pointer copies, plus a copy of each room changed since
+// the previous snapshot, which later snapshots then share.
+typedef struct {
+    RoomVersion *rooms[64];
+} RoomSnapshot;
+
+// Everything the rooms point to lives in arena, so edits must allocate from
+// it too (ARENA_ARRAY_ADD etc), and nothing in a room is freed on its own.
 typedef struct RoomFile {
     Room rooms[64];
+    Arena arena;
+    RoomVersion *versions[64]; // What each room looked like at the last snapshot, NULL once it is changed
 } RoomFile;
 
+// The tile pictures. BACKS.SPL has the same Header as ROOMS.SPL, but at 0x3000
+// bytes it is a definition per room, not the tiles. BLOCKS.EGA is 0x4000: 512
+// tiles of 8x8, each 4 planes of 8 rows, a bit per pixel with the left most
+// pixel in the high bit. A room's tile is tile_offset * 16 + (tile & 0x3f),
+// the top two bits of a tile only change how it behaves.
+#define GRAPHICS_FILE "BLOCKS.EGA"
+#define TILE_PIXELS 8
+#define MAX_GRAPHICS_TILES 512
+#define GRAPHICS_TILE(tile, tile_offset) ((size_t)(tile_offset) * 16 + ((tile) & 0x3f))
+
+typedef struct {
+    size_t num_tiles; // 0 if nothing is loaded
+    uint8_t pixels[MAX_GRAPHICS_TILES][TILE_PIXELS][TILE_PIXELS]; // EGA colours, 0-15
+} TileGraphics;
+
+#define MAX_ROOM_FILE_SIZE 0x3000
+// there is also a MAX_ROOM_SIZE, unknown yet, add a few switches to midnight and it will corrupt
+// Upper bound for decompressRoom output, well above any room writeRoom can produce
+#define MAX_DECOMPRESSED_ROOM_SIZE 0x1000
+
+typedef enum {
+    DECOMPRESS_OK,
+    DECOMPRESS_BAD_MARKER,  // Room does not start with 0x8F
+    DECOMPRESS_TRUNCATED,   // Compressed data ends part way through a copy
+    DECOMPRESS_BAD_BACKREF, // Copy from before the start of the room
+    DECOMPRESS_OVERFLOW,    // Output does not fit in the buffer
+
+    NUM_DECOMPRESS_ERRORS // _Static_asserts depend on this being the last entry
+} DecompressError;
+
+#define DECOMPRESS_ERROR(e) (const char *[]){ \
+    "ok", \
+    "room does not start with 0x8F", \
+    "compressed data is truncated", \
+    "copy from before the start of the room", \
+    "decompressed room is too large", \
+}[(size_t)(e)]
+
 void freeRoomFile(RoomFile *file);
 bool readFile(RoomFile *file, FILE *fp);
+bool readFilePartial(RoomFile *file, FILE *fp, RoomLoad load);
 bool writeFile(RoomFile *file, FILE *fp);
 bool readRooms(RoomFile *file);
 bool readRoomFromFile(Room *room, FILE *fp, const char *filename);
-bool writeRooms(RoomFile *file);
+// Tiles as display prints them, or as readRoomFromFile reads them: two hex
+// digits or spaces each, a line per row, escape sequences skipped. Goes in
+// tiles row by row, max_width apart, short rows are padded with 0. On failure
+// error says why, for the caller to report.
+bool parseTiles(const char *text, size_t length, const char *name, uint8_t *tiles, size_t max_width, size_t max_height, size_t *width, size_t *height, char *error, size_t error_size);
+bool relinkSwitchBits(RoomFile *file);
+bool writeRooms(RoomFile *file, CompressLevel level);
+bool readTileGraphics(TileGraphics *graphics, FILE *fp);
+bool readGraphics(TileGraphics *graphics);
+DecompressError decompressRoom(const uint8_t *compressed, size_t c_len, uint8_t *decompressed, size_t capacity, size_t *d_len);
+DecompressError decompressRoomPrefix(const uint8_t *compressed, size_t c_len, uint8_t *decompressed, size_t capacity, size_t *d_len);
+bool compressRoom(Arena *arena, Room *room, CompressLevel level);
+bool compressRooms(RoomFile *file, CompressLevel level, size_t limit, double seconds);
+size_t compressedRoomSize(Arena *arena, Room *room);
+size_t compressedFileSize(RoomFile *file);
+// On disk a chunk is 2 bytes, 4 for TOGGLE_BLOCK. Both return how many bytes were used, decode returns 0 if length is too short
+size_t decodeSwitchChunk(const uint8_t *bytes, size_t length, bool preamble, struct SwitchChunk *chunk);
+size_t encodeSwitchChunk(const struct SwitchChunk *chunk, uint8_t *bytes);
 void dumpRoom(Room *room, RoomFile *file);
+// Anything that edits a room has to call roomChanged before the next takeSnapshot
+void roomChanged(RoomFile *file, size_t idx);
+void takeSnapshot(RoomFile *file, RoomSnapshot *snapshot);
+void releaseSnapshot(RoomSnapshot *snapshot);
+void restoreSnapshot(RoomFile *file, RoomSnapshot *snapshot);
 
 #endif // ROOM_H
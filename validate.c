@@ -0,0 +1,215 @@
+#include <assert.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "validate.h"
+
+__attribute__((format(printf, 4, 5)))
+static void diagnose(DiagnosticArray *out, ValidationRule rule, size_t room, const char *fmt, ...) {
+    Diagnostic diagnostic = { .rule = rule, .room = room };
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(diagnostic.message, sizeof(diagnostic.message), fmt, args);
+    va_end(args);
+    ARRAY_ADD(*out, diagnostic);
+}
+
+typedef struct {
+    int x, y, width, height;
+} Area;
+
+static bool overlaps(Area a, Area b) {
+    return a.x < b.x + b.width && b.x < a.x + a.width &&
+        a.y < b.y + b.height && b.y < a.y + a.height;
+}
+
+static Area toggleArea(struct SwitchToggleBlock *block) {
+    if (block->dir == HORIZONTAL) return (Area){ block->x, block->y, block->size, 1 };
+    return (Area){ block->x, block->y, 1, block->size };
+}
+
+static void ruleBounds(Validator *validator, RoomFile *file, size_t idx, DiagnosticArray *out) {
+    (void)validator;
+    struct DecompresssedRoom *room = &file->rooms[idx].data;
+    for (size_t o = 0; o < room->num_objects; o ++) {
+        struct RoomObject *obj = room->objects + o;
+        Area area = { obj->x, obj->y, 1, 1 };
+        if (obj->type == BLOCK) area = (Area){ obj->x, obj->y, obj->block.width, obj->block.height };
+        if (area.x + area.width > WIDTH_TILES || area.y + area.height > HEIGHT_TILES) {
+            diagnose(out, RULE_BOUNDS, idx, "object %zu is out of bounds at (%u,%u)", o, obj->x, obj->y);
+        }
+    }
+    for (size_t sw = 0; sw < room->num_switches; sw ++) {
+        struct SwitchObject *switcch = room->switches + sw;
+        struct SwitchPreamble *preamble = chunkPreamble(SMALL_ARRAY_DATA(switcch->chunks));
+        if (preamble->x >= WIDTH_TILES || preamble->y >= HEIGHT_TILES) {
+            diagnose(out, RULE_BOUNDS, idx, "switch %zu is out of bounds at (%u,%u)", sw, preamble->x, preamble->y);
+        }
+        for (size_t c = 1; c < switcch->chunks.length; c ++) {
+            struct SwitchChunk *chunk = SMALL_ARRAY_DATA(switcch->chunks) + c;
+            if (chunk->type != TOGGLE_BLOCK) continue;
+            struct SwitchToggleBlock *block = chunkToggleBlock(chunk);
+            Area area = toggleArea(block);
+            if (area.x + area.width > WIDTH_TILES || area.y + area.height > HEIGHT_TILES) {
+                diagnose(out, RULE_BOUNDS, idx, "switch %zu chunk %zu toggles out of bounds from (%u,%u)", sw, c, block->x, block->y);
+            }
+        }
+    }
+}
+
+static void ruleOverlap(Validator *validator, RoomFile *file, size_t idx, DiagnosticArray *out) {
+    (void)validator;
+    struct DecompresssedRoom *room = &file->rooms[idx].data;
+    for (size_t o = 0; o < room->num_objects; o ++) {
+        struct RoomObject *obj = room->objects + o;
+        if (obj->type != BLOCK) continue;
+        Area area = { obj->x, obj->y, obj->block.width, obj->block.height };
+        for (size_t other = o + 1; other < room->num_objects; other ++) {
+            struct RoomObject *obj2 = room->objects + other;
+            if (obj2->type != BLOCK) continue;
+            if (overlaps(area, (Area){ obj2->x, obj2->y, obj2->block.width, obj2->block.height })) {
+                diagnose(out, RULE_OVERLAP, idx, "objects %zu and %zu overlap", o, other);
+            }
+        }
+    }
+    for (size_t sw = 0; sw < room->num_switches; sw ++) {
+        struct SwitchObject *switcch = room->switches + sw;
+        for (size_t c = 1; c < switcch->chunks.length; c ++) {
+            struct SwitchChunk *chunk = SMALL_ARRAY_DATA(switcch->chunks) + c;
+            if (chunk->type != TOGGLE_BLOCK) continue;
+            Area area = toggleArea(chunkToggleBlock(chunk));
+            for (size_t o = 0; o < room->num_objects; o ++) {
+                struct RoomObject *obj = room->objects + o;
+                if (obj->type != BLOCK) continue;
+                if (overlaps(area, (Area){ obj->x, obj->y, obj->block.width, obj->block.height })) {
+                    diagnose(out, RULE_OVERLAP, idx, "switch %zu chunk %zu toggles tiles of object %zu", sw, c, o);
+                }
+            }
+        }
+    }
+}
+
+static void ruleToggleBit(Validator *validator, RoomFile *file, size_t idx, DiagnosticArray *out) {
+    struct DecompresssedRoom *room = &file->rooms[idx].data;
+    validator->links[idx] = 0;
+    for (size_t sw = 0; sw < room->num_switches; sw ++) {
+        struct SwitchObject *switcch = room->switches + sw;
+        for (size_t c = 1; c < switcch->chunks.length; c ++) {
+            struct SwitchChunk *chunk = SMALL_ARRAY_DATA(switcch->chunks) + c;
+            if (chunk->type != TOGGLE_BIT) continue;
+            struct SwitchToggleBit *toggle = chunkToggleBit(chunk);
+            if (toggle->room_idx < C_ARRAY_LEN(validator->links)) validator->links[idx] |= 1ull << toggle->room_idx;
+            // Same test relinkSwitchBits uses to link it back up
+            if (toggle->room_idx >= C_ARRAY_LEN(file->rooms) || !file->rooms[toggle->room_idx].valid ||
+                    toggle->switch_idx >= file->rooms[toggle->room_idx].data.num_switches) {
+                diagnose(out, RULE_TOGGLE_BIT, idx, "switch %zu chunk %zu links to missing room %u switch %u", sw, c, toggle->room_idx, toggle->switch_idx);
+            }
+        }
+    }
+}
+
+static void ruleToggleObject(Validator *validator, RoomFile *file, size_t idx, DiagnosticArray *out) {
+    (void)validator;
+    struct DecompresssedRoom *room = &file->rooms[idx].data;
+    for (size_t sw = 0; sw < room->num_switches; sw ++) {
+        struct SwitchObject *switcch = room->switches + sw;
+        for (size_t c = 1; c < switcch->chunks.length; c ++) {
+            struct SwitchChunk *chunk = SMALL_ARRAY_DATA(switcch->chunks) + c;
+            if (chunk->type != TOGGLE_OBJECT) continue;
+            struct SwitchToggleObject *toggle = chunkToggleObject(chunk);
+            if (toggle->index >= room->num_objects) {
+                diagnose(out, RULE_TOGGLE_OBJECT, idx, "switch %zu chunk %zu toggles object %u of %u", sw, c, toggle->index, room->num_objects);
+            }
+        }
+    }
+}
+
+// idx is VALIDATE_FILE
+static void ruleSize(Validator *validator, RoomFile *file, size_t idx, DiagnosticArray *out) {
+    (void)validator;
+    size_t size = compressedFileSize(file);
+    if (size > MAX_ROOM_FILE_SIZE) {
+        diagnose(out, RULE_SIZE, idx, "0x%04zx bytes is over the 0x%04x limit", size, MAX_ROOM_FILE_SIZE);
+    }
+}
+
+typedef void (*RuleFunction)(Validator *validator, RoomFile *file, size_t idx, DiagnosticArray *out);
+static const struct {
+    RuleFunction run;
+    bool per_room; // otherwise it is run once, for VALIDATE_FILE
+} rules[] = {
+    [RULE_BOUNDS] = { ruleBounds, true },
+    [RULE_OVERLAP] = { ruleOverlap, true },
+    [RULE_TOGGLE_BIT] = { ruleToggleBit, true },
+    [RULE_TOGGLE_OBJECT] = { ruleToggleObject, true },
+    [RULE_SIZE] = { ruleSize, false },
+};
+_Static_assert(C_ARRAY_LEN(rules) == NUM_RULES, "Rule missing from rules");
+
+void validatorInvalidate(Validator *validator, size_t room) {
+    assert(room < VALIDATE_FILE);
+    for (ValidationRule rule = 0; rule < NUM_RULES; rule ++) {
+        validator->clean[rules[rule].per_room ? room : VALIDATE_FILE][rule] = false;
+    }
+    // Their targets could have gone, or come back
+    for (size_t other = 0; other < C_ARRAY_LEN(validator->links); other ++) {
+        if (validator->links[other] & (1ull << room)) validator->clean[other][RULE_TOGGLE_BIT] = false;
+    }
+}
+
+void validatorInvalidateAll(Validator *validator) {
+    memset(validator->clean, 0, sizeof(validator->clean));
+}
+
+size_t validate(Validator *validator, RoomFile *file) {
+    size_t total = 0;
+    for (ValidationRule rule = 0; rule < NUM_RULES; rule ++) {
+        struct timespec start, end;
+        bool ran = false;
+        assert(clock_gettime(CLOCK_MONOTONIC, &start) == 0);
+        for (size_t idx = 0; idx <= VALIDATE_FILE; idx ++) {
+            if ((idx == VALIDATE_FILE) == rules[rule].per_room) continue;
+            DiagnosticArray *results = &validator->results[idx][rule];
+            if (!validator->clean[idx][rule]) {
+                results->length = 0;
+                if (idx == VALIDATE_FILE) {
+                    rules[rule].run(validator, file, idx, results);
+                } else if (file->rooms[idx].valid && file->rooms[idx].loaded == LOAD_ALL) {
+                    rules[rule].run(validator, file, idx, results);
+                } else if (rule == RULE_TOGGLE_BIT) {
+                    validator->links[idx] = 0;
+                }
+                validator->clean[idx][rule] = true;
+                validator->timings[rule].runs ++;
+                ran = true;
+            }
+            total += results->length;
+        }
+        assert(clock_gettime(CLOCK_MONOTONIC, &end) == 0);
+        if (ran) validator->timings[rule].seconds += (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    }
+    return total;
+}
+
+size_t validatorCount(Validator *validator, size_t room) {
+    assert(room <= VALIDATE_FILE);
+    size_t count = 0;
+    for (ValidationRule rule = 0; rule < NUM_RULES; rule ++) count += validator->results[room][rule].length;
+    return count;
+}
+
+Diagnostic *validatorFirst(Validator *validator, size_t room) {
+    assert(room <= VALIDATE_FILE);
+    for (ValidationRule rule = 0; rule < NUM_RULES; rule ++) {
+        if (validator->results[room][rule].length > 0) return validator->results[room][rule].data;
+    }
+    return NULL;
+}
+
+void freeValidator(Validator *validator) {
+    for (size_t idx = 0; idx <= VALIDATE_FILE; idx ++) {
+        for (ValidationRule rule = 0; rule < NUM_RULES; rule ++) ARRAY_FREE(validator->results[idx][rule]);
+    }
+    *validator = (Validator){0};
+}
@@ -0,0 +1,62 @@
+#ifndef VALIDATE_H
+#define VALIDATE_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "array.h"
+#include "room.h"
+
+typedef enum {
+    RULE_BOUNDS,        // Objects, switches and TOGGLE_BLOCK areas inside the room
+    RULE_OVERLAP,       // Blocks over each other, TOGGLE_BLOCK areas over blocks
+    RULE_TOGGLE_BIT,    // TOGGLE_BIT linked to a switch that exists
+    RULE_TOGGLE_OBJECT, // TOGGLE_OBJECT index below num_objects
+    RULE_SIZE,          // Whole file fits in MAX_ROOM_FILE_SIZE
+
+    NUM_RULES // _Static_asserts depend on this being the last entry
+} ValidationRule;
+
+#define VALIDATION_RULE(r) (const char *[]){ \
+    "bounds", \
+    "overlap", \
+    "toggle_bit", \
+    "toggle_object", \
+    "size", \
+}[(size_t)(r)]
+
+// Results for rules about the whole file, like RULE_SIZE, go under this room
+#define VALIDATE_FILE 64
+
+typedef struct {
+    ValidationRule rule;
+    uint8_t room; // or VALIDATE_FILE
+    char message[80];
+} Diagnostic;
+
+typedef ARRAY(Diagnostic) DiagnosticArray;
+
+// Keeps the diagnostics of each rule for each room, so after an edit only the
+// rules validatorInvalidate says could have changed are run again. A zeroed
+// Validator runs everything on the first validate.
+typedef struct {
+    DiagnosticArray results[VALIDATE_FILE + 1][NUM_RULES];
+    bool clean[VALIDATE_FILE + 1][NUM_RULES];
+    uint64_t links[64]; // Rooms each room's TOGGLE_BIT chunks point into, as of its last run
+    struct {
+        double seconds;
+        size_t runs;
+    } timings[NUM_RULES]; // Since the Validator was zeroed
+} Validator;
+
+// Call for each room edited, also reruns RULE_TOGGLE_BIT in rooms linking to it
+void validatorInvalidate(Validator *validator, size_t room);
+void validatorInvalidateAll(Validator *validator);
+// Runs the rules that are not clean, returns the total number of diagnostics
+size_t validate(Validator *validator, RoomFile *file);
+// Diagnostics of every rule for room (or VALIDATE_FILE) as of the last validate
+size_t validatorCount(Validator *validator, size_t room);
+Diagnostic *validatorFirst(Validator *validator, size_t room);
+void freeValidator(Validator *validator);
+
+#endif // VALIDATE_H